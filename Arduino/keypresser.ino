@@ -1,4 +1,5 @@
-#include <Keyboard.h>
+#include <HID.h>
+#include <Keyboard.h>  // 需要1.0.4及以上版本（Keyboard.pressRaw）
 #include <Mouse.h>
 
 // 定义通信常量
@@ -7,6 +8,10 @@ const char START_CHAR = '<';      // 指令起始字符
 const char END_CHAR = '>';        // 指令结束字符
 const char SEPARATOR_CHAR = ',';  // 参数分隔符
 
+// 固件构建标识，每次编译都不同。主机从hex文件中查找 "KPFW:" 得到同一字符串，
+// 与设备回复比较，一致时跳过烧录
+const char FIRMWARE_BUILD[] = "KPFW:" __DATE__ " " __TIME__;
+
 // 定义指令类型
 enum CommandType {
   PRESS_KEY,      // 按下按键
@@ -18,9 +23,66 @@ enum CommandType {
   MOUSE_PRESS,    // 鼠标按下
   MOUSE_RELEASE,  // 鼠标释放
   MOUSE_CLICK,    // 鼠标点击
-  MOUSE_WHEEL     // 鼠标滚轮
+  MOUSE_WHEEL,    // 鼠标滚轮
+  QUERY_VERSION,  // 查询固件构建标识
+  HEARTBEAT,      // 心跳，可附带看门狗参数
+  RELEASE_ALL,    // 释放所有按键和鼠标按键
+  KEYBOARD_REPORT,// 直接发送一个完整的键盘HID报告
+  MOUSE_REPORT,   // 直接发送一个完整的鼠标HID报告
+  TAP_KEY,        // 按下、按住指定时长后释放一个按键
+  CLOCK_PROBE,    // 时钟同步探测，回复收到和回复时的micros()
+  AT_TIME         // 在指定的micros()时刻执行其中的指令
 };
 
+// Keyboard/Mouse库使用的HID报告ID
+const uint8_t KEYBOARD_REPORT_ID = 2;
+const uint8_t MOUSE_REPORT_ID = 1;
+
+// 看门狗：记录当前按住的按键和鼠标按键。主机停止发送指令（崩溃、USB断开）超过
+// heartbeatTimeoutMs，或某个按键按住超过maxHoldMs时，由固件自动释放，避免按键卡住。
+// 两个时间为0表示关闭，主机通过HEARTBEAT指令开启。
+const int MAX_HELD_KEYS = 8;
+byte heldKeys[MAX_HELD_KEYS];
+unsigned long heldSince[MAX_HELD_KEYS];
+int heldKeyCount = 0;
+byte heldButtons = 0;
+unsigned long buttonsSince = 0;
+// 原始报告不经过Keyboard/Mouse库，单独记录
+bool rawKeysDown = false;
+unsigned long rawKeysSince = 0;
+byte rawButtons = 0;
+unsigned long rawButtonsSince = 0;
+
+unsigned long heartbeatTimeoutMs = 0;
+unsigned long maxHoldMs = 0;
+unsigned long lastHeartbeat = 0;
+unsigned long comboHoldMs = 100;  // 组合键按下到释放的时长
+
+// LED熄灭时间，不阻塞主循环
+unsigned long ledOffAt = 0;
+bool ledOn = false;
+
+// 定时指令队列：AT_TIME指令按执行时刻排序保存，到时在主循环中执行，
+// 执行时刻不受USB传输和主机调度的抖动影响。RELEASE_ALL和看门狗超时会清空队列。
+// 主机的定时指令最多SCHEDULE_CAPACITY条，满了回复"<KPNAK:时刻>"拒收；另外DEFERRED_CAPACITY条
+// 留给固件自己的后续动作（按住到期后的释放、连击的下一次点击），按住期间主循环照常运行
+const int SCHEDULE_CAPACITY = 16;
+const int DEFERRED_CAPACITY = 8;
+const int QUEUE_CAPACITY = SCHEDULE_CAPACITY + DEFERRED_CAPACITY;
+unsigned long scheduledAt[QUEUE_CAPACITY];
+String scheduledCommands[QUEUE_CAPACITY];
+bool scheduledByHost[QUEUE_CAPACITY];
+int scheduledCount = 0;      // 队列中的总条数
+int hostScheduledCount = 0;  // 其中主机的AT_TIME指令条数
+
+// 按住（DELAY、TAP_KEY的按住时长、组合键、连击间隔）期间暂停读取串口：同一次写入中排在后面的指令
+// 等按住结束再执行，顺序与原来相同，定时队列不受影响
+bool inputPaused = false;
+unsigned long inputResumeAt = 0;  // micros()
+
+// 当前指令读完时的micros()，时钟同步用
+unsigned long commandReceivedAt = 0;
+
 void setup() {
   Serial.begin(BAUD_RATE);  // 初始化串口通信
   Keyboard.begin();         // 初始化键盘模拟
@@ -29,14 +91,26 @@ void setup() {
 }
 
 void loop() {
-  if (Serial.available() > 0) {
+  // 先判断按住是否结束，再执行到期的定时指令：按住结束时的释放一定排在后面的指令之前
+  bool holdOver = inputPaused && (long)(micros() - inputResumeAt) >= 0;
+  runScheduledCommands();
+  if (holdOver && (long)(micros() - inputResumeAt) >= 0) {
+    inputPaused = false;
+    lastHeartbeat = millis();  // 按住期间主机发来的指令还在缓冲区里
+  }
+
+  if (!inputPaused && Serial.available() > 0) {
     String command = Serial.readStringUntil(END_CHAR);
+    commandReceivedAt = micros();
 
     // 验证指令格式
     if (command.startsWith(String(START_CHAR))) {
       // 移除起始字符
       command = command.substring(1);
 
+      // 任何有效指令都说明主机仍在工作
+      lastHeartbeat = millis();
+
       // 解析指令
       parseAndExecuteCommand(command);
 
@@ -44,6 +118,9 @@ void loop() {
       blinkLED();
     }
   }
+
+  checkWatchdog();
+  updateLED();
 }
 
 void parseAndExecuteCommand(String command) {
@@ -86,33 +163,298 @@ void parseAndExecuteCommand(String command) {
     case MOUSE_WHEEL:
       mouseWheel(params);
       break;
+    case QUERY_VERSION:
+      queryVersion();
+      break;
+    case HEARTBEAT:
+      heartbeat(params);
+      break;
+    case RELEASE_ALL:
+      releaseAll();
+      break;
+    case KEYBOARD_REPORT:
+      keyboardReport(params);
+      break;
+    case MOUSE_REPORT:
+      mouseReport(params);
+      break;
+    case TAP_KEY:
+      tapKey(params);
+      break;
+    case CLOCK_PROBE:
+      clockProbe(params);
+      break;
+    case AT_TIME:
+      scheduleCommand(params);
+      break;
   }
 }
 
+byte keyFromParam(String keyParam) {
+  // 按键一律为十进制HID用法码（修饰键为0xE0~0xE7），由主机换算好，固件不做字符到按键的转换
+  return (byte)keyParam.toInt();
+}
+
 void pressKey(String keyParam) {
-  if (keyParam.length() == 1) {
-    // 普通字符
-    char key = keyParam.charAt(0);
-    Keyboard.press(key);
-  } else {
-    // 特殊按键（使用虚拟按键码）
-    int vkCode = keyParam.toInt();
-    Keyboard.press((byte)vkCode);
+  byte key = keyFromParam(keyParam);
+  Keyboard.pressRaw(key);
+  markKeyHeld(key);
+}
+
+void releaseKey(String keysParam) {
+  // 格式："key"；组合键按住到期时为"key1,key2,..."
+  int startIndex = 0;
+  while (startIndex < keysParam.length()) {
+    int commaIndex = keysParam.indexOf(SEPARATOR_CHAR, startIndex);
+    if (commaIndex == -1) commaIndex = keysParam.length();
+
+    byte key = keyFromParam(keysParam.substring(startIndex, commaIndex));
+    Keyboard.releaseRaw(key);
+    markKeyReleased(key);
+
+    startIndex = commaIndex + 1;
+  }
+}
+
+void tapKey(String params) {
+  // 格式："key" 或 "key,holdMs"，由主机把相邻的按下/延迟/释放合并而来
+  int commaIndex = params.indexOf(SEPARATOR_CHAR);
+  String key = commaIndex == -1 ? params : params.substring(0, commaIndex);
+  pressKey(key);
+  if (commaIndex == -1) {
+    releaseKey(key);
+    return;
+  }
+  holdThen(params.substring(commaIndex + 1).toInt(), String(RELEASE_KEY) + SEPARATOR_CHAR + key);
+}
+
+void clockProbe(String seq) {
+  // 回复格式："<KPCK:序号,收到时的micros,回复时的micros>"，主机据此估计时钟偏移和漂移
+  Serial.print(START_CHAR);
+  Serial.print("KPCK:");
+  Serial.print(seq);
+  Serial.print(SEPARATOR_CHAR);
+  Serial.print(commandReceivedAt);
+  Serial.print(SEPARATOR_CHAR);
+  Serial.print(micros());
+  Serial.print(END_CHAR);
+}
+
+void scheduleCommand(String params) {
+  // 格式："micros,类型,参数"，时刻为设备时钟（32位，回绕按差值比较）；时刻已过则立即执行
+  int commaIndex = params.indexOf(SEPARATOR_CHAR);
+  if (commaIndex == -1) return;
+  unsigned long at = strtoul(params.c_str(), NULL, 10);
+  String command = params.substring(commaIndex + 1);
+  if ((long)(at - micros()) <= 0) {
+    parseAndExecuteCommand(command);
+    return;
+  }
+  if (!queueCommand(at, command, true)) {
+    // 队列满时拒收，不提前执行：提前的释放会跑到它的按下前面，按键一直按到看门狗超时
+    Serial.print(START_CHAR);
+    Serial.print("KPNAK:");
+    Serial.print(at);
+    Serial.print(END_CHAR);
   }
 }
 
-void releaseKey(String keyParam) {
-  if (keyParam.length() == 1) {
-    // 普通字符
-    char key = keyParam.charAt(0);
-    Keyboard.release(key);
+bool queueCommand(unsigned long at, String command, bool byHost) {
+  if (byHost ? hostScheduledCount == SCHEDULE_CAPACITY
+             : scheduledCount - hostScheduledCount == DEFERRED_CAPACITY) {
+    return false;
+  }
+
+  // 插入排序，时刻相同的指令保持发送顺序
+  int i = scheduledCount;
+  while (i > 0 && (long)(at - scheduledAt[i - 1]) < 0) {
+    scheduledAt[i] = scheduledAt[i - 1];
+    scheduledCommands[i] = scheduledCommands[i - 1];
+    scheduledByHost[i] = scheduledByHost[i - 1];
+    i--;
+  }
+  scheduledAt[i] = at;
+  scheduledCommands[i] = command;
+  scheduledByHost[i] = byHost;
+  scheduledCount++;
+  if (byHost) hostScheduledCount++;
+  return true;
+}
+
+void runScheduledCommands() {
+  while (scheduledCount > 0 && (long)(micros() - scheduledAt[0]) >= 0) {
+    String command = scheduledCommands[0];
+    if (scheduledByHost[0]) hostScheduledCount--;
+    for (int i = 1; i < scheduledCount; i++) {
+      scheduledAt[i - 1] = scheduledAt[i];
+      scheduledCommands[i - 1] = scheduledCommands[i];
+      scheduledByHost[i - 1] = scheduledByHost[i];
+    }
+    scheduledCount--;
+    parseAndExecuteCommand(command);
+  }
+}
+
+// 暂停读取串口ms毫秒（已在暂停中则取较晚的结束时刻），返回结束时刻（micros）
+unsigned long pauseInput(unsigned long ms) {
+  unsigned long until = micros() + ms * 1000UL;
+  if (!inputPaused || (long)(until - inputResumeAt) > 0) inputResumeAt = until;
+  inputPaused = true;
+  return until;
+}
+
+// 按住ms毫秒后执行command，期间不阻塞主循环；固件自己的后续动作排满时退回阻塞等待
+void holdThen(long ms, String command) {
+  if (ms <= 0) {
+    parseAndExecuteCommand(command);
+  } else if (scheduledCount - hostScheduledCount == DEFERRED_CAPACITY) {
+    delay(ms);
+    parseAndExecuteCommand(command);
   } else {
-    // 特殊按键（使用虚拟按键码）
-    int vkCode = keyParam.toInt();
-    Keyboard.release((byte)vkCode);
+    queueCommand(pauseInput(ms), command, false);
   }
 }
 
+void markKeyHeld(byte key) {
+  for (int i = 0; i < heldKeyCount; i++) {
+    if (heldKeys[i] == key) return;
+  }
+  if (heldKeyCount < MAX_HELD_KEYS) {
+    heldKeys[heldKeyCount] = key;
+    heldSince[heldKeyCount] = millis();
+    heldKeyCount++;
+  }
+}
+
+void markKeyReleased(byte key) {
+  for (int i = 0; i < heldKeyCount; i++) {
+    if (heldKeys[i] == key) {
+      // 用最后一个填补空位
+      heldKeyCount--;
+      heldKeys[i] = heldKeys[heldKeyCount];
+      heldSince[i] = heldSince[heldKeyCount];
+      return;
+    }
+  }
+}
+
+void heartbeat(String params) {
+  // 参数格式："timeoutMs,maxHoldMs,comboHoldMs"，均可省略；无参数时只刷新心跳
+  if (params.length() == 0) return;
+
+  int first = params.indexOf(SEPARATOR_CHAR);
+  heartbeatTimeoutMs = params.substring(0, first == -1 ? params.length() : first).toInt();
+  if (first == -1) return;
+
+  int second = params.indexOf(SEPARATOR_CHAR, first + 1);
+  maxHoldMs = params.substring(first + 1, second == -1 ? params.length() : second).toInt();
+  if (second == -1) return;
+
+  int hold = params.substring(second + 1).toInt();
+  if (hold > 0) comboHoldMs = hold;
+}
+
+void releaseAll() {
+  // 按住中的后续动作一并取消，暂停读取的时刻不变，后面的指令仍按原来的顺序执行
+  scheduledCount = 0;
+  hostScheduledCount = 0;
+  Keyboard.releaseAll();
+  Mouse.release(MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE);
+  heldKeyCount = 0;
+  heldButtons = 0;
+  if (rawKeysDown) sendKeyboardReport(0, NULL, 0);
+  if (rawButtons != 0) sendMouseReport(0, 0, 0, 0);
+}
+
+void checkWatchdog() {
+  if (heldKeyCount == 0 && heldButtons == 0 && !rawKeysDown && rawButtons == 0 && scheduledCount == 0) return;
+  unsigned long now = millis();
+
+  // 按住期间不读串口，主机的指令不算超时
+  if (heartbeatTimeoutMs > 0 && !inputPaused && now - lastHeartbeat > heartbeatTimeoutMs) {
+    releaseAll();
+    return;
+  }
+  if (maxHoldMs == 0) return;
+
+  for (int i = heldKeyCount - 1; i >= 0; i--) {
+    if (now - heldSince[i] > maxHoldMs) {
+      Keyboard.releaseRaw(heldKeys[i]);
+      markKeyReleased(heldKeys[i]);
+    }
+  }
+  if (heldButtons != 0 && now - buttonsSince > maxHoldMs) {
+    Mouse.release(heldButtons);
+    heldButtons = 0;
+  }
+  if (rawKeysDown && now - rawKeysSince > maxHoldMs) {
+    sendKeyboardReport(0, NULL, 0);
+  }
+  if (rawButtons != 0 && now - rawButtonsSince > maxHoldMs) {
+    sendMouseReport(0, 0, 0, 0);
+  }
+}
+
+// 解析以逗号分隔的整数参数，返回个数
+int parseInts(String params, int *values, int maxCount) {
+  int count = 0;
+  int startIndex = 0;
+  while (startIndex < params.length() && count < maxCount) {
+    int commaIndex = params.indexOf(SEPARATOR_CHAR, startIndex);
+    if (commaIndex == -1) commaIndex = params.length();
+    values[count++] = params.substring(startIndex, commaIndex).toInt();
+    startIndex = commaIndex + 1;
+  }
+  return count;
+}
+
+void sendKeyboardReport(byte modifiers, const byte *usages, int count) {
+  // 报告格式：修饰键位图、保留字节、最多6个HID用法码
+  uint8_t report[8] = { modifiers, 0, 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < count && i < 6; i++) {
+    report[2 + i] = usages[i];
+  }
+  HID().SendReport(KEYBOARD_REPORT_ID, report, sizeof(report));
+  rawKeysDown = modifiers != 0 || count > 0;
+  if (rawKeysDown) rawKeysSince = millis();
+}
+
+void sendMouseReport(byte buttons, int dx, int dy, int wheel) {
+  // 报告格式：按键位图、dx、dy、滚轮，位移范围-127到127
+  uint8_t report[4] = { buttons, (uint8_t)(int8_t)constrain(dx, -127, 127),
+                        (uint8_t)(int8_t)constrain(dy, -127, 127), (uint8_t)(int8_t)constrain(wheel, -127, 127) };
+  HID().SendReport(MOUSE_REPORT_ID, report, sizeof(report));
+  if (buttons != 0 && rawButtons == 0) rawButtonsSince = millis();
+  rawButtons = buttons;
+}
+
+void keyboardReport(String params) {
+  // 参数格式："modifiers,usage1,...,usage6"，整个组合键在同一个报告中按下；"0"表示全部松开。
+  // 与Keyboard库的状态相互独立，不要与PRESS_KEY混用同一个按键
+  int values[7];
+  int count = parseInts(params, values, 7);
+  if (count == 0) return;
+  byte usages[6];
+  for (int i = 1; i < count; i++) {
+    usages[i - 1] = (byte)values[i];
+  }
+  sendKeyboardReport((byte)values[0], usages, count - 1);
+}
+
+void mouseReport(String params) {
+  // 参数格式："buttons,dx,dy,wheel"，按键与移动在同一个报告中生效
+  int values[4] = { 0, 0, 0, 0 };
+  if (parseInts(params, values, 4) == 0) return;
+  sendMouseReport((byte)values[0], values[1], values[2], values[3]);
+}
+
+void queryVersion() {
+  // 回复格式："<KPFW:构建时间>"
+  Serial.print(START_CHAR);
+  Serial.print(FIRMWARE_BUILD);
+  Serial.print(END_CHAR);
+}
+
 void typeString(String str) {
   Keyboard.print(str);
 }
@@ -132,33 +474,30 @@ void pressKeyCombination(String keysParam) {
     startIndex = commaIndex + 1;
   }
 
-  // 短暂延迟
-  delay(100);
-
-  // 释放所有按键
-  startIndex = 0;
-  while (startIndex < keysParam.length()) {
-    int commaIndex = keysParam.indexOf(SEPARATOR_CHAR, startIndex);
-    if (commaIndex == -1) commaIndex = keysParam.length();
-
-    String key = keysParam.substring(startIndex, commaIndex);
-    releaseKey(key);
-
-    startIndex = commaIndex + 1;
-  }
+  // 按住时长（主机可通过HEARTBEAT调整）到期后释放所有按键
+  holdThen(comboHoldMs, String(RELEASE_KEY) + SEPARATOR_CHAR + keysParam);
 }
 
 void delayCommand(String delayMsParam) {
-  int delayMs = delayMsParam.toInt();
+  // 只推迟后面的指令，定时队列照常运行
+  long delayMs = delayMsParam.toInt();
   if (delayMs > 0) {
-    delay(delayMs);
+    pauseInput(delayMs);
   }
 }
 
 void blinkLED() {
+  // 只点亮并记录熄灭时间，由updateLED()熄灭，不再阻塞100ms
   digitalWrite(LED_BUILTIN, HIGH);
-  delay(100);
-  digitalWrite(LED_BUILTIN, LOW);
+  ledOn = true;
+  ledOffAt = millis() + 100;
+}
+
+void updateLED() {
+  if (ledOn && (long)(millis() - ledOffAt) >= 0) {
+    digitalWrite(LED_BUILTIN, LOW);
+    ledOn = false;
+  }
 }
 
 void mouseMove(String params) {
@@ -179,12 +518,15 @@ void mousePress(String params) {
   // 参数格式："button" 表示鼠标按键 (1=左键, 2=中键, 4=右键)
   int button = params.toInt();
   Mouse.press(button);
+  if (heldButtons == 0) buttonsSince = millis();
+  heldButtons |= button;
 }
 
 void mouseRelease(String params) {
   // 参数格式："button" 表示鼠标按键 (1=左键, 2=中键, 4=右键)
   int button = params.toInt();
   Mouse.release(button);
+  heldButtons &= ~button;
 }
 
 void mouseClick(String params) {
@@ -197,10 +539,14 @@ void mouseClick(String params) {
   } else {
     int button = params.substring(0, commaIndex).toInt();
     int clickCount = params.substring(commaIndex + 1).toInt();
+    if (clickCount <= 0) return;
 
-    for (int i = 0; i < clickCount; i++) {
-      Mouse.click(button);
-      delay(50); // 点击间隔
+    // 每次点击后间隔50ms，剩下的点击排在间隔之后
+    Mouse.click(button);
+    if (clickCount > 1) {
+      holdThen(50, String(MOUSE_CLICK) + SEPARATOR_CHAR + button + SEPARATOR_CHAR + (clickCount - 1));
+    } else {
+      pauseInput(50);
     }
   }
 }
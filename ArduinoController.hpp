@@ -1,15 +1,26 @@
 #ifndef ARDUINOCONTROLLER_HPP
 #define ARDUINOCONTROLLER_HPP
 
-#include <iostream>
 #include <string>
+#include <algorithm>
+#include <cstdlib>
 #include <windows.h>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <setupapi.h>
 #include <devguid.h>
 #include <regstr.h>
 #include <QDebug>
 #include <QCoreApplication>
+#include "KeyPresserRing.h"
+#include "DeviceClock.hpp"
+#include "KeyTable.hpp"
+#include "TraceLog.hpp"
+#include "Metrics.hpp"
 
 // Link SetupAPI library
 #pragma comment(lib, "setupapi.lib")
@@ -17,9 +28,10 @@
 // Serial port communication class
 class SerialPort {
 private:
-    HANDLE hSerial;
+    std::atomic<HANDLE> hSerial; // Read without the lock by isOpen(), replaced only under it
     DCB dcbSerialParams;
     COMMTIMEOUTS timeouts;
+    mutable std::mutex ioMutex; // Serializes the GUI, ring drain and reconnect threads
 
 public:
     SerialPort() : hSerial(INVALID_HANDLE_VALUE), portName("") {}
@@ -32,19 +44,15 @@ public:
 
     // Alternative COM port detection method by direct scanning
     // Working principle: Directly try to open COM1 to COM20, successfully opened ones might be Arduino
-    static std::string findArduinoByDirectPortScan(bool enableDebug = false) {
-        if (enableDebug) {
-            std::cout << "\n=== Starting direct COM port scan ===" << std::endl;
-        }
+    static std::string findArduinoByDirectPortScan() {
+        KP_TRACE_DEBUG("Direct COM port scan started");
 
         // Try COM1 to COM20 (usually enough to cover all possible ports)
         for (int i = 1; i <= 20; i++) {
             char portName[20];
             sprintf_s(portName, sizeof(portName), "\\\\.\\COM%d", i);
 
-            if (enableDebug) {
-                std::cout << "  Trying to open port: " << portName << std::endl;
-            }
+            KP_TRACE_DEBUG("Trying to open COM%1", i);
 
             // Try to open COM port
             HANDLE hPort = CreateFileA(
@@ -60,98 +68,60 @@ public:
             if (hPort != INVALID_HANDLE_VALUE) {
                 // Port opened successfully!
                 // Simple communication test can be added here to further verify if it's Arduino
-                if (enableDebug) {
-                    std::cout << "  ✅ Port " << portName << " opened successfully! May be Arduino device" << std::endl;
-                }
-
                 CloseHandle(hPort);
 
                 // Extract port name (remove \\.\ prefix)
                 char comOnly[10];
                 sscanf_s(portName, "\\\\.\\%[COM0-9]", comOnly, sizeof(comOnly));
 
-                if (enableDebug) {
-                    std::cout << "=== Direct COM scanning completed ===" << std::endl;
-                    std::cout << "Found possible Arduino port: " << comOnly << std::endl;
-                }
+                KP_TRACE_INFO("Direct scan opened %s, may be the Arduino", comOnly);
 
                 return std::string(comOnly);
             }
             else {
                 // Failed to open port, get error code
                 DWORD error = GetLastError();
-                if (enableDebug) {
-                    if (error == ERROR_FILE_NOT_FOUND) {
-                        std::cout << "  ❌ Port does not exist" << std::endl;
-                    }
-                    else if (error == ERROR_ACCESS_DENIED) {
-                        std::cout << "  ⚠️  Port is occupied" << std::endl;
-                    }
-                    else {
-                        std::cout << "  ❌ Failed to open, error code: " << error << std::endl;
-                    }
+                if (error == ERROR_ACCESS_DENIED) {
+                    KP_TRACE_DEBUG("COM%1 is occupied", i);
+                }
+                else if (error != ERROR_FILE_NOT_FOUND) {
+                    KP_TRACE_DEBUG("COM%1 failed to open, error %2", i, error);
                 }
             }
         }
 
-        if (enableDebug) {
-            std::cout << "=== Direct COM scanning completed ===" << std::endl;
-            std::cout << "No accessible COM ports found!" << std::endl;
-        }
+        KP_TRACE_WARN("Direct scan found no accessible COM port");
 
         return "";  // No available ports found
     }
 
-    // Automatically detect Arduino Leonardo port
-    // Working principle:
-    // 1. Priority use SetupAPI method to enumerate devices and verify VID/PID
-    // 2. If SetupAPI method fails, use direct COM port scanning as backup
-    static std::string findArduinoLeonardoPort(bool enableDebug = false) {
-        // Arduino Leonardo's VID (Vendor ID) and PID (Product ID)
-        // These values are officially defined by Arduino and can be verified in Device Manager
-        const int ARDUINO_VID = 0x2341;  // Arduino's Vendor ID
-        const int ARDUINO_LEONARDO_PID = 0x8036;  // Leonardo's Product ID
-
-        // Build hardware ID string for matching
-        char expectedHardwareId[64];
-        sprintf_s(expectedHardwareId, sizeof(expectedHardwareId), "VID_%04X&PID_%04X", ARDUINO_VID, ARDUINO_LEONARDO_PID);
-
-        if (enableDebug) {
-            std::cout << "=== Arduino Leonardo port detection started ===" << std::endl;
-            std::cout << "Expected hardware ID: " << expectedHardwareId << std::endl;
-        }
-
-        // Step 1: Enumerate all serial port devices
+    // Enumerate present serial port devices through SetupAPI and call visit
+    // with each COM name, friendly name and hardware ids (REG_MULTI_SZ, may
+    // be empty) until it returns true. Returns false when enumeration failed.
+    static bool forEachPortDevice(const std::function<bool(const char* comPortName, const char* friendlyName, const char* hardwareIds)>& visit) {
         // First try using GUID_DEVINTERFACE_COMPORT (more precise serial port GUID)
         GUID deviceGuid = GUID_DEVINTERFACE_COMPORT;
         HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&deviceGuid, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
 
         if (deviceInfoSet == INVALID_HANDLE_VALUE) {
             // If failed, try using GUID_DEVCLASS_PORTS (more general port class)
-            if (enableDebug) {
-                std::cout << "Failed to use GUID_DEVINTERFACE_COMPORT, trying GUID_DEVCLASS_PORTS" << std::endl;
-            }
+            KP_TRACE_DEBUG("GUID_DEVINTERFACE_COMPORT failed, trying GUID_DEVCLASS_PORTS");
 
             deviceGuid = GUID_DEVCLASS_PORTS;
             deviceInfoSet = SetupDiGetClassDevs(&deviceGuid, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
 
             if (deviceInfoSet == INVALID_HANDLE_VALUE) {
-                if (enableDebug) {
-                    std::cout << "Failed to enumerate port devices, error code: " << GetLastError() << std::endl;
-                }
-                return "";
+                KP_TRACE_WARN("Failed to enumerate port devices, error %1", GetLastError());
+                return false;
             }
         }
 
         SP_DEVICE_INTERFACE_DATA deviceInterfaceData;
         deviceInterfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
 
-        // Step 2: Iterate through all found port devices
-        for (DWORD deviceIndex = 0; SetupDiEnumDeviceInterfaces(deviceInfoSet, NULL, &deviceGuid, deviceIndex, &deviceInterfaceData); ++deviceIndex) {
-            if (enableDebug) {
-                std::cout << "\nDevice detected #" << deviceIndex + 1 << std::endl;
-            }
-
+        // Iterate through all found port devices
+        bool stop = false;
+        for (DWORD deviceIndex = 0; !stop && SetupDiEnumDeviceInterfaces(deviceInfoSet, NULL, &deviceGuid, deviceIndex, &deviceInterfaceData); ++deviceIndex) {
             // Get device interface details
             DWORD requiredSize = 0;
             SetupDiGetDeviceInterfaceDetailA(deviceInfoSet, &deviceInterfaceData, NULL, 0, &requiredSize, NULL);
@@ -159,9 +129,7 @@ public:
             PSP_DEVICE_INTERFACE_DETAIL_DATA_A deviceDetailData =
                 (PSP_DEVICE_INTERFACE_DETAIL_DATA_A)malloc(requiredSize);
             if (!deviceDetailData) {
-                if (enableDebug) {
-                    std::cout << "  Memory allocation failed" << std::endl;
-                }
+                KP_TRACE_ERROR("Memory allocation failed for device #%1", deviceIndex + 1);
                 continue;
             }
 
@@ -177,86 +145,92 @@ public:
                 unsigned int comPortSize = sizeof(comPortName);
 
                 if (sscanf_s(devicePath.c_str(), "\\\\.\\%[COM0-9]", comPortName, comPortSize) == 1) {
-                    if (enableDebug) {
-                        std::cout << "  Port name: " << comPortName << std::endl;
-                        std::cout << "  Device path: " << devicePath << std::endl;
-                    }
+                    KP_TRACE_DEBUG("Device #%1 is %s", deviceIndex + 1, comPortName);
 
-                    // Step 3: Check device friendly name
+                    // Two extra zero bytes terminate the multi-string even when the property is truncated
                     char friendlyName[256] = { 0 };
-                    DWORD dataSize = sizeof(friendlyName);
-                    bool isArduinoByName = false;
-
-                    if (SetupDiGetDeviceRegistryPropertyA(deviceInfoSet, &devInfoData, SPDRP_FRIENDLYNAME, NULL, (LPBYTE)friendlyName, dataSize, NULL)) {
-                        if (enableDebug) {
-                            std::cout << "  Friendly name: " << friendlyName << std::endl;
-                        }
-
-                        // Check if friendly name contains "Arduino" or "Leonardo"
-                        if (strstr(friendlyName, "Arduino") != NULL || strstr(friendlyName, "Leonardo") != NULL) {
-                            isArduinoByName = true;
-                            if (enableDebug) {
-                                std::cout << "  ✅ Matched Arduino device by friendly name!" << std::endl;
-                            }
-                        }
-                    }
-
-                    // Step 4: If friendly name doesn't match, check hardware ID
-                    bool isArduinoByHardwareId = false;
-
-                    if (!isArduinoByName) {
-                        char hardwareIds[1024] = { 0 };
-                        dataSize = sizeof(hardwareIds);
-
-                        if (SetupDiGetDeviceRegistryPropertyA(deviceInfoSet, &devInfoData, SPDRP_HARDWAREID, NULL, (LPBYTE)hardwareIds, dataSize, NULL)) {
-                            if (enableDebug) {
-                                std::cout << "  Hardware ID: " << hardwareIds << std::endl;
-                            }
-
-                            // Check if hardware ID contains expected VID/PID
-                            if (strstr(hardwareIds, expectedHardwareId) != NULL) {
-                                isArduinoByHardwareId = true;
-                                if (enableDebug) {
-                                    std::cout << "  ✅ Matched Arduino Leonardo by hardware ID!" << std::endl;
-                                }
-                            }
-                        }
-                    }
-
-                    // If any check passes, return COM port name
-                    if (isArduinoByName || isArduinoByHardwareId) {
-                        if (enableDebug) {
-                            std::cout << "\n=== Detection completed ===" << std::endl;
-                            std::cout << "Found Arduino Leonardo port: " << comPortName << std::endl;
-                        }
-
-                        free(deviceDetailData);
-                        SetupDiDestroyDeviceInfoList(deviceInfoSet);
-                        return std::string(comPortName);
-                    }
+                    char hardwareIds[1026] = { 0 };
+                    SetupDiGetDeviceRegistryPropertyA(deviceInfoSet, &devInfoData, SPDRP_FRIENDLYNAME, NULL, (LPBYTE)friendlyName, sizeof(friendlyName) - 1, NULL);
+                    SetupDiGetDeviceRegistryPropertyA(deviceInfoSet, &devInfoData, SPDRP_HARDWAREID, NULL, (LPBYTE)hardwareIds, sizeof(hardwareIds) - 2, NULL);
+                    stop = visit(comPortName, friendlyName, hardwareIds);
                 }
             }
 
             free(deviceDetailData);
         }
 
-        if (enableDebug) {
-            std::cout << "\n=== Detection completed ===" << std::endl;
-            std::cout << "SetupAPI method didn't find Arduino Leonardo device!" << std::endl;
+        SetupDiDestroyDeviceInfoList(deviceInfoSet);
+        return true;
+    }
+
+    // True when one of the hardware ids carries the Leonardo's VID and PID
+    static bool isLeonardoHardwareId(const char* hardwareIds) {
+        // Arduino Leonardo's VID (Vendor ID) and PID (Product ID)
+        // These values are officially defined by Arduino and can be verified in Device Manager
+        const int ARDUINO_VID = 0x2341;  // Arduino's Vendor ID
+        const int ARDUINO_LEONARDO_PID = 0x8036;  // Leonardo's Product ID
+
+        // Build hardware ID string for matching
+        char expectedHardwareId[64];
+        sprintf_s(expectedHardwareId, sizeof(expectedHardwareId), "VID_%04X&PID_%04X", ARDUINO_VID, ARDUINO_LEONARDO_PID);
+
+        for (const char* id = hardwareIds; *id; id += strlen(id) + 1) {
+            if (strstr(id, expectedHardwareId) != NULL) {
+                return true;
+            }
         }
+        return false;
+    }
 
-        SetupDiDestroyDeviceInfoList(deviceInfoSet);
+    // Automatically detect Arduino Leonardo port
+    // Working principle:
+    // 1. Priority use SetupAPI method to enumerate devices and verify VID/PID
+    // 2. If SetupAPI method fails, use direct COM port scanning as backup
+    static std::string findArduinoLeonardoPort() {
+        KP_TRACE_DEBUG("Leonardo detection started");
+
+        std::string found;
+        forEachPortDevice([&found](const char* comPortName, const char* friendlyName, const char* hardwareIds) {
+            // Check if friendly name contains "Arduino" or "Leonardo", then the hardware ID
+            if (strstr(friendlyName, "Arduino") != NULL || strstr(friendlyName, "Leonardo") != NULL) {
+                KP_TRACE_DEBUG("%s matched by friendly name", comPortName);
+            } else if (isLeonardoHardwareId(hardwareIds)) {
+                KP_TRACE_DEBUG("%s matched by hardware id", comPortName);
+            } else {
+                return false;
+            }
+            found = comPortName;
+            return true;
+        });
+        if (!found.empty()) {
+            KP_TRACE_INFO("Found Arduino Leonardo on %s", found);
+            return found;
+        }
 
         // Method 2: If SetupAPI fails, use direct COM port scanning
-        if (enableDebug) {
-            std::cout << "Trying direct COM port scanning..." << std::endl;
-        }
-        return findArduinoByDirectPortScan(enableDebug);
+        KP_TRACE_INFO("SetupAPI found no Arduino Leonardo, falling back to a direct scan");
+        return findArduinoByDirectPortScan();
     }
 
+    // COM ports whose hardware id carries the Leonardo's VID/PID. Unlike
+    // findArduinoLeonardoPort there is no fallback to the direct scan, which
+    // would hand back any serial device; used for unattended reconnects.
+    static std::vector<std::string> findVerifiedLeonardoPorts() {
+        std::vector<std::string> ports;
+        forEachPortDevice([&ports](const char* comPortName, const char*, const char* hardwareIds) {
+            if (isLeonardoHardwareId(hardwareIds)) {
+                ports.push_back(comPortName);
+            }
+            return false;
+        });
+        return ports;
+    }
+
+    // The handle is only published under ioMutex once fully configured, so
+    // the ring thread never writes through a half-open or closing port
     bool open(const std::string& portName, DWORD baudRate) {
         // Open serial port
-        hSerial = CreateFileA(
+        HANDLE handle = CreateFileA(
             portName.c_str(),
             GENERIC_READ | GENERIC_WRITE,
             0,
@@ -265,19 +239,23 @@ public:
             FILE_ATTRIBUTE_NORMAL,
             NULL
             );
+        DWORD openError = GetLastError();
 
-        // Store the port name
-        this->portName = portName;
+        {
+            // Store the port name
+            std::lock_guard<std::mutex> lock(ioMutex);
+            this->portName = portName;
+        }
 
-        if (hSerial == INVALID_HANDLE_VALUE) {
+        if (handle == INVALID_HANDLE_VALUE) {
+            KP_TRACE_WARN("Failed to open %s, error %1", openError, portName);
             return false;
         }
 
         // Configure serial port parameters
         dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
-        if (!GetCommState(hSerial, &dcbSerialParams)) {
-            CloseHandle(hSerial);
-            hSerial = INVALID_HANDLE_VALUE;
+        if (!GetCommState(handle, &dcbSerialParams)) {
+            CloseHandle(handle);
             return false;
         }
 
@@ -286,9 +264,8 @@ public:
         dcbSerialParams.StopBits = ONESTOPBIT;
         dcbSerialParams.Parity = NOPARITY;
 
-        if (!SetCommState(hSerial, &dcbSerialParams)) {
-            CloseHandle(hSerial);
-            hSerial = INVALID_HANDLE_VALUE;
+        if (!SetCommState(handle, &dcbSerialParams)) {
+            CloseHandle(handle);
             return false;
         }
 
@@ -299,12 +276,16 @@ public:
         timeouts.WriteTotalTimeoutConstant = 50;
         timeouts.WriteTotalTimeoutMultiplier = 10;
 
-        if (!SetCommTimeouts(hSerial, &timeouts)) {
-            CloseHandle(hSerial);
-            hSerial = INVALID_HANDLE_VALUE;
+        if (!SetCommTimeouts(handle, &timeouts)) {
+            CloseHandle(handle);
             return false;
         }
 
+        std::lock_guard<std::mutex> lock(ioMutex);
+        if (isOpen()) {
+            CloseHandle(hSerial);
+        }
+        hSerial = handle;
         return true;
     }
 
@@ -312,20 +293,70 @@ public:
         return hSerial != INVALID_HANDLE_VALUE;
     }
 
+    void close() {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        if (isOpen()) {
+            CloseHandle(hSerial);
+            hSerial = INVALID_HANDLE_VALUE;
+        }
+    }
+
     bool write(const std::string& data) {
+        static Metrics::Counter& writes = Metrics::Registry::instance().counter(
+            "kp_serial_writes_total", "Serial writes attempted");
+        static Metrics::Counter& commands = Metrics::Registry::instance().counter(
+            "kp_serial_commands_total", "Commands sent to the board");
+        static Metrics::Counter& bytes = Metrics::Registry::instance().counter(
+            "kp_serial_bytes_written_total", "Bytes written to the serial port");
+        static Metrics::Counter& failures = Metrics::Registry::instance().counter(
+            "kp_serial_write_failures_total", "Serial writes that failed or timed out");
+        static Metrics::Histogram& blocked = Metrics::Registry::instance().histogram(
+            "kp_serial_write_seconds", "Time spent in WriteFile", { 0.0001, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.05 });
+
+        std::lock_guard<std::mutex> lock(ioMutex);
+        writes.add();
         if (!isOpen()) {
+            failures.add();
             return false;
         }
 
-        DWORD bytesWritten;
-        if (!WriteFile(hSerial, data.c_str(), data.length(), &bytesWritten, NULL)) {
+        LARGE_INTEGER begin, end, frequency;
+        QueryPerformanceCounter(&begin);
+        DWORD bytesWritten = 0;
+        BOOL ok = WriteFile(hSerial, data.c_str(), data.length(), &bytesWritten, NULL);
+        QueryPerformanceCounter(&end);
+        QueryPerformanceFrequency(&frequency);
+        blocked.observe(double(end.QuadPart - begin.QuadPart) / frequency.QuadPart);
+        bytes.add(bytesWritten);
+
+        if (!ok) {
+            failures.add();
+            KP_TRACE_WARN("Serial write of %1 bytes failed, error %2", data.length(), GetLastError());
+            return false;
+        }
+        if (bytesWritten != data.length()) {
+            failures.add();
+            KP_TRACE_WARN("Serial write timed out after %1 of %2 bytes", bytesWritten, data.length());
             return false;
         }
+        commands.add(std::count(data.begin(), data.end(), '<'));
+        return true;
+    }
 
-        return bytesWritten == data.length();
+    // False once the device behind an open handle has gone away (unplugged,
+    // board reset); ClearCommError fails on such handles
+    bool isAlive() {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        if (!isOpen()) {
+            return false;
+        }
+        DWORD errors = 0;
+        COMSTAT status;
+        return ClearCommError(hSerial, &errors, &status) != FALSE;
     }
 
     bool read(std::string& data, DWORD maxBytes) {
+        std::lock_guard<std::mutex> lock(ioMutex);
         if (!isOpen()) {
             return false;
         }
@@ -343,12 +374,45 @@ public:
         return true;
     }
 
+    // Read whatever has already arrived, without waiting; data is left
+    // empty when nothing has. Unlike read() this never holds the lock for
+    // the port's read timeouts, so writes from other threads go out meanwhile.
+    bool readAvailable(std::string& data) {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        data.clear();
+        if (!isOpen()) {
+            return false;
+        }
+        DWORD errors = 0;
+        COMSTAT status;
+        if (!ClearCommError(hSerial, &errors, &status)) {
+            return false;
+        }
+        if (status.cbInQue == 0) {
+            return true;
+        }
+
+        char buffer[1024];
+        DWORD bytesRead = 0;
+        DWORD wanted = status.cbInQue < sizeof(buffer) ? status.cbInQue : static_cast<DWORD>(sizeof(buffer));
+        if (!ReadFile(hSerial, buffer, wanted, &bytesRead, NULL)) {
+            return false;
+        }
+        data.assign(buffer, bytesRead);
+        return true;
+    }
+
     // Get the name of the currently open port
     std::string getPortName() const {
-        if(portName.empty()){
-            return SerialPort::findArduinoLeonardoPort(true);
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(ioMutex);
+            name = portName;
+        }
+        if(name.empty()){
+            return SerialPort::findArduinoLeonardoPort();
         }
-        return portName;
+        return name;
     }
 
 private:
@@ -356,17 +420,28 @@ private:
 };
 
 // Command type enumeration
+// Keys are HID usages in decimal (see KeyTable.hpp); the firmware presses
+// them with Keyboard.pressRaw, modifiers included (0xE0..0xE7)
 enum class CommandType {
     PRESS_KEY = 0,
     RELEASE_KEY,
-    TYPE_STRING,
+    TYPE_STRING,   // ASCII through Keyboard.print, US layout only; typeString() sends reports instead
     PRESS_COMBINATION,
-    DELAY,
+    DELAY,         // "ms": the commands after it wait, timed (AT_TIME) ones still run
     MOUSE_MOVE,
     MOUSE_PRESS,
     MOUSE_RELEASE,
     MOUSE_CLICK,
-    MOUSE_WHEEL
+    MOUSE_WHEEL,
+    QUERY_VERSION, // Firmware replies "<KPFW:build-id>"
+    HEARTBEAT,     // Empty params refresh the watchdog, "timeout,maxHold,comboHold" configures it
+    RELEASE_ALL,   // Release every key and mouse button the firmware holds
+    KEYBOARD_REPORT, // "modifiers,usage1..usage6" sent as one HID report
+    MOUSE_REPORT,  // "buttons,dx,dy,wheel" sent as one HID report
+    TAP_KEY,       // "key[,holdMs]": press, hold on the board, release
+    CLOCK_PROBE,   // "seq": firmware replies "<KPCK:seq,receivedMicros,replyMicros>"
+    AT_TIME        // "deviceMicros,type,params": run the inner command at that micros();
+                   // refused with "<KPNAK:deviceMicros>" when the board's queue is full
 };
 
 #define MOUSE_LEFT 1
@@ -374,36 +449,814 @@ enum class CommandType {
 #define MOUSE_MIDDLE 4
 #define MOUSE_ALL (MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE)
 
+// Peephole pass over a batch of encoded commands, run just before it is
+// written (ArduinoController::setPeephole). Only adjacent commands whose
+// combined effect on the board is the same, in the same order and with the
+// same delays, are rewritten:
+// - consecutive MOUSE_MOVEs and MOUSE_WHEELs are summed while within ±127
+// - consecutive DELAYs are summed; DELAYs of zero are dropped
+// - MOUSE_CLICK "b,n" followed by "b,m" becomes "b,n+m" (explicit counts
+//   only, the one-argument form skips the 50 ms pause after the click)
+// - PRESS_KEY k [DELAY d] RELEASE_KEY k becomes TAP_KEY "k[,d]"
+// - a keyboard report, or a mouse report without movement, equal to the
+//   one right before it, and a repeated RELEASE_ALL are dropped
+// - an empty HEARTBEAT followed by another command is dropped, since every
+//   command refreshes the watchdog when it is received
+// Batches containing anything but complete commands are left alone.
+class CommandOptimizer {
+public:
+    struct Savings {
+        size_t bytes = 0;
+        size_t commands = 0;
+    };
+
+    static Savings optimize(std::string& commands) {
+        std::vector<Command> out;
+        size_t count = 0;
+        size_t begin = 0;
+        while (begin < commands.size()) {
+            size_t end = commands.find('>', begin);
+            if (commands[begin] != '<' || end == std::string::npos) {
+                return Savings();
+            }
+            push(out, parse(commands.substr(begin, end - begin + 1)));
+            ++count;
+            begin = end + 1;
+        }
+        if (out.size() == count) {
+            return Savings();
+        }
+
+        std::string optimized;
+        optimized.reserve(commands.size());
+        for (const Command& command : out) {
+            optimized += command.text;
+        }
+        Savings savings;
+        savings.bytes = commands.size() - optimized.size();
+        savings.commands = count - out.size();
+        commands.swap(optimized);
+        return savings;
+    }
+
+private:
+    static constexpr int kMaxDelta = 127;    // HID reports carry signed bytes
+    static constexpr int kMaxCount = 32767;  // the firmware parses into a 16-bit int
+
+    struct Command {
+        int type = -1;
+        bool numeric = false;   // all parameters are integers (or there are none)
+        std::vector<int> args;
+        std::string text;       // encoded form, "<type,params>"
+    };
+
+    static Command parse(const std::string& text) {
+        Command command;
+        command.text = text;
+        size_t comma = text.find(',');
+        if (comma == std::string::npos) {
+            return command;
+        }
+        command.type = std::atoi(text.c_str() + 1);
+        command.numeric = true;
+        size_t begin = comma + 1;
+        const size_t end = text.size() - 1;
+        while (begin < end) {
+            size_t next = text.find(',', begin);
+            if (next == std::string::npos || next > end) next = end;
+            size_t digits = begin + (text[begin] == '-' ? 1 : 0);
+            if (digits == next || text.find_first_not_of("0123456789", digits) < next) {
+                command.numeric = false;
+                break;
+            }
+            command.args.push_back(std::atoi(text.c_str() + begin));
+            begin = next + 1;
+        }
+        return command;
+    }
+
+    static void set(Command& command, int type, std::vector<int> args) {
+        command.type = type;
+        command.numeric = true;
+        command.args = std::move(args);
+        command.text = "<" + std::to_string(type) + ",";
+        for (size_t i = 0; i < command.args.size(); ++i) {
+            command.text += (i ? "," : "") + std::to_string(command.args[i]);
+        }
+        command.text += ">";
+    }
+
+    static bool is(const Command& command, CommandType type, size_t argCount) {
+        return command.numeric && command.type == static_cast<int>(type) && command.args.size() == argCount;
+    }
+
+    static bool withinDelta(int value) {
+        return value >= -kMaxDelta && value <= kMaxDelta;
+    }
+
+    static void push(std::vector<Command>& out, Command next) {
+        if (is(next, CommandType::DELAY, 1) && next.args[0] <= 0) {
+            return;
+        }
+        if (out.empty()) {
+            out.push_back(std::move(next));
+            return;
+        }
+        Command& last = out.back();
+        if (is(last, CommandType::HEARTBEAT, 0)) {
+            out.pop_back();
+            push(out, std::move(next));
+            return;
+        }
+
+        if (is(last, CommandType::MOUSE_MOVE, 2) && is(next, CommandType::MOUSE_MOVE, 2)) {
+            int dx = last.args[0] + next.args[0], dy = last.args[1] + next.args[1];
+            if (withinDelta(dx) && withinDelta(dy)) {
+                set(last, last.type, { dx, dy });
+                return;
+            }
+        } else if (is(last, CommandType::MOUSE_WHEEL, 1) && is(next, CommandType::MOUSE_WHEEL, 1)) {
+            int delta = last.args[0] + next.args[0];
+            if (withinDelta(delta)) {
+                set(last, last.type, { delta });
+                return;
+            }
+        } else if (is(last, CommandType::DELAY, 1) && is(next, CommandType::DELAY, 1)) {
+            if (last.args[0] + next.args[0] <= kMaxCount) {
+                set(last, last.type, { last.args[0] + next.args[0] });
+                return;
+            }
+        } else if (is(last, CommandType::MOUSE_CLICK, 2) && is(next, CommandType::MOUSE_CLICK, 2)) {
+            if (last.args[0] == next.args[0] && last.args[1] > 0 && next.args[1] > 0 &&
+                last.args[1] + next.args[1] <= kMaxCount) {
+                set(last, last.type, { last.args[0], last.args[1] + next.args[1] });
+                return;
+            }
+        } else if (is(next, CommandType::RELEASE_KEY, 1)) {
+            const int key = next.args[0];
+            if (is(last, CommandType::PRESS_KEY, 1) && last.args[0] == key) {
+                set(last, static_cast<int>(CommandType::TAP_KEY), { key });
+                return;
+            }
+            if (out.size() >= 2 && is(last, CommandType::DELAY, 1)) {
+                Command& press = out[out.size() - 2];
+                if (is(press, CommandType::PRESS_KEY, 1) && press.args[0] == key) {
+                    set(press, static_cast<int>(CommandType::TAP_KEY), { key, last.args[0] });
+                    out.pop_back();
+                    return;
+                }
+            }
+        } else if (last.text == next.text) {
+            if (is(next, CommandType::RELEASE_ALL, 1) ||
+                (next.numeric && next.type == static_cast<int>(CommandType::KEYBOARD_REPORT))) {
+                return;
+            }
+            if (is(next, CommandType::MOUSE_REPORT, 4) && next.args[1] == 0 && next.args[2] == 0 && next.args[3] == 0) {
+                return;
+            }
+        }
+        out.push_back(std::move(next));
+    }
+};
+
+// Stand-in for the serial port, e.g. for dry runs. write() receives exactly
+// what would have gone to the board; wait() replaces the host-side sleeps
+// (sendKey's hold time) so that a virtual clock can account for them.
+class CommandTransport {
+public:
+    virtual ~CommandTransport() = default;
+    virtual bool write(const std::string& commands) = 0;
+    virtual void wait(unsigned int milliseconds) { ::Sleep(milliseconds); }
+};
+
+// Accepts and discards everything without waiting
+class NullTransport : public CommandTransport {
+public:
+    bool write(const std::string&) override { return true; }
+    void wait(unsigned int) override {}
+};
+
 // Arduino controller class
 class ArduinoController {
 private:
     SerialPort serialPort;
 
+    // Shared-memory command ring (see KeyPresserRing.h)
+    HANDLE ringMapping = NULL;
+    HANDLE ringEvent = NULL;
+    kp_ring_header* ring = nullptr;
+    uint32_t ringSlots = 0;                 // slot_count as validated at attach time
+    std::thread ringThread;
+    std::atomic<bool> ringStop{ false };
+
+    CommandTransport* transport = nullptr;  // not owned; replaces the port when set
+    std::atomic<bool> peephole{ false };    // run CommandOptimizer on multi-command writes
+
+    // Device clock estimate (see syncClock())
+    mutable std::mutex clockMutex;
+    DeviceClock deviceClock;
+    uint32_t probeSequence = 0;
+    std::thread clockThread;                // see syncClockAsync()
+    std::atomic<bool> clockSyncing{ false };
+
+    // Host times of the AT_TIME commands the board may still hold in its
+    // queue (see encodeAt()); guarded by clockMutex
+    static constexpr int64_t kScheduleSlackUs = 2000;  // covers the clock estimate's error
+    std::vector<int64_t> scheduledTimes;
+
+    // Link loss handling (see reconnect())
+    static constexpr size_t kMaxReplay = 64;
+    std::atomic<bool> linkLost{ false };
+    std::function<void()> linkLostHandler;
+    std::mutex replayMutex;
+    std::deque<std::string> replayQueue;
+    std::thread reconnectThread;            // see reconnectAsync()
+    std::atomic<bool> reconnecting{ false };
+
+    void resetClock() {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        deviceClock.reset();
+        scheduledTimes.clear();
+    }
+
+    // Forget the queued commands the board has run by now; clockMutex must be held
+    void pruneScheduled(int64_t now) {
+        scheduledTimes.erase(std::remove_if(scheduledTimes.begin(), scheduledTimes.end(),
+                                            [now](int64_t at) { return at + kScheduleSlackUs <= now; }),
+                             scheduledTimes.end());
+    }
+
+    // Every write goes through here. A failed write on an open port means the
+    // link is gone: the commands are queued per their replay policy.
+    bool send(const std::string& commands) {
+        if (peephole.load(std::memory_order_relaxed) && commands.find('<', 1) != std::string::npos) {
+            static Metrics::Counter& savedBytes = Metrics::Registry::instance().counter(
+                "kp_peephole_saved_bytes_total", "Bytes removed from writes by the peephole optimizer");
+            static Metrics::Counter& savedCommands = Metrics::Registry::instance().counter(
+                "kp_peephole_saved_commands_total", "Commands removed from writes by the peephole optimizer");
+            std::string optimized = commands;
+            CommandOptimizer::Savings savings = CommandOptimizer::optimize(optimized);
+            savedBytes.add(static_cast<int64_t>(savings.bytes));
+            savedCommands.add(static_cast<int64_t>(savings.commands));
+            return deliver(optimized);
+        }
+        return deliver(commands);
+    }
+
+    bool deliver(const std::string& commands) {
+        if (transport) {
+            return transport->write(commands);
+        }
+        if (linkLost.load() && queueForReplay(commands)) {
+            return false;  // the port may be mid-reopen on the reconnect thread
+        }
+        if (serialPort.write(commands)) {
+            return true;
+        }
+        if (!serialPort.isOpen()) {
+            return false;  // closed on purpose (disconnect), nothing to recover
+        }
+        markLinkLost();
+        queueForReplay(commands);
+        return false;
+    }
+
+    void markLinkLost() {
+        if (linkLost.exchange(true)) {
+            return;
+        }
+        static Metrics::Counter& losses = Metrics::Registry::instance().counter(
+            "kp_link_losses_total", "Times the serial link to the board was lost");
+        losses.add();
+        KP_TRACE_WARN("Serial link to %s lost", serialPort.getPortName());
+        if (linkLostHandler) {
+            linkLostHandler();
+        }
+    }
+
+    // False when the link came back meanwhile (reconnect() clears linkLost
+    // under the same lock); the caller then writes to the port instead
+    bool queueForReplay(const std::string& commands) {
+        static Metrics::Counter& dropped = Metrics::Registry::instance().counter(
+            "kp_link_dropped_commands_total", "Commands dropped while the link was down");
+        std::lock_guard<std::mutex> lock(replayMutex);
+        if (!linkLost.load()) {
+            return false;
+        }
+        size_t begin = 0;
+        while ((begin = commands.find('<', begin)) != std::string::npos) {
+            size_t end = commands.find('>', begin);
+            if (end == std::string::npos) {
+                break;
+            }
+            std::string command = commands.substr(begin, end - begin + 1);
+            begin = end + 1;
+            CommandType type = static_cast<CommandType>(std::atoi(command.c_str() + 1));
+            if (replayPolicy(type) == ReplayPolicy::Drop) {
+                dropped.add();
+                continue;
+            }
+            if (replayQueue.size() == kMaxReplay) {
+                replayQueue.pop_front();
+                dropped.add();
+            }
+            replayQueue.push_back(command);
+        }
+        return true;
+    }
+
+    // Drain loop of the I/O thread: forwards ring contents to the serial port,
+    // batching everything already queued into a single write, and sleeps on the
+    // event only after announcing it via consumer_sleeping and re-checking.
+    void ringLoop() {
+        static Metrics::Counter& malformed = Metrics::Registry::instance().counter(
+            "kp_ring_malformed_total", "Ring slots dropped because their length exceeded the slot");
+        const size_t maxBatchBytes = 4096;
+        char command[KP_RING_DATA_SIZE];
+        std::string batch;
+        batch.reserve(maxBatchBytes + KP_RING_DATA_SIZE);
+
+        while (!ringStop.load()) {
+            batch.clear();
+            int length;
+            while (batch.size() < maxBatchBytes && (length = kp_ring_pop(ring, ringSlots, command)) != -1) {
+                if (length < 0) {
+                    malformed.add();
+                    continue;
+                }
+                batch.append(command, length);
+            }
+            if (!batch.empty()) {
+                send(batch);
+                continue;
+            }
+
+            ring->consumer_sleeping = 1;
+            MemoryBarrier();
+            if ((length = kp_ring_pop(ring, ringSlots, command)) != -1) {
+                ring->consumer_sleeping = 0;
+                if (length < 0) {
+                    malformed.add();
+                } else {
+                    send(std::string(command, length));
+                }
+                continue;
+            }
+            WaitForSingleObject(ringEvent, INFINITE);
+            ring->consumer_sleeping = 0;
+        }
+    }
+
 public:
+    ~ArduinoController() {
+        waitForReconnect();
+        waitForClockSync();
+        detachSharedRing();
+    }
     bool connect(const std::string& portName, DWORD baudRate = 9600) {
-        return serialPort.open(portName, baudRate);
+        waitForReconnect();
+        waitForClockSync();
+        if (!serialPort.open(portName, baudRate)) {
+            return false;
+        }
+        linkLost = false;
+        resetClock();
+        return true;
     }
 
     bool isConnected() const {
         return serialPort.isOpen();
     }
 
-    // Send key press command
+    // Route every command to transport instead of the serial port (nullptr
+    // restores the port). The transport must outlive its use here.
+    void setTransport(CommandTransport* commandTransport) {
+        transport = commandTransport;
+    }
+
+    // Coalesce and de-duplicate the commands of each multi-command write
+    // before it goes out (see CommandOptimizer). Needs firmware that knows
+    // TAP_KEY.
+    void setPeephole(bool enabled) {
+        peephole = enabled;
+    }
+
+    // Release the port, e.g. so that the uploader can reset the board
+    void disconnect() {
+        waitForReconnect();  // otherwise it could reopen the port right after
+        waitForClockSync();
+        serialPort.close();
+        linkLost = false;
+        resetClock();
+        std::lock_guard<std::mutex> lock(replayMutex);
+        replayQueue.clear();
+    }
+
+    std::string getPortName() const {
+        return serialPort.getPortName();
+    }
+
+    // Ask the firmware for its build id ("KPFW:..."). Returns an empty string
+    // when the board does not answer in time (e.g. firmware predating QUERY_VERSION).
+    std::string queryFirmwareBuild(DWORD timeoutMs = 500) {
+        if (!send(encode(CommandType::QUERY_VERSION, "0"))) {
+            return "";
+        }
+
+        std::string reply, chunk;
+        DWORD start = GetTickCount();
+        while (GetTickCount() - start < timeoutMs) {
+            if (!serialPort.read(chunk, 64)) {
+                if (serialPort.isOpen()) {
+                    markLinkLost();
+                }
+                break;
+            }
+            reply += chunk;
+            size_t begin = reply.find("<KPFW:");
+            size_t end = (begin == std::string::npos) ? std::string::npos : reply.find('>', begin);
+            if (end != std::string::npos) {
+                return reply.substr(begin + 1, end - begin - 1);
+            }
+        }
+        return "";
+    }
+
+    // Exchange probes with the firmware (CLOCK_PROBE) and refine the device
+    // clock estimate. Blocks for one round trip per probe (about a
+    // millisecond over USB, timeoutMs when unanswered); prefer
+    // syncClockAsync() on a GUI thread. Returns false when no probe was
+    // answered, e.g. with firmware predating CLOCK_PROBE or while a
+    // transport is set.
+    bool syncClock(int probes = 1, DWORD timeoutMs = 100) {
+        static Metrics::Gauge& roundTrip = Metrics::Registry::instance().gauge(
+            "kp_clock_round_trip_us", "Quickest recent clock probe round trip");
+        static Metrics::Gauge& drift = Metrics::Registry::instance().gauge(
+            "kp_clock_drift_ppm", "Device clock rate relative to the host");
+        static Metrics::Counter& rejected = Metrics::Registry::instance().counter(
+            "kp_schedule_rejected_total", "Timed commands the board refused because its queue was full");
+        const int64_t kSpinUs = 2000;  // replies usually arrive well within this
+        if (transport) {
+            return false;
+        }
+
+        bool answered = false;
+        for (int i = 0; i < probes; ++i) {
+            uint32_t sequence;
+            {
+                std::lock_guard<std::mutex> lock(clockMutex);
+                sequence = ++probeSequence;
+            }
+            const std::string expected = "<KPCK:" + std::to_string(sequence) + ",";
+            int64_t sent = DeviceClock::hostMicros();
+            if (!send(encode(CommandType::CLOCK_PROBE, std::to_string(sequence)))) {
+                break;
+            }
+
+            // Poll what has arrived rather than block in ReadFile, which would
+            // keep writers out until the port's read timeouts expire
+            std::string reply, chunk;
+            int64_t received = 0;
+            size_t begin = std::string::npos;
+            const int64_t deadline = sent + int64_t(timeoutMs) * 1000;
+            while (received == 0 && DeviceClock::hostMicros() < deadline) {
+                if (!serialPort.readAvailable(chunk)) {
+                    if (serialPort.isOpen()) {
+                        markLinkLost();
+                    }
+                    return answered;
+                }
+                if (chunk.empty()) {
+                    if (DeviceClock::hostMicros() - sent < kSpinUs) {
+                        std::this_thread::yield();
+                    } else {
+                        ::Sleep(1);
+                    }
+                    continue;
+                }
+                int64_t arrived = DeviceClock::hostMicros();
+                reply += chunk;
+                begin = reply.find(expected);
+                if (begin != std::string::npos && reply.find('>', begin) != std::string::npos) {
+                    received = arrived;
+                }
+            }
+
+            // Replies to AT_TIME commands that did not fit the board's queue
+            for (size_t nak = reply.find("<KPNAK:"); nak != std::string::npos; nak = reply.find("<KPNAK:", nak + 1)) {
+                rejected.add();
+                KP_TRACE_WARN("Board queue full, a timed command was refused");
+            }
+            if (received == 0) {
+                KP_TRACE_WARN("Clock probe %1 unanswered", sequence);
+                continue;
+            }
+
+            const char* fields = reply.c_str() + begin + expected.size();
+            char* end = nullptr;
+            uint32_t deviceReceived = static_cast<uint32_t>(std::strtoul(fields, &end, 10));
+            uint32_t deviceSent = static_cast<uint32_t>(std::strtoul(end + 1, nullptr, 10));
+            std::lock_guard<std::mutex> lock(clockMutex);
+            deviceClock.addProbe(sent, deviceReceived, deviceSent, received);
+            roundTrip.set(static_cast<double>(deviceClock.current().roundTripUs));
+            drift.set(deviceClock.current().driftPpm);
+            answered = true;
+        }
+        return answered;
+    }
+
+    // Run syncClock() on a worker thread; done (may be empty) is called
+    // there with the result. Returns false while a sync is still running.
+    bool syncClockAsync(int probes, std::function<void(bool)> done) {
+        if (clockSyncing.exchange(true)) {
+            return false;
+        }
+        if (clockThread.joinable()) {
+            clockThread.join();
+        }
+        clockThread = std::thread([this, probes, done]() {
+            bool synced = syncClock(probes);
+            clockSyncing = false;
+            if (done) {
+                done(synced);
+            }
+        });
+        return true;
+    }
+
+    void waitForClockSync() {
+        if (clockThread.joinable()) {
+            clockThread.join();
+        }
+    }
+
+    bool isClockSynced() const {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        return deviceClock.isSynced();
+    }
+
+    DeviceClock::Estimate clockEstimate() const {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        return deviceClock.current();
+    }
+
+    // The firmware queues at most this many AT_TIME commands and refuses
+    // more ("<KPNAK:micros>") rather than running them early
+    static constexpr size_t kScheduleCapacity = 16;
+
+    // Wrap already encoded commands so that the firmware queues them and
+    // runs them at host time hostMicros (DeviceClock::hostMicros), in order.
+    // Appends nothing and returns false until the clock has been synced, and
+    // when commands due in the future would overflow the board's queue (see
+    // scheduleRoom()).
+    bool encodeAt(int64_t hostMicros, const std::string& commands, std::string& out) {
+        static Metrics::Counter& full = Metrics::Registry::instance().counter(
+            "kp_schedule_full_total", "Timed writes held back because the board's queue was full");
+        uint32_t deviceMicros;
+        {
+            std::lock_guard<std::mutex> lock(clockMutex);
+            if (!deviceClock.isSynced()) {
+                return false;
+            }
+            const int64_t now = DeviceClock::hostMicros();
+            if (hostMicros > now) {
+                const size_t count = std::count(commands.begin(), commands.end(), '<');
+                pruneScheduled(now);
+                if (scheduledTimes.size() + count > kScheduleCapacity) {
+                    full.add();
+                    return false;
+                }
+                scheduledTimes.insert(scheduledTimes.end(), count, hostMicros);
+            }
+            deviceMicros = static_cast<uint32_t>(deviceClock.toDevice(hostMicros));
+        }
+        const std::string prefix = "<" + std::to_string(static_cast<int>(CommandType::AT_TIME)) + "," +
+                                   std::to_string(deviceMicros) + ",";
+        size_t begin = 0;
+        while ((begin = commands.find('<', begin)) != std::string::npos) {
+            size_t end = commands.find('>', begin);
+            if (end == std::string::npos) {
+                break;
+            }
+            out += prefix;
+            out.append(commands, begin + 1, end - begin);
+            begin = end + 1;
+        }
+        return true;
+    }
+
+    bool sendAt(int64_t hostMicros, const std::string& commands) {
+        std::string scheduled;
+        return encodeAt(hostMicros, commands, scheduled) && send(scheduled);
+    }
+
+    // Entries left in the board's AT_TIME queue, counting the commands sent
+    // through encodeAt() that are not due yet
+    size_t scheduleRoom() {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        pruneScheduled(DeviceClock::hostMicros());
+        return scheduledTimes.size() < kScheduleCapacity ? kScheduleCapacity - scheduledTimes.size() : 0;
+    }
+
+    // Host time at which the board's queue frees its next entry, 0 when it is empty
+    int64_t nextScheduleExpiry() {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        pruneScheduled(DeviceClock::hostMicros());
+        if (scheduledTimes.empty()) {
+            return 0;
+        }
+        return *std::min_element(scheduledTimes.begin(), scheduledTimes.end()) + kScheduleSlackUs;
+    }
+
+    // sendKey/chord with the press and the release timed by the board: the
+    // press lands at hostMicros, the release holdMs later, and nothing blocks
+    bool sendKeyAt(int64_t hostMicros, const std::string& key, unsigned int holdMs) {
+        std::string scheduled;
+        return encodeAt(hostMicros, encode(CommandType::PRESS_KEY, key), scheduled) &&
+               encodeAt(hostMicros + holdMs * int64_t(1000), encode(CommandType::RELEASE_KEY, key), scheduled) &&
+               send(scheduled);
+    }
+
+    bool chordAt(int64_t hostMicros, uint8_t modifiers, const std::vector<uint8_t>& usages, unsigned int holdMs) {
+        std::string scheduled;
+        return encodeAt(hostMicros, encode(CommandType::KEYBOARD_REPORT, reportParams(modifiers, usages)), scheduled) &&
+               encodeAt(hostMicros + holdMs * int64_t(1000), encode(CommandType::KEYBOARD_REPORT, "0"), scheduled) &&
+               send(scheduled);
+    }
+
+    static std::string reportParams(uint8_t modifiers, const std::vector<uint8_t>& usages) {
+        std::string params = std::to_string(modifiers);
+        for (uint8_t usage : usages) {
+            params += "," + std::to_string(usage);
+        }
+        return params;
+    }
+
+    // Encode one command in the wire format "<type,params>"
+    static std::string encode(CommandType type, const std::string& params) {
+        return "<" + std::to_string(static_cast<int>(type)) + "," + params + ">";
+    }
+
+    // Send one or more already encoded commands in a single write
+    bool sendRaw(const std::string& commands) {
+        return send(commands);
+    }
+
+    // What to do with a command that could not be written because the link
+    // was down: typed text is replayed after reconnecting, timed actions are
+    // stale by then and dropped. Releases are dropped too: reconnect() sends
+    // RELEASE_ALL before the replay, after which they would do nothing.
+    enum class ReplayPolicy { Replay, Drop };
+
+    static ReplayPolicy replayPolicy(CommandType type) {
+        switch (type) {
+        case CommandType::TYPE_STRING:
+            return ReplayPolicy::Replay;
+        default:
+            return ReplayPolicy::Drop;
+        }
+    }
+
+    bool isLinkLost() const {
+        return linkLost.load();
+    }
+
+    // Called (on the writing thread) when a write or read fails on an open
+    // port; the owner schedules reconnect()
+    void setLinkLostHandler(std::function<void()> handler) {
+        linkLostHandler = std::move(handler);
+    }
+
+    // Poll the device behind the open port; reports link loss like a failed write
+    bool checkLink() {
+        if (!serialPort.isOpen() || linkLost.load()) {
+            return !linkLost.load();
+        }
+        if (!serialPort.isAlive()) {
+            markLinkLost();
+            return false;
+        }
+        return true;
+    }
+
+    // Reopen the port after link loss and flush the replay queue. Blocks for
+    // the device enumeration; prefer reconnectAsync() on a GUI thread. Only a
+    // port whose hardware id is the Leonardo's is accepted, preferring the
+    // previous COM number, so an unrelated serial device that happens to be
+    // present never receives the replay.
+    bool reconnect() {
+        std::string name = serialPort.getPortName();
+        std::vector<std::string> ports = SerialPort::findVerifiedLeonardoPorts();
+        if (ports.empty()) {
+            return false;
+        }
+        auto previous = std::find(ports.begin(), ports.end(), name);
+        std::rotate(ports.begin(), previous == ports.end() ? ports.begin() : previous, ports.end());
+
+        serialPort.close();
+        bool opened = false;
+        for (const std::string& port : ports) {
+            if (serialPort.open(port, 9600)) {
+                opened = true;
+                break;
+            }
+        }
+        if (!opened) {
+            return false;
+        }
+
+        resetClock();  // the board may have been reset, restarting micros()
+        static Metrics::Counter& replayed = Metrics::Registry::instance().counter(
+            "kp_link_replayed_commands_total", "Commands replayed after a reconnect");
+        // Release everything first: the board may have kept keys down across the glitch
+        std::string batch = encode(CommandType::RELEASE_ALL, "0");
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(replayMutex);
+            for (const std::string& command : replayQueue) {
+                batch += command;
+            }
+            count = replayQueue.size();
+            replayQueue.clear();
+            // Under the lock: a writer either queued above or sees the link up
+            linkLost = false;
+        }
+        replayed.add(static_cast<int64_t>(count));
+        KP_TRACE_INFO("Reconnected to %s, replaying %1 commands", count, serialPort.getPortName());
+        return send(batch);
+    }
+
+    // Run reconnect() on a worker thread; done is called there with the
+    // result. Returns false while an attempt is still running.
+    bool reconnectAsync(std::function<void(bool)> done) {
+        if (reconnecting.exchange(true)) {
+            return false;
+        }
+        if (reconnectThread.joinable()) {
+            reconnectThread.join();
+        }
+        reconnectThread = std::thread([this, done]() {
+            bool ok = reconnect();
+            reconnecting = false;
+            done(ok);
+        });
+        return true;
+    }
+
+    void waitForReconnect() {
+        if (reconnectThread.joinable()) {
+            reconnectThread.join();
+        }
+    }
+
+    // Send key press command; key is a decimal HID usage, use
+    // KeyTable::fromText for names and characters
     bool pressKey(const std::string& key) {
         std::string command = "<0," + key + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send key release command
     bool releaseKey(const std::string& key) {
         std::string command = "<1," + key + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
-    // Send string input command
+    // Type UTF-8 text as the foreground window's keyboard layout would
+    // produce it; nothing is sent when a character has no key on that layout
     bool typeString(const std::string& str) {
-        std::string command = "<2," + str + ">";
-        return serialPort.write(command);
+        std::string commands;
+        return encodeText(str, KeyTable::foregroundLayout(), commands) && send(commands);
+    }
+
+    // Encode text as one press and one release report per character, with
+    // the modifiers (Shift, AltGr) the layout needs; dead keys get a Space
+    static bool encodeText(const std::string& utf8, HKL layout, std::string& commands) {
+        if (utf8.empty()) {
+            return true;
+        }
+        int length = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), nullptr, 0);
+        std::wstring text(static_cast<size_t>(length), L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), &text[0], length);
+
+        const std::string release = encode(CommandType::KEYBOARD_REPORT, "0");
+        std::string encoded;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == L'\r' && i + 1 < text.size() && text[i + 1] == L'\n') {
+                continue;  // CRLF is one Enter
+            }
+            KeyTable::Stroke stroke;
+            if (!KeyTable::fromCharacter(text[i], layout, stroke)) {
+                KP_TRACE_WARN("No key types U+%1 on the current layout", static_cast<int>(text[i]));
+                return false;
+            }
+            encoded += encode(CommandType::KEYBOARD_REPORT, reportParams(stroke.modifiers, { stroke.usage })) + release;
+            if (stroke.dead) {
+                encoded += encode(CommandType::KEYBOARD_REPORT, reportParams(0, { KeyTable::usage("Space") })) + release;
+            }
+        }
+        commands += encoded;
+        return true;
     }
 
     // Send key combination command
@@ -416,13 +1269,13 @@ public:
             }
         }
         std::string command = "<3," + keysStr + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send delay command
     bool delay(unsigned int milliseconds) {
         std::string command = "<4," + std::to_string(milliseconds) + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send complete key operation (press then release)
@@ -432,78 +1285,182 @@ public:
         }
 
         // Wait for key press duration
-        ::Sleep(pressDuration);
+        if (transport) {
+            transport->wait(pressDuration);
+        } else {
+            ::Sleep(pressDuration);
+        }
 
         return releaseKey(key);
     }
 
+    // Configure the firmware watchdog. The board releases everything it holds
+    // when no command arrives for heartbeatTimeoutMs, and releases any single
+    // key or mouse button held longer than maxHoldMs. comboHoldMs is how long
+    // PRESS_COMBINATION keeps its keys down. Zero timeouts disable the watchdog.
+    bool configureWatchdog(unsigned int heartbeatTimeoutMs, unsigned int maxHoldMs, unsigned int comboHoldMs) {
+        return send(encode(CommandType::HEARTBEAT, std::to_string(heartbeatTimeoutMs) + "," +
+                           std::to_string(maxHoldMs) + "," + std::to_string(comboHoldMs)));
+    }
+
+    // Keep the watchdog from firing. Every command counts as a heartbeat, so
+    // this only matters while no keys are being sent.
+    bool heartbeat() {
+        return send(encode(CommandType::HEARTBEAT, ""));
+    }
+
+    bool releaseAll() {
+        {
+            std::lock_guard<std::mutex> lock(clockMutex);
+            scheduledTimes.clear();  // the board empties its queue too
+        }
+        return send(encode(CommandType::RELEASE_ALL, "0"));
+    }
+
+    // Send a whole keyboard state as one HID report.
+    // - modifiers: bit 0..3 = left Ctrl/Shift/Alt/GUI, bit 4..7 = right side
+    // - usages: up to 6 HID usage IDs (0x04 = 'a', 0x3A = F1, ...)
+    // An empty report ("<13,0>") releases everything it pressed.
+    bool keyboardReport(uint8_t modifiers, const std::vector<uint8_t>& usages) {
+        return send(encode(CommandType::KEYBOARD_REPORT, reportParams(modifiers, usages)));
+    }
+
+    // Send buttons and movement as one HID report; movement is clamped to -127..127
+    bool mouseReport(uint8_t buttons, int dx, int dy, int wheel = 0) {
+        return send(encode(CommandType::MOUSE_REPORT, std::to_string(buttons) + "," + std::to_string(dx) + "," +
+                           std::to_string(dy) + "," + std::to_string(wheel)));
+    }
+
+    // Press a chord in a single report, hold it on the board and release it,
+    // all in one write, so every key lands in the same USB frame.
+    bool chord(uint8_t modifiers, const std::vector<uint8_t>& usages, unsigned int holdMs) {
+        return send(encode(CommandType::KEYBOARD_REPORT, reportParams(modifiers, usages)) +
+                                encode(CommandType::DELAY, std::to_string(holdMs)) +
+                                encode(CommandType::KEYBOARD_REPORT, "0"));
+    }
+
+    // Split keys as sent with PRESS_KEY (decimal HID usages) into a report's
+    // modifier byte and usages. Returns false for invalid usages or when there
+    // are more than 6 non-modifier keys.
+    static bool chordFromKeys(const std::vector<std::string>& keys, uint8_t& modifiers, std::vector<uint8_t>& usages) {
+        modifiers = 0;
+        usages.clear();
+        for (const std::string& key : keys) {
+            int usage = std::atoi(key.c_str());
+            if (!KeyTable::isValidUsage(usage)) {
+                return false;
+            }
+            if (KeyTable::isModifier(usage)) {
+                modifiers |= KeyTable::modifierBit(usage);
+                continue;
+            }
+            if (usages.size() == 6) {
+                return false;
+            }
+            usages.push_back(static_cast<uint8_t>(usage));
+        }
+        return true;
+    }
+
     // Send mouse move command
     bool mouseMove(int dx, int dy) {
         std::string command = "<" + std::to_string(static_cast<int>(CommandType::MOUSE_MOVE)) + "," +
                               std::to_string(dx) + "," + std::to_string(dy) + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send mouse press command
     bool mousePress(int button) {
         std::string command = "<" + std::to_string(static_cast<int>(CommandType::MOUSE_PRESS)) + "," +
                               std::to_string(button) + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send mouse release command
     bool mouseRelease(int button) {
         std::string command = "<" + std::to_string(static_cast<int>(CommandType::MOUSE_RELEASE)) + "," +
                               std::to_string(button) + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send mouse click command
     bool mouseClick(int button, int clickCount = 1) {
         std::string command = "<" + std::to_string(static_cast<int>(CommandType::MOUSE_CLICK)) + "," +
                               std::to_string(button) + "," + std::to_string(clickCount) + ">";
-        return serialPort.write(command);
+        return send(command);
     }
 
     // Send mouse wheel command
     bool mouseWheel(int delta) {
         std::string command = "<" + std::to_string(static_cast<int>(CommandType::MOUSE_WHEEL)) + "," +
                               std::to_string(delta) + ">";
-        return serialPort.write(command);
-    }
-
-    // Upload sketch (HEX file) to Arduino board
-    // Parameters:
-    // - hexFilePath: Path to the HEX file
-    // - avrdudePath: Path to avrdude executable (default: common Arduino IDE path)
-    // - boardType: Arduino board type (default: "leonardo" for Arduino Leonardo)
-    // - baudRate: Baud rate for uploading (default: 57600 for Arduino Leonardo)
-    // - enableDebug: Print debug information
-    bool uploadSketch(const std::string& hexFilePath,
-                      bool enableDebug = true) {
-
-        std::string arduino_cli_path = (QCoreApplication::applicationDirPath() + "/arduino-cli.exe").toStdString();
-        //  command
-        // 使用 --input-file 参数直接指定 HEX 文件
-        std::string command = "cmd.exe /S /C \"" + arduino_cli_path + "\" upload --fqbn arduino:avr:leonardo --port " + serialPort.getPortName() + " --input-file \"" + hexFilePath + "\"";
-        if (enableDebug) {
-            qInfo() << "=== Starting sketch upload ===";
-            qInfo() << "AVRDUDE command: " << command.c_str();
-        }
-
-        // Execute avrdude command
-        int result = system(command.c_str());
-
-        if (enableDebug) {
-            if (result == 0) {
-                qInfo() << "✅ Sketch upload completed successfully!";
-            } else {
-                qDebug() << "❌ Sketch upload failed with error code: " << result;
+        return send(command);
+    }
+
+    // Publish a shared-memory ring named "Local\KeyPresserRing_<name>" that
+    // external processes fill with encoded commands (KeyPresserRing.h), and
+    // start the I/O thread that drains it to the board.
+    // - slotCount: ring capacity in commands, must be a power of two
+    bool attachSharedRing(const std::string& name, uint32_t slotCount = KP_RING_DEFAULT_SLOTS) {
+        if (ring || slotCount == 0 || (slotCount & (slotCount - 1)) != 0) {
+            return false;
+        }
+
+        const uint64_t bytes = KP_RING_BYTES(slotCount);
+        std::string mappingName = "Local\\KeyPresserRing_" + name;
+        ringMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                         static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), mappingName.c_str());
+        if (!ringMapping) {
+            return false;
+        }
+        const bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+        ring = static_cast<kp_ring_header*>(MapViewOfFile(ringMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        ringEvent = CreateEventA(NULL, FALSE, FALSE, (mappingName + "_event").c_str());
+        if (!ring || !ringEvent) {
+            detachSharedRing();
+            return false;
+        }
+
+        // A mapping that outlived its previous consumer (a producer still
+        // holds it open) keeps its queued commands: drain it, don't format it.
+        // Whoever created it chose its size, so the view must be checked to
+        // cover every slot the header claims.
+        if (existed) {
+            MEMORY_BASIC_INFORMATION view = {};
+            if (!kp_ring_valid(ring) || ring->slot_count != slotCount ||
+                VirtualQuery(ring, &view, sizeof(view)) == 0 || view.RegionSize < KP_RING_BYTES(slotCount)) {
+                KP_TRACE_ERROR("Ring %s already exists with an incompatible header or size", name);
+                detachSharedRing();
+                return false;
             }
-            qInfo() << "=== Upload process finished ===";
+            KP_TRACE_INFO("Attached to existing ring %s", name);
+        } else {
+            kp_ring_init(ring, slotCount);
         }
+        ringSlots = slotCount;
+        ringStop = false;
+        ringThread = std::thread(&ArduinoController::ringLoop, this);
+        return true;
+    }
 
-        return (result == 0);
+    void detachSharedRing() {
+        if (ringThread.joinable()) {
+            ringStop = true;
+            SetEvent(ringEvent);
+            ringThread.join();
+        }
+        if (ring) {
+            UnmapViewOfFile(ring);
+            ring = nullptr;
+        }
+        if (ringEvent) {
+            CloseHandle(ringEvent);
+            ringEvent = NULL;
+        }
+        if (ringMapping) {
+            CloseHandle(ringMapping);
+            ringMapping = NULL;
+        }
     }
 };
 
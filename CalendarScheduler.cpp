@@ -0,0 +1,314 @@
+﻿#include "CalendarScheduler.h"
+#include <QCoreApplication>
+#include <algorithm>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+const int kHorizonDays = 8;                    // 每次展开未来8天的区间
+const int kMaxWaitMs = 15 * 60 * 1000;         // 最长等待15分钟，兜底检测系统休眠等情况
+const qint64 kClockJumpMs = 2000;              // 墙上时间与单调时间相差超过2秒视为系统时间被修改
+
+QTime parseClock(const QString &text)
+{
+    QTime time = QTime::fromString(text, "HH:mm");
+    if (!time.isValid()) time = QTime::fromString(text, "HH:mm:ss");
+    return time;
+}
+
+// 解析cron字段：*、a、a-b、a,b、*/n、a-b/n。与Vixie cron相同，以*开头（含*/n）的字段算作通配，
+// 决定日和周两个字段按“且”还是按“或”组合
+bool parseCronField(const QString &field, int low, int high, quint64 &mask, bool &wildcard)
+{
+    mask = 0;
+    wildcard = field.startsWith('*');
+    for (const QString &part : field.split(',')) {
+        QString range = part;
+        int step = 1;
+        int slash = part.indexOf('/');
+        if (slash >= 0) {
+            bool ok = false;
+            step = part.mid(slash + 1).toInt(&ok);
+            if (!ok || step <= 0) return false;
+            range = part.left(slash);
+        }
+
+        int first = low;
+        int last = high;
+        if (range != "*") {
+            int dash = range.indexOf('-');
+            bool ok1 = false, ok2 = true;
+            first = range.left(dash < 0 ? range.size() : dash).toInt(&ok1);
+            last = dash < 0 ? first : range.mid(dash + 1).toInt(&ok2);
+            if (!ok1 || !ok2) return false;
+        }
+        if (first < low || last > high || first > last) return false;
+
+        for (int value = first; value <= last; value += step) {
+            mask |= (quint64(1) << value);
+        }
+    }
+    return mask != 0;
+}
+
+} // namespace
+
+TimeWindow TimeWindow::once(const QDateTime &start, const QDateTime &end)
+{
+    TimeWindow window;
+    window.kind = Once;
+    window.onceStart = start;
+    window.onceEnd = end;
+    return window;
+}
+
+bool TimeWindow::parse(const QString &spec, TimeWindow &out)
+{
+    QStringList parts = spec.simplified().split(' ');
+    if (parts.isEmpty()) return false;
+
+    TimeWindow window;
+    const QString kind = parts.takeFirst().toLower();
+
+    if (kind == "once" && parts.size() == 2) {
+        window.kind = Once;
+        window.onceStart = QDateTime::fromString(parts[0], Qt::ISODate);
+        window.onceEnd = QDateTime::fromString(parts[1], Qt::ISODate);
+        if (!window.onceStart.isValid() || !window.onceEnd.isValid() || window.onceEnd <= window.onceStart) return false;
+    } else if ((kind == "daily" && parts.size() == 2) || (kind == "weekly" && parts.size() == 3)) {
+        window.kind = kind == "daily" ? Daily : Weekly;
+        if (window.kind == Weekly) {
+            quint64 days = 0;
+            bool wildcard = false;
+            if (!parseCronField(parts.takeFirst(), 1, 7, days, wildcard)) return false;
+            window.weekDays = static_cast<quint8>(days);
+        }
+        window.startTime = parseClock(parts[0]);
+        QTime endTime = parseClock(parts[1]);
+        if (!window.startTime.isValid() || !endTime.isValid()) return false;
+        window.durationSecs = window.startTime.secsTo(endTime);
+        if (window.durationSecs <= 0) window.durationSecs += 24 * 3600;
+    } else if (kind == "cron" && parts.size() == 6) {
+        window.kind = Cron;
+        quint64 minutes, hours, monthDays, months, weekDays;
+        bool minuteAll, hourAll, monthAll;
+        if (!parseCronField(parts[0], 0, 59, minutes, minuteAll)
+            || !parseCronField(parts[1], 0, 23, hours, hourAll)
+            || !parseCronField(parts[2], 1, 31, monthDays, window.monthDayWildcard)
+            || !parseCronField(parts[3], 1, 12, months, monthAll)
+            || !parseCronField(parts[4], 0, 7, weekDays, window.weekDayWildcard)) {
+            return false;
+        }
+        // cron中0和7都表示周日
+        if (weekDays & 1) weekDays = (weekDays & ~quint64(1)) | (quint64(1) << 7);
+        bool ok = false;
+        window.durationSecs = parts[5].toLongLong(&ok) * 60;
+        if (!ok || window.durationSecs <= 0) return false;
+        window.minutes = minutes;
+        window.hours = static_cast<quint32>(hours);
+        window.monthDays = static_cast<quint32>(monthDays);
+        window.months = static_cast<quint16>(months);
+        window.weekDays = static_cast<quint8>(weekDays);
+    } else {
+        return false;
+    }
+
+    out = window;
+    return true;
+}
+
+QVector<TimeWindow> TimeWindow::parseList(const QString &text, QStringList *invalid)
+{
+    QVector<TimeWindow> windows;
+    for (const QString &line : text.split('\n')) {
+        if (line.trimmed().isEmpty()) continue;
+        TimeWindow window;
+        if (parse(line, window)) {
+            windows.append(window);
+        } else if (invalid) {
+            invalid->append(line.trimmed());
+        }
+    }
+    return windows;
+}
+
+void TimeWindow::occurrences(const QDateTime &from, const QDateTime &to, QVector<QPair<QDateTime, QDateTime>> &out) const
+{
+    auto emitOccurrence = [&](const QDateTime &start, const QDateTime &end) {
+        if (start < to && end > from) out.append(qMakePair(start, end));
+    };
+
+    if (kind == Once) {
+        emitOccurrence(onceStart, onceEnd);
+        return;
+    }
+
+    // 向前多看几天，以包含开始于from之前但仍在持续的区间
+    const qint64 lookbackDays = durationSecs / (24 * 3600) + 1;
+    for (QDate day = from.date().addDays(-lookbackDays); day <= to.date(); day = day.addDays(1)) {
+        const quint8 dayBit = static_cast<quint8>(1u << day.dayOfWeek());
+        if (kind == Daily || (kind == Weekly && (weekDays & dayBit))) {
+            QDateTime start(day, startTime);
+            emitOccurrence(start, start.addSecs(durationSecs));
+            continue;
+        }
+        if (kind != Cron || !(months & (1u << day.month()))) continue;
+
+        bool monthDayMatch = monthDays & (1u << day.day());
+        bool weekDayMatch = weekDays & dayBit;
+        // 与标准cron一致：日和周都有限定时满足其一即可
+        bool dayMatch = (!monthDayWildcard && !weekDayWildcard) ? (monthDayMatch || weekDayMatch)
+                                                                : (monthDayMatch && weekDayMatch);
+        if (!dayMatch) continue;
+
+        for (int hour = 0; hour < 24; ++hour) {
+            if (!(hours & (1u << hour))) continue;
+            for (int minute = 0; minute < 60; ++minute) {
+                if (!(minutes & (quint64(1) << minute))) continue;
+                QDateTime start(day, QTime(hour, minute));
+                emitOccurrence(start, start.addSecs(durationSecs));
+            }
+        }
+    }
+}
+
+CalendarScheduler::CalendarScheduler(QObject *parent) : QObject(parent)
+{
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, &CalendarScheduler::onTimeout);
+    monotonic.start();
+
+    // 系统时间被修改时Windows会广播WM_TIMECHANGE，借此立即重新排期
+    if (QCoreApplication::instance()) {
+        QCoreApplication::instance()->installNativeEventFilter(this);
+    }
+}
+
+CalendarScheduler::~CalendarScheduler()
+{
+    if (QCoreApplication::instance()) {
+        QCoreApplication::instance()->removeNativeEventFilter(this);
+    }
+}
+
+void CalendarScheduler::setWindows(const QVector<TimeWindow> &windows)
+{
+    timeWindows = windows;
+    if (enabled) replan();
+}
+
+void CalendarScheduler::setEnabled(bool enable)
+{
+    enabled = enable;
+    if (!enabled) {
+        // 关闭定时任务只是不再自动开始/停止，不影响当前的运行状态
+        timer->stop();
+        plan.clear();
+        active = false;
+        return;
+    }
+    replan();
+}
+
+void CalendarScheduler::replan()
+{
+    if (!enabled) return;
+
+    QDateTime now = QDateTime::currentDateTime();
+    horizonEnd = now.addDays(kHorizonDays);
+
+    QVector<QPair<QDateTime, QDateTime>> occurrences;
+    for (const TimeWindow &window : timeWindows) {
+        window.occurrences(now, horizonEnd, occurrences);
+    }
+    std::sort(occurrences.begin(), occurrences.end());
+
+    // 合并重叠或相接的区间，得到互不重叠的开始/结束时刻序列
+    plan.clear();
+    for (const auto &occurrence : occurrences) {
+        if (!plan.isEmpty() && occurrence.first <= plan.last().second) {
+            plan.last().second = qMax(plan.last().second, occurrence.second);
+        } else {
+            plan.append(occurrence);
+        }
+    }
+
+    bool nowActive = activeAt(now);
+    if (nowActive != active) {
+        active = nowActive;
+        Q_EMIT activeChanged(active);
+    }
+    arm();
+}
+
+bool CalendarScheduler::activeAt(const QDateTime &time) const
+{
+    for (const auto &interval : plan) {
+        if (interval.first > time) break;
+        if (time < interval.second) return true;
+    }
+    return false;
+}
+
+QDateTime CalendarScheduler::nextTransition() const
+{
+    if (!enabled) return QDateTime();
+
+    QDateTime now = QDateTime::currentDateTime();
+    for (const auto &interval : plan) {
+        if (interval.first > now) return interval.first;
+        if (interval.second > now) return interval.second;
+    }
+    return horizonEnd;
+}
+
+void CalendarScheduler::arm()
+{
+    if (!enabled || timeWindows.isEmpty()) {
+        timer->stop();
+        return;
+    }
+
+    qint64 waitMs = QDateTime::currentDateTime().msecsTo(nextTransition());
+    armedWallMs = QDateTime::currentMSecsSinceEpoch();
+    armedMonoMs = monotonic.elapsed();
+    timer->start(static_cast<int>(qBound<qint64>(0, waitMs, kMaxWaitMs)));
+}
+
+void CalendarScheduler::onTimeout()
+{
+    // 定时器基于单调时钟；两者走过的时间不一致说明系统时间被修改或刚从休眠恢复
+    qint64 wallElapsed = QDateTime::currentMSecsSinceEpoch() - armedWallMs;
+    qint64 monoElapsed = monotonic.elapsed() - armedMonoMs;
+    QDateTime now = QDateTime::currentDateTime();
+
+    if (qAbs(wallElapsed - monoElapsed) > kClockJumpMs || now >= horizonEnd) {
+        replan();
+        return;
+    }
+
+    bool nowActive = activeAt(now);
+    if (nowActive != active) {
+        active = nowActive;
+        Q_EMIT activeChanged(active);
+    }
+    arm();
+}
+
+bool CalendarScheduler::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
+{
+    Q_UNUSED(result);
+#ifdef Q_OS_WIN
+    if (enabled && eventType == "windows_generic_MSG" && static_cast<MSG *>(message)->message == WM_TIMECHANGE) {
+        replan();
+    }
+#else
+    Q_UNUSED(eventType);
+    Q_UNUSED(message);
+#endif
+    return false;
+}
@@ -0,0 +1,84 @@
+﻿#ifndef CALENDARSCHEDULER_H
+#define CALENDARSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QVector>
+#include <QPair>
+#include <QStringList>
+#include <QAbstractNativeEventFilter>
+
+// 定时任务的一条时间规则，文本格式（每行一条）:
+//   once   2026-10-19T09:00:00 2026-10-19T18:00:00   单次
+//   daily  09:00 18:00                               每天（结束早于开始表示跨零点）
+//   weekly 1,2,3,4,5 09:00 18:00                     每周，1=周一 ... 7=周日
+//   cron   0 9-17 * * 1-5 30                         分 时 日 月 周 + 持续分钟数
+struct TimeWindow {
+    enum Kind { Once, Daily, Weekly, Cron };
+
+    Kind kind = Once;
+    QDateTime onceStart;
+    QDateTime onceEnd;
+    QTime startTime;
+    qint64 durationSecs = 0;
+    quint64 minutes = 0;   // cron 字段位图
+    quint32 hours = 0;
+    quint32 monthDays = 0; // bit1..bit31
+    quint16 months = 0;    // bit1..bit12
+    quint8 weekDays = 0;   // bit1..bit7，周一为1（weekly与cron共用）
+    bool monthDayWildcard = true;
+    bool weekDayWildcard = true;
+
+    static TimeWindow once(const QDateTime &start, const QDateTime &end);
+    static bool parse(const QString &spec, TimeWindow &out);
+    // 逐行解析规则文本，空行忽略，无法解析的行放入invalid
+    static QVector<TimeWindow> parseList(const QString &text, QStringList *invalid = nullptr);
+
+    // 追加与 [from, to) 相交的所有发生区间
+    void occurrences(const QDateTime &from, const QDateTime &to, QVector<QPair<QDateTime, QDateTime>> &out) const;
+};
+
+// 日历调度器：把所有规则展开成一段时间内排好序、合并后的区间，
+// 只为下一个开始/结束时刻设置一个精确定时器，不再每秒轮询。
+class CalendarScheduler : public QObject, public QAbstractNativeEventFilter {
+    Q_OBJECT
+
+public:
+    explicit CalendarScheduler(QObject *parent = nullptr);
+    ~CalendarScheduler();
+
+    void setWindows(const QVector<TimeWindow> &windows);
+    const QVector<TimeWindow> &windows() const { return timeWindows; }
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled; }
+    bool isActive() const { return active; }
+    QDateTime nextTransition() const;
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+public slots:
+    void replan();
+
+Q_SIGNALS:
+    void activeChanged(bool active);
+
+private:
+    void onTimeout();
+    void arm();
+    bool activeAt(const QDateTime &time) const;
+
+    QVector<TimeWindow> timeWindows;
+    QVector<QPair<QDateTime, QDateTime>> plan;  // 已排序且互不重叠
+    QDateTime horizonEnd;
+    QTimer *timer;
+    QElapsedTimer monotonic;
+    qint64 armedWallMs = 0;
+    qint64 armedMonoMs = 0;
+    bool enabled = false;
+    bool active = false;
+};
+
+#endif // CALENDARSCHEDULER_H
@@ -0,0 +1,153 @@
+#ifndef DEVICECLOCK_HPP
+#define DEVICECLOCK_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <windows.h>
+
+// Host/device clock estimate from NTP-style round trips.
+// A probe records the host time it was sent (t0) and its reply received
+// (t3), and the device's micros() when the probe was read (t1) and the
+// reply written (t2). With a symmetric link the device clock at host time
+// (t0 + t3) / 2 is (t1 + t2) / 2, uncertain by half the round trip
+// (t3 - t0) - (t2 - t1). The device clock is modelled as
+// host + offset + drift * (host - origin), fitted by least squares over the
+// quicker half of the recent probes; slow round trips (USB scheduling,
+// a busy loop()) mostly add one-sided delay and would bias the fit.
+// The device counter is 32 bits and wraps every ~71.6 minutes; samples are
+// unwrapped against the previous one, so probes must come more often.
+
+class DeviceClock {
+public:
+    static constexpr size_t kWindow = 32;             // probes kept for the fit
+    static constexpr int64_t kMinDriftSpanUs = 2000000;  // host time the fit needs to estimate drift
+
+    struct Estimate {
+        bool synced = false;
+        int64_t offsetUs = 0;      // device - host at the newest probe
+        double driftPpm = 0.0;     // device clock rate relative to the host, minus one
+        int64_t roundTripUs = 0;   // quickest round trip in the window
+        int probes = 0;
+    };
+
+    // Monotonic host time in microseconds (QueryPerformanceCounter)
+    static int64_t hostMicros() {
+        static const int64_t frequency = [] {
+            LARGE_INTEGER value;
+            QueryPerformanceFrequency(&value);
+            return value.QuadPart;
+        }();
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return now.QuadPart / frequency * 1000000 + now.QuadPart % frequency * 1000000 / frequency;
+    }
+
+    // Forget all probes, e.g. after the board reset and micros() restarted
+    void reset() {
+        samples.clear();
+        haveDevice = false;
+        intercept = 0;
+        slope = 0.0;
+        estimate = Estimate();
+    }
+
+    void addProbe(int64_t hostSend, uint32_t deviceReceive, uint32_t deviceSend, int64_t hostReceive) {
+        Sample sample;
+        int64_t received = unwrap(deviceReceive);
+        int64_t sent = unwrap(deviceSend);
+        sample.host = (hostSend + hostReceive) / 2;
+        sample.offset = (received + sent) / 2 - sample.host;
+        sample.roundTrip = (hostReceive - hostSend) - (sent - received);
+        if (sample.roundTrip < 0) {
+            sample.roundTrip = 0;
+        }
+        samples.push_back(sample);
+        if (samples.size() > kWindow) {
+            samples.pop_front();
+        }
+        fit();
+    }
+
+    bool isSynced() const {
+        return estimate.synced;
+    }
+
+    const Estimate& current() const {
+        return estimate;
+    }
+
+    // Unwrapped device time at the given host time; only meaningful once synced
+    int64_t toDevice(int64_t hostUs) const {
+        return hostUs + intercept + static_cast<int64_t>(slope * static_cast<double>(hostUs - origin));
+    }
+
+private:
+    struct Sample {
+        int64_t host;       // midpoint of the round trip
+        int64_t offset;     // device - host at that point
+        int64_t roundTrip;
+    };
+
+    int64_t unwrap(uint32_t device) {
+        if (!haveDevice) {
+            lastDevice = device;
+            haveDevice = true;
+        } else {
+            lastDevice += static_cast<int32_t>(device - static_cast<uint32_t>(lastDevice));
+        }
+        return lastDevice;
+    }
+
+    void fit() {
+        std::vector<Sample> best(samples.begin(), samples.end());
+        std::sort(best.begin(), best.end(), [](const Sample& a, const Sample& b) { return a.roundTrip < b.roundTrip; });
+        best.resize((best.size() + 1) / 2);
+
+        const Sample& newest = samples.back();
+        int64_t first = best.front().host, last = best.front().host;
+        for (const Sample& sample : best) {
+            first = std::min(first, sample.host);
+            last = std::max(last, sample.host);
+        }
+
+        origin = newest.host;
+        if (best.size() >= 3 && last - first >= kMinDriftSpanUs) {
+            double meanHost = 0.0, meanOffset = 0.0;
+            for (const Sample& sample : best) {
+                meanHost += static_cast<double>(sample.host - origin);
+                meanOffset += static_cast<double>(sample.offset);
+            }
+            meanHost /= best.size();
+            meanOffset /= best.size();
+            double covariance = 0.0, variance = 0.0;
+            for (const Sample& sample : best) {
+                double dx = static_cast<double>(sample.host - origin) - meanHost;
+                covariance += dx * (static_cast<double>(sample.offset) - meanOffset);
+                variance += dx * dx;
+            }
+            slope = covariance / variance;
+            intercept = static_cast<int64_t>(meanOffset - slope * meanHost);
+        } else {
+            // Too short to see drift: keep the previous rate, anchor on the quickest probe
+            intercept = best.front().offset - static_cast<int64_t>(slope * static_cast<double>(best.front().host - origin));
+        }
+
+        estimate.synced = true;
+        estimate.offsetUs = intercept;
+        estimate.driftPpm = slope * 1e6;
+        estimate.roundTripUs = best.front().roundTrip;
+        estimate.probes = static_cast<int>(samples.size());
+    }
+
+    std::deque<Sample> samples;
+    bool haveDevice = false;
+    int64_t lastDevice = 0;
+    int64_t origin = 0;
+    int64_t intercept = 0;
+    double slope = 0.0;
+    Estimate estimate;
+};
+
+#endif // DEVICECLOCK_HPP
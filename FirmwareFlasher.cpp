@@ -0,0 +1,220 @@
+﻿#include "FirmwareFlasher.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+FirmwareFlasher::FirmwareFlasher(ArduinoController *controller, QObject *parent)
+    : QObject(parent), controller(controller)
+{
+    process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::MergedChannels);
+    connect(process, &QProcess::readyRead, this, &FirmwareFlasher::onOutput);
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &FirmwareFlasher::onProcessFinished);
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            pendingResult = Failed;
+            pendingMessage = QStringLiteral("无法启动arduino-cli：") + process->errorString();
+            stage = Reconnecting;
+            reconnectAttempts = 0;
+            tryReconnect();
+        }
+    });
+
+    reconnectTimer = new QTimer(this);
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &FirmwareFlasher::tryReconnect);
+
+    checkPool.setMaxThreadCount(1);
+}
+
+FirmwareFlasher::~FirmwareFlasher()
+{
+    cancelRequested = true;
+    if (process->state() != QProcess::NotRunning) {
+        process->kill();
+        process->waitForFinished(1000);
+    }
+    checkPool.waitForDone();
+}
+
+QString FirmwareFlasher::buildIdFromHex(const QString &hexPath)
+{
+    QFile file(hexPath);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) return QString();
+
+    // 按地址展开数据记录（Leonardo最多32KB，直接平铺）
+    QByteArray image;
+    quint32 base = 0;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.size() < 11 || line[0] != ':') continue;
+        QByteArray record = QByteArray::fromHex(line.mid(1));
+        if (record.size() < 5) continue;
+
+        int count = static_cast<quint8>(record[0]);
+        quint32 address = (static_cast<quint8>(record[1]) << 8) | static_cast<quint8>(record[2]);
+        int type = static_cast<quint8>(record[3]);
+        if (record.size() < 5 + count) continue;
+
+        if (type == 0x00) {
+            quint32 offset = base + address;
+            if (offset + count > 1024u * 1024u) continue;
+            if (image.size() < static_cast<int>(offset + count)) image.resize(offset + count);
+            for (int i = 0; i < count; ++i) image[offset + i] = record[4 + i];
+        } else if (type == 0x02 && count == 2) {
+            base = ((static_cast<quint8>(record[4]) << 8) | static_cast<quint8>(record[5])) << 4;
+        } else if (type == 0x04 && count == 2) {
+            base = ((static_cast<quint8>(record[4]) << 8) | static_cast<quint8>(record[5])) << 16;
+        } else if (type == 0x01) {
+            break;
+        }
+    }
+
+    int begin = image.indexOf("KPFW:");
+    if (begin < 0) return QString();
+    int end = image.indexOf('\0', begin);
+    if (end < 0) end = image.size();
+    return QString::fromLatin1(image.mid(begin, end - begin));
+}
+
+bool FirmwareFlasher::start(const QString &path, bool force)
+{
+    if (isBusy()) return false;
+    if (!QFileInfo::exists(path)) {
+        Q_EMIT finished(Failed, QStringLiteral("固件文件不存在：") + path);
+        return false;
+    }
+
+    hexPath = path;
+    hexBuild = buildIdFromHex(path);
+    portName = QString::fromStdString(controller->getPortName());
+    cancelRequested = false;
+    pendingResult = Uploaded;
+    pendingMessage.clear();
+
+    if (force || hexBuild.isEmpty() || !controller->isConnected()) {
+        upload();
+        return true;
+    }
+
+    stage = Checking;
+    Q_EMIT progress(0, QStringLiteral("正在检查设备固件版本..."));
+    checkPool.start([this]() {
+        QString deviceBuild = QString::fromStdString(controller->queryFirmwareBuild());
+        QMetaObject::invokeMethod(this, [this, deviceBuild]() { onChecked(deviceBuild); }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+void FirmwareFlasher::onChecked(const QString &deviceBuild)
+{
+    if (cancelRequested) {
+        finish(Cancelled, QStringLiteral("已取消"));
+        return;
+    }
+    if (deviceBuild == hexBuild) {
+        finish(UpToDate, QStringLiteral("设备固件已是最新（%1），无需烧录").arg(hexBuild));
+        return;
+    }
+    qInfo() << "Firmware on device:" << (deviceBuild.isEmpty() ? QStringLiteral("unknown") : deviceBuild)
+            << "bundled:" << hexBuild;
+    upload();
+}
+
+void FirmwareFlasher::upload()
+{
+    stage = Uploading;
+    progressPhase.clear();
+    progressHashes = 0;
+    written = false;
+
+    // arduino-cli需要独占串口来触发复位进入bootloader
+    controller->disconnect();
+
+    QString cli = QCoreApplication::applicationDirPath() + "/arduino-cli.exe";
+    QStringList args{ "upload", "--fqbn", "arduino:avr:leonardo", "--port", portName,
+                      "--input-file", QDir::toNativeSeparators(hexPath), "--verbose" };
+    qInfo() << "Uploading firmware:" << cli << args;
+    Q_EMIT progress(5, QStringLiteral("正在复位设备..."));
+    process->start(cli, args);
+}
+
+void FirmwareFlasher::onOutput()
+{
+    QByteArray output = process->readAll();
+    // avrdude逐个输出'#'来绘制进度条："Writing | #### ... | 100%"，每个阶段共50个
+    for (int i = 0; i < output.size(); ++i) {
+        char c = output[i];
+        if (c == '#') {
+            ++progressHashes;
+        } else if (c == '|' && i >= 8) {
+            QByteArray before = output.mid(i - 8, 8);
+            if (before.contains("Writing") || before.contains("Reading")) {
+                if (progressPhase == "Writing" && before.contains("Reading")) written = true;
+                progressPhase = before.contains("Writing") ? "Writing" : "Reading";
+                progressHashes = 0;
+            }
+        }
+    }
+
+    int hashes = qMin(progressHashes, 50);
+    if (progressPhase == "Writing") {
+        Q_EMIT progress(10 + hashes * 70 / 50, QStringLiteral("正在写入固件..."));
+    } else if (progressPhase == "Reading") {
+        Q_EMIT progress(written ? 80 + hashes * 20 / 50 : 10, written ? QStringLiteral("正在校验...") : QStringLiteral("正在读取设备信息..."));
+    }
+}
+
+void FirmwareFlasher::onProcessFinished(int exitCode, QProcess::ExitStatus status)
+{
+    if (stage != Uploading) return;
+
+    if (cancelRequested) {
+        pendingResult = Cancelled;
+        pendingMessage = QStringLiteral("已取消");
+    } else if (status != QProcess::NormalExit || exitCode != 0) {
+        pendingResult = Failed;
+        pendingMessage = QStringLiteral("烧录失败，arduino-cli返回 %1").arg(exitCode);
+    } else {
+        pendingResult = Uploaded;
+        pendingMessage = QStringLiteral("烧录完成");
+    }
+
+    // 上传后板子会重新枚举，稍后再连接
+    stage = Reconnecting;
+    reconnectAttempts = 0;
+    Q_EMIT progress(100, QStringLiteral("正在重新连接设备..."));
+    reconnectTimer->start(1000);
+}
+
+void FirmwareFlasher::tryReconnect()
+{
+    if (controller->connect(portName.toStdString())) {
+        finish(pendingResult, pendingMessage);
+        return;
+    }
+    if (++reconnectAttempts >= 20) {
+        finish(pendingResult == Uploaded ? Failed : pendingResult,
+               pendingMessage + QStringLiteral("，但无法重新连接 %1").arg(portName));
+        return;
+    }
+    reconnectTimer->start(500);
+}
+
+void FirmwareFlasher::cancel()
+{
+    cancelRequested = true;
+    if (stage == Uploading && process->state() != QProcess::NotRunning) {
+        process->kill();
+    }
+}
+
+void FirmwareFlasher::finish(Result result, const QString &message)
+{
+    stage = Idle;
+    qInfo().noquote() << "Firmware flashing:" << message;
+    Q_EMIT finished(result, message);
+}
@@ -0,0 +1,67 @@
+﻿#ifndef FIRMWAREFLASHER_H
+#define FIRMWAREFLASHER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include "ArduinoController.hpp"
+
+// 异步固件烧录：
+//   1. 在线程池中向设备查询固件构建标识（QUERY_VERSION），与hex文件中的 "KPFW:..." 比较，一致则跳过
+//   2. 释放串口，用QProcess调用arduino-cli上传，解析avrdude的进度条输出
+//   3. 上传完成后等待板子重新枚举并重新连接串口
+// 整个过程不阻塞调用线程，可随时cancel()。
+class FirmwareFlasher : public QObject {
+    Q_OBJECT
+
+public:
+    enum Result { Uploaded, UpToDate, Failed, Cancelled };
+
+    explicit FirmwareFlasher(ArduinoController *controller, QObject *parent = nullptr);
+    ~FirmwareFlasher();
+
+    bool isBusy() const { return stage != Idle; }
+    // force为true时不比较构建标识，总是烧录
+    bool start(const QString &hexPath, bool force = false);
+    void cancel();
+
+    // 从Intel HEX文件中提取固件构建标识，找不到时返回空字符串
+    static QString buildIdFromHex(const QString &hexPath);
+
+Q_SIGNALS:
+    void progress(int percent, const QString &message);
+    void finished(FirmwareFlasher::Result result, const QString &message);
+
+private:
+    enum Stage { Idle, Checking, Uploading, Reconnecting };
+
+    void onChecked(const QString &deviceBuild);
+    void upload();
+    void onOutput();
+    void onProcessFinished(int exitCode, QProcess::ExitStatus status);
+    void tryReconnect();
+    void finish(Result result, const QString &message);
+
+    ArduinoController *controller;
+    QProcess *process;
+    QTimer *reconnectTimer;
+    QThreadPool checkPool;  // 查询设备时的串口读写在这里进行，析构时等待其结束
+    Stage stage = Idle;
+    QString hexPath;
+    QString hexBuild;
+    QString portName;
+    std::atomic<bool> cancelRequested{ false };
+    Result pendingResult = Uploaded;
+    QString pendingMessage;
+    int reconnectAttempts = 0;
+
+    // avrdude进度条解析状态
+    QString progressPhase;
+    int progressHashes = 0;
+    bool written = false;
+};
+
+#endif // FIRMWAREFLASHER_H
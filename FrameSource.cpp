@@ -0,0 +1,122 @@
+﻿#include "FrameSource.h"
+#include <QDir>
+#include <QDebug>
+
+GdiFrameSource::~GdiFrameSource()
+{
+    if (memoryDc) {
+        SelectObject(memoryDc, previousBitmap);
+        DeleteDC(memoryDc);
+    }
+    if (bitmap) DeleteObject(bitmap);
+}
+
+bool GdiFrameSource::ensureBitmap(int width, int height)
+{
+    if (bitmap && width <= bitmapWidth && height <= bitmapHeight) return true;
+
+    if (!memoryDc) {
+        memoryDc = CreateCompatibleDC(nullptr);
+        if (!memoryDc) return false;
+    }
+    // 只增不减，区域来回变化时不反复分配
+    width = qMax(width, bitmapWidth);
+    height = qMax(height, bitmapHeight);
+
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = width;
+    info.bmiHeader.biHeight = -height;  // 自上而下
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    void *pixels = nullptr;
+    HBITMAP created = CreateDIBSection(memoryDc, &info, DIB_RGB_COLORS, &pixels, nullptr, 0);
+    if (!created) return false;
+
+    HGDIOBJ old = SelectObject(memoryDc, created);
+    if (bitmap) {
+        DeleteObject(bitmap);
+    } else {
+        previousBitmap = old;
+    }
+    bitmap = created;
+    bits = static_cast<uint32_t *>(pixels);
+    bitmapWidth = width;
+    bitmapHeight = height;
+    return true;
+}
+
+bool GdiFrameSource::grab(const QRect &region, PixelKernels::Frame &frame)
+{
+    if (region.isEmpty() || (window && !IsWindow(window))) return false;
+    if (!ensureBitmap(region.width(), region.height())) return false;
+
+    // 窗口DC的原点即客户区左上角；没有窗口时为整个屏幕
+    HDC source = GetDC(window);
+    if (!source) return false;
+    BOOL ok = BitBlt(memoryDc, 0, 0, region.width(), region.height(), source, region.x(), region.y(), SRCCOPY);
+    ReleaseDC(window, source);
+    GdiFlush();
+    if (!ok) return false;
+
+    frame.pixels = bits;
+    frame.width = region.width();
+    frame.height = region.height();
+    frame.stride = bitmapWidth;
+    return true;
+}
+
+QRect GdiFrameSource::bounds() const
+{
+    if (!window) {
+        return QRect(GetSystemMetrics(SM_XVIRTUALSCREEN), GetSystemMetrics(SM_YVIRTUALSCREEN),
+                     GetSystemMetrics(SM_CXVIRTUALSCREEN), GetSystemMetrics(SM_CYVIRTUALSCREEN));
+    }
+    RECT client;
+    if (!IsWindow(window) || !GetClientRect(window, &client)) return QRect();
+    return QRect(0, 0, client.right, client.bottom);
+}
+
+ImageSequenceSource::ImageSequenceSource(const QStringList &paths)
+{
+    for (const QString &path : paths) {
+        QImage image(path);
+        if (image.isNull()) {
+            qWarning() << "Failed to load frame" << path;
+            continue;
+        }
+        images.append(image.convertToFormat(QImage::Format_RGB32));
+    }
+}
+
+QStringList ImageSequenceSource::imagesInDirectory(const QString &directory)
+{
+    QDir dir(directory);
+    QStringList paths;
+    for (const QString &name : dir.entryList({ "*.png", "*.bmp", "*.jpg" }, QDir::Files, QDir::Name)) {
+        paths.append(dir.filePath(name));
+    }
+    return paths;
+}
+
+QRect ImageSequenceSource::bounds() const
+{
+    return images.isEmpty() ? QRect() : images[next].rect();
+}
+
+bool ImageSequenceSource::grab(const QRect &region, PixelKernels::Frame &frame)
+{
+    if (images.isEmpty()) return false;
+    const QImage &image = images[next];
+    next = (next + 1) % images.size();
+
+    // 直接指向图片内存；区域超出图片右下方的部分裁掉，左上角必须在图片内
+    if (!image.rect().contains(region.topLeft())) return false;
+    QRect clipped = region.intersected(image.rect());
+    frame.pixels = reinterpret_cast<const uint32_t *>(image.constScanLine(clipped.y())) + clipped.x();
+    frame.width = clipped.width();
+    frame.height = clipped.height();
+    frame.stride = image.bytesPerLine() / 4;
+    return true;
+}
@@ -0,0 +1,60 @@
+﻿#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <QImage>
+#include <QRect>
+#include <QStringList>
+#include <QVector>
+#include <windows.h>
+#include "PixelKernels.hpp"
+
+// 截图来源：grab按需要的区域返回一帧BGRA像素，帧左上角对应region左上角，
+// 数据在下一次grab之前有效。像素条件和模板匹配都只依赖这个接口。
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+    // region为窗口客户区坐标（未指定窗口时为屏幕坐标）
+    virtual bool grab(const QRect &region, PixelKernels::Frame &frame) = 0;
+    // 可截取的整个范围（窗口客户区 / 虚拟屏幕 / 下一张图片），不可用时为空
+    virtual QRect bounds() const = 0;
+};
+
+// GDI截图：只BitBlt需要的区域到复用的DIB中。
+// 判断少量像素时比整屏复制（DXGI桌面复制）的开销小得多
+class GdiFrameSource : public FrameSource {
+public:
+    explicit GdiFrameSource(HWND window = nullptr) : window(window) {}
+    ~GdiFrameSource() override;
+    bool grab(const QRect &region, PixelKernels::Frame &frame) override;
+    QRect bounds() const override;
+
+private:
+    bool ensureBitmap(int width, int height);
+
+    HWND window;
+    HDC memoryDc = nullptr;
+    HBITMAP bitmap = nullptr;
+    HGDIOBJ previousBitmap = nullptr;
+    uint32_t *bits = nullptr;
+    int bitmapWidth = 0;
+    int bitmapHeight = 0;
+};
+
+// 图片序列：依次循环返回保存的截图，用于离线调试规则和性能测试
+class ImageSequenceSource : public FrameSource {
+public:
+    explicit ImageSequenceSource(const QStringList &paths);
+    // 目录中的png/bmp/jpg按文件名排序
+    static QStringList imagesInDirectory(const QString &directory);
+
+    bool grab(const QRect &region, PixelKernels::Frame &frame) override;
+    QRect bounds() const override;
+    int frameCount() const { return images.size(); }
+    const QImage &image(int index) const { return images[index]; }
+
+private:
+    QVector<QImage> images;
+    int next = 0;
+};
+
+#endif // FRAMESOURCE_H
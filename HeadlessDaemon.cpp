@@ -0,0 +1,310 @@
+﻿#include "HeadlessDaemon.h"
+#include "SlotProfile.h"
+#include "TraceLog.hpp"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSettings>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QDebug>
+
+HeadlessDaemon::HeadlessDaemon(QObject *parent) : QObject(parent)
+{
+    scheduler = new PressScheduler(&controller, this);
+    scheduler->setSlotCount(SlotProfile::schedulerSlotCount(SlotProfile::kDefaultKeySlotCount));
+
+    pixelTrigger = new PixelTrigger(scheduler, this);
+    pixelTrigger->setSource(std::make_unique<GdiFrameSource>());
+
+    linkKeeper = new LinkKeeper(&controller, this);
+    connect(linkKeeper, &LinkKeeper::linkLost, this, [this]() {
+        qWarning() << "Serial link lost, reconnecting";
+        scheduler->pause();
+    });
+    connect(linkKeeper, &LinkKeeper::linkRestored, this, [this](int downtimeMs) {
+        portName = QString::fromStdString(controller.getPortName());
+        qInfo() << "Serial link restored on" << portName << "after" << downtimeMs << "ms";
+        scheduler->resume();
+    });
+
+    profileSwitcher = new WindowProfileSwitcher(this);
+    connect(profileSwitcher, &WindowProfileSwitcher::matched, this, [this](HWND, const QString &profile) {
+        QString error;
+        if (profile != profilePath && !loadProfile(profile, &error)) qWarning() << error;
+    });
+
+    calendar = new CalendarScheduler(this);
+    connect(calendar, &CalendarScheduler::activeChanged, this, [this](bool active) {
+        active ? start() : stop();
+    });
+
+    server = new QLocalServer(this);
+    connect(server, &QLocalServer::newConnection, this, &HeadlessDaemon::onNewConnection);
+}
+
+bool HeadlessDaemon::connectDevice(const QString &port)
+{
+    std::string name = port.isEmpty() ? SerialPort::findArduinoLeonardoPort() : port.toStdString();
+    if (name.empty() || !controller.connect(name)) {
+        qWarning() << "Failed to connect to Arduino Leonardo" << name.c_str();
+        return false;
+    }
+    portName = QString::fromStdString(name);
+    qInfo() << "Connected to Arduino Leonardo on" << portName;
+    return true;
+}
+
+bool HeadlessDaemon::loadProfile(const QString &path, QString *error)
+{
+    if (!QFileInfo::exists(path)) {
+        if (error) *error = QStringLiteral("profile not found: %1").arg(path);
+        return false;
+    }
+
+    QSettings settings(path, QSettings::IniFormat);
+    SlotProfile profile = SlotProfile::fromSettings(settings);
+    if (!profile.error.isEmpty()) {
+        if (error) *error = profile.error;
+        return false;
+    }
+
+    // 运行中加载新配置同样按槽位增量生效
+    scheduler->setMode(profile.mode);
+    scheduler->setSeed(profile.seed);
+    scheduler->setHoldTime(profile.holdTime);
+    scheduler->setLeadTime(profile.leadTime);
+    scheduler->setSlotCount(static_cast<int>(profile.slotConfigs.size()));
+    for (int i = 0; i < static_cast<int>(profile.slotConfigs.size()); ++i) {
+        scheduler->setSlot(i, profile.slotConfigs[i]);
+    }
+    // 时间轴整体替换会让轨道从头开始，文本不变时保留进度
+    if (profile.timeline != timelineText) {
+        QStringList invalid;
+        Timeline timeline = Timeline::parse(profile.timeline, &invalid);
+        for (const QString &line : invalid) qWarning() << "Ignored timeline line" << line;
+        scheduler->setTimeline(CompiledTimeline::compile(timeline));
+        timelineText = profile.timeline;
+    }
+
+    QStringList invalidRules;
+    pixelTrigger->setRules(PixelRule::parseList(profile.pixelRules, &invalidRules));
+    for (const QString &line : invalidRules) qWarning() << "Ignored pixel rule" << line;
+    if (scheduler->isRunning()) pixelTrigger->start();
+
+    QVector<TimeWindow> windows = TimeWindow::parseList(profile.timerRules);
+    calendar->setWindows(windows);
+    calendar->setEnabled(!windows.isEmpty());
+
+    profilePath = path;
+    qInfo() << "Loaded profile" << path;
+    return true;
+}
+
+bool HeadlessDaemon::loadWindowProfiles(const QString &path, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if (error) *error = QStringLiteral("cannot read window profile rules: %1").arg(path);
+        return false;
+    }
+    QStringList invalid;
+    QVector<WindowProfileRule> rules = WindowProfileRule::parseList(QString::fromUtf8(file.readAll()), &invalid);
+    profileSwitcher->setRules(rules, &invalid);
+    for (const QString &line : invalid) qWarning() << "Invalid window profile rule:" << line;
+    qInfo() << "Loaded" << rules.size() << "window profile rules from" << path;
+    return true;
+}
+
+bool HeadlessDaemon::listen(const QString &serverName)
+{
+    // 清理上次异常退出残留的套接字文件（Unix）
+    QLocalServer::removeServer(serverName);
+    if (!server->listen(serverName)) {
+        qWarning() << "Failed to listen on" << serverName << server->errorString();
+        return false;
+    }
+    qInfo() << "Control socket listening on" << server->fullServerName();
+    return true;
+}
+
+void HeadlessDaemon::start()
+{
+    if (!scheduler->isRunning()) scheduler->start();
+    pixelTrigger->start();
+}
+
+void HeadlessDaemon::stop()
+{
+    pixelTrigger->stop();
+    scheduler->stop();
+}
+
+bool HeadlessDaemon::usePixelFrames(const QString &directory)
+{
+    auto source = std::make_unique<ImageSequenceSource>(ImageSequenceSource::imagesInDirectory(directory));
+    if (source->frameCount() == 0) return false;
+    pixelTrigger->setSource(std::move(source));
+    return true;
+}
+
+void HeadlessDaemon::onNewConnection()
+{
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            while (socket->canReadLine()) {
+                QByteArray line = socket->readLine().trimmed();
+                if (line.isEmpty()) continue;
+
+                QJsonParseError parseError;
+                QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+                QJsonObject reply;
+                if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+                    reply = QJsonObject{ { "ok", false }, { "error", "invalid json" } };
+                } else {
+                    reply = execute(document.object());
+                }
+                socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+            }
+        });
+    }
+}
+
+QJsonObject HeadlessDaemon::execute(const QJsonObject &request)
+{
+    const QString cmd = request.value("cmd").toString();
+
+    if (cmd == "start") {
+        start();
+    } else if (cmd == "stop") {
+        stop();
+    } else if (cmd == "load") {
+        QString error;
+        if (!loadProfile(request.value("profile").toString(), &error)) {
+            return QJsonObject{ { "ok", false }, { "error", error } };
+        }
+    } else if (cmd == "send") {
+        return sendOneShot(request);
+    } else if (cmd == "trace") {
+        // 导出内存中最近的跟踪记录
+        QString path = request.value("path").toString();
+        if (path.isEmpty() || !TraceLog::dump(path.toLocal8Bit().toStdString())) {
+            return QJsonObject{ { "ok", false }, { "error", QStringLiteral("cannot write trace to %1").arg(path) } };
+        }
+    } else if (cmd != "status") {
+        return QJsonObject{ { "ok", false }, { "error", QStringLiteral("unknown cmd: %1").arg(cmd) } };
+    }
+
+    return QJsonObject{
+        { "ok", true },
+        { "running", scheduler->isRunning() },
+        { "connected", controller.isConnected() && !controller.isLinkLost() },
+        { "reconnecting", linkKeeper->isReconnecting() },
+        { "port", portName },
+        { "profile", profilePath },
+        { "timerTask", calendar->isEnabled() },
+    };
+}
+
+namespace {
+
+// 按键可以是数字（HID用法码），也可以是按键名称或单个字符（按当前键盘布局），见KeyTable::fromText；
+// 无法识别时返回空
+std::string keyParam(const QJsonValue &value)
+{
+    int usage = value.isDouble() ? value.toInt()
+                                 : KeyTable::fromText(value.toString().toStdString(), KeyTable::foregroundLayout());
+    return KeyTable::isValidUsage(usage) ? std::to_string(usage) : std::string();
+}
+
+}
+
+QJsonObject HeadlessDaemon::sendOneShot(const QJsonObject &request)
+{
+    const QString action = request.value("action").toString();
+    const std::string key = keyParam(request.value("key"));
+    const bool needsKey = action == "key" || action == "press" || action == "release";
+    if (needsKey && key.empty()) {
+        return QJsonObject{ { "ok", false }, { "error", QStringLiteral("unknown key: %1").arg(request.value("key").toVariant().toString()) } };
+    }
+    bool ok = false;
+
+    if (action == "key") {
+        ok = controller.sendKey(key, request.value("duration").toInt(100));
+    } else if (action == "press") {
+        ok = controller.pressKey(key);
+    } else if (action == "release") {
+        ok = controller.releaseKey(key);
+    } else if (action == "release_all") {
+        ok = controller.releaseAll();
+    } else if (action == "combo") {
+        std::vector<std::string> keys;
+        for (const QJsonValue &value : request.value("keys").toArray()) {
+            std::string combined = keyParam(value);
+            if (combined.empty()) {
+                return QJsonObject{ { "ok", false }, { "error", QStringLiteral("unknown key: %1").arg(value.toVariant().toString()) } };
+            }
+            keys.push_back(combined);
+        }
+        ok = !keys.empty() && controller.pressKeyCombination(keys);
+    } else if (action == "text") {
+        ok = controller.typeString(request.value("text").toString().toStdString());
+    } else if (action == "mouse_move") {
+        ok = controller.mouseMove(request.value("dx").toInt(), request.value("dy").toInt());
+    } else if (action == "mouse_click") {
+        ok = controller.mouseClick(request.value("button").toInt(MOUSE_LEFT), request.value("count").toInt(1));
+    } else if (action == "mouse_wheel") {
+        ok = controller.mouseWheel(request.value("delta").toInt());
+    } else {
+        return QJsonObject{ { "ok", false }, { "error", QStringLiteral("unknown action: %1").arg(action) } };
+    }
+
+    return ok ? QJsonObject{ { "ok", true } } : QJsonObject{ { "ok", false }, { "error", "write failed" } };
+}
+
+int HeadlessDaemon::runClient(const QString &serverName, const QStringList &args)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    // 简写：start / stop / status / load <file> / trace <file> / key <code> / text <str> / raw <json>
+    QJsonObject request;
+    const QString verb = args.value(0);
+    if (verb == "start" || verb == "stop" || verb == "status") {
+        request = QJsonObject{ { "cmd", verb } };
+    } else if (verb == "load" && args.size() == 2) {
+        request = QJsonObject{ { "cmd", "load" }, { "profile", QFileInfo(args[1]).absoluteFilePath() } };
+    } else if (verb == "trace" && args.size() == 2) {
+        request = QJsonObject{ { "cmd", "trace" }, { "path", QFileInfo(args[1]).absoluteFilePath() } };
+    } else if (verb == "key" && args.size() == 2) {
+        request = QJsonObject{ { "cmd", "send" }, { "action", "key" }, { "key", args[1] } };
+    } else if (verb == "text" && args.size() >= 2) {
+        request = QJsonObject{ { "cmd", "send" }, { "action", "text" }, { "text", args.mid(1).join(' ') } };
+    } else if (verb == "raw" && args.size() == 2) {
+        request = QJsonDocument::fromJson(args[1].toUtf8()).object();
+    } else {
+        err << "usage: --ctl start|stop|status|load <file>|trace <file>|key <code>|text <string>|raw <json>" << Qt::endl;
+        return 2;
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName);
+    if (!socket.waitForConnected(1000)) {
+        err << "cannot connect to " << serverName << ": " << socket.errorString() << Qt::endl;
+        return 1;
+    }
+
+    socket.write(QJsonDocument(request).toJson(QJsonDocument::Compact) + '\n');
+    socket.flush();
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(5000)) {
+            err << "no reply from " << serverName << Qt::endl;
+            return 1;
+        }
+    }
+
+    QByteArray reply = socket.readLine().trimmed();
+    out << reply << Qt::endl;
+    return QJsonDocument::fromJson(reply).object().value("ok").toBool() ? 0 : 1;
+}
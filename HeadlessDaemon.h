@@ -0,0 +1,63 @@
+﻿#ifndef HEADLESSDAEMON_H
+#define HEADLESSDAEMON_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include "ArduinoController.hpp"
+#include "PressScheduler.h"
+#include "CalendarScheduler.h"
+#include "LinkKeeper.h"
+#include "PixelTrigger.h"
+#include "WindowProfileSwitcher.h"
+
+// 无界面模式：只使用QCoreApplication，由配置文件驱动，并通过本地套接字
+// （Windows下为命名管道）接受控制命令。协议为每行一个JSON对象：
+//   {"cmd":"start"} {"cmd":"stop"} {"cmd":"status"}
+//   {"cmd":"load","profile":"D:/a.kphset"}
+//   {"cmd":"trace","path":"D:/trace.log"}
+//   {"cmd":"send","action":"key","key":"65"}   action: key/press/release/release_all/combo/text/mouse_move/mouse_click/mouse_wheel
+// 每个请求回复一行JSON，{"ok":true,...} 或 {"ok":false,"error":"..."}
+class HeadlessDaemon : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr const char *kDefaultServerName = "KeyPresserHardware";
+
+    explicit HeadlessDaemon(QObject *parent = nullptr);
+
+    bool connectDevice(const QString &portName);  // 为空时自动检测
+    bool loadProfile(const QString &path, QString *error = nullptr);
+    bool listen(const QString &serverName);
+    bool attachSharedRing(const QString &name) { return controller.attachSharedRing(name.toStdString()); }
+    void setPeephole(bool enabled) { controller.setPeephole(enabled); }
+    // 像素条件改为读取保存的截图（循环播放），默认截取屏幕，规则中的坐标为屏幕坐标
+    bool usePixelFrames(const QString &directory);
+    // 从文件读取窗口配置规则（格式见WindowProfileSwitcher.h），前台窗口符合规则时加载对应配置
+    bool loadWindowProfiles(const QString &path, QString *error = nullptr);
+
+    void start();
+    void stop();
+
+    // 命令行客户端：把参数转换成一条请求发给正在运行的实例，打印回复
+    static int runClient(const QString &serverName, const QStringList &args);
+
+private:
+    void onNewConnection();
+    QJsonObject execute(const QJsonObject &request);
+    QJsonObject sendOneShot(const QJsonObject &request);
+
+    ArduinoController controller;
+    PressScheduler *scheduler;
+    CalendarScheduler *calendar;
+    LinkKeeper *linkKeeper;
+    PixelTrigger *pixelTrigger;
+    WindowProfileSwitcher *profileSwitcher;
+    QLocalServer *server;
+    QString profilePath;
+    QString timelineText;
+    QString portName;
+};
+
+#endif // HEADLESSDAEMON_H
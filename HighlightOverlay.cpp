@@ -0,0 +1,47 @@
+﻿#include "HighlightOverlay.h"
+#include <QPainter>
+
+HighlightOverlay::HighlightOverlay(QWidget *parent)
+    : QWidget(parent, Qt::Tool | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint
+                          | Qt::WindowTransparentForInput | Qt::WindowDoesNotAcceptFocus)
+{
+    setAttribute(Qt::WA_TranslucentBackground);
+    setAttribute(Qt::WA_ShowWithoutActivating);
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+
+    timer = new QTimer(this);
+    timer->setInterval(kFlashInterval);
+    connect(timer, &QTimer::timeout, this, &HighlightOverlay::onTick);
+}
+
+void HighlightOverlay::flash(const RECT &rect)
+{
+    tick = 0;
+    show();
+    // Qt的几何坐标是逻辑像素，直接用物理像素定位，避免高DPI下偏移
+    SetWindowPos(reinterpret_cast<HWND>(winId()), HWND_TOPMOST,
+                 rect.left - kBorderWidth, rect.top - kBorderWidth,
+                 rect.right - rect.left + 2 * kBorderWidth, rect.bottom - rect.top + 2 * kBorderWidth,
+                 SWP_NOACTIVATE | SWP_SHOWWINDOW);
+    update();
+    timer->start();
+}
+
+void HighlightOverlay::onTick()
+{
+    if (++tick >= kFlashCount) {
+        timer->stop();
+        hide();
+        return;
+    }
+    update();
+}
+
+void HighlightOverlay::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    QPen pen(tick % 2 ? QColor(255, 0, 0) : QColor(255, 255, 255), kBorderWidth);
+    pen.setJoinStyle(Qt::MiterJoin);
+    painter.setPen(pen);
+    painter.drawRect(QRectF(rect()).adjusted(kBorderWidth / 2.0, kBorderWidth / 2.0, -kBorderWidth / 2.0, -kBorderWidth / 2.0));
+}
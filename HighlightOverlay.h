@@ -0,0 +1,33 @@
+﻿#ifndef HIGHLIGHTOVERLAY_H
+#define HIGHLIGHTOVERLAY_H
+
+#include <QWidget>
+#include <QTimer>
+#include <windows.h>
+
+// 目标窗口高亮框：透明、鼠标穿透、不抢焦点的置顶无边框窗口，
+// 由事件循环中的定时器驱动闪烁，不在目标窗口上绘制，也不会让它重绘。
+class HighlightOverlay : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit HighlightOverlay(QWidget *parent = nullptr);
+
+    // rect为屏幕物理像素坐标（GetWindowRect的结果）
+    void flash(const RECT &rect);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    static constexpr int kBorderWidth = 3;
+    static constexpr int kFlashCount = 10;
+    static constexpr int kFlashInterval = 30;
+
+    void onTick();
+
+    QTimer *timer;
+    int tick = 0;
+};
+
+#endif // HIGHLIGHTOVERLAY_H
@@ -0,0 +1,146 @@
+﻿#include "HotkeyService.h"
+#include "TraceLog.hpp"
+#include "Metrics.hpp"
+#include <QDebug>
+#include <chrono>
+
+std::atomic<LowLevelHookBackend *> LowLevelHookBackend::active{ nullptr };
+
+LowLevelHookBackend::~LowLevelHookBackend()
+{
+    stop();
+}
+
+bool LowLevelHookBackend::start(Callback cb)
+{
+    if (worker.joinable()) return true;
+    callback = std::move(cb);
+
+    std::promise<bool> started;
+    std::future<bool> result = started.get_future();
+    worker = std::thread(&LowLevelHookBackend::run, this, &started);
+    if (!result.get()) {
+        worker.join();
+        return false;
+    }
+    return true;
+}
+
+void LowLevelHookBackend::stop()
+{
+    if (!worker.joinable()) return;
+    PostThreadMessage(threadId.load(), WM_QUIT, 0, 0);
+    worker.join();
+    threadId = 0;
+}
+
+void LowLevelHookBackend::run(std::promise<bool> *started)
+{
+    // 低级钩子在安装它的线程的消息循环中回调，这个线程只负责热键
+    MSG msg;
+    PeekMessage(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);  // 确保线程有消息队列
+    threadId = GetCurrentThreadId();
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+    active = this;
+    HHOOK hook = SetWindowsHookEx(WH_KEYBOARD_LL, &LowLevelHookBackend::hookProc, GetModuleHandle(nullptr), 0);
+    started->set_value(hook != nullptr);
+    if (!hook) {
+        qWarning() << "SetWindowsHookEx failed:" << GetLastError();
+        active = nullptr;
+        return;
+    }
+
+    while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    UnhookWindowsHookEx(hook);
+    active = nullptr;
+}
+
+LRESULT CALLBACK LowLevelHookBackend::hookProc(int code, WPARAM wParam, LPARAM lParam)
+{
+    LowLevelHookBackend *self = active.load();
+    if (code == HC_ACTION && self) {
+        // 钩子回调有超时限制，这里只比较按键码，命中后立即回调
+        qint64 pressedAt = HotkeyService::now();
+        const KBDLLHOOKSTRUCT *info = reinterpret_cast<const KBDLLHOOKSTRUCT *>(lParam);
+        if (info->vkCode == self->key.load()) {
+            bool down = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
+            if (self->keyTransition(down)) self->callback(pressedAt);
+        }
+    }
+    return CallNextHookEx(nullptr, code, wParam, lParam);
+}
+
+void FakeHotkeyBackend::input(unsigned int virtualKey, bool down)
+{
+    qint64 pressedAt = HotkeyService::now();
+    if (virtualKey == key.load() && keyTransition(down) && callback) callback(pressedAt);
+}
+
+HotkeyService::HotkeyService(std::unique_ptr<HotkeyBackend> backend, QObject *parent)
+    : QObject(parent), backend(std::move(backend))
+{
+}
+
+HotkeyService::~HotkeyService()
+{
+    stop();
+}
+
+qint64 HotkeyService::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void HotkeyService::setStopHandler(std::function<bool()> running, std::function<void()> stop)
+{
+    isRunning = std::move(running);
+    stopNow = std::move(stop);
+}
+
+bool HotkeyService::start(unsigned int virtualKey)
+{
+    backend->setKey(virtualKey);
+    return backend->start([this](qint64 pressedAt) { onPressed(pressedAt); });
+}
+
+void HotkeyService::stop()
+{
+    backend->stop();
+}
+
+void HotkeyService::onPressed(qint64 pressedAt)
+{
+    // 运行在后端线程：停止必须在这里完成，不能等界面线程空闲
+    bool wasRunning = isRunning && isRunning();
+    if (wasRunning && stopNow) stopNow();
+    QMetaObject::invokeMethod(this, [this, wasRunning, pressedAt]() {
+        Q_EMIT toggled(wasRunning, pressedAt);
+    }, Qt::QueuedConnection);
+}
+
+void HotkeyService::markStopped(qint64 pressedAt)
+{
+    qint64 elapsedUs = (now() - pressedAt) / 1000;
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    stats.count++;
+    stats.lastUs = elapsedUs;
+    stats.maxUs = qMax(stats.maxUs, elapsedUs);
+    stats.totalUs += elapsedUs;
+    KP_TRACE_INFO("Hotkey press-to-stopped latency %1 us, max %2 us", elapsedUs, stats.maxUs);
+    static Metrics::Histogram &histogram = Metrics::Registry::instance().histogram(
+        "kp_hotkey_stop_latency_us", "Time from the stop hotkey to presses being blocked",
+        { 50, 100, 250, 500, 1000, 5000, 20000 });
+    histogram.observe(static_cast<double>(elapsedUs));
+}
+
+HotkeyService::Latency HotkeyService::latency() const
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    return stats;
+}
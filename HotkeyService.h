@@ -0,0 +1,119 @@
+﻿#ifndef HOTKEYSERVICE_H
+#define HOTKEYSERVICE_H
+
+#include <QObject>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <windows.h>
+
+// 全局热键后端：在自己的线程中监听按键，命中时在该线程调用回调。
+// 回调参数为按键事件到达时的单调时间戳（纳秒，HotkeyService::now()）。
+class HotkeyBackend {
+public:
+    using Callback = std::function<void(qint64 pressedAt)>;
+
+    virtual ~HotkeyBackend() = default;
+    virtual bool start(Callback callback) = 0;
+    virtual void stop() = 0;
+    // 可在任意线程调用，下一次按键即生效
+    virtual void setKey(unsigned int virtualKey) = 0;
+
+protected:
+    // 后端线程收到热键的按下或松开时调用，过滤按住不放时的自动重复：从松开变为按下时返回true
+    bool keyTransition(bool down)
+    {
+        bool pressed = down && !keyDown;
+        keyDown = down;
+        return pressed;
+    }
+
+private:
+    bool keyDown = false;  // 只在后端线程访问
+};
+
+// Windows低级键盘钩子。相比RegisterHotKey可以单独监听Alt等修饰键，
+// 钩子线程只做比较和回调，不经过界面线程的消息循环。
+class LowLevelHookBackend : public HotkeyBackend {
+public:
+    ~LowLevelHookBackend() override;
+    bool start(Callback callback) override;
+    void stop() override;
+    void setKey(unsigned int virtualKey) override { key = virtualKey; }
+
+private:
+    static LRESULT CALLBACK hookProc(int code, WPARAM wParam, LPARAM lParam);
+    void run(std::promise<bool> *started);
+
+    static std::atomic<LowLevelHookBackend *> active;
+    Callback callback;
+    std::thread worker;
+    std::atomic<DWORD> threadId{ 0 };
+    std::atomic<unsigned int> key{ 0 };
+};
+
+// 不依赖系统的后端，由调用方通过keyDown()/keyUp()模拟按键，回调在调用线程执行，用于测试和测量
+class FakeHotkeyBackend : public HotkeyBackend {
+public:
+    bool start(Callback cb) override { callback = std::move(cb); return true; }
+    void stop() override { callback = nullptr; }
+    void setKey(unsigned int virtualKey) override { key = virtualKey; }
+    void keyDown(unsigned int virtualKey) { input(virtualKey, true); }
+    void keyUp(unsigned int virtualKey) { input(virtualKey, false); }
+
+private:
+    void input(unsigned int virtualKey, bool down);
+
+    Callback callback;
+    std::atomic<unsigned int> key{ 0 };
+};
+
+// 全局开始/停止热键服务。
+// 运行中按下热键时，钩子线程直接调用 stopNow 让调度器停止发送按键，
+// 不等待界面线程；界面状态的切换随后以队列方式投递到本对象所在线程。
+class HotkeyService : public QObject {
+    Q_OBJECT
+
+public:
+    struct Latency {
+        qint64 count = 0;
+        qint64 lastUs = 0;   // 最近一次从按下到调度器停止的耗时（微秒）
+        qint64 maxUs = 0;
+        qint64 totalUs = 0;
+    };
+
+    explicit HotkeyService(std::unique_ptr<HotkeyBackend> backend, QObject *parent = nullptr);
+    ~HotkeyService();
+
+    // isRunning/stopNow 在钩子线程中调用，必须线程安全
+    void setStopHandler(std::function<bool()> isRunning, std::function<void()> stopNow);
+
+    bool start(unsigned int virtualKey);
+    void stop();
+    void setKey(unsigned int virtualKey) { backend->setKey(virtualKey); }
+    HotkeyBackend *hotkeyBackend() const { return backend.get(); }
+
+    // 界面线程完成停止后调用，记录从按下热键到停止的延迟
+    void markStopped(qint64 pressedAt);
+    Latency latency() const;
+
+    static qint64 now();
+
+Q_SIGNALS:
+    // wasRunning为true时调度器已经在钩子线程中停止，界面只需同步状态
+    void toggled(bool wasRunning, qint64 pressedAt);
+
+private:
+    void onPressed(qint64 pressedAt);
+
+    std::unique_ptr<HotkeyBackend> backend;
+    std::function<bool()> isRunning;
+    std::function<void()> stopNow;
+    mutable std::mutex latencyMutex;
+    Latency stats;
+};
+
+#endif // HOTKEYSERVICE_H
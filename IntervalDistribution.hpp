@@ -0,0 +1,285 @@
+#ifndef INTERVALDISTRIBUTION_HPP
+#define INTERVALDISTRIBUTION_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Key interval distributions.
+// Every slot owns an IntervalStream with its own xoshiro256++ generator, so
+// drawing an interval never touches a shared, locked generator. Intervals are
+// produced 256 at a time into a flat buffer (uniforms first, then a transform
+// pass over plain arrays); the scheduler's tick path only reads the next value.
+
+namespace IntervalDistribution {
+
+enum Kind {
+    Uniform = 0,    // uniform integer in [min, max]
+    Normal,         // normal centred in the range, truncated to [min, max]
+    LogNormal,      // right-skewed like human reaction times, truncated to [min, max]
+    Empirical       // recorded human intervals, sampled with the alias method
+};
+
+inline const char* name(Kind kind) {
+    switch (kind) {
+    case Normal: return "normal";
+    case LogNormal: return "lognormal";
+    case Empirical: return "empirical";
+    default: return "uniform";
+    }
+}
+
+inline Kind fromName(const std::string& text) {
+    if (text == "normal") return Normal;
+    if (text == "lognormal") return LogNormal;
+    if (text == "empirical") return Empirical;
+    return Uniform;
+}
+
+// xoshiro256++ seeded through splitmix64
+class Xoshiro256 {
+public:
+    explicit Xoshiro256(uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(uint64_t seed) {
+        for (uint64_t& word : s) {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform double in [0, 1) from the top 53 bits
+    double nextDouble() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Per-thread generator for callers without their own stream
+    static Xoshiro256& threadLocal() {
+        thread_local Xoshiro256 generator(std::random_device{}() ^ (uint64_t(std::random_device{}()) << 32));
+        return generator;
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4];
+};
+
+// Recorded intervals (any unit) reduced to a histogram relative to their mean
+// and prepared for O(1) sampling with Vose's alias method. One recording
+// serves every slot: a draw is a multiplier applied to the slot's mid-range.
+class EmpiricalTable {
+public:
+    static std::shared_ptr<const EmpiricalTable> fromSamples(const std::vector<double>& samples, int binCount = 64) {
+        std::vector<double> valid;
+        for (double v : samples) {
+            if (v > 0.0 && std::isfinite(v)) valid.push_back(v);
+        }
+        if (valid.size() < 2 || binCount < 1) {
+            return nullptr;
+        }
+
+        double mean = 0.0;
+        for (double v : valid) mean += v;
+        mean /= valid.size();
+
+        auto table = std::make_shared<EmpiricalTable>();
+        double lo = valid[0], hi = valid[0];
+        for (double v : valid) {
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+        table->low = lo / mean;
+        table->binWidth = (hi - lo) / mean / binCount;
+
+        std::vector<double> weights(binCount, 0.0);
+        for (double v : valid) {
+            int bin = table->binWidth > 0.0 ? int((v / mean - table->low) / table->binWidth) : 0;
+            weights[bin < binCount ? bin : binCount - 1] += 1.0;
+        }
+        table->build(weights);
+        return table;
+    }
+
+    // One interval per line; blank lines and lines starting with '#' are skipped
+    static std::shared_ptr<const EmpiricalTable> fromText(const std::string& text) {
+        std::vector<double> samples;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) end = text.size();
+            std::string line = text.substr(pos, end - pos);
+            pos = end + 1;
+            if (line.empty() || line[0] == '#') continue;
+            samples.push_back(std::atof(line.c_str()));
+        }
+        return fromSamples(samples);
+    }
+
+    // Multiplier relative to the recording's mean; u1, u2 uniform in [0, 1)
+    double sample(double u1, double u2) const {
+        const size_t n = probability.size();
+        size_t bin = size_t(u1 * n);
+        if (bin >= n) bin = n - 1;
+        // Reuse u2 for the position inside the chosen bin, rescaled so it stays uniform
+        double p = probability[bin];
+        double within = u2 < p ? u2 / p : (u2 - p) / (1.0 - p);
+        if (u2 >= p) bin = alias[bin];
+        return low + (bin + within) * binWidth;
+    }
+
+private:
+    void build(const std::vector<double>& weights) {
+        const size_t n = weights.size();
+        double total = 0.0;
+        for (double w : weights) total += w;
+
+        probability.assign(n, 1.0);
+        alias.resize(n);
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            alias[i] = uint32_t(i);
+            scaled[i] = weights[i] * n / total;
+            (scaled[i] < 1.0 ? small : large).push_back(uint32_t(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            probability[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+    }
+
+    double low = 1.0;
+    double binWidth = 0.0;
+    std::vector<double> probability;
+    std::vector<uint32_t> alias;
+};
+
+// Pre-generated intervals for one slot
+class IntervalStream {
+public:
+    static constexpr int kBatch = 256;
+
+    IntervalStream() : generator(Xoshiro256::threadLocal().next()) {}
+
+    // Changing the parameters drops what was pre-generated for the old ones
+    void configure(Kind kind, int minInterval, int maxInterval, std::shared_ptr<const EmpiricalTable> table = nullptr) {
+        if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
+        // Zero or negative intervals would spin the timer; keep at least 1 ms
+        this->minInterval = minInterval < 1 ? 1 : minInterval;
+        this->maxInterval = maxInterval < 1 ? 1 : maxInterval;
+        this->kind = (kind == Empirical && !table) ? Uniform : kind;
+        empirical = std::move(table);
+        cursor = kBatch;
+    }
+
+    void seed(uint64_t value) {
+        generator.reseed(value);
+        cursor = kBatch;
+    }
+
+    int next() {
+        if (cursor >= kBatch) refill();
+        return buffer[cursor++];
+    }
+
+private:
+    void refill() {
+        const double lo = minInterval, hi = maxInterval, span = hi - lo;
+        for (int i = 0; i < kBatch; ++i) u1[i] = generator.nextDouble();
+        for (int i = 0; i < kBatch; ++i) u2[i] = generator.nextDouble();
+
+        switch (kind) {
+        case Uniform:
+            for (int i = 0; i < kBatch; ++i) value[i] = lo + u1[i] * (span + 1.0);
+            break;
+        case Normal: {
+            // Box-Muller, ±3 sigma spans the range
+            const double mean = lo + span / 2.0, sigma = span / 6.0;
+            for (int i = 0; i < kBatch; ++i) {
+                value[i] = mean + sigma * std::sqrt(-2.0 * std::log(1.0 - u1[i])) * std::cos(6.283185307179586 * u2[i]);
+            }
+            break;
+        }
+        case LogNormal: {
+            // min + exp(N(mu, 0.5)) with the median at a quarter of the range
+            const double mu = std::log(span / 4.0 + 1.0), sigma = 0.5;
+            for (int i = 0; i < kBatch; ++i) {
+                value[i] = lo + std::exp(mu + sigma * std::sqrt(-2.0 * std::log(1.0 - u1[i])) * std::cos(6.283185307179586 * u2[i]));
+            }
+            break;
+        }
+        case Empirical: {
+            const double mid = lo + span / 2.0;
+            for (int i = 0; i < kBatch; ++i) value[i] = mid * empirical->sample(u1[i], u2[i]);
+            break;
+        }
+        }
+
+        // Truncate: redraw the (rare) values outside the range, clamp if still outside
+        for (int i = 0; i < kBatch; ++i) {
+            double v = value[i];
+            for (int attempt = 0; (v < lo || v >= hi + 1.0) && attempt < 8; ++attempt) {
+                v = redraw(lo, span);
+            }
+            v = v < lo ? lo : (v >= hi + 1.0 ? hi : v);
+            buffer[i] = int(v);
+        }
+        cursor = 0;
+    }
+
+    double redraw(double lo, double span) {
+        double a = generator.nextDouble(), b = generator.nextDouble();
+        double z = std::sqrt(-2.0 * std::log(1.0 - a)) * std::cos(6.283185307179586 * b);
+        switch (kind) {
+        case Normal: return lo + span / 2.0 + span / 6.0 * z;
+        case LogNormal: return lo + std::exp(std::log(span / 4.0 + 1.0) + 0.5 * z);
+        case Empirical: return (lo + span / 2.0) * empirical->sample(a, b);
+        default: return lo + a * (span + 1.0);
+        }
+    }
+
+    Xoshiro256 generator;
+    Kind kind = Uniform;
+    int minInterval = 1000;
+    int maxInterval = 1000;
+    std::shared_ptr<const EmpiricalTable> empirical;
+    int cursor = kBatch;
+    alignas(32) double u1[kBatch];
+    alignas(32) double u2[kBatch];
+    alignas(32) double value[kBatch];
+    alignas(32) int buffer[kBatch];
+};
+
+} // namespace IntervalDistribution
+
+#endif // INTERVALDISTRIBUTION_HPP
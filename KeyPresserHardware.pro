@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -17,16 +17,67 @@ QMAKE_PROJECT_DEPTH = 0
 win32:LIBS += -lgdi32
 
 SOURCES += \
+    CalendarScheduler.cpp \
+    FirmwareFlasher.cpp \
+    FrameSource.cpp \
+    HeadlessDaemon.cpp \
+    HighlightOverlay.cpp \
+    HotkeyService.cpp \
+    LinkKeeper.cpp \
+    MetricsExporter.cpp \
     aboutmedlg.cpp \
+    PixelTrigger.cpp \
+    PressScheduler.cpp \
+    Simulator.cpp \
+    SlotProfile.cpp \
+    SlotTableModel.cpp \
+    TemplateMatcher.cpp \
+    Timeline.cpp \
+    WindowProfileSwitcher.cpp \
+    WindowStateTracker.cpp \
     keypresserHardware.cpp \
     main.cpp
 
 
 HEADERS += \
     ArduinoController.hpp \
+    CalendarScheduler.h \
+    DeviceClock.hpp \
+    FirmwareFlasher.h \
+    FrameSource.h \
+    HeadlessDaemon.h \
+    HighlightOverlay.h \
+    HotkeyService.h \
+    IntervalDistribution.hpp \
+    KeyPresserRing.h \
+    KeyTable.hpp \
+    LinkKeeper.h \
+    Metrics.hpp \
+    MetricsExporter.h \
+    PixelKernels.hpp \
+    PixelTrigger.h \
+    PressScheduler.h \
+    Simulator.h \
+    SlotProfile.h \
+    SlotTableModel.h \
+    StartupProfile.hpp \
+    TemplateKernels.hpp \
+    TemplateMatcher.h \
+    Timeline.h \
+    TraceLog.hpp \
+    WindowProfileSwitcher.h \
+    WindowStateTracker.h \
     aboutmedlg.h \
     keypresserHardware.h
 
+# 可选：嵌入Python脚本支持，qmake CONFIG+=python PYTHON_HOME=C:/Python311
+python {
+    DEFINES += KP_WITH_PYTHON
+    INCLUDEPATH += $$PYTHON_HOME/include
+    LIBS += -L$$PYTHON_HOME/libs -lpython3
+    SOURCES += PythonScripting.cpp
+    HEADERS += PythonScripting.h
+}
 
 # 添加 User32.lib 库链接
 LIBS += -luser32
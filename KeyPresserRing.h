@@ -0,0 +1,235 @@
+/*
+ * KeyPresserRing.h - shared-memory command ring for external producers
+ *
+ * External processes (bots, test rigs, schedulers) write encoded commands
+ * straight into a shared-memory ring that KeyPresserHardware drains on its
+ * I/O thread and forwards to the Arduino. Plain C, no dependencies beyond the
+ * Win32 API, so it can be dropped into any producer.
+ *
+ * Start the consumer with `KeyPresserHardware --ring <name>`; the mapping is
+ * then "Local\KeyPresserRing_<name>" and the wake event
+ * "Local\KeyPresserRing_<name>_event".
+ *
+ * Layout (all fields little-endian, offsets in bytes):
+ *
+ *   0    kp_ring_header (192 bytes)
+ *          0    uint32 magic        KP_RING_MAGIC
+ *          4    uint32 version      KP_RING_VERSION
+ *          8    uint32 slot_count   power of two
+ *          12   uint32 slot_size    KP_RING_SLOT_SIZE
+ *          64   uint64 head         next position to claim (producers, CAS)
+ *          128  uint64 tail         next position to consume (consumer only)
+ *          136  uint32 consumer_sleeping
+ *   192  kp_ring_slot[slot_count] (64 bytes each)
+ *          0    uint64 sequence     == pos: free for position pos
+ *                                   == pos + 1: filled for position pos
+ *          8    uint16 length       bytes used in data
+ *          16   char   data[48]     one encoded command, e.g. "<0,4>" (press A;
+ *                                   keys are decimal HID usages)
+ *
+ * The ring is a bounded multi-producer / single-consumer queue: producers
+ * claim a position with a CAS on head, fill the slot, then publish it by
+ * storing sequence = pos + 1 with release semantics. The consumer only
+ * sleeps after setting consumer_sleeping and re-checking the ring, so
+ * producers signal the event only on the empty-to-non-empty transition.
+ */
+#ifndef KEYPRESSER_RING_H
+#define KEYPRESSER_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KP_RING_MAGIC 0x4752504Bu /* "KPRG" */
+#define KP_RING_VERSION 1u
+#define KP_RING_SLOT_SIZE 64u
+#define KP_RING_DATA_SIZE 48u
+#define KP_RING_DEFAULT_SLOTS 4096u
+
+typedef struct kp_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint8_t pad0[48];
+    volatile uint64_t head;
+    uint8_t pad1[56];
+    volatile uint64_t tail;
+    volatile uint32_t consumer_sleeping;
+    uint8_t pad2[52];
+} kp_ring_header;
+
+typedef struct kp_ring_slot {
+    volatile uint64_t sequence;
+    uint16_t length;
+    uint8_t pad[6];
+    char data[KP_RING_DATA_SIZE];
+} kp_ring_slot;
+
+#define KP_RING_HEADER_SIZE ((uint32_t)sizeof(kp_ring_header))
+#define KP_RING_BYTES(slots) (KP_RING_HEADER_SIZE + (uint64_t)(slots) * KP_RING_SLOT_SIZE)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define KP_LOAD_ACQUIRE(p) (_ReadWriteBarrier(), *(p))
+#define KP_STORE_RELEASE(p, v) do { _ReadWriteBarrier(); *(p) = (v); } while (0)
+#define KP_CAS64(p, expected, desired) \
+    (_InterlockedCompareExchange64((volatile long long *)(p), (long long)(desired), (long long)(expected)) == (long long)(expected))
+#define KP_FULL_FENCE() _mm_mfence()
+#else
+#define KP_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define KP_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define KP_CAS64(p, expected, desired) kp_cas64((p), (expected), (desired))
+#define KP_FULL_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+static inline int kp_cas64(volatile uint64_t *p, uint64_t expected, uint64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+#endif
+
+static inline kp_ring_slot *kp_ring_slots(kp_ring_header *ring)
+{
+    return (kp_ring_slot *)((char *)ring + KP_RING_HEADER_SIZE);
+}
+
+/* Consumer side: format a freshly created mapping. */
+static inline void kp_ring_init(kp_ring_header *ring, uint32_t slot_count)
+{
+    uint32_t i;
+    kp_ring_slot *slots = kp_ring_slots(ring);
+    memset(ring, 0, KP_RING_HEADER_SIZE);
+    ring->magic = KP_RING_MAGIC;
+    ring->version = KP_RING_VERSION;
+    ring->slot_count = slot_count;
+    ring->slot_size = KP_RING_SLOT_SIZE;
+    for (i = 0; i < slot_count; ++i) {
+        slots[i].sequence = i;
+        slots[i].length = 0;
+    }
+}
+
+static inline int kp_ring_valid(const kp_ring_header *ring)
+{
+    return ring->magic == KP_RING_MAGIC && ring->version == KP_RING_VERSION
+        && ring->slot_size == KP_RING_SLOT_SIZE
+        && ring->slot_count != 0 && (ring->slot_count & (ring->slot_count - 1)) == 0;
+}
+
+/*
+ * Producer side: copy one encoded command into the ring.
+ * Returns 1 if the consumer is asleep and must be woken (call
+ * kp_ring_submit or SetEvent), 0 if queued, -1 if the ring is full,
+ * -2 if the command does not fit in a slot.
+ */
+static inline int kp_ring_push(kp_ring_header *ring, const char *data, uint32_t length)
+{
+    kp_ring_slot *slots = kp_ring_slots(ring);
+    uint64_t mask = ring->slot_count - 1;
+    uint64_t pos;
+    kp_ring_slot *slot;
+
+    if (length > KP_RING_DATA_SIZE) return -2;
+
+    for (;;) {
+        int64_t diff;
+        pos = KP_LOAD_ACQUIRE(&ring->head);
+        slot = &slots[pos & mask];
+        diff = (int64_t)(KP_LOAD_ACQUIRE(&slot->sequence) - pos);
+        if (diff == 0) {
+            if (KP_CAS64(&ring->head, pos, pos + 1)) break;
+        } else if (diff < 0) {
+            return -1;
+        }
+    }
+
+    memcpy(slot->data, data, length);
+    slot->length = (uint16_t)length;
+    KP_STORE_RELEASE(&slot->sequence, pos + 1);
+
+    /* Pairs with the consumer's fence between setting consumer_sleeping
+       and re-checking the ring before it waits. */
+    KP_FULL_FENCE();
+    return ring->consumer_sleeping ? 1 : 0;
+}
+
+/*
+ * Consumer side: pop one command. Returns its length, -1 if empty, or -2
+ * if the slot claimed more than KP_RING_DATA_SIZE bytes; such a slot is
+ * dropped and the ring advances past it. `slot_count` is the value
+ * checked at attach time: the header lives in memory every producer can
+ * write, so it is never re-read here. `out` must hold KP_RING_DATA_SIZE
+ * bytes.
+ */
+static inline int kp_ring_pop(kp_ring_header *ring, uint32_t slot_count, char *out)
+{
+    kp_ring_slot *slots = kp_ring_slots(ring);
+    uint64_t mask = slot_count - 1;
+    uint64_t pos = ring->tail;
+    kp_ring_slot *slot = &slots[pos & mask];
+    int length;
+
+    if (KP_LOAD_ACQUIRE(&slot->sequence) != pos + 1) return -1;
+
+    length = slot->length;
+    if (length > (int)KP_RING_DATA_SIZE) {
+        length = -2;
+    } else {
+        memcpy(out, slot->data, (size_t)length);
+    }
+    KP_STORE_RELEASE(&slot->sequence, pos + mask + 1);
+    ring->tail = pos + 1;
+    return length;
+}
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef struct kp_ring_handle {
+    HANDLE mapping;
+    HANDLE event;
+    kp_ring_header *ring;
+} kp_ring_handle;
+
+/* Producer side: open the ring published by `KeyPresserHardware --ring <name>`. */
+static inline int kp_ring_open(kp_ring_handle *handle, const char *name)
+{
+    char path[256];
+    handle->ring = NULL;
+    handle->event = NULL;
+    _snprintf_s(path, sizeof(path), _TRUNCATE, "Local\\KeyPresserRing_%s", name);
+    handle->mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path);
+    if (!handle->mapping) return -1;
+
+    handle->ring = (kp_ring_header *)MapViewOfFile(handle->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    _snprintf_s(path, sizeof(path), _TRUNCATE, "Local\\KeyPresserRing_%s_event", name);
+    handle->event = OpenEventA(EVENT_MODIFY_STATE, FALSE, path);
+    if (!handle->ring || !handle->event || !kp_ring_valid(handle->ring)) return -1;
+    return 0;
+}
+
+static inline int kp_ring_submit(kp_ring_handle *handle, const char *data, uint32_t length)
+{
+    int result = kp_ring_push(handle->ring, data, length);
+    if (result == 1) {
+        SetEvent(handle->event);
+        result = 0;
+    }
+    return result;
+}
+
+static inline void kp_ring_close(kp_ring_handle *handle)
+{
+    if (handle->ring) UnmapViewOfFile(handle->ring);
+    if (handle->event) CloseHandle(handle->event);
+    if (handle->mapping) CloseHandle(handle->mapping);
+}
+#endif /* _WIN32 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KEYPRESSER_RING_H */
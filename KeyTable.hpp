@@ -0,0 +1,307 @@
+#ifndef KEYTABLE_HPP
+#define KEYTABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <windows.h>
+
+// Key identities.
+// One compile-time table ties together the key names used in profiles and
+// scripts, Windows virtual-key codes, scan codes (set 1, 0xE0xx for extended
+// keys), X11 keysyms and USB HID usages (keyboard page 0x07). The board is
+// only ever sent HID usages and presses them with Keyboard.pressRaw, so what
+// reaches the target is exactly the physical key named here. The reverse
+// indexes are built by constexpr functions: mapping a VK, scan code or keysym
+// is one array read.
+// Text is another matter: which key types a character depends on the
+// keyboard layout of the receiving window, see fromCharacter().
+
+namespace KeyTable {
+
+struct Key {
+    const char* name;
+    uint8_t usage;
+    uint8_t vk;       // 0 when the key shares its VK with another (keypad Enter)
+    uint16_t scan;    // 0 when the key has no single scan code (Pause)
+    uint32_t keysym;  // 0 when X11 has no keysym specific to the key
+};
+
+// Usages 0xE0..0xE7 are the modifiers, bits 0..7 of a report's modifier byte:
+// left Ctrl, Shift, Alt, GUI, then the right side in the same order
+constexpr uint8_t kFirstModifier = 0xE0;
+constexpr uint8_t kLastModifier = 0xE7;
+
+inline constexpr Key kKeys[] = {
+    { "A", 0x04, 'A', 0x1E, 'a' }, { "B", 0x05, 'B', 0x30, 'b' }, { "C", 0x06, 'C', 0x2E, 'c' },
+    { "D", 0x07, 'D', 0x20, 'd' }, { "E", 0x08, 'E', 0x12, 'e' }, { "F", 0x09, 'F', 0x21, 'f' },
+    { "G", 0x0A, 'G', 0x22, 'g' }, { "H", 0x0B, 'H', 0x23, 'h' }, { "I", 0x0C, 'I', 0x17, 'i' },
+    { "J", 0x0D, 'J', 0x24, 'j' }, { "K", 0x0E, 'K', 0x25, 'k' }, { "L", 0x0F, 'L', 0x26, 'l' },
+    { "M", 0x10, 'M', 0x32, 'm' }, { "N", 0x11, 'N', 0x31, 'n' }, { "O", 0x12, 'O', 0x18, 'o' },
+    { "P", 0x13, 'P', 0x19, 'p' }, { "Q", 0x14, 'Q', 0x10, 'q' }, { "R", 0x15, 'R', 0x13, 'r' },
+    { "S", 0x16, 'S', 0x1F, 's' }, { "T", 0x17, 'T', 0x14, 't' }, { "U", 0x18, 'U', 0x16, 'u' },
+    { "V", 0x19, 'V', 0x2F, 'v' }, { "W", 0x1A, 'W', 0x11, 'w' }, { "X", 0x1B, 'X', 0x2D, 'x' },
+    { "Y", 0x1C, 'Y', 0x15, 'y' }, { "Z", 0x1D, 'Z', 0x2C, 'z' },
+    { "1", 0x1E, '1', 0x02, '1' }, { "2", 0x1F, '2', 0x03, '2' }, { "3", 0x20, '3', 0x04, '3' },
+    { "4", 0x21, '4', 0x05, '4' }, { "5", 0x22, '5', 0x06, '5' }, { "6", 0x23, '6', 0x07, '6' },
+    { "7", 0x24, '7', 0x08, '7' }, { "8", 0x25, '8', 0x09, '8' }, { "9", 0x26, '9', 0x0A, '9' },
+    { "0", 0x27, '0', 0x0B, '0' },
+    { "Enter", 0x28, VK_RETURN, 0x1C, 0xFF0D },
+    { "Esc", 0x29, VK_ESCAPE, 0x01, 0xFF1B },
+    { "Backspace", 0x2A, VK_BACK, 0x0E, 0xFF08 },
+    { "Tab", 0x2B, VK_TAB, 0x0F, 0xFF09 },
+    { "Space", 0x2C, VK_SPACE, 0x39, 0x0020 },
+    { "Minus", 0x2D, VK_OEM_MINUS, 0x0C, 0x002D },
+    { "Equal", 0x2E, VK_OEM_PLUS, 0x0D, 0x003D },
+    { "LeftBracket", 0x2F, VK_OEM_4, 0x1A, 0x005B },
+    { "RightBracket", 0x30, VK_OEM_6, 0x1B, 0x005D },
+    { "Backslash", 0x31, VK_OEM_5, 0x2B, 0x005C },
+    { "Semicolon", 0x33, VK_OEM_1, 0x27, 0x003B },
+    { "Quote", 0x34, VK_OEM_7, 0x28, 0x0027 },
+    { "Grave", 0x35, VK_OEM_3, 0x29, 0x0060 },
+    { "Comma", 0x36, VK_OEM_COMMA, 0x33, 0x002C },
+    { "Period", 0x37, VK_OEM_PERIOD, 0x34, 0x002E },
+    { "Slash", 0x38, VK_OEM_2, 0x35, 0x002F },
+    { "CapsLock", 0x39, VK_CAPITAL, 0x3A, 0xFFE5 },
+    { "F1", 0x3A, VK_F1, 0x3B, 0xFFBE }, { "F2", 0x3B, VK_F2, 0x3C, 0xFFBF },
+    { "F3", 0x3C, VK_F3, 0x3D, 0xFFC0 }, { "F4", 0x3D, VK_F4, 0x3E, 0xFFC1 },
+    { "F5", 0x3E, VK_F5, 0x3F, 0xFFC2 }, { "F6", 0x3F, VK_F6, 0x40, 0xFFC3 },
+    { "F7", 0x40, VK_F7, 0x41, 0xFFC4 }, { "F8", 0x41, VK_F8, 0x42, 0xFFC5 },
+    { "F9", 0x42, VK_F9, 0x43, 0xFFC6 }, { "F10", 0x43, VK_F10, 0x44, 0xFFC7 },
+    { "F11", 0x44, VK_F11, 0x57, 0xFFC8 }, { "F12", 0x45, VK_F12, 0x58, 0xFFC9 },
+    { "PrintScreen", 0x46, VK_SNAPSHOT, 0xE037, 0xFF61 },
+    { "ScrollLock", 0x47, VK_SCROLL, 0x46, 0xFF14 },
+    { "Pause", 0x48, VK_PAUSE, 0, 0xFF13 },
+    { "Insert", 0x49, VK_INSERT, 0xE052, 0xFF63 },
+    { "Home", 0x4A, VK_HOME, 0xE047, 0xFF50 },
+    { "PageUp", 0x4B, VK_PRIOR, 0xE049, 0xFF55 },
+    { "Delete", 0x4C, VK_DELETE, 0xE053, 0xFFFF },
+    { "End", 0x4D, VK_END, 0xE04F, 0xFF57 },
+    { "PageDown", 0x4E, VK_NEXT, 0xE051, 0xFF56 },
+    { "Right", 0x4F, VK_RIGHT, 0xE04D, 0xFF53 },
+    { "Left", 0x50, VK_LEFT, 0xE04B, 0xFF51 },
+    { "Down", 0x51, VK_DOWN, 0xE050, 0xFF54 },
+    { "Up", 0x52, VK_UP, 0xE048, 0xFF52 },
+    { "NumLock", 0x53, VK_NUMLOCK, 0x45, 0xFF7F },
+    { "NumDivide", 0x54, VK_DIVIDE, 0xE035, 0xFFAF },
+    { "NumMultiply", 0x55, VK_MULTIPLY, 0x37, 0xFFAA },
+    { "NumSubtract", 0x56, VK_SUBTRACT, 0x4A, 0xFFAD },
+    { "NumAdd", 0x57, VK_ADD, 0x4E, 0xFFAB },
+    { "NumEnter", 0x58, 0, 0xE01C, 0xFF8D },
+    { "Num1", 0x59, VK_NUMPAD1, 0x4F, 0xFFB1 }, { "Num2", 0x5A, VK_NUMPAD2, 0x50, 0xFFB2 },
+    { "Num3", 0x5B, VK_NUMPAD3, 0x51, 0xFFB3 }, { "Num4", 0x5C, VK_NUMPAD4, 0x4B, 0xFFB4 },
+    { "Num5", 0x5D, VK_NUMPAD5, 0x4C, 0xFFB5 }, { "Num6", 0x5E, VK_NUMPAD6, 0x4D, 0xFFB6 },
+    { "Num7", 0x5F, VK_NUMPAD7, 0x47, 0xFFB7 }, { "Num8", 0x60, VK_NUMPAD8, 0x48, 0xFFB8 },
+    { "Num9", 0x61, VK_NUMPAD9, 0x49, 0xFFB9 }, { "Num0", 0x62, VK_NUMPAD0, 0x52, 0xFFB0 },
+    { "NumDecimal", 0x63, VK_DECIMAL, 0x53, 0xFFAE },
+    { "IntlBackslash", 0x64, VK_OEM_102, 0x56, 0 },
+    { "Menu", 0x65, VK_APPS, 0xE05D, 0xFF67 },
+    { "F13", 0x68, VK_F13, 0x64, 0xFFCA }, { "F14", 0x69, VK_F14, 0x65, 0xFFCB },
+    { "F15", 0x6A, VK_F15, 0x66, 0xFFCC }, { "F16", 0x6B, VK_F16, 0x67, 0xFFCD },
+    { "F17", 0x6C, VK_F17, 0x68, 0xFFCE }, { "F18", 0x6D, VK_F18, 0x69, 0xFFCF },
+    { "F19", 0x6E, VK_F19, 0x6A, 0xFFD0 }, { "F20", 0x6F, VK_F20, 0x6B, 0xFFD1 },
+    { "F21", 0x70, VK_F21, 0x6C, 0xFFD2 }, { "F22", 0x71, VK_F22, 0x6D, 0xFFD3 },
+    { "F23", 0x72, VK_F23, 0x6E, 0xFFD4 }, { "F24", 0x73, VK_F24, 0x76, 0xFFD5 },
+    { "LeftCtrl", 0xE0, VK_LCONTROL, 0x1D, 0xFFE3 },
+    { "LeftShift", 0xE1, VK_LSHIFT, 0x2A, 0xFFE1 },
+    { "LeftAlt", 0xE2, VK_LMENU, 0x38, 0xFFE9 },
+    { "LeftWin", 0xE3, VK_LWIN, 0xE05B, 0xFFEB },
+    { "RightCtrl", 0xE4, VK_RCONTROL, 0xE01D, 0xFFE4 },
+    { "RightShift", 0xE5, VK_RSHIFT, 0x36, 0xFFE2 },
+    { "RightAlt", 0xE6, VK_RMENU, 0xE038, 0xFFEA },
+    { "RightWin", 0xE7, VK_RWIN, 0xE05C, 0xFFEC },
+};
+constexpr int kKeyCount = static_cast<int>(sizeof(kKeys) / sizeof(kKeys[0]));
+
+constexpr char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Names compare case-insensitively and ignore spaces ("page up" == "PageUp")
+constexpr bool sameName(const char* a, const char* b) {
+    for (;;) {
+        while (*a == ' ') ++a;
+        while (*b == ' ') ++b;
+        if (lower(*a) != lower(*b)) return false;
+        if (*a == '\0') return true;
+        ++a;
+        ++b;
+    }
+}
+
+// Index into kKeys, -1 when unknown
+constexpr int find(const char* name) {
+    for (int i = 0; i < kKeyCount; ++i) {
+        if (sameName(kKeys[i].name, name)) return i;
+    }
+    return -1;
+}
+
+// Usage of a named key, 0 when unknown. Meant for constant expressions:
+// constexpr uint8_t f1 = KeyTable::usage("F1");
+constexpr uint8_t usage(const char* name) {
+    return find(name) < 0 ? 0 : kKeys[find(name)].usage;
+}
+
+constexpr bool isModifier(int usage) {
+    return usage >= kFirstModifier && usage <= kLastModifier;
+}
+
+// Highest non-modifier usage in the table (F24, 0x73). The firmware's
+// keyboard descriptor stops there too (logical maximum 0x73); a report with
+// a higher usage is dropped by the host.
+constexpr uint8_t lastKey() {
+    uint8_t last = 0;
+    for (const Key& key : kKeys) {
+        if (!isModifier(key.usage) && key.usage > last) last = key.usage;
+    }
+    return last;
+}
+constexpr uint8_t kLastKey = lastKey();
+static_assert(kLastKey == 0x73, "keep in step with the firmware's keyboard report descriptor");
+
+constexpr bool isValidUsage(int usage) {
+    return (usage >= 0x04 && usage <= kLastKey) || isModifier(usage);
+}
+
+// Bit of a modifier usage in the report's modifier byte
+constexpr uint8_t modifierBit(int usage) {
+    return static_cast<uint8_t>(1 << (usage - kFirstModifier));
+}
+
+namespace detail {
+
+// 256-entry reverse index; key(entry) gives the slot, -1 to leave the entry out.
+// Returns index + 1 into kKeys, 0 for slots no key maps to.
+template <typename Slot>
+constexpr std::array<uint8_t, 256> reverseIndex(Slot slot) {
+    std::array<uint8_t, 256> table{};
+    for (int i = 0; i < kKeyCount; ++i) {
+        int s = slot(kKeys[i]);
+        if (s >= 0 && s < 256 && table[s] == 0) table[s] = static_cast<uint8_t>(i + 1);
+    }
+    return table;
+}
+
+inline constexpr auto kByUsage = reverseIndex([](const Key& key) { return int(key.usage); });
+inline constexpr auto kByVk = reverseIndex([](const Key& key) { return key.vk ? int(key.vk) : -1; });
+inline constexpr auto kByScan = reverseIndex([](const Key& key) { return key.scan && key.scan < 0x100 ? int(key.scan) : -1; });
+inline constexpr auto kByExtendedScan = reverseIndex([](const Key& key) {
+    return (key.scan & 0xFF00) == 0xE000 ? int(key.scan & 0xFF) : -1;
+});
+inline constexpr auto kByLatinKeysym = reverseIndex([](const Key& key) {
+    return key.keysym && key.keysym < 0x100 ? int(key.keysym) : -1;
+});
+inline constexpr auto kByFunctionKeysym = reverseIndex([](const Key& key) {
+    return (key.keysym & 0xFF00) == 0xFF00 ? int(key.keysym & 0xFF) : -1;
+});
+
+constexpr uint8_t usageAt(uint8_t index) {
+    return index ? kKeys[index - 1].usage : 0;
+}
+
+} // namespace detail
+
+static_assert(usage("F1") == 0x3A && usage("page up") == 0x4B, "name lookup");
+static_assert(detail::kByUsage[0x2C] != 0 && detail::kByVk[VK_SPACE] != 0, "reverse indexes");
+
+// Name of a usage, nullptr when not in the table
+constexpr const char* name(int usage) {
+    return (usage >= 0 && usage < 256 && detail::kByUsage[usage]) ? kKeys[detail::kByUsage[usage] - 1].name : nullptr;
+}
+
+// The reverse lookups return 0 for codes no key maps to
+constexpr uint8_t fromVk(int vk) {
+    return (vk > 0 && vk < 256) ? detail::usageAt(detail::kByVk[vk]) : 0;
+}
+
+constexpr uint8_t fromScanCode(int scan) {
+    if (scan > 0 && scan < 0x100) return detail::usageAt(detail::kByScan[scan]);
+    if ((scan & 0xFF00) == 0xE000) return detail::usageAt(detail::kByExtendedScan[scan & 0xFF]);
+    return 0;
+}
+
+constexpr uint8_t fromKeysym(uint32_t keysym) {
+    if (keysym > 0 && keysym < 0x100) {
+        // Latin-1 upper case letters are the same key as lower case
+        return detail::usageAt(detail::kByLatinKeysym[keysym >= 'A' && keysym <= 'Z' ? keysym - 'A' + 'a' : keysym]);
+    }
+    if ((keysym & 0xFF00) == 0xFF00) return detail::usageAt(detail::kByFunctionKeysym[keysym & 0xFF]);
+    return 0;
+}
+
+// One key press that types a character: the key plus the modifiers the
+// layout needs for it (Shift, AltGr). A dead key has to be followed by Space
+// to produce the character on its own.
+struct Stroke {
+    uint8_t modifiers = 0;
+    uint8_t usage = 0;
+    bool dead = false;
+};
+
+// Layout of the window that receives the board's key presses
+inline HKL foregroundLayout() {
+    return GetKeyboardLayout(GetWindowThreadProcessId(GetForegroundWindow(), nullptr));
+}
+
+// Key that types ch on the given layout. The layout decides which VK (and
+// with which modifiers) produces the character, the layout's scan code for
+// that VK decides the physical key, and the physical key is the HID usage.
+inline bool fromCharacter(wchar_t ch, HKL layout, Stroke& stroke) {
+    stroke = Stroke();
+    if (ch == L'\n' || ch == L'\r') {
+        stroke.usage = usage("Enter");
+        return true;
+    }
+    if (ch == L'\t') {
+        stroke.usage = usage("Tab");
+        return true;
+    }
+    SHORT scan = VkKeyScanExW(ch, layout);
+    if (scan == -1) {
+        return false;
+    }
+    const UINT vk = LOBYTE(scan);
+    const BYTE shift = HIBYTE(scan);
+    if (shift & ~0x07) {
+        return false;  // needs a layout-specific state such as Kana
+    }
+    stroke.usage = fromScanCode(static_cast<int>(MapVirtualKeyExW(vk, MAPVK_VK_TO_VSC_EX, layout)));
+    if (stroke.usage == 0) stroke.usage = fromVk(static_cast<int>(vk));
+    if (stroke.usage == 0) {
+        return false;
+    }
+    if (shift & 0x01) stroke.modifiers |= modifierBit(usage("LeftShift"));
+    if ((shift & 0x06) == 0x06) {
+        stroke.modifiers |= modifierBit(usage("RightAlt"));  // AltGr
+    } else {
+        if (shift & 0x02) stroke.modifiers |= modifierBit(usage("LeftCtrl"));
+        if (shift & 0x04) stroke.modifiers |= modifierBit(usage("LeftAlt"));
+    }
+    stroke.dead = (MapVirtualKeyExW(vk, MAPVK_VK_TO_CHAR, layout) & 0x80000000u) != 0;
+    return true;
+}
+
+// Usage for a key given as text by a user or script: a single character is
+// the key that types it on the given layout ("z" is the key labelled Z on a
+// German keyboard, too), longer text a key name ("F1", "PageUp", "LeftCtrl")
+// or a raw usage in hex ("0x3A"). 0 when nothing fits.
+inline uint8_t fromText(const std::string& text, HKL layout) {
+    wchar_t wide[3];
+    int length = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, text.data(), static_cast<int>(text.size()), wide, 3);
+    Stroke stroke;
+    if (length == 1 && fromCharacter(wide[0], layout, stroke)) {
+        return stroke.usage;
+    }
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        char* end = nullptr;
+        long value = std::strtol(text.c_str() + 2, &end, 16);
+        return (*end == '\0' && isValidUsage(value)) ? static_cast<uint8_t>(value) : 0;
+    }
+    return usage(text.c_str());
+}
+
+} // namespace KeyTable
+
+#endif // KEYTABLE_HPP
@@ -0,0 +1,99 @@
+﻿#include "LinkKeeper.h"
+#include "TraceLog.hpp"
+#include <QCoreApplication>
+#include <QPointer>
+#include <dbt.h>
+
+LinkKeeper::LinkKeeper(ArduinoController *controller, QObject *parent)
+    : QObject(parent), controller(controller)
+{
+    // 回调可能在串口I/O线程中触发，切回本对象所在线程处理。
+    // 所有者析构时控制器成员先于本对象销毁，因此析构函数不再访问控制器，由QPointer判断存活
+    QPointer<LinkKeeper> self(this);
+    controller->setLinkLostHandler([self]() {
+        if (self) QMetaObject::invokeMethod(self, &LinkKeeper::onLinkLost, Qt::QueuedConnection);
+    });
+
+    // 键盘空闲时没有写入，靠轮询句柄状态发现断开
+    pollTimer = new QTimer(this);
+    connect(pollTimer, &QTimer::timeout, this, [this]() {
+        if (!reconnecting) this->controller->checkLink();
+    });
+    pollTimer->start(kPollMs);
+
+    retryTimer = new QTimer(this);
+    retryTimer->setSingleShot(true);
+    connect(retryTimer, &QTimer::timeout, this, &LinkKeeper::tryReconnect);
+
+    QCoreApplication::instance()->installNativeEventFilter(this);
+}
+
+LinkKeeper::~LinkKeeper()
+{
+    QCoreApplication::instance()->removeNativeEventFilter(this);
+}
+
+void LinkKeeper::onLinkLost()
+{
+    if (reconnecting || !controller->isLinkLost()) return;
+    reconnecting = true;
+    retryMs = kFirstRetryMs;
+    downtime.start();
+    Q_EMIT linkLost();
+    retryTimer->start(retryMs);
+}
+
+void LinkKeeper::tryReconnect()
+{
+    if (!reconnecting) return;
+    // 期间被主动断开（如烧录固件）则交给调用方处理，不再重试
+    if (!controller->isLinkLost()) {
+        reconnecting = false;
+        return;
+    }
+    // 枚举设备可能耗时数秒，在控制器的重连线程中进行；上一次尝试未结束时等它的结果
+    QPointer<LinkKeeper> self(this);
+    retryQueued = !controller->reconnectAsync([self](bool ok) {
+        if (self) QMetaObject::invokeMethod(self, [self, ok]() { if (self) self->onReconnectFinished(ok); }, Qt::QueuedConnection);
+    });
+}
+
+void LinkKeeper::onReconnectFinished(bool ok)
+{
+    if (!reconnecting) return;
+    if (ok) {
+        reconnecting = false;
+        int ms = static_cast<int>(downtime.elapsed());
+        KP_TRACE_INFO("Serial link restored after %1 ms", ms);
+        Q_EMIT linkRestored(ms);
+        return;
+    }
+    // 尝试期间又插入了串口设备，立即再试一次
+    if (retryQueued) {
+        retryQueued = false;
+        retryTimer->start(0);
+        return;
+    }
+    retryMs = qMin(retryMs * 2, kMaxRetryMs);
+    retryTimer->start(retryMs);
+}
+
+bool LinkKeeper::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
+{
+    Q_UNUSED(result);
+    if (eventType != "windows_generic_MSG") return false;
+    const MSG *msg = static_cast<MSG *>(message);
+    if (msg->message != WM_DEVICECHANGE || !msg->lParam) return false;
+
+    const DEV_BROADCAST_HDR *header = reinterpret_cast<const DEV_BROADCAST_HDR *>(msg->lParam);
+    if (header->dbch_devicetype != DBT_DEVTYP_PORT) return false;
+
+    if (msg->wParam == DBT_DEVICEARRIVAL && reconnecting) {
+        // 新串口出现，多半是板子回来了，不必等到下一次退避
+        retryMs = kFirstRetryMs;
+        retryTimer->start(0);
+    } else if (msg->wParam == DBT_DEVICEREMOVECOMPLETE && !reconnecting) {
+        controller->checkLink();
+    }
+    return false;
+}
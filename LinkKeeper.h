@@ -0,0 +1,48 @@
+﻿#ifndef LINKKEEPER_H
+#define LINKKEEPER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAbstractNativeEventFilter>
+#include "ArduinoController.hpp"
+
+// 串口链路守护：写入失败、串口句柄失效或设备被拔出时判定断开，
+// 按退避间隔（250ms起翻倍，最长8s）重新打开串口；插入新的串口设备时立即重试。
+// 重连在控制器的工作线程中进行，只接受硬件ID为Leonardo的串口；
+// 成功后控制器会先发送RELEASE_ALL，再重放断开期间未能写入的输入文本命令。
+class LinkKeeper : public QObject, public QAbstractNativeEventFilter {
+    Q_OBJECT
+
+public:
+    explicit LinkKeeper(ArduinoController *controller, QObject *parent = nullptr);
+    ~LinkKeeper();
+
+    bool isReconnecting() const { return reconnecting; }
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+Q_SIGNALS:
+    void linkLost();
+    // downtimeMs：从判定断开到重新连接的耗时
+    void linkRestored(int downtimeMs);
+
+private:
+    void onLinkLost();
+    void tryReconnect();
+    void onReconnectFinished(bool ok);
+
+    static constexpr int kPollMs = 1000;
+    static constexpr int kFirstRetryMs = 250;
+    static constexpr int kMaxRetryMs = 8000;
+
+    ArduinoController *controller;
+    QTimer *pollTimer;
+    QTimer *retryTimer;
+    QElapsedTimer downtime;
+    int retryMs = kFirstRetryMs;
+    bool reconnecting = false;
+    bool retryQueued = false;  // 重试时上一次尝试仍在进行
+};
+
+#endif // LINKKEEPER_H
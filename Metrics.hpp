@@ -0,0 +1,218 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Operational metrics.
+// Counters and histograms are split into cache-line sized shards; threads are
+// spread over the shards and update them with relaxed atomics, and readers
+// merge the shards. Look a metric up once (the registry lock is only taken
+// there) and keep the reference: updating it is then one atomic add.
+// Registry::prometheus() renders everything in the Prometheus text format.
+
+namespace Metrics {
+
+constexpr int kShards = 8;
+
+// Thread's shard index, assigned round-robin on first use
+inline int shardIndex() {
+    static std::atomic<int> next{ 0 };
+    thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return index;
+}
+
+class Counter {
+public:
+    void add(int64_t n = 1) {
+        shards[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t value() const {
+        int64_t total = 0;
+        for (const Shard& shard : shards) total += shard.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value{ 0 };
+    };
+    Shard shards[kShards];
+};
+
+class Gauge {
+public:
+    void set(double v) { value_.store(v, std::memory_order_relaxed); }
+    double value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value_{ 0.0 };
+};
+
+class Histogram {
+public:
+    struct Snapshot {
+        std::vector<double> bounds;
+        std::vector<int64_t> cumulative;  // per bound, plus +Inf last
+        double sum = 0.0;
+        int64_t count = 0;
+    };
+
+    explicit Histogram(std::vector<double> upperBounds)
+        : bounds(std::move(upperBounds)) {
+        std::sort(bounds.begin(), bounds.end());
+        for (Shard& shard : shards) shard.buckets.reset(new std::atomic<int64_t>[bounds.size() + 1]());
+    }
+
+    void observe(double v) {
+        size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+        Shard& shard = shards[shardIndex()];
+        shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        // Threads beyond kShards share a shard, so the sum needs a CAS loop
+        double sum = shard.sum.load(std::memory_order_relaxed);
+        while (!shard.sum.compare_exchange_weak(sum, sum + v, std::memory_order_relaxed)) {
+        }
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        s.bounds = bounds;
+        s.cumulative.assign(bounds.size() + 1, 0);
+        for (const Shard& shard : shards) {
+            for (size_t i = 0; i <= bounds.size(); ++i) s.cumulative[i] += shard.buckets[i].load(std::memory_order_relaxed);
+            s.sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        for (size_t i = 1; i < s.cumulative.size(); ++i) s.cumulative[i] += s.cumulative[i - 1];
+        s.count = s.cumulative.back();
+        return s;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<int64_t>[]> buckets;
+        std::atomic<double> sum{ 0.0 };
+    };
+    std::vector<double> bounds;
+    Shard shards[kShards];
+};
+
+class Registry {
+public:
+    // The process-wide registry the exporters read. Separate instances keep
+    // metrics of throwaway runs (e.g. simulations) out of it.
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    // labels in Prometheus syntax without braces, e.g. "slot=\"3\""
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+        return get<Counter>(counters, name, help, labels, [] { return new Counter(); });
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "") {
+        return get<Gauge>(gauges, name, help, labels, [] { return new Gauge(); });
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                         const std::string& labels = "") {
+        return get<Histogram>(histograms, name, help, labels, [&bounds] { return new Histogram(bounds); });
+    }
+
+    // Read without registering; missing metrics read as zero
+    int64_t counterValue(const std::string& name, const std::string& labels = "") const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = counters.find(Key(name, labels));
+        return it == counters.end() ? 0 : it->second->value();
+    }
+
+    double gaugeValue(const std::string& name, const std::string& labels = "") const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = gauges.find(Key(name, labels));
+        return it == gauges.end() ? 0.0 : it->second->value();
+    }
+
+    Histogram::Snapshot histogramSnapshot(const std::string& name, const std::string& labels = "") const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = histograms.find(Key(name, labels));
+        return it == histograms.end() ? Histogram::Snapshot() : it->second->snapshot();
+    }
+
+    std::string prometheus() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out;
+        char number[64];
+        std::string lastName;
+        auto header = [&](const std::string& name, const char* type) {
+            if (name == lastName) return;
+            lastName = name;
+            out += "# HELP " + name + " " + help.at(name) + "\n# TYPE " + name + " " + type + "\n";
+        };
+        auto series = [](const std::string& name, const std::string& labels) {
+            return labels.empty() ? name : name + "{" + labels + "}";
+        };
+
+        for (const auto& entry : counters) {
+            header(entry.first.first, "counter");
+            std::snprintf(number, sizeof(number), " %lld\n", static_cast<long long>(entry.second->value()));
+            out += series(entry.first.first, entry.first.second) + number;
+        }
+        for (const auto& entry : gauges) {
+            header(entry.first.first, "gauge");
+            std::snprintf(number, sizeof(number), " %.6g\n", entry.second->value());
+            out += series(entry.first.first, entry.first.second) + number;
+        }
+        for (const auto& entry : histograms) {
+            const std::string& name = entry.first.first;
+            const std::string& labels = entry.first.second;
+            std::string prefix = labels.empty() ? "" : labels + ",";
+            header(name, "histogram");
+            Histogram::Snapshot s = entry.second->snapshot();
+            for (size_t i = 0; i <= s.bounds.size(); ++i) {
+                char le[32];
+                if (i < s.bounds.size()) {
+                    std::snprintf(le, sizeof(le), "%g", s.bounds[i]);
+                } else {
+                    std::snprintf(le, sizeof(le), "+Inf");
+                }
+                std::snprintf(number, sizeof(number), " %lld\n", static_cast<long long>(s.cumulative[i]));
+                out += name + "_bucket{" + prefix + "le=\"" + le + "\"}" + number;
+            }
+            std::snprintf(number, sizeof(number), " %.6g\n", s.sum);
+            out += series(name + "_sum", labels) + number;
+            std::snprintf(number, sizeof(number), " %lld\n", static_cast<long long>(s.count));
+            out += series(name + "_count", labels) + number;
+        }
+        return out;
+    }
+
+private:
+    using Key = std::pair<std::string, std::string>;  // name, labels
+
+    template <typename T, typename Map, typename Make>
+    T& get(Map& map, const std::string& name, const std::string& helpText, const std::string& labels, Make make) {
+        std::lock_guard<std::mutex> lock(mutex);
+        help.emplace(name, helpText);
+        std::unique_ptr<T>& metric = map[Key(name, labels)];
+        if (!metric) metric.reset(make());
+        return *metric;
+    }
+
+    mutable std::mutex mutex;
+    std::map<std::string, std::string> help;
+    std::map<Key, std::unique_ptr<Counter>> counters;
+    std::map<Key, std::unique_ptr<Gauge>> gauges;
+    std::map<Key, std::unique_ptr<Histogram>> histograms;
+};
+
+} // namespace Metrics
+
+#endif // METRICS_HPP
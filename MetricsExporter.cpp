@@ -0,0 +1,57 @@
+﻿#include "MetricsExporter.h"
+#include <QSaveFile>
+#include <QTcpSocket>
+
+MetricsExporter::MetricsExporter(QObject *parent) : QObject(parent)
+{
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, &MetricsExporter::onNewConnection);
+
+    fileTimer = new QTimer(this);
+    connect(fileTimer, &QTimer::timeout, this, [this]() { writeFile(filePath); });
+}
+
+bool MetricsExporter::listen(quint16 port)
+{
+    return server->listen(QHostAddress::LocalHost, port);
+}
+
+void MetricsExporter::writePeriodically(const QString &path, int intervalMs)
+{
+    filePath = path;
+    writeFile(filePath);
+    fileTimer->start(intervalMs);
+}
+
+bool MetricsExporter::writeFile(const QString &path) const
+{
+    // 先写临时文件再替换，采集程序不会读到写了一半的内容
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+    file.write(QByteArray::fromStdString(Metrics::Registry::instance().prometheus()));
+    return file.commit();
+}
+
+void MetricsExporter::onNewConnection()
+{
+    while (QTcpSocket *socket = server->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+            // 请求头收完（空行）后回复，不区分路径和方法
+            QByteArray request = socket->peek(socket->bytesAvailable());
+            if (!request.contains("\r\n\r\n")) {
+                if (request.size() > 8192) socket->abort();
+                return;
+            }
+            socket->readAll();
+
+            QByteArray body = QByteArray::fromStdString(Metrics::Registry::instance().prometheus());
+            socket->write("HTTP/1.1 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                          "Connection: close\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n");
+            socket->write(body);
+            socket->disconnectFromHost();
+        });
+    }
+}
@@ -0,0 +1,31 @@
+﻿#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+#include <QTimer>
+#include "Metrics.hpp"
+
+// 导出运行指标（Prometheus文本格式）：
+//   listen(port)：只监听127.0.0.1，任何HTTP请求都返回当前指标，供本机的采集程序抓取
+//   writePeriodically(path, ms)：定时整体替换写入文件，供node_exporter的textfile收集器读取
+class MetricsExporter : public QObject {
+    Q_OBJECT
+
+public:
+    explicit MetricsExporter(QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+    void writePeriodically(const QString &path, int intervalMs = 10000);
+    bool writeFile(const QString &path) const;
+
+private:
+    void onNewConnection();
+
+    QTcpServer *server;
+    QTimer *fileTimer;
+    QString filePath;
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,90 @@
+#ifndef PIXELKERNELS_HPP
+#define PIXELKERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define KP_PIXEL_SSE2 1
+#endif
+
+// Colour kernels over 32-bit BGRA frames (the memory layout of GDI DIB
+// sections and of QImage::Format_RGB32/ARGB32 on little-endian machines).
+// Alpha is ignored; colour distance is the squared Euclidean distance in RGB.
+// The SSE2 paths handle four pixels per iteration, the scalar tail the rest.
+
+namespace PixelKernels {
+
+struct Frame {
+    const uint32_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;  // pixels per row
+
+    const uint32_t* row(int y) const {
+        return pixels + static_cast<ptrdiff_t>(y) * stride;
+    }
+};
+
+constexpr int kMaxDistanceSquared = 3 * 255 * 255;
+
+inline int distanceSquared(uint32_t a, uint32_t b) {
+    int db = int(a & 0xFF) - int(b & 0xFF);
+    int dg = int((a >> 8) & 0xFF) - int((b >> 8) & 0xFF);
+    int dr = int((a >> 16) & 0xFF) - int((b >> 16) & 0xFF);
+    return db * db + dg * dg + dr * dr;
+}
+
+// Number of pixels in row[0, count) whose distance to color is at most
+// maxDistanceSquared
+inline int countNear(const uint32_t* row, int count, uint32_t color, int maxDistanceSquared) {
+    if (maxDistanceSquared >= kMaxDistanceSquared) {
+        return count;
+    }
+    int matched = 0;
+    int i = 0;
+#ifdef KP_PIXEL_SSE2
+    static const int bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i reference = _mm_unpacklo_epi8(_mm_and_si128(_mm_set1_epi32(static_cast<int>(color)), rgb), zero);
+    const __m128i limit = _mm_set1_epi32(maxDistanceSquared + 1);
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)), rgb);
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(pixels, zero), reference);
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(pixels, zero), reference);
+        // madd leaves (db²+dg², dr²) per pixel; adding the swapped pairs puts
+        // each pixel's distance in lanes 0 and 2
+        lo = _mm_madd_epi16(lo, lo);
+        hi = _mm_madd_epi16(hi, hi);
+        lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(lo, limit))) & 0x5;
+        mask |= (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(hi, limit))) & 0x5) << 1;
+        matched += bits[mask];
+    }
+#endif
+    for (; i < count; ++i) {
+        matched += distanceSquared(row[i], color) <= maxDistanceSquared;
+    }
+    return matched;
+}
+
+// countNear over a rectangle, clipped to the frame
+inline int countNearInRect(const Frame& frame, int x, int y, int width, int height, uint32_t color,
+                           int maxDistanceSquared) {
+    int left = x < 0 ? 0 : x;
+    int top = y < 0 ? 0 : y;
+    int right = x + width > frame.width ? frame.width : x + width;
+    int bottom = y + height > frame.height ? frame.height : y + height;
+    int matched = 0;
+    for (int row = top; row < bottom && left < right; ++row) {
+        matched += countNear(frame.row(row) + left, right - left, color, maxDistanceSquared);
+    }
+    return matched;
+}
+
+} // namespace PixelKernels
+
+#endif // PIXELKERNELS_HPP
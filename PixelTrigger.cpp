@@ -0,0 +1,246 @@
+﻿#include "PixelTrigger.h"
+#include "SlotProfile.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QProcess>
+#include <cmath>
+
+bool PixelRule::parse(const QString &line, PixelRule &out)
+{
+    // 按空白分割，双引号内的路径保持完整
+    QStringList parts = QProcess::splitCommand(line);
+    if (parts.size() < 4) return false;
+
+    PixelRule rule;
+    const QString action = parts[0].toLower();
+    if (action == "fire") {
+        rule.action = Fire;
+    } else if (action == "suppress") {
+        rule.action = Suppress;
+    } else if (action == "require") {
+        rule.action = Require;
+    } else {
+        return false;
+    }
+
+    bool ok = false;
+    if (parts[1].toLower() == "space") {
+        rule.slot = SlotProfile::kSpaceSlot;
+    } else {
+        int key = parts[1].toInt(&ok) - 1;
+        if (!ok || key < 0 || key >= SlotProfile::kMaxKeySlotCount) return false;
+        rule.slot = SlotProfile::schedulerSlot(key);
+    }
+
+    QPoint position;
+    QSize size(1, 1);
+    bool hasPosition = false, hasSize = false, hasColor = false;
+    for (int i = 2; i + 1 < parts.size(); i += 2) {
+        const QString option = parts[i].toLower();
+        const QString value = parts[i + 1];
+        bool ok2 = true;
+        if (option == "at") {
+            QStringList xy = value.split(',');
+            ok = xy.size() == 2;
+            if (ok) position = QPoint(xy[0].toInt(&ok), xy[1].toInt(&ok2));
+            hasPosition = ok && ok2;
+        } else if (option == "size") {
+            QStringList wh = value.toLower().split('x');
+            ok = wh.size() == 2;
+            if (ok) size = QSize(wh[0].toInt(&ok), wh[1].toInt(&ok2));
+            ok = ok && ok2 && size.width() > 0 && size.height() > 0;
+            hasSize = ok;
+        } else if (option == "color") {
+            QString hex = value.startsWith('#') ? value.mid(1) : value;
+            rule.color = hex.toUInt(&ok, 16);
+            ok = ok && hex.size() == 6;
+            hasColor = ok;
+        } else if (option == "tol") {
+            rule.tolerance = value.toInt(&ok);
+            ok = ok && rule.tolerance >= 0;
+        } else if (option == "min") {
+            rule.minFraction = value.toDouble(&ok);
+            ok = ok && rule.minFraction > 0.0 && rule.minFraction <= 1.0;
+        } else if (option == "image") {
+            rule.image = value;
+            ok = !value.isEmpty();
+        } else if (option == "score") {
+            rule.minScore = value.toDouble(&ok);
+            ok = ok && rule.minScore > -1.0 && rule.minScore <= 1.0;
+        } else {
+            ok = false;
+        }
+        if (!ok || !ok2) return false;
+    }
+    // 选项必须成对出现
+    if (parts.size() % 2 != 0) return false;
+    if (rule.image.isEmpty()) {
+        if (!hasPosition || !hasColor) return false;
+        rule.area = QRect(position, size);
+    } else {
+        // 图片规则的区域可省略，指定时必须同时给出大小
+        if (hasColor || hasPosition != hasSize) return false;
+        if (hasPosition) rule.area = QRect(position, size);
+    }
+    out = rule;
+    return true;
+}
+
+QVector<PixelRule> PixelRule::parseList(const QString &text, QStringList *invalid)
+{
+    QVector<PixelRule> rules;
+    for (const QString &line : text.split('\n')) {
+        QString trimmed = line.trimmed();
+        if (trimmed.isEmpty() || trimmed.startsWith('#')) continue;
+        PixelRule rule;
+        if (PixelRule::parse(trimmed, rule)) {
+            rules.append(rule);
+        } else if (invalid) {
+            invalid->append(trimmed);
+        }
+    }
+    return rules;
+}
+
+PixelTrigger::PixelTrigger(PressScheduler *scheduler, QObject *parent)
+    : QObject(parent), scheduler(scheduler)
+{
+    timer = new QTimer(this);
+    timer->setInterval(50);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, [this]() {
+        evaluate();
+        applyResults();
+    });
+    evaluationUs = &Metrics::Registry::instance().histogram(
+        "kp_pixel_evaluation_us", "Time to capture and evaluate all pixel rules", { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000 });
+}
+
+void PixelTrigger::setRules(const QVector<PixelRule> &rules)
+{
+    releaseGates();
+    pixelRules = rules;
+    bounds = QRect();
+    fullFrame = false;
+    for (const PixelRule &rule : pixelRules) {
+        bounds = bounds.united(rule.area);
+        fullFrame = fullFrame || (!rule.image.isEmpty() && rule.area.isEmpty());
+    }
+
+    // 同一张图片只加载一次
+    matcher.clear();
+    templateOf.assign(pixelRules.size(), -1);
+    QHash<QString, int> loaded;
+    for (int i = 0; i < pixelRules.size(); ++i) {
+        const QString &path = pixelRules[i].image;
+        if (path.isEmpty()) continue;
+        if (!loaded.contains(path)) {
+            int index = matcher.addTemplate(QImage(path));
+            if (index < 0) qWarning() << "Failed to load template image (at least 8x8)" << path;
+            loaded.insert(path, index);
+        }
+        templateOf[i] = loaded.value(path);
+    }
+    matched.assign(pixelRules.size(), 0);
+    previous.assign(pixelRules.size(), 0);
+}
+
+void PixelTrigger::setSource(std::unique_ptr<FrameSource> frameSource)
+{
+    source = std::move(frameSource);
+}
+
+void PixelTrigger::start()
+{
+    if (pixelRules.isEmpty() || !source) return;
+    std::fill(previous.begin(), previous.end(), 0);
+    timer->start();
+}
+
+void PixelTrigger::stop()
+{
+    timer->stop();
+    releaseGates();
+}
+
+const std::vector<uint8_t> &PixelTrigger::evaluate()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    PixelKernels::Frame frame;
+    const QRect region = (fullFrame && source) ? source->bounds() : bounds;
+    if (!source || region.isEmpty() || !source->grab(region, frame)) {
+        // 截图失败（窗口最小化、关闭）时视为全部不满足
+        std::fill(matched.begin(), matched.end(), 0);
+        return matched;
+    }
+
+    queries.clear();
+    for (int i = 0; i < pixelRules.size(); ++i) {
+        const PixelRule &rule = pixelRules[i];
+        QRect area = rule.area.translated(-region.topLeft());
+        if (!rule.image.isEmpty()) {
+            // 图片规则汇总后一起搜索，共用同一份灰度金字塔
+            matched[i] = 0;
+            if (templateOf[i] < 0) continue;
+            TemplateMatcher::Query query;
+            query.templateIndex = templateOf[i];
+            query.region = rule.area.isEmpty() ? QRect(0, 0, frame.width, frame.height) : area;
+            queries.append(query);
+            continue;
+        }
+        int count = PixelKernels::countNearInRect(frame, area.x(), area.y(), area.width(), area.height(),
+                                                  rule.color, rule.tolerance * rule.tolerance);
+        int required = qMax(1, static_cast<int>(std::ceil(rule.minFraction * area.width() * area.height())));
+        matched[i] = count >= required;
+    }
+
+    if (!queries.isEmpty()) {
+        matcher.search(frame, queries, matches);
+        int next = 0;
+        for (int i = 0; i < pixelRules.size(); ++i) {
+            if (pixelRules[i].image.isEmpty() || templateOf[i] < 0) continue;
+            matched[i] = matches[next++].score >= pixelRules[i].minScore;
+        }
+    }
+    evaluationUs->observe(elapsed.nsecsElapsed() / 1000.0);
+    return matched;
+}
+
+void PixelTrigger::applyResults()
+{
+    if (!scheduler->isRunning()) {
+        previous = matched;
+        return;
+    }
+
+    std::vector<uint8_t> blocked(scheduler->slotCount(), 0);
+    for (int i = 0; i < pixelRules.size(); ++i) {
+        const PixelRule &rule = pixelRules[i];
+        if (rule.slot >= static_cast<int>(blocked.size())) continue;
+        if (rule.action == PixelRule::Fire) {
+            if (matched[i] && !previous[i]) scheduler->pressNow(rule.slot);
+        } else if ((rule.action == PixelRule::Suppress) == (matched[i] != 0)) {
+            blocked[rule.slot] = 1;
+        }
+    }
+    previous = matched;
+
+    gated.resize(blocked.size(), 0);
+    for (int slot = 0; slot < static_cast<int>(blocked.size()); ++slot) {
+        if (blocked[slot] != gated[slot]) {
+            scheduler->setSlotSuppressed(slot, blocked[slot] != 0);
+            gated[slot] = blocked[slot];
+        }
+    }
+}
+
+void PixelTrigger::releaseGates()
+{
+    for (int slot = 0; slot < static_cast<int>(gated.size()); ++slot) {
+        if (gated[slot]) scheduler->setSlotSuppressed(slot, false);
+    }
+    gated.clear();
+}
@@ -0,0 +1,81 @@
+﻿#ifndef PIXELTRIGGER_H
+#define PIXELTRIGGER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QRect>
+#include <QRgb>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+#include "FrameSource.h"
+#include "PressScheduler.h"
+#include "TemplateMatcher.h"
+
+// 像素条件规则，文本格式（每行一条，#开头为注释）:
+//   动作 槽位 at x,y [size 宽x高] color #RRGGBB [tol 容差] [min 比例]
+//   动作 槽位 image 图片路径 [at x,y size 宽x高] [score 相似度]
+// 动作：fire     条件由不满足变为满足时立即按一次该槽位（槽位无需勾选）
+//       suppress 条件满足期间不按该槽位
+//       require  条件不满足期间不按该槽位
+// 槽位为按键序号（从1开始）或space；坐标为目标窗口客户区坐标；tol为RGB欧氏距离（默认30）；
+// min为区域内符合颜色的像素比例下限（默认1，即全部符合）；
+// image规则在区域内（省略时为整个窗口）查找图片，含空格的路径加双引号，score为NCC下限（默认0.9）
+struct PixelRule {
+    enum Action { Fire, Suppress, Require };
+
+    Action action = Fire;
+    int slot = 0;
+    QRect area;
+    QRgb color = 0;
+    int tolerance = 30;
+    double minFraction = 1.0;
+    QString image;          // 非空时为图片规则，area为空表示整个窗口
+    double minScore = 0.9;
+
+    static bool parse(const QString &line, PixelRule &out);
+    static QVector<PixelRule> parseList(const QString &text, QStringList *invalid = nullptr);
+};
+
+// 像素条件触发：按固定间隔只截取所有规则区域的外接矩形（有不限区域的图片规则时截取整个窗口），
+// 用SIMD内核逐条统计符合颜色的像素、用TemplateMatcher查找图片，
+// 根据结果屏蔽/放行调度器中的槽位，或在条件出现时立即按键。只在调度器运行时生效。
+class PixelTrigger : public QObject {
+    Q_OBJECT
+
+public:
+    explicit PixelTrigger(PressScheduler *scheduler, QObject *parent = nullptr);
+
+    void setRules(const QVector<PixelRule> &rules);
+    const QVector<PixelRule> &rules() const { return pixelRules; }
+    void setSource(std::unique_ptr<FrameSource> source);
+    void setInterval(int ms) { timer->setInterval(ms); }
+
+    void start();
+    void stop();
+    bool isActive() const { return timer->isActive(); }
+
+    // 评估一帧，返回各规则是否满足（start后由定时器调用，也可直接调用）
+    const std::vector<uint8_t> &evaluate();
+
+private:
+    void applyResults();
+    void releaseGates();
+
+    PressScheduler *scheduler;
+    QTimer *timer;
+    std::unique_ptr<FrameSource> source;
+    QVector<PixelRule> pixelRules;
+    QRect bounds;                  // 所有规则区域的外接矩形，每帧只截取这一块
+    bool fullFrame = false;        // 有不限区域的图片规则
+    TemplateMatcher matcher;
+    std::vector<int> templateOf;   // 各规则的模板编号，颜色规则和加载失败的图片为-1
+    QVector<TemplateMatcher::Query> queries;
+    QVector<TemplateMatcher::Match> matches;
+    std::vector<uint8_t> matched;  // 本帧各规则的结果
+    std::vector<uint8_t> previous; // 上一帧，用于fire的上升沿
+    std::vector<uint8_t> gated;    // 当前被屏蔽的槽位
+    Metrics::Histogram *evaluationUs;
+};
+
+#endif // PIXELTRIGGER_H
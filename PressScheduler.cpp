@@ -0,0 +1,669 @@
+﻿#include "PressScheduler.h"
+#include <QPointer>
+#include <algorithm>
+
+namespace {
+
+// PRESS_COMBINATION的编码，提前发送时由ArduinoController::sendAt包装
+std::string combinationCommand(const std::vector<std::string> &keys)
+{
+    std::string params;
+    for (const std::string &key : keys) {
+        if (!params.empty()) params += ",";
+        params += key;
+    }
+    return ArduinoController::encode(CommandType::PRESS_COMBINATION, params);
+}
+
+} // namespace
+
+PressScheduler::PressScheduler(ArduinoController *controller, QObject *parent, Metrics::Registry *registry)
+    : QObject(parent), controller(controller), registry(registry ? registry : &Metrics::Registry::instance())
+{
+    wakeTimer = new QTimer(this);
+    wakeTimer->setSingleShot(true);
+    wakeTimer->setTimerType(Qt::PreciseTimer);
+    connect(wakeTimer, &QTimer::timeout, this, &PressScheduler::onWake);
+
+    lateness = &this->registry->histogram(
+        "kp_press_lateness_ms", "How late presses fire after their deadline", { 1, 2, 5, 10, 20, 50, 100 });
+
+    timelineSteps = &this->registry->counter("kp_timeline_steps_total", "Timeline steps sent");
+    timelineSkipped = &this->registry->counter("kp_timeline_skipped_total", "Timeline steps skipped by their skip probability");
+
+    heartbeatTimer = new QTimer(this);
+    connect(heartbeatTimer, &QTimer::timeout, this, &PressScheduler::keepAlive);
+    clock.start();
+}
+
+void PressScheduler::setSlotCount(int count)
+{
+    const bool shrinking = count < slotCount();
+    slotConfigs.resize(count);
+    lastFired.resize(count, 0);
+    deadlines.resize(count, kUnscheduled);
+    suppressed.resize(count, 0);
+    streams.resize(count);
+
+    for (int i = static_cast<int>(metrics.size()); i < count; ++i) {
+        std::string label = "slot=\"" + std::to_string(i) + "\"";
+        metrics.push_back({ &registry->counter("kp_presses_total", "Presses sent per slot", label),
+                            &registry->counter("kp_press_failures_total", "Presses whose serial write failed", label),
+                            &registry->gauge("kp_interval_planned_ms", "Interval drawn for the slot", label),
+                            &registry->gauge("kp_interval_achieved_ms", "Measured time between the last two presses", label) });
+    }
+
+    // 运行中删除槽位时，顺序触发的序列里可能还留着被删除的槽位，被删除的槽位也可能还按着
+    if (running && shrinking) {
+        releaseWhere([count](const Hold &hold) { return !hold.track && hold.index >= count; });
+        if (runMode == Sequential) rebuildSequence();
+        armTimer();
+    }
+}
+
+int PressScheduler::randomInterval(int minInterval, int maxInterval)
+{
+    if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
+    // 间隔为0或负数时会让定时器空转，至少间隔1毫秒
+    minInterval = qMax(minInterval, 1);
+    maxInterval = qMax(maxInterval, 1);
+    if (minInterval == maxInterval) return minInterval;
+    // 每个线程独立的生成器，不经过全局生成器的锁
+    double u = IntervalDistribution::Xoshiro256::threadLocal().nextDouble();
+    return minInterval + static_cast<int>(u * (maxInterval - minInterval + 1));
+}
+
+qint64 PressScheduler::nextDeadline(int index, qint64 from)
+{
+    return from + stream(index).next();
+}
+
+IntervalDistribution::IntervalStream &PressScheduler::stream(int index)
+{
+    std::unique_ptr<IntervalDistribution::IntervalStream> &slot = streams[index];
+    if (!slot) {
+        // 与开始运行时播种的效果相同：固定种子下先创建还是后创建，抽到的间隔序列都一样
+        const SlotConfig &config = slotConfigs[index];
+        slot = std::make_unique<IntervalDistribution::IntervalStream>();
+        slot->configure(config.distribution, config.minInterval, config.maxInterval, config.empirical);
+        if (seed != 0) slot->seed(streamSeed(index));
+    }
+    return *slot;
+}
+
+bool PressScheduler::pressNow(int index)
+{
+    // 固件的定时队列已满时不能插到已发出的指令前面，由onWake在队列腾出位置后按下
+    if (running && !paused && scheduleFull(now() + lead())) {
+        pendingPresses.push_back(index);
+        armTimer();
+        return true;
+    }
+    bool ok = press(index, kUnscheduled);
+    armTimer();  // 释放排在了定时器上
+    return ok;
+}
+
+// at为按下的时刻（调度器时钟），kUnscheduled为立即。提前发送时立即按下也延后lead()，
+// 排在已经发出的指令之后，按住中的按键合成的报告才能按执行顺序生成
+bool PressScheduler::press(int index, qint64 at)
+{
+    if (!running || paused || index < 0 || index >= slotCount() || suppressed[index]) return false;
+    if (beforePress && !beforePress()) return false;
+
+    const SlotConfig &config = slotConfigs[index];
+    if (config.keys.empty()) return false;
+
+    if (at == kUnscheduled) at = now() + lead();
+    bool ok;
+    uint8_t modifiers;
+    std::vector<uint8_t> usages;
+    if (ArduinoController::chordFromKeys(config.keys, modifiers, usages)) {
+        ok = holdKeys(false, index, modifiers, usages.data(), static_cast<int>(usages.size()), at, holdMs);
+    } else {
+        // 超过6个普通键放不进一个报告，由固件按住和释放
+        ok = lead() > 0 ? controller->sendAt(hostMicros(at), combinationCommand(config.keys))
+                        : controller->pressKeyCombination(config.keys);
+    }
+    KP_TRACE_DEBUG("Slot %1 pressed, %2 keys, ok %3", index, config.keys.size(), ok);
+    metrics[index].presses->add();
+    if (!ok) metrics[index].failures->add();
+    Q_EMIT slotPressed(index);
+    return ok;
+}
+
+bool PressScheduler::holdKeys(bool track, int index, uint8_t modifiers, const uint8_t *usages, int usageCount,
+                              qint64 at, int hold)
+{
+    // 间隔短于按住时长时，同一来源上一次的按键还没松开，先松开，每次按下都是一次新的按下
+    for (size_t i = 0; i < holds.size(); ++i) {
+        if (holds[i].releaseAt != kUnscheduled && holds[i].track == track && holds[i].index == index) {
+            release(i, at);
+            break;
+        }
+    }
+    Hold held = { at + hold, track, index, modifiers, static_cast<uint8_t>(usageCount), {} };
+    std::copy(usages, usages + usageCount, held.usages);
+    countHeld(held, 1);
+    holds.push_back(held);
+    return sendHeldReport(at);
+}
+
+void PressScheduler::release(size_t index, qint64 at)
+{
+    Hold &held = holds[index];
+    countHeld(held, -1);
+    held.releaseAt = kUnscheduled;  // onWake结束时移除，其间下标保持不变
+    sendHeldReport(at);
+    if (held.track) {
+        Q_EMIT trackReleased(held.index);
+    } else {
+        Q_EMIT slotReleased(held.index);
+    }
+}
+
+// 来源被删除或替换时按着的按键不等到期，改为现在释放，由onWake排在已发出的指令之后发送；
+// 调用方随后重新设置定时器
+void PressScheduler::releaseWhere(const std::function<bool(const Hold &)> &match)
+{
+    const qint64 at = now() + lead();
+    for (Hold &held : holds) {
+        if (held.releaseAt != kUnscheduled && match(held)) held.releaseAt = qMin(held.releaseAt, at);
+    }
+}
+
+void PressScheduler::countHeld(const Hold &held, int delta)
+{
+    for (int bit = 0; bit < 8; ++bit) {
+        if (held.modifiers & (1 << bit)) modifierHolds[bit] = static_cast<uint16_t>(modifierHolds[bit] + delta);
+    }
+    for (int i = 0; i < held.usageCount; ++i) {
+        usageHolds[held.usages[i]] = static_cast<uint16_t>(usageHolds[held.usages[i]] + delta);
+    }
+}
+
+bool PressScheduler::sendHeldReport(qint64 at)
+{
+    uint8_t modifiers = 0;
+    std::vector<uint8_t> usages;
+    for (int bit = 0; bit < 8; ++bit) {
+        if (modifierHolds[bit]) modifiers |= static_cast<uint8_t>(1 << bit);
+    }
+    // 同时按住超过6个普通键时只发送前6个，HID报告放不下更多
+    for (int usage = 0; usage < 256 && usages.size() < 6; ++usage) {
+        if (usageHolds[usage]) usages.push_back(static_cast<uint8_t>(usage));
+    }
+    const std::string report = ArduinoController::encode(CommandType::KEYBOARD_REPORT,
+                                                         ArduinoController::reportParams(modifiers, usages));
+    return lead() > 0 ? controller->sendAt(hostMicros(at), report) : controller->sendRaw(report);
+}
+
+void PressScheduler::setTimeline(std::shared_ptr<const CompiledTimeline> compiled)
+{
+    if (compiled && compiled->tracks.empty()) compiled = nullptr;
+    // 轨道从头开始，旧轨道按着的按键立即松开
+    releaseWhere([](const Hold &hold) { return hold.track; });
+    timeline = std::move(compiled);
+    tracks.clear();
+    gapStreams.clear();
+    if (timeline) {
+        tracks.resize(timeline->tracks.size());
+        gapStreams.resize(timeline->gaps.size());
+        for (size_t i = 0; i < gapStreams.size(); ++i) {
+            const CompiledTimeline::Gap &gap = timeline->gaps[i];
+            gapStreams[i].configure(gap.distribution, gap.minGap, gap.maxGap);
+        }
+    }
+    if (running && !paused) {
+        armWatchdog();  // 新时间轴的步骤可能有更长的hold
+        startTracks(now());
+        armTimer();
+    }
+}
+
+void PressScheduler::startTracks(qint64 from)
+{
+    if (!timeline) return;
+    if (seed != 0) {
+        // 与槽位的种子错开，同一种子下轨道的间隔序列同样可复现
+        for (size_t i = 0; i < gapStreams.size(); ++i) {
+            gapStreams[i].seed(~seed + static_cast<quint64>(i) * 0x9E3779B97F4A7C15ull);
+        }
+    }
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        const CompiledTimeline::Track &track = timeline->tracks[i];
+        tracks[i].cursor = track.begin;
+        tracks[i].loopsLeft = track.loops;
+        tracks[i].deadline = from + track.offsetMs;
+        tracks[i].skipRandom.reseed(seed != 0 ? (seed ^ 0x5DEECE66Dull) + static_cast<quint64>(i) * 0x9E3779B97F4A7C15ull
+                                              : IntervalDistribution::Xoshiro256::threadLocal().next());
+    }
+}
+
+bool PressScheduler::sendTimelineStep(int track, const CompiledTimeline::Step &step, qint64 at)
+{
+    if (step.send == CompiledTimeline::SendChord) {
+        return holdKeys(true, track, step.modifiers, step.usages, step.usageCount, at, step.holdMs ? step.holdMs : holdMs);
+    }
+    auto first = timeline->keys.begin() + step.keyBegin;
+    std::vector<std::string> keys(first, first + step.keyCount);
+    return lead() > 0 ? controller->sendAt(hostMicros(at), combinationCommand(keys)) : controller->pressKeyCombination(keys);
+}
+
+void PressScheduler::runTrackStep(int index, qint64 at)
+{
+    TrackState &state = tracks[index];
+    const CompiledTimeline::Track &track = timeline->tracks[index];
+    const CompiledTimeline::Step &step = timeline->steps[state.cursor];
+
+    lateness->observe(static_cast<double>(at - state.deadline));
+    if (step.skipBelow != 0 && static_cast<uint32_t>(state.skipRandom.next() >> 32) < step.skipBelow) {
+        timelineSkipped->add();
+    } else if (!beforePress || beforePress()) {
+        sendTimelineStep(index, step, at);
+        timelineSteps->add();
+        KP_TRACE_DEBUG("Track %1 step %2", index, state.cursor - track.begin);
+        Q_EMIT trackStepped(index, static_cast<int>(state.cursor - track.begin));
+    }
+
+    state.deadline = qMax(at, now()) + gapStreams[step.gap].next();
+    if (++state.cursor < track.end) return;
+    state.cursor = track.begin;
+    if (state.loopsLeft > 0 && --state.loopsLeft == 0) {
+        state.deadline = kUnscheduled;
+    }
+}
+
+void PressScheduler::start()
+{
+    running = true;
+    paused = false;
+    armWatchdog();
+    syncDeviceClock();
+    std::fill(deadlines.begin(), deadlines.end(), kUnscheduled);
+    if (seed != 0) {
+        for (int i = 0; i < slotCount(); ++i) {
+            if (streams[i]) streams[i]->seed(streamSeed(i));
+        }
+    }
+    sequence.clear();
+    sequenceCursor = 0;
+    sequenceDeadline = kUnscheduled;
+    startTracks(now());
+
+    if (runMode == Sequential) {
+        rebuildSequence();
+    } else {
+        // 独立触发：勾选的按键先各按一次，再按各自的间隔排期
+        for (int i = 0; i < slotCount(); ++i) {
+            if (!slotConfigs[i].enabled) continue;
+            pressNow(i);
+            lastFired[i] = now();
+            deadlines[i] = nextDeadline(i, lastFired[i]);
+        }
+    }
+    armTimer();
+}
+
+void PressScheduler::stop()
+{
+    running = false;
+    paused = false;
+    wakeTimer->stop();
+    heartbeatTimer->stop();
+    // 停止时可能正处于组合键中间，统一释放；空闲时手动按住的按键不受看门狗限制
+    controller->configureWatchdog(0, 0, holdMs);
+    controller->releaseAll();
+    holds.clear();
+    modifierHolds.fill(0);
+    usageHolds.fill(0);
+    pendingPresses.clear();
+    scheduleBlocked = false;
+    std::fill(deadlines.begin(), deadlines.end(), kUnscheduled);
+    sequence.clear();
+    sequenceDeadline = kUnscheduled;
+    for (TrackState &state : tracks) state.deadline = kUnscheduled;
+}
+
+void PressScheduler::pause()
+{
+    if (!running || paused) return;
+    paused = true;
+    wakeTimer->stop();
+    heartbeatTimer->stop();
+    // 重新连接时先统一释放，按着的按键不再单独松开
+    holds.clear();
+    modifierHolds.fill(0);
+    usageHolds.fill(0);
+    pendingPresses.clear();
+    scheduleBlocked = false;
+}
+
+void PressScheduler::resume()
+{
+    if (!running || !paused) return;
+    paused = false;
+    armWatchdog();
+    // 重连时设备可能已复位，时钟估计从头开始
+    syncDeviceClock();
+
+    // 断开期间错过的触发不补发，以恢复时刻为锚点重新排期
+    qint64 now = this->now();
+    if (runMode == Sequential) {
+        if (sequenceDeadline != kUnscheduled) {
+            sequenceAnchor = now;
+            sequenceDeadline = nextDeadline(sequence[sequenceCursor], now);
+        }
+    } else {
+        for (int i = 0; i < slotCount(); ++i) {
+            if (deadlines[i] == kUnscheduled) continue;
+            lastFired[i] = now;
+            deadlines[i] = nextDeadline(i, now);
+        }
+    }
+    // 轨道保持游标，从恢复时刻重新抽取上一步之后的间隔
+    for (int i = 0; i < static_cast<int>(tracks.size()); ++i) {
+        TrackState &state = tracks[i];
+        if (state.deadline == kUnscheduled) continue;
+        const CompiledTimeline::Track &track = timeline->tracks[i];
+        uint32_t previous = state.cursor == track.begin ? track.end - 1 : state.cursor - 1;
+        state.deadline = now + gapStreams[timeline->steps[previous].gap].next();
+    }
+    armTimer();
+}
+
+void PressScheduler::setMode(Mode mode)
+{
+    if (runMode == mode) return;
+    runMode = mode;
+    // 切换模式会改变所有槽位的排期方式，只能整体重新开始
+    if (running) {
+        stop();
+        start();
+    }
+}
+
+void PressScheduler::setSlotSuppressed(int index, bool value)
+{
+    if (index >= 0 && index < slotCount()) suppressed[index] = value;
+}
+
+void PressScheduler::setSlot(int index, const SlotConfig &config)
+{
+    if (index < 0 || index >= slotCount()) return;
+
+    SlotConfig previous = slotConfigs[index];
+    slotConfigs[index] = config;
+    if (!previous.sameSchedule(config)) {
+        if (streams[index]) {
+            streams[index]->configure(config.distribution, config.minInterval, config.maxInterval, config.empirical);
+        }
+    }
+
+    // 只改了按键，下次触发时直接使用新的按键，排期保持不变
+    if (!running || previous.sameSchedule(config)) return;
+
+    if (runMode == Sequential) {
+        bool membershipChanged = (previous.enabled && previous.sequential) != (config.enabled && config.sequential);
+        if (membershipChanged) {
+            rebuildSequence();
+        } else if (!sequence.empty() && sequence[sequenceCursor] == index) {
+            // 当前等待的正是该槽位，以上次触发为锚点按新间隔重新计算
+            sequenceDeadline = nextDeadline(index, sequenceAnchor);
+        }
+    } else if (!config.enabled) {
+        deadlines[index] = kUnscheduled;
+    } else if (!previous.enabled) {
+        pressNow(index);
+        lastFired[index] = now();
+        deadlines[index] = nextDeadline(index, lastFired[index]);
+    } else {
+        deadlines[index] = nextDeadline(index, lastFired[index]);
+    }
+    armTimer();
+}
+
+void PressScheduler::rebuildSequence()
+{
+    int current = sequence.empty() ? -1 : sequence[sequenceCursor];
+
+    sequence.clear();
+    for (int i = 0; i < slotCount(); ++i) {
+        if (slotConfigs[i].enabled && slotConfigs[i].sequential) {
+            sequence.push_back(i);
+        }
+    }
+
+    if (sequence.empty()) {
+        sequenceCursor = 0;
+        sequenceDeadline = kUnscheduled;
+        return;
+    }
+
+    if (current < 0) {
+        // 首次排期（开始运行或此前没有可用槽位）
+        sequenceCursor = 0;
+        sequenceAnchor = now();
+        sequenceDeadline = nextDeadline(sequence.front(), sequenceAnchor);
+        return;
+    }
+
+    // 保持游标停在原来的槽位上；若该槽位被移除则顺延到其后的下一个槽位
+    auto it = std::lower_bound(sequence.begin(), sequence.end(), current);
+    if (it == sequence.end()) it = sequence.begin();
+    sequenceCursor = static_cast<int>(it - sequence.begin());
+    if (*it != current) {
+        sequenceDeadline = nextDeadline(*it, sequenceAnchor);
+    }
+}
+
+void PressScheduler::onWake()
+{
+    if (!running || paused) return;
+
+    // 提前发送时，截止时间落在lead()之内的按下和释放现在就发出，由固件到点执行。
+    // 按住中的按键合成一个报告，各报告必须按执行的先后生成，所以到期事件放进最小堆按时刻处理；
+    // 处理中新排出且同样到期的事件（间隔或按住时长短于lead()）也加入堆中。
+    // 固件的定时队列排满时停下，剩下的事件等队列腾出位置再发，不打乱执行顺序
+    const qint64 horizon = now() + lead();
+    scheduleBlocked = false;
+    due.clear();
+    if (runMode == Sequential) {
+        queueDue(sequenceDeadline, DueSequence, 0, horizon);
+    } else {
+        for (int i = 0; i < slotCount(); ++i) queueDue(deadlines[i], DueSlot, i, horizon);
+    }
+    for (int i = 0; i < static_cast<int>(tracks.size()); ++i) queueDue(tracks[i].deadline, DueTrack, i, horizon);
+    for (size_t i = 0; i < holds.size(); ++i) queueDue(holds[i].releaseAt, DueRelease, static_cast<int>(i), horizon);
+    for (size_t i = 0; i < pendingPresses.size(); ++i) queueDue(horizon, DuePending, static_cast<int>(i), horizon);
+
+    while (!due.empty()) {
+        if (scheduleFull(due.front().at)) {
+            scheduleBlocked = true;
+            break;
+        }
+        std::pop_heap(due.begin(), due.end(), later);
+        const DueEvent event = due.back();
+        due.pop_back();
+        const size_t heldBefore = holds.size();
+        const int i = event.index;
+
+        switch (event.kind) {
+        case DueRelease:
+            // 同一来源再次按下时已经提前释放
+            if (holds[i].releaseAt == event.at) release(i, event.at);
+            break;
+        case DueSequence: {
+            qint64 at = recordFired(sequence[sequenceCursor], sequenceDeadline, sequenceAnchor);
+            press(sequence[sequenceCursor], at);
+            sequenceCursor = (sequenceCursor + 1) % static_cast<int>(sequence.size());
+            sequenceAnchor = qMax(at, now());
+            sequenceDeadline = nextDeadline(sequence[sequenceCursor], sequenceAnchor);
+            queueDue(sequenceDeadline, DueSequence, 0, horizon);
+            break;
+        }
+        case DueSlot: {
+            qint64 at = recordFired(i, deadlines[i], lastFired[i]);
+            press(i, at);
+            lastFired[i] = qMax(at, now());
+            deadlines[i] = nextDeadline(i, lastFired[i]);
+            queueDue(deadlines[i], DueSlot, i, horizon);
+            break;
+        }
+        case DueTrack:
+            runTrackStep(i, qMax(tracks[i].deadline, now()));
+            queueDue(tracks[i].deadline, DueTrack, i, horizon);
+            break;
+        case DuePending:
+            press(pendingPresses[i], event.at);
+            pendingPresses[i] = -1;
+            break;
+        }
+        for (size_t h = heldBefore; h < holds.size(); ++h) {
+            queueDue(holds[h].releaseAt, DueRelease, static_cast<int>(h), horizon);
+        }
+    }
+    holds.erase(std::remove_if(holds.begin(), holds.end(), [](const Hold &hold) { return hold.releaseAt == kUnscheduled; }),
+                holds.end());
+    pendingPresses.erase(std::remove(pendingPresses.begin(), pendingPresses.end(), -1), pendingPresses.end());
+    armTimer();
+}
+
+void PressScheduler::queueDue(qint64 at, DueKind kind, int index, qint64 horizon)
+{
+    if (at == kUnscheduled || at > horizon) return;
+    due.push_back({ at, kind, index });
+    std::push_heap(due.begin(), due.end(), later);
+}
+
+// 提前发送的指令在固件的定时队列里等到执行，队列只有ArduinoController::kScheduleCapacity条，
+// 满了固件会拒收；到期时刻已过的指令固件收到即执行，不占队列
+bool PressScheduler::scheduleFull(qint64 at) const
+{
+    return lead() > 0 && at > now() && controller->scheduleRoom() < kEventCommands;
+}
+
+// 堆顶为最早的事件
+bool PressScheduler::later(const DueEvent &a, const DueEvent &b)
+{
+    if (a.at != b.at) return a.at > b.at;
+    if (a.kind != b.kind) return a.kind > b.kind;
+    return a.index > b.index;
+}
+
+// 返回按键实际按下的时刻：即时发送为现在，提前发送为截止时间（已经错过时同样为现在）
+qint64 PressScheduler::recordFired(int index, qint64 deadline, qint64 previous)
+{
+    qint64 at = qMax(deadline, now());
+    lateness->observe(static_cast<double>(at - deadline));
+    metrics[index].planned->set(static_cast<double>(deadline - previous));
+    metrics[index].achieved->set(static_cast<double>(at - previous));
+    return at;
+}
+
+void PressScheduler::syncDeviceClock()
+{
+    // 旧固件不回应探测，每次都要等到超时，只在开始和恢复时尝试。探测在工作线程上进行，
+    // 结果回到调度器所在的线程；同步完成前照常即时发送
+    clockProbing = false;
+    clockSyncPending = false;
+    if (leadMs <= 0 || clockSource) return;
+    QPointer<PressScheduler> self(this);
+    clockSyncPending = !controller->syncClockAsync(kInitialProbes, [self](bool synced) {
+        QMetaObject::invokeMethod(self, [self, synced]() { if (self) self->onClockSynced(synced); }, Qt::QueuedConnection);
+    });
+}
+
+void PressScheduler::onClockSynced(bool synced)
+{
+    clockProbing = synced && running && !paused;
+    KP_TRACE_INFO("Device clock sync %1, round trip %2 us", synced, controller->clockEstimate().roundTripUs);
+}
+
+void PressScheduler::setHoldTime(int ms)
+{
+    holdMs = qBound(1, ms, kMaxHoldTimeMs);
+    if (running && !paused) armWatchdog();
+}
+
+// 按键到期才由主机释放，单个按键的最长按住时间按最长的按住时长（含时间轴步骤的hold）放宽，
+// 否则较长的按住会被固件提前松开
+void PressScheduler::armWatchdog()
+{
+    int longest = holdMs;
+    if (timeline) {
+        for (const CompiledTimeline::Step &step : timeline->steps) longest = qMax(longest, static_cast<int>(step.holdMs));
+    }
+    controller->configureWatchdog(kHeartbeatTimeoutMs, qMax(kMaxHoldMs, longest + kHeartbeatTimeoutMs), holdMs);
+    if (!clockSource) heartbeatTimer->start(kHeartbeatTimeoutMs / 3);
+}
+
+void PressScheduler::keepAlive()
+{
+    // 探测本身也是一条指令，同样刷新固件看门狗；持续探测使漂移估计跟上温度变化。
+    // 上一次探测还没结束时照常发送心跳
+    if (clockSyncPending) syncDeviceClock();
+    if (clockProbing && controller->syncClockAsync(1, {})) return;
+    controller->heartbeat();
+}
+
+void PressScheduler::setClock(SchedulerClock *source)
+{
+    clockSource = source;
+    wakeTimer->stop();
+    heartbeatTimer->stop();
+}
+
+void PressScheduler::runDue()
+{
+    onWake();
+}
+
+qint64 PressScheduler::nextWakeTime() const
+{
+    if (!running || paused) return kUnscheduled;
+    qint64 earliest = kUnscheduled;
+    if (runMode == Sequential) {
+        earliest = sequenceDeadline;
+    } else {
+        for (qint64 deadline : deadlines) {
+            if (deadline != kUnscheduled && (earliest == kUnscheduled || deadline < earliest)) {
+                earliest = deadline;
+            }
+        }
+    }
+
+    for (const TrackState &state : tracks) {
+        if (state.deadline != kUnscheduled && (earliest == kUnscheduled || state.deadline < earliest)) {
+            earliest = state.deadline;
+        }
+    }
+    for (const Hold &held : holds) {
+        if (held.releaseAt != kUnscheduled && (earliest == kUnscheduled || held.releaseAt < earliest)) {
+            earliest = held.releaseAt;
+        }
+    }
+    if (!pendingPresses.empty()) {
+        qint64 pending = now() + lead();
+        if (earliest == kUnscheduled || pending < earliest) earliest = pending;
+    }
+    return earliest;
+}
+
+void PressScheduler::armTimer()
+{
+    // 外部时钟由调用方按nextWakeTime()推进并调用runDue()
+    if (clockSource) return;
+    qint64 earliest = nextWakeTime();
+    if (earliest == kUnscheduled) {
+        wakeTimer->stop();
+        return;
+    }
+    qint64 wait = qMax<qint64>(0, earliest - lead() - now());
+    if (scheduleBlocked) {
+        // 等固件的定时队列执行掉最早的一条
+        int64_t expiry = controller->nextScheduleExpiry();
+        if (expiry != 0) wait = qMax<qint64>(wait, (expiry - DeviceClock::hostMicros()) / 1000 + 1);
+    }
+    wakeTimer->start(static_cast<int>(wait));
+}
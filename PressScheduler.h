@@ -0,0 +1,242 @@
+﻿#ifndef PRESSSCHEDULER_H
+#define PRESSSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ArduinoController.hpp"
+#include "IntervalDistribution.hpp"
+#include "Timeline.h"
+#include "Metrics.hpp"
+
+// 单个按键槽位的配置快照，运行中由界面整体替换
+struct SlotConfig {
+    bool enabled = false;
+    std::vector<std::string> keys;  // 修饰键 + 主按键（HID用法码），不超过6个普通键时合成一个报告发送
+    int minInterval = 1000;
+    int maxInterval = 1000;
+    bool sequential = true;         // 是否参与顺序触发（空格槽位不参与）
+    IntervalDistribution::Kind distribution = IntervalDistribution::Uniform;  // 间隔在[min,max]内的分布
+    std::shared_ptr<const IntervalDistribution::EmpiricalTable> empirical;    // distribution为Empirical时使用
+
+    bool sameSchedule(const SlotConfig &other) const {
+        return enabled == other.enabled && minInterval == other.minInterval
+               && maxInterval == other.maxInterval && sequential == other.sequential
+               && distribution == other.distribution && empirical == other.empirical;
+    }
+};
+
+// 调度器的时间源（毫秒，单调递增）。默认使用内部的QElapsedTimer；
+// 模拟运行时换成手动推进的虚拟时钟，不再启动任何定时器
+class SchedulerClock {
+public:
+    virtual ~SchedulerClock() = default;
+    virtual qint64 now() const = 0;
+};
+
+class VirtualClock : public SchedulerClock {
+public:
+    qint64 now() const override { return current; }
+    void set(qint64 ms) { current = ms; }
+    void advance(qint64 ms) { current += ms; }
+
+private:
+    qint64 current = 0;
+};
+
+// 按键调度器：所有槽位共用一个精确定时器，按各自的截止时间触发。
+// 运行中修改某个槽位只替换该槽位的配置和排期，不影响其他槽位的相位。
+class PressScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    enum Mode { Independent, Sequential };
+
+    // registry为空时指标记入全局注册表
+    explicit PressScheduler(ArduinoController *controller, QObject *parent = nullptr, Metrics::Registry *registry = nullptr);
+
+    void setSlotCount(int count);
+    int slotCount() const { return static_cast<int>(slotConfigs.size()); }
+    const SlotConfig &slot(int index) const { return slotConfigs[index]; }
+    void setSlot(int index, const SlotConfig &config);
+
+    Mode mode() const { return runMode; }
+    void setMode(Mode mode);
+
+    // 时间轴的各条轨道与按键槽位并行运行（两种模式下均可）。运行中替换时所有轨道从头开始；
+    // 传入nullptr或空时间轴则停止轨道
+    void setTimeline(std::shared_ptr<const CompiledTimeline> timeline);
+    const std::shared_ptr<const CompiledTimeline> &currentTimeline() const { return timeline; }
+
+    // 屏蔽某个槽位的按键（如像素条件不满足），排期照常进行，只是到期时不发送
+    void setSlotSuppressed(int index, bool suppressed);
+    bool isSlotSuppressed(int index) const { return suppressed[index] != 0; }
+
+    // 每次按键前调用，返回false则跳过本次按键（仍会继续排期）
+    void setBeforePressHook(std::function<bool()> hook) { beforePress = std::move(hook); }
+
+    bool isRunning() const { return running.load(); }
+    bool isPaused() const { return paused; }
+    // 可在任意线程调用：立即阻止后续按键，定时器等状态随后由stop()在所属线程清理
+    void requestStop() { running = false; }
+    bool pressNow(int index);
+
+    // 随机种子，非0时每次开始运行都产生相同的间隔序列；0表示不固定
+    void setSeed(quint64 value) { seed = value; }
+
+    // 按键按住时长：按下后由调度器在到期时释放，不阻塞；超过6个普通键的组合键由固件计时。
+    // 固件看门狗保证按键不会卡住，可以设为目标程序能识别的最小值；最长kMaxHoldTimeMs，看门狗的超时随之放宽
+    void setHoldTime(int ms);
+    int holdTime() const { return holdMs; }
+
+    // 提前发送：大于0时，按键提前该毫秒数连同设备时钟上的执行时刻一起发出，由固件在截止时间准时按下和释放，
+    // 不受USB传输和界面线程调度的抖动影响。运行中心跳改为时钟同步探测（在工作线程上，不阻塞界面）；
+    // 固件不支持或尚未同步时照常即时发送。固件的定时队列排满时，后面的按键等队列腾出位置再发
+    void setLeadTime(int ms) { leadMs = qBound(0, ms, kMaxLeadMs); }
+    int leadTime() const { return leadMs; }
+
+    static int randomInterval(int minInterval, int maxInterval);
+
+    // 使用外部时钟（不转移所有权）。设置后调度器不再自行定时，由调用方循环：
+    // 把时钟推进到nextWakeTime()，再调用runDue()；没有待触发的按键时nextWakeTime()返回-1
+    void setClock(SchedulerClock *source);
+    qint64 nextWakeTime() const;
+    void runDue();
+
+public slots:
+    void start();
+    void stop();
+    // 连接断开时暂停：保留运行状态和槽位配置，恢复后各槽位从恢复时刻重新排期
+    void pause();
+    void resume();
+
+Q_SIGNALS:
+    void slotPressed(int index);
+    void trackStepped(int track, int step);
+    // 按键在按住时长到期（或同一来源再次按下）时松开
+    void slotReleased(int index);
+    void trackReleased(int track);
+
+private:
+    static constexpr qint64 kUnscheduled = -1;
+    static constexpr int kHeartbeatTimeoutMs = 1000;  // 超过该时间没有指令，固件释放所有按键
+    static constexpr int kMaxHoldMs = 2000;           // 单个按键最长按住时间
+    static constexpr int kMaxHoldTimeMs = 10000;      // 按住时长上限，超过时看门狗形同虚设
+    static constexpr int kMaxLeadMs = 100;            // 固件的定时队列只有16条，提前太多会排满
+    static constexpr int kInitialProbes = 8;
+    static constexpr size_t kEventCommands = 2;       // 一次按下最多占用定时队列的条数（先松开上次的按键）
+
+    // 各槽位的运行指标，setSlotCount时注册，之后只做原子更新
+    struct SlotMetrics {
+        Metrics::Counter *presses;
+        Metrics::Counter *failures;
+        Metrics::Gauge *planned;   // 本次抽到的间隔
+        Metrics::Gauge *achieved;  // 实际两次触发的间隔
+    };
+
+    // 调度器按住的按键：所有来源按下的按键合成一个键盘报告，每个按键记按住它的来源数，
+    // 按下和到期释放都只改计数再发送整个报告，槽位和轨道的按住时间可以重叠，互不提前松开
+    struct Hold {
+        qint64 releaseAt;    // kUnscheduled为已释放，onWake结束时移除
+        bool track;
+        int index;
+        uint8_t modifiers;
+        uint8_t usageCount;
+        uint8_t usages[6];
+    };
+
+    // onWake中到期的事件，按时刻从小到大处理；同一时刻先释放再按下
+    enum DueKind { DueRelease, DueSequence, DueSlot, DueTrack, DuePending };
+    struct DueEvent {
+        qint64 at;
+        int kind;
+        int index;
+    };
+    static bool later(const DueEvent &a, const DueEvent &b);
+
+    void onWake();
+    void queueDue(qint64 at, DueKind kind, int index, qint64 horizon);
+    void armTimer();
+    qint64 now() const { return clockSource ? clockSource->now() : clock.elapsed(); }
+    qint64 nextDeadline(int index, qint64 from);
+    IntervalDistribution::IntervalStream &stream(int index);
+    quint64 streamSeed(int index) const { return seed + static_cast<quint64>(index) * 0x9E3779B97F4A7C15ull; }
+    void rebuildSequence();
+    qint64 recordFired(int index, qint64 deadline, qint64 previous);
+    qint64 lead() const { return leadMs > 0 && !clockSource && controller->isClockSynced() ? leadMs : 0; }
+    bool scheduleFull(qint64 at) const;
+    int64_t hostMicros(qint64 at) const { return DeviceClock::hostMicros() + (at - now()) * 1000; }
+    bool press(int index, qint64 at);
+    bool holdKeys(bool track, int index, uint8_t modifiers, const uint8_t *usages, int usageCount, qint64 at, int hold);
+    void release(size_t index, qint64 at);
+    void releaseWhere(const std::function<bool(const Hold &)> &match);
+    void countHeld(const Hold &hold, int delta);
+    bool sendHeldReport(qint64 at);
+    void keepAlive();
+    void armWatchdog();
+    void syncDeviceClock();
+    void onClockSynced(bool synced);
+    void startTracks(qint64 from);
+    void runTrackStep(int track, qint64 at);
+    bool sendTimelineStep(int track, const CompiledTimeline::Step &step, qint64 at);
+
+    ArduinoController *controller;
+    Metrics::Registry *registry;
+    std::function<bool()> beforePress;
+    std::vector<SlotConfig> slotConfigs;
+    std::vector<qint64> lastFired;   // 上次触发的时间点，作为改动间隔后的相位锚点
+    std::vector<qint64> deadlines;   // 独立模式下各槽位的下次触发时间
+    std::vector<uint8_t> suppressed;
+    // 各槽位预生成的间隔，每个约7KB，第一次排期时才创建，未启用过的槽位不占内存
+    std::vector<std::unique_ptr<IntervalDistribution::IntervalStream>> streams;
+    std::vector<SlotMetrics> metrics;
+    Metrics::Histogram *lateness;    // 实际触发时间晚于截止时间的毫秒数
+    quint64 seed = 0;
+    QTimer *wakeTimer;
+    QTimer *heartbeatTimer;          // 运行中定时发送心跳，界面卡死时固件会自动释放按键
+    int holdMs = 100;
+    int leadMs = 0;
+    bool clockProbing = false;       // 固件回应了时钟探测，心跳改为探测
+    bool clockSyncPending = false;   // 上一次探测还没结束，开始同步的请求留到下次心跳
+    bool scheduleBlocked = false;    // 固件的定时队列已满，onWake等到队列腾出位置再继续
+    QElapsedTimer clock;             // 单调时钟
+    SchedulerClock *clockSource = nullptr;
+    Mode runMode = Independent;
+    std::atomic<bool> running{ false };
+    bool paused = false;
+
+    // 按住中的按键（见Hold）和各按键的按住来源数
+    std::vector<Hold> holds;
+    std::array<uint16_t, 8> modifierHolds{};
+    std::array<uint16_t, 256> usageHolds{};
+    std::vector<DueEvent> due;
+    std::vector<int> pendingPresses; // 定时队列满时的立即按下，排在已发出的指令之后
+
+    // 顺序触发状态
+    std::vector<int> sequence;
+    int sequenceCursor = 0;
+    qint64 sequenceAnchor = 0;
+    qint64 sequenceDeadline = kUnscheduled;
+
+    // 时间轴状态：每条轨道一个游标、截止时间和跳过用的随机数，轨道内每组间隔参数一个间隔流，
+    // 各轨道的随机序列互不影响
+    struct TrackState {
+        uint32_t cursor = 0;
+        int loopsLeft = 0;   // 0为无限
+        qint64 deadline = kUnscheduled;
+        IntervalDistribution::Xoshiro256 skipRandom;
+    };
+    std::shared_ptr<const CompiledTimeline> timeline;
+    std::vector<TrackState> tracks;
+    std::vector<IntervalDistribution::IntervalStream> gapStreams;
+    Metrics::Counter *timelineSteps;
+    Metrics::Counter *timelineSkipped;
+};
+
+#endif // PRESSSCHEDULER_H
@@ -0,0 +1,512 @@
+﻿// Python.h 中的结构体成员名 slots 与Qt的宏冲突，需在包含前临时取消
+#pragma push_macro("slots")
+#undef slots
+#define PY_SSIZE_T_CLEAN
+#define Py_LIMITED_API 0x03080000
+#include <Python.h>
+#pragma pop_macro("slots")
+
+#include "PythonScripting.h"
+#include <QFile>
+#include <QDebug>
+#include <QMetaObject>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+// 解释器全局唯一，模块函数通过这些指针访问宿主
+ArduinoController *gController = nullptr;
+PythonScripting::Hooks gHooks;
+QObject *gOwner = nullptr;
+
+// 析构时置位：界面线程要等待脚本线程结束，不能再反过来等界面线程
+std::mutex gShutdownMutex;
+std::condition_variable gShutdownWake;
+bool gShuttingDown = false;
+
+// 在界面线程中执行回调，等待期间释放GIL。
+// 不用BlockingQueuedConnection：析构函数在界面线程中join脚本线程时，
+// 脚本线程若正等着界面线程执行回调就会死锁；这里改为等待条件变量，关闭时直接放弃
+template <typename Result, typename Func>
+Result callOnOwnerThread(Func func)
+{
+    struct Call {
+        Result result{};
+        bool done = false;
+    };
+    auto call = std::make_shared<Call>();
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::unique_lock<std::mutex> lock(gShutdownMutex);
+        if (!gShuttingDown) {
+            QMetaObject::invokeMethod(gOwner, [call, func]() {
+                Result result = func();
+                std::lock_guard<std::mutex> lock(gShutdownMutex);
+                call->result = result;
+                call->done = true;
+                gShutdownWake.notify_all();
+            }, Qt::QueuedConnection);
+            gShutdownWake.wait(lock, [&]() { return call->done || gShuttingDown; });
+        }
+    }
+    Py_END_ALLOW_THREADS
+    return call->result;
+}
+
+bool writeCommands(const std::string &commands)
+{
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = gController->sendRaw(commands);
+    Py_END_ALLOW_THREADS
+    return ok;
+}
+
+bool toParam(PyObject *object, std::string &out)
+{
+    if (PyLong_Check(object)) {
+        out = std::to_string(PyLong_AsLong(object));
+        return !PyErr_Occurred();
+    }
+    if (PyUnicode_Check(object)) {
+        PyObject *bytes = PyUnicode_AsUTF8String(object);
+        if (!bytes) return false;
+        out = PyBytes_AsString(bytes);
+        Py_DECREF(bytes);
+        return true;
+    }
+    PyErr_SetString(PyExc_TypeError, "expected int or str");
+    return false;
+}
+
+// 按键参数既可以是HID用法码整数，也可以是按键名称或单个字符（按当前键盘布局），见KeyTable::fromText
+bool keyParam(PyObject *object, std::string &out)
+{
+    int usage = 0;
+    if (PyLong_Check(object)) {
+        usage = static_cast<int>(PyLong_AsLong(object));
+        if (PyErr_Occurred()) return false;
+    } else {
+        std::string text;
+        if (!toParam(object, text)) return false;
+        usage = KeyTable::fromText(text, KeyTable::foregroundLayout());
+    }
+    if (!KeyTable::isValidUsage(usage)) {
+        PyErr_SetString(PyExc_ValueError, "unknown key");
+        return false;
+    }
+    out = std::to_string(usage);
+    return true;
+}
+
+// 文本按当前键盘布局换算成键盘报告
+bool textCommands(const std::string &text, std::string &out)
+{
+    if (!ArduinoController::encodeText(text, KeyTable::foregroundLayout(), out)) {
+        PyErr_SetString(PyExc_ValueError, "text contains characters the keyboard layout cannot type");
+        return false;
+    }
+    return true;
+}
+
+bool toInt(PyObject *object, int &out)
+{
+    out = static_cast<int>(PyLong_AsLong(object));
+    return !PyErr_Occurred();
+}
+
+bool keyList(PyObject *sequence, std::string &out)
+{
+    Py_ssize_t size = PySequence_Size(sequence);
+    if (size < 0) return false;
+    for (Py_ssize_t i = 0; i < size; ++i) {
+        PyObject *item = PySequence_GetItem(sequence, i);
+        std::string key;
+        bool ok = item && keyParam(item, key);
+        Py_XDECREF(item);
+        if (!ok) return false;
+        if (i > 0) out += ",";
+        out += key;
+    }
+    return true;
+}
+
+PyObject *result(bool ok)
+{
+    return PyBool_FromLong(ok ? 1 : 0);
+}
+
+PyObject *pyPressKey(PyObject *, PyObject *args)
+{
+    PyObject *key;
+    std::string param;
+    if (!PyArg_ParseTuple(args, "O", &key) || !keyParam(key, param)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::PRESS_KEY, param)));
+}
+
+PyObject *pyReleaseKey(PyObject *, PyObject *args)
+{
+    PyObject *key;
+    std::string param;
+    if (!PyArg_ParseTuple(args, "O", &key) || !keyParam(key, param)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::RELEASE_KEY, param)));
+}
+
+PyObject *pySendKey(PyObject *, PyObject *args)
+{
+    PyObject *key;
+    unsigned int duration = 100;
+    std::string param;
+    if (!PyArg_ParseTuple(args, "O|I", &key, &duration) || !keyParam(key, param)) return nullptr;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = gController->sendKey(param, duration);
+    Py_END_ALLOW_THREADS
+    return result(ok);
+}
+
+PyObject *pyTypeString(PyObject *, PyObject *args)
+{
+    const char *text;
+    std::string commands;
+    if (!PyArg_ParseTuple(args, "s", &text) || !textCommands(text, commands)) return nullptr;
+    return result(writeCommands(commands));
+}
+
+PyObject *pyCombo(PyObject *, PyObject *args)
+{
+    PyObject *keys;
+    std::string param;
+    if (!PyArg_ParseTuple(args, "O", &keys) || !keyList(keys, param)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::PRESS_COMBINATION, param)));
+}
+
+PyObject *pyDelay(PyObject *, PyObject *args)
+{
+    unsigned int ms;
+    if (!PyArg_ParseTuple(args, "I", &ms)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::DELAY, std::to_string(ms))));
+}
+
+PyObject *pyMouseMove(PyObject *, PyObject *args)
+{
+    int dx, dy;
+    if (!PyArg_ParseTuple(args, "ii", &dx, &dy)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::MOUSE_MOVE, std::to_string(dx) + "," + std::to_string(dy))));
+}
+
+PyObject *pyMousePress(PyObject *, PyObject *args)
+{
+    int button = MOUSE_LEFT;
+    if (!PyArg_ParseTuple(args, "|i", &button)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::MOUSE_PRESS, std::to_string(button))));
+}
+
+PyObject *pyMouseRelease(PyObject *, PyObject *args)
+{
+    int button = MOUSE_LEFT;
+    if (!PyArg_ParseTuple(args, "|i", &button)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::MOUSE_RELEASE, std::to_string(button))));
+}
+
+PyObject *pyMouseClick(PyObject *, PyObject *args)
+{
+    int button = MOUSE_LEFT, count = 1;
+    if (!PyArg_ParseTuple(args, "|ii", &button, &count)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::MOUSE_CLICK, std::to_string(button) + "," + std::to_string(count))));
+}
+
+PyObject *pyMouseWheel(PyObject *, PyObject *args)
+{
+    int delta;
+    if (!PyArg_ParseTuple(args, "i", &delta)) return nullptr;
+    return result(writeCommands(ArduinoController::encode(CommandType::MOUSE_WHEEL, std::to_string(delta))));
+}
+
+// 把一个动作元组编码后追加到out，例如 ("key", 65, 30)、("move", 10, -5)、("delay", 50)
+bool encodeAction(PyObject *action, std::string &out)
+{
+    Py_ssize_t size = PySequence_Size(action);
+    if (size < 1) {
+        PyErr_SetString(PyExc_ValueError, "each action must be a non-empty tuple");
+        return false;
+    }
+
+    PyObject *items[4] = { nullptr, nullptr, nullptr, nullptr };
+    for (Py_ssize_t i = 0; i < size && i < 4; ++i) {
+        items[i] = PySequence_GetItem(action, i);
+    }
+    auto release = [&]() {
+        for (PyObject *item : items) Py_XDECREF(item);
+    };
+
+    std::string name, key, text;
+    int a = 0, b = 0;
+    bool ok = toParam(items[0], name);
+    auto need = [&](Py_ssize_t count) {
+        if (size < count) {
+            PyErr_Format(PyExc_ValueError, "action '%s' needs %d arguments", name.c_str(), static_cast<int>(count - 1));
+            return false;
+        }
+        return true;
+    };
+
+    if (!ok) {
+    } else if (name == "press" || name == "release") {
+        ok = need(2) && keyParam(items[1], key);
+        if (ok) out += ArduinoController::encode(name == "press" ? CommandType::PRESS_KEY : CommandType::RELEASE_KEY, key);
+    } else if (name == "key") {
+        // 按下、设备端等待、释放，整个过程不需要主机参与
+        a = 100;
+        ok = need(2) && keyParam(items[1], key) && (size < 3 || toInt(items[2], a));
+        if (ok) {
+            out += ArduinoController::encode(CommandType::PRESS_KEY, key);
+            out += ArduinoController::encode(CommandType::DELAY, std::to_string(a));
+            out += ArduinoController::encode(CommandType::RELEASE_KEY, key);
+        }
+    } else if (name == "text") {
+        ok = need(2) && toParam(items[1], text) && textCommands(text, out);
+    } else if (name == "combo") {
+        ok = need(2) && keyList(items[1], key);
+        if (ok) out += ArduinoController::encode(CommandType::PRESS_COMBINATION, key);
+    } else if (name == "delay") {
+        ok = need(2) && toInt(items[1], a);
+        if (ok) out += ArduinoController::encode(CommandType::DELAY, std::to_string(a));
+    } else if (name == "move") {
+        ok = need(3) && toInt(items[1], a) && toInt(items[2], b);
+        if (ok) out += ArduinoController::encode(CommandType::MOUSE_MOVE, std::to_string(a) + "," + std::to_string(b));
+    } else if (name == "click") {
+        a = MOUSE_LEFT;
+        b = 1;
+        ok = (size < 2 || toInt(items[1], a)) && (size < 3 || toInt(items[2], b));
+        if (ok) out += ArduinoController::encode(CommandType::MOUSE_CLICK, std::to_string(a) + "," + std::to_string(b));
+    } else if (name == "mouse_press" || name == "mouse_release") {
+        a = MOUSE_LEFT;
+        ok = size < 2 || toInt(items[1], a);
+        if (ok) out += ArduinoController::encode(name == "mouse_press" ? CommandType::MOUSE_PRESS : CommandType::MOUSE_RELEASE, std::to_string(a));
+    } else if (name == "wheel") {
+        ok = need(2) && toInt(items[1], a);
+        if (ok) out += ArduinoController::encode(CommandType::MOUSE_WHEEL, std::to_string(a));
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown action '%s'", name.c_str());
+        ok = false;
+    }
+
+    release();
+    return ok;
+}
+
+// batch(actions): 在持有GIL时一次性编码全部动作，然后释放GIL写一次串口，返回动作个数
+PyObject *pyBatch(PyObject *, PyObject *args)
+{
+    PyObject *actions;
+    if (!PyArg_ParseTuple(args, "O", &actions)) return nullptr;
+
+    Py_ssize_t count = PySequence_Size(actions);
+    if (count < 0) return nullptr;
+
+    std::string commands;
+    commands.reserve(static_cast<size_t>(count) * 8);
+    for (Py_ssize_t i = 0; i < count; ++i) {
+        PyObject *action = PySequence_GetItem(actions, i);
+        bool ok = action && encodeAction(action, commands);
+        Py_XDECREF(action);
+        if (!ok) return nullptr;
+    }
+
+    if (!commands.empty() && !writeCommands(commands)) {
+        PyErr_SetString(PyExc_IOError, "failed to write to Arduino");
+        return nullptr;
+    }
+    return PyLong_FromSsize_t(count);
+}
+
+PyObject *pySleep(PyObject *, PyObject *args)
+{
+    unsigned int ms;
+    if (!PyArg_ParseTuple(args, "I", &ms)) return nullptr;
+    // 关闭时提前醒来，析构函数不必等完整个睡眠
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::unique_lock<std::mutex> lock(gShutdownMutex);
+        gShutdownWake.wait_for(lock, std::chrono::milliseconds(ms), []() { return gShuttingDown; });
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+PyObject *pyStart(PyObject *, PyObject *)
+{
+    callOnOwnerThread<bool>([]() { gHooks.start(); return true; });
+    Py_RETURN_NONE;
+}
+
+PyObject *pyStop(PyObject *, PyObject *)
+{
+    callOnOwnerThread<bool>([]() { gHooks.stop(); return true; });
+    Py_RETURN_NONE;
+}
+
+PyObject *pyIsRunning(PyObject *, PyObject *)
+{
+    return result(callOnOwnerThread<bool>([]() { return gHooks.isRunning(); }));
+}
+
+PyObject *pyWindowInfo(PyObject *, PyObject *)
+{
+    HWND hwnd = callOnOwnerThread<HWND>([]() { return gHooks.targetWindow(); });
+    if (!hwnd || !IsWindow(hwnd)) Py_RETURN_NONE;
+
+    wchar_t title[256] = { 0 };
+    GetWindowTextW(hwnd, title, 256);
+    RECT rect;
+    GetWindowRect(hwnd, &rect);
+    QByteArray utf8Title = QString::fromWCharArray(title).toUtf8();
+
+    return Py_BuildValue("{s:K,s:s,s:(iiii),s:O,s:O}",
+                         "hwnd", static_cast<unsigned long long>(reinterpret_cast<quintptr>(hwnd)),
+                         "title", utf8Title.constData(),
+                         "rect", rect.left, rect.top, rect.right, rect.bottom,
+                         "minimized", IsIconic(hwnd) ? Py_True : Py_False,
+                         "foreground", GetForegroundWindow() == hwnd ? Py_True : Py_False);
+}
+
+PyObject *pyLog(PyObject *, PyObject *args)
+{
+    const char *text;
+    if (!PyArg_ParseTuple(args, "s", &text)) return nullptr;
+    qInfo().noquote() << "[script]" << QString::fromUtf8(text);
+    Py_RETURN_NONE;
+}
+
+PyMethodDef kMethods[] = {
+    { "press_key", pyPressKey, METH_VARARGS, "press_key(key)" },
+    { "release_key", pyReleaseKey, METH_VARARGS, "release_key(key)" },
+    { "send_key", pySendKey, METH_VARARGS, "send_key(key, duration_ms=100)" },
+    { "type_string", pyTypeString, METH_VARARGS, "type_string(text)" },
+    { "combo", pyCombo, METH_VARARGS, "combo([key, ...])" },
+    { "delay", pyDelay, METH_VARARGS, "delay(ms) - executed on the device" },
+    { "mouse_move", pyMouseMove, METH_VARARGS, "mouse_move(dx, dy)" },
+    { "mouse_press", pyMousePress, METH_VARARGS, "mouse_press(button=MOUSE_LEFT)" },
+    { "mouse_release", pyMouseRelease, METH_VARARGS, "mouse_release(button=MOUSE_LEFT)" },
+    { "mouse_click", pyMouseClick, METH_VARARGS, "mouse_click(button=MOUSE_LEFT, count=1)" },
+    { "mouse_wheel", pyMouseWheel, METH_VARARGS, "mouse_wheel(delta)" },
+    { "batch", pyBatch, METH_VARARGS, "batch([(action, args...), ...]) -> count" },
+    { "sleep", pySleep, METH_VARARGS, "sleep(ms) - host side, releases the GIL" },
+    { "start", pyStart, METH_NOARGS, "start the configured key slots" },
+    { "stop", pyStop, METH_NOARGS, "stop the configured key slots" },
+    { "is_running", pyIsRunning, METH_NOARGS, "is_running() -> bool" },
+    { "window_info", pyWindowInfo, METH_NOARGS, "window_info() -> dict or None" },
+    { "log", pyLog, METH_VARARGS, "log(text)" },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+PyModuleDef kModule = {
+    PyModuleDef_HEAD_INIT, "keypresser", "KeyPresserHardware automation API", -1, kMethods,
+    nullptr, nullptr, nullptr, nullptr
+};
+
+PyObject *initModule()
+{
+    PyObject *module = PyModule_Create(&kModule);
+    if (module) {
+        PyModule_AddIntConstant(module, "MOUSE_LEFT", MOUSE_LEFT);
+        PyModule_AddIntConstant(module, "MOUSE_RIGHT", MOUSE_RIGHT);
+        PyModule_AddIntConstant(module, "MOUSE_MIDDLE", MOUSE_MIDDLE);
+    }
+    return module;
+}
+
+// 界面程序没有控制台，print和异常信息转到日志
+const char *kRedirectOutput =
+    "import sys, keypresser\n"
+    "class _Log:\n"
+    "    def write(self, s):\n"
+    "        if s.strip(): keypresser.log(s.rstrip())\n"
+    "    def flush(self): pass\n"
+    "sys.stdout = sys.stderr = _Log()\n";
+
+} // namespace
+
+PythonScripting::PythonScripting(ArduinoController *controller, const Hooks &hooks, QObject *parent)
+    : QObject(parent)
+{
+    gController = controller;
+    gHooks = hooks;
+    gOwner = this;
+    gShuttingDown = false;
+
+    PyImport_AppendInittab("keypresser", &initModule);
+    Py_InitializeEx(0);
+    PyRun_SimpleString(kRedirectOutput);
+    // 释放GIL，脚本线程通过PyGILState_Ensure获取
+    mainThreadState = PyEval_SaveThread();
+}
+
+PythonScripting::~PythonScripting()
+{
+    {
+        std::lock_guard<std::mutex> lock(gShutdownMutex);
+        gShuttingDown = true;
+    }
+    gShutdownWake.notify_all();
+    stop();
+    if (worker.joinable()) worker.join();
+    PyEval_RestoreThread(static_cast<PyThreadState *>(mainThreadState));
+    Py_FinalizeEx();
+    gOwner = nullptr;
+}
+
+bool PythonScripting::runFile(const QString &path)
+{
+    if (running.load()) return false;
+
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) return false;
+    QByteArray source = file.readAll();
+    QByteArray fileName = path.toUtf8();
+
+    if (worker.joinable()) worker.join();
+    running = true;
+    worker = std::thread([this, source, fileName]() {
+        PyGILState_STATE gil = PyGILState_Ensure();
+        scriptThreadId = PyThread_get_thread_ident();
+
+        bool ok = false;
+        PyObject *code = Py_CompileString(source.constData(), fileName.constData(), Py_file_input);
+        if (code) {
+            // 每次运行使用独立的全局命名空间
+            PyObject *globals = PyDict_New();
+            PyObject *name = PyUnicode_FromString("__main__");
+            PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+            PyDict_SetItemString(globals, "__name__", name);
+            PyObject *value = PyEval_EvalCode(code, globals, globals);
+            ok = value != nullptr;
+            Py_XDECREF(value);
+            Py_DECREF(name);
+            Py_DECREF(globals);
+            Py_DECREF(code);
+        }
+        if (!ok) PyErr_Print();
+
+        scriptThreadId = 0;
+        PyGILState_Release(gil);
+        running = false;
+        QMetaObject::invokeMethod(this, [this, ok]() { Q_EMIT finished(ok); }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+void PythonScripting::stop()
+{
+    unsigned long threadId = scriptThreadId.load();
+    if (!running.load() || threadId == 0) return;
+
+    // 在脚本线程中抛出KeyboardInterrupt，脚本下次执行Python代码时生效
+    PyGILState_STATE gil = PyGILState_Ensure();
+    PyThreadState_SetAsyncExc(threadId, PyExc_KeyboardInterrupt);
+    PyGILState_Release(gil);
+}
@@ -0,0 +1,49 @@
+﻿#ifndef PYTHONSCRIPTING_H
+#define PYTHONSCRIPTING_H
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "ArduinoController.hpp"
+
+// 嵌入式Python脚本（可选功能，qmake CONFIG+=python 时编译）。
+// 脚本在独立线程中运行，通过内置模块 keypresser 调用：
+//   press_key/release_key/send_key/type_string/combo/delay
+//   mouse_move/mouse_press/mouse_release/mouse_click/mouse_wheel
+//   batch([...])  一次调用提交任意多个动作，只编码一次、只写一次串口
+//   start()/stop()/is_running()  控制按键调度
+//   window_info()  目标窗口的标题、位置和状态
+//   sleep(ms)/log(text)
+// 所有串口写入和等待期间都会释放GIL。
+class PythonScripting : public QObject {
+    Q_OBJECT
+
+public:
+    // 调度相关的回调都在本对象所在线程（界面线程）中执行
+    struct Hooks {
+        std::function<void()> start;
+        std::function<void()> stop;
+        std::function<bool()> isRunning;
+        std::function<HWND()> targetWindow;
+    };
+
+    PythonScripting(ArduinoController *controller, const Hooks &hooks, QObject *parent = nullptr);
+    ~PythonScripting();
+
+    bool isRunning() const { return running.load(); }
+    bool runFile(const QString &path);
+    void stop();
+
+Q_SIGNALS:
+    void finished(bool ok);
+
+private:
+    std::thread worker;
+    std::atomic<bool> running{ false };
+    std::atomic<unsigned long> scriptThreadId{ 0 };
+    void *mainThreadState = nullptr;
+};
+
+#endif // PYTHONSCRIPTING_H
@@ -0,0 +1,208 @@
+﻿#include "Simulator.h"
+#include "CalendarScheduler.h"
+#include "Timeline.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+namespace {
+
+// 命令只记录不发送；需要等待的调用（如sendKey）改为推进虚拟时钟
+class RecordingTransport : public CommandTransport {
+public:
+    explicit RecordingTransport(VirtualClock &clock) : clock(clock) {}
+
+    bool write(const std::string &data) override {
+        commands += std::count(data.begin(), data.end(), '<');
+        bytes += static_cast<qint64>(data.size());
+        // 看门狗配置和统一释放不属于任何按键
+        if (data.rfind("<11,", 0) == 0 || data.rfind("<12,", 0) == 0) return true;
+        if (pending.isEmpty()) pendingStart = clock.now();
+        pending += QByteArray::fromStdString(data);
+        return true;
+    }
+
+    void wait(unsigned int milliseconds) override { clock.advance(milliseconds); }
+
+    VirtualClock &clock;
+    QByteArray pending;
+    qint64 pendingStart = 0;
+    qint64 commands = 0;
+    qint64 bytes = 0;
+};
+
+// 定时任务规则在模拟时段内的运行区间（相对开始的毫秒数，已排序合并）
+QVector<QPair<qint64, qint64>> activeRanges(const QString &rules, const QDateTime &start, qint64 durationMs)
+{
+    QVector<QPair<qint64, qint64>> ranges;
+    QVector<TimeWindow> windows = TimeWindow::parseList(rules);
+    if (windows.isEmpty()) {
+        ranges.append(qMakePair(qint64(0), durationMs));
+        return ranges;
+    }
+
+    QDateTime end = start.addMSecs(durationMs);
+    QVector<QPair<QDateTime, QDateTime>> occurrences;
+    for (const TimeWindow &window : windows) window.occurrences(start, end, occurrences);
+    std::sort(occurrences.begin(), occurrences.end());
+    for (const auto &occurrence : occurrences) {
+        qint64 from = qMax(qint64(0), start.msecsTo(occurrence.first));
+        qint64 to = qMin(durationMs, start.msecsTo(occurrence.second));
+        if (to <= from) continue;
+        if (!ranges.isEmpty() && from <= ranges.last().second) {
+            ranges.last().second = qMax(ranges.last().second, to);
+        } else {
+            ranges.append(qMakePair(from, to));
+        }
+    }
+    return ranges;
+}
+
+} // namespace
+
+SimulationResult ProfileSimulator::run(const SlotProfile &profile, qint64 durationMs, const QDateTime &start, int maxEvents)
+{
+    SimulationResult result;
+    result.durationMs = durationMs;
+
+    VirtualClock clock;
+    RecordingTransport transport(clock);
+    ArduinoController controller;
+    controller.setTransport(&transport);
+    Metrics::Registry registry;  // 不计入全局运行指标
+    PressScheduler scheduler(&controller, nullptr, &registry);
+    scheduler.setClock(&clock);
+
+    const int slotCount = static_cast<int>(profile.slotConfigs.size());
+    scheduler.setSlotCount(slotCount);
+    scheduler.setMode(profile.mode);
+    scheduler.setSeed(profile.seed);
+    scheduler.setHoldTime(profile.holdTime);
+    for (int i = 0; i < slotCount; ++i) scheduler.setSlot(i, profile.slotConfigs[i]);
+    Timeline timeline = Timeline::parse(profile.timeline);
+    scheduler.setTimeline(CompiledTimeline::compile(timeline));
+
+    for (int i = 0; i < slotCount; ++i) {
+        SimulationSource source;
+        source.name = i == SlotProfile::kSpaceSlot ? QStringLiteral("空格") : QStringLiteral("按键%1").arg(SlotProfile::keyOfSlot(i) + 1);
+        result.sources.append(source);
+    }
+    for (const TimelineTrack &track : timeline.tracks) {
+        if (track.steps.empty()) continue;
+        SimulationSource source;
+        source.name = QStringLiteral("轨道 %1").arg(track.name.isEmpty() ? QString::number(result.sources.size() - slotCount + 1) : track.name);
+        result.sources.append(source);
+    }
+
+    QVector<int> lastEvent(result.sources.size(), -1);  // 各来源最近一次按下在events中的下标
+    auto record = [&](int sourceIndex, int holdMs) {
+        qint64 startMs = transport.pending.isEmpty() ? clock.now() : transport.pendingStart;
+        qint64 endMs = qMax(clock.now(), startMs + holdMs);
+
+        for (int i = 0; i < result.sources.size(); ++i) {
+            if (i == sourceIndex) continue;
+            const SimulationSource &other = result.sources[i];
+            if (other.lastEnd > startMs) ++result.overlaps;
+            if (other.lastStart == startMs) ++result.collisions;
+        }
+
+        SimulationSource &source = result.sources[sourceIndex];
+        if (source.lastStart >= 0) {
+            qint64 interval = startMs - source.lastStart;
+            ++source.intervals;
+            source.intervalSum += interval;
+            source.minInterval = source.minInterval < 0 ? interval : qMin(source.minInterval, interval);
+            source.maxInterval = qMax(source.maxInterval, interval);
+        }
+        ++source.presses;
+        source.lastStart = startMs;
+        source.lastEnd = endMs;
+
+        lastEvent[sourceIndex] = -1;
+        if (result.events.size() < maxEvents) {
+            lastEvent[sourceIndex] = result.events.size();
+            result.events.append({ startMs, endMs, sourceIndex, transport.pending });
+        } else if (maxEvents > 0) {
+            result.truncated = true;
+        }
+        transport.pending.clear();
+    };
+    QObject::connect(&scheduler, &PressScheduler::slotPressed, [&](int index) {
+        record(index, scheduler.holdTime());
+    });
+    QObject::connect(&scheduler, &PressScheduler::trackStepped, [&](int track, int step) {
+        const CompiledTimeline &compiled = *scheduler.currentTimeline();
+        int hold = compiled.steps[compiled.tracks[track].begin + step].holdMs;
+        record(slotCount + track, hold ? hold : scheduler.holdTime());
+    });
+    // 按键由调度器到期释放：松开的报告和实际松开时间记到对应的按下上
+    auto released = [&](int sourceIndex) {
+        result.sources[sourceIndex].lastEnd = clock.now();
+        if (lastEvent[sourceIndex] >= 0) {
+            SimulationEvent &event = result.events[lastEvent[sourceIndex]];
+            event.endMs = clock.now();
+            event.commands += transport.pending;
+        }
+        transport.pending.clear();
+    };
+    QObject::connect(&scheduler, &PressScheduler::slotReleased, [&](int index) { released(index); });
+    QObject::connect(&scheduler, &PressScheduler::trackReleased, [&](int track) { released(slotCount + track); });
+
+    for (const auto &range : activeRanges(profile.timerRules, start, durationMs)) {
+        clock.set(qMax(clock.now(), range.first));
+        qint64 begin = clock.now();
+        // 每个运行区间重新开始计算间隔，不把两段之间停止的时间算进去
+        for (SimulationSource &source : result.sources) source.lastStart = -1;
+        scheduler.start();
+        for (qint64 wake = scheduler.nextWakeTime(); wake >= 0 && wake < range.second; wake = scheduler.nextWakeTime()) {
+            clock.set(qMax(clock.now(), wake));
+            scheduler.runDue();
+        }
+        clock.set(qMax(clock.now(), range.second));
+        scheduler.stop();
+        result.activeMs += clock.now() - begin;
+    }
+
+    result.commands = transport.commands;
+    result.bytes = transport.bytes;
+    return result;
+}
+
+QString SimulationResult::summary() const
+{
+    QStringList lines;
+    lines << QStringLiteral("模拟 %1 小时，实际运行 %2 小时，命令 %3 条（%4 KB）")
+                 .arg(durationMs / 3600000.0, 0, 'f', 1)
+                 .arg(activeMs / 3600000.0, 0, 'f', 1)
+                 .arg(commands)
+                 .arg(bytes / 1024.0, 0, 'f', 1);
+    double minutes = qMax(activeMs, qint64(1)) / 60000.0;
+    for (const SimulationSource &source : sources) {
+        if (source.presses == 0) continue;
+        lines << QStringLiteral("%1  %2 次  %3 次/分  间隔 平均%4 最短%5 最长%6 ms")
+                     .arg(source.name, -8)
+                     .arg(source.presses)
+                     .arg(source.presses / minutes, 0, 'f', 2)
+                     .arg(source.intervals > 0 ? source.intervalSum / source.intervals : 0)
+                     .arg(qMax(source.minInterval, qint64(0)))
+                     .arg(source.maxInterval);
+    }
+    lines << QStringLiteral("按住重叠 %1 次，同一毫秒冲突 %2 次").arg(overlaps).arg(collisions);
+    if (truncated) lines << QStringLiteral("时间线只保留了前 %1 条事件").arg(events.size());
+    return lines.join('\n');
+}
+
+bool SimulationResult::writeTimeline(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly | QFile::Text | QFile::Truncate)) return false;
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    out << "start_ms,end_ms,source,commands\n";
+    for (const SimulationEvent &event : events) {
+        // 命令本身含逗号，整列加引号
+        out << event.startMs << ',' << event.endMs << ",\"" << sources[event.source].name << "\",\""
+            << QString::fromLatin1(event.commands) << "\"\n";
+    }
+    return out.status() == QTextStream::Ok;
+}
@@ -0,0 +1,54 @@
+﻿#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+#include <QVector>
+#include "SlotProfile.h"
+
+// 模拟运行：用虚拟时钟和记录命令的传输层驱动一个独立的调度器，
+// 不连接设备、不等待真实时间，几小时的运行在毫秒级完成，用于调整配置和回归验证。
+// 覆盖间隔生成、独立/顺序模式、时间轴和定时任务规则；目标窗口检查不参与模拟。
+struct SimulationEvent {
+    qint64 startMs;     // 相对模拟开始
+    qint64 endMs;       // 按键松开的时间
+    int source;         // 调度器槽位（SlotProfile::kSpaceSlot为空格），从schedulerSlotCount(keyCount)起为时间轴轨道
+    QByteArray commands;
+};
+
+struct SimulationSource {
+    QString name;
+    int presses = 0;
+    int intervals = 0;        // 同一运行区间内相邻两次按下的间隔个数
+    qint64 intervalSum = 0;
+    qint64 minInterval = -1;
+    qint64 maxInterval = 0;
+    qint64 lastStart = -1;
+    qint64 lastEnd = -1;
+};
+
+struct SimulationResult {
+    qint64 durationMs = 0;
+    qint64 activeMs = 0;      // 定时任务窗口内实际运行的时间
+    qint64 commands = 0;      // 发送的命令条数（含心跳配置和释放）
+    qint64 bytes = 0;
+    int overlaps = 0;         // 按下时其他来源的按键尚未松开
+    int collisions = 0;       // 与其他来源在同一毫秒按下
+    QVector<SimulationSource> sources;
+    QVector<SimulationEvent> events;
+    bool truncated = false;   // 事件超过上限，只保留了前面的部分（统计仍是完整的）
+
+    QString summary() const;
+    // CSV：start_ms,end_ms,source,commands
+    bool writeTimeline(const QString &path) const;
+};
+
+class ProfileSimulator {
+public:
+    // start为模拟开始的墙上时间，只用于展开定时任务规则；maxEvents为0时不保留时间线，只做统计
+    static SimulationResult run(const SlotProfile &profile, qint64 durationMs,
+                                const QDateTime &start = QDateTime::currentDateTime(), int maxEvents = 100000);
+};
+
+#endif // SIMULATOR_H
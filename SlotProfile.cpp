@@ -0,0 +1,171 @@
+﻿#include "SlotProfile.h"
+#include <QFile>
+#include <QDebug>
+
+namespace {
+
+// 按键码在编译期由KeyTable按名称查出，名称写错时编译失败
+constexpr uint8_t kShift = KeyTable::usage("LeftShift");
+constexpr uint8_t kCtrl = KeyTable::usage("LeftCtrl");
+constexpr uint8_t kAlt = KeyTable::usage("LeftAlt");
+constexpr uint8_t kWin = KeyTable::usage("LeftWin");
+
+constexpr KeyEntry key(const char *name, const char *tableName = nullptr)
+{
+    return { name, KeyTable::usage(tableName ? tableName : name) };
+}
+
+}
+
+// 条目顺序即配置文件中保存的下拉框索引，只能在末尾追加
+constexpr ShortcutEntry kShortcutEntries[] = {
+    // 单个修饰键
+    { "", { 0, 0 }, 0 },
+    { "Shift", { kShift, 0 }, 1 },
+    { "Ctrl", { kCtrl, 0 }, 1 },
+    { "Alt", { kAlt, 0 }, 1 },
+    { "Win", { kWin, 0 }, 1 },
+    // 常见的两键组合
+    { "Shift+Ctrl", { kShift, kCtrl }, 2 },
+    { "Shift+Alt", { kShift, kAlt }, 2 },
+    { "Ctrl+Alt", { kCtrl, kAlt }, 2 },
+    { "Ctrl+Win", { kCtrl, kWin }, 2 },
+    { "Alt+Win", { kAlt, kWin }, 2 },
+    { "Shift+Win", { kShift, kWin }, 2 },
+};
+constexpr int kShortcutEntryCount = sizeof(kShortcutEntries) / sizeof(kShortcutEntries[0]);
+
+constexpr KeyEntry kKeyEntries[] = {
+    key("F1"), key("F2"), key("F3"), key("F4"), key("F5"), key("F6"),
+    key("F7"), key("F8"), key("F9"), key("F10"), key("F11"), key("F12"),
+    key("A"), key("B"), key("C"), key("D"), key("E"), key("F"), key("G"), key("H"), key("I"),
+    key("J"), key("K"), key("L"), key("M"), key("N"), key("O"), key("P"), key("Q"), key("R"),
+    key("S"), key("T"), key("U"), key("V"), key("W"), key("X"), key("Y"), key("Z"),
+    key("0"), key("1"), key("2"), key("3"), key("4"), key("5"), key("6"), key("7"), key("8"), key("9"),
+    key("Shift", "LeftShift"),
+    key("Space"),
+    key("Enter"),
+    key("Tab"),
+    key("Esc"),
+    key("Backspace"),
+    key("Insert"),
+    key("Delete"),
+    key("Home"),
+    key("End"),
+    key("Page Up"),
+    key("Page Down"),
+    key("Left Arrow", "Left"),
+    key("Right Arrow", "Right"),
+    key("Up Arrow", "Up"),
+    key("Down Arrow", "Down"),
+};
+constexpr int kKeyEntryCount = sizeof(kKeyEntries) / sizeof(kKeyEntries[0]);
+
+constexpr bool allKeysKnown()
+{
+    for (const KeyEntry &entry : kKeyEntries) {
+        if (entry.code == 0) return false;
+    }
+    return true;
+}
+static_assert(allKeysKnown(), "kKeyEntries中有KeyTable没有的按键名称");
+
+SlotConfig SlotProfile::keySlot(bool enabled, int shortcutIndex, int keyIndex, int minInterval, int maxInterval)
+{
+    SlotConfig config;
+    config.enabled = enabled && keyIndex >= 0 && keyIndex < kKeyEntryCount;
+    if (shortcutIndex >= 0 && shortcutIndex < kShortcutEntryCount) {
+        const ShortcutEntry &shortcut = kShortcutEntries[shortcutIndex];
+        for (int i = 0; i < shortcut.count; ++i) {
+            config.keys.push_back(std::to_string(shortcut.codes[i]));
+        }
+    }
+    if (keyIndex >= 0 && keyIndex < kKeyEntryCount) {
+        config.keys.push_back(std::to_string(kKeyEntries[keyIndex].code));
+    }
+    config.minInterval = minInterval;
+    config.maxInterval = maxInterval;
+    return config;
+}
+
+SlotConfig SlotProfile::spaceSlot(bool enabled, int minInterval, int maxInterval)
+{
+    SlotConfig config;
+    config.enabled = enabled;
+    config.keys.push_back(std::to_string(KeyTable::usage("Space")));
+    config.minInterval = minInterval;
+    config.maxInterval = maxInterval;
+    config.sequential = false;
+    return config;
+}
+
+SlotProfile SlotProfile::fromSettings(QSettings &settings)
+{
+    SlotProfile profile;
+    profile.mode = settings.value("triggerMode", "independent").toString() == "sequential"
+                       ? PressScheduler::Sequential : PressScheduler::Independent;
+    profile.topmost = settings.value("topmostCheckBox", false).toBool();
+    profile.timerRules = settings.value("timerRules").toString();
+    profile.timeline = settings.value("timeline").toString();
+    profile.pixelRules = settings.value("pixelTriggers").toString();
+
+    profile.keySlotCount = qBound(0, settings.value("keySlotCount", kDefaultKeySlotCount).toInt(), kMaxKeySlotCount);
+    profile.slotConfigs.resize(schedulerSlotCount(profile.keySlotCount));
+    for (int i = 0; i < profile.keySlotCount; ++i) {
+        profile.slotConfigs[schedulerSlot(i)] = keySlot(
+            settings.value(QString("keyCheckBox%1").arg(i), false).toBool(),
+            settings.value(QString("shortcutCombo%1").arg(i), 0).toInt(),
+            settings.value(QString("keyCombo%1").arg(i), defaultKeyIndex(i)).toInt(),
+            settings.value(QString("intervalLineEdit%1").arg(i), "1000").toInt(),
+            settings.value(QString("maxIntervalLineEdit%1").arg(i), "1000").toInt());
+    }
+    profile.slotConfigs[kSpaceSlot] = spaceSlot(
+        settings.value("spaceCheckBox", false).toBool(),
+        settings.value("spaceIntervalLineEdit", "1000").toInt(),
+        settings.value("spaceMaxIntervalLineEdit", "1000").toInt());
+    applyDistributions(settings, profile.slotConfigs, &profile.error);
+    profile.seed = settings.value("randomSeed", 0).toULongLong();
+    profile.holdTime = settings.value("holdTime", 100).toInt();
+    profile.leadTime = settings.value("leadTime", 0).toInt();
+    return profile;
+}
+
+bool SlotProfile::applyDistributions(QSettings &settings, std::vector<SlotConfig> &configs, QString *error)
+{
+    QString global = settings.value("intervalDistribution", "uniform").toString();
+    std::shared_ptr<const IntervalDistribution::EmpiricalTable> table;
+    QString samplesPath = settings.value("empiricalIntervals").toString();
+    if (!samplesPath.isEmpty()) {
+        table = loadEmpirical(samplesPath);
+    }
+
+    for (int i = 0; i < static_cast<int>(configs.size()); ++i) {
+        // 空格槽位的单独设置保存在 intervalDistribution15
+        QString name = settings.value(QString("intervalDistribution%1").arg(i), global).toString();
+        configs[i].distribution = IntervalDistribution::fromName(name.toStdString());
+        configs[i].empirical = configs[i].distribution == IntervalDistribution::Empirical ? table : nullptr;
+        // 没有样本时IntervalStream会退回均匀分布，这里报告出来，不让配置悄悄变样
+        if (configs[i].distribution == IntervalDistribution::Empirical && !table) {
+            if (error) {
+                *error = samplesPath.isEmpty() ? QStringLiteral("empirical interval distribution without empiricalIntervals")
+                                               : QStringLiteral("cannot load interval samples: %1").arg(samplesPath);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const IntervalDistribution::EmpiricalTable> SlotProfile::loadEmpirical(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        qWarning() << "Failed to open interval samples" << path;
+        return nullptr;
+    }
+    auto table = IntervalDistribution::EmpiricalTable::fromText(file.readAll().toStdString());
+    if (!table) {
+        qWarning() << "Not enough interval samples in" << path;
+    }
+    return table;
+}
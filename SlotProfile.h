@@ -0,0 +1,66 @@
+﻿#ifndef SLOTPROFILE_H
+#define SLOTPROFILE_H
+
+#include <QSettings>
+#include <QString>
+#include <vector>
+#include "PressScheduler.h"
+#include "KeyTable.hpp"
+
+// 按键下拉框条目：显示名称 + 发送给Arduino的HID用法码（见KeyTable.hpp）
+struct KeyEntry {
+    const char *name;
+    int code;
+};
+
+// 修饰键下拉框条目：最多两个修饰键（HID用法码0xE0~0xE7）
+struct ShortcutEntry {
+    const char *name;
+    int codes[2];
+    int count;
+};
+
+extern const KeyEntry kKeyEntries[];
+extern const int kKeyEntryCount;
+extern const ShortcutEntry kShortcutEntries[];
+extern const int kShortcutEntryCount;
+
+// 不依赖界面控件读取配置文件（.kphset 或注册表中的设置），无界面模式直接使用
+struct SlotProfile {
+    static constexpr int kDefaultKeySlotCount = 15;
+    static constexpr int kMaxKeySlotCount = 1000;
+    static constexpr int kSpaceSlot = kDefaultKeySlotCount;  // 调度器中空格键所在的槽位
+
+    // 自定义按键在调度器中的槽位：前15个为0~14，空格为15，第16个起从16开始，
+    // 这样旧配置、指标和规则中的槽位编号保持不变
+    static int schedulerSlot(int key) { return key < kSpaceSlot ? key : key + 1; }
+    // 调度器槽位对应的自定义按键序号，空格为-1
+    static int keyOfSlot(int slot) { return slot < kSpaceSlot ? slot : (slot == kSpaceSlot ? -1 : slot - 1); }
+    // keyCount个自定义按键时调度器需要的槽位数（不足15个时空位保持未启用）
+    static int schedulerSlotCount(int keyCount) { return (keyCount > kDefaultKeySlotCount ? keyCount : kDefaultKeySlotCount) + 1; }
+    // 默认按键：前12个为F1-F12，后3个为ABC，恰好等于按键下拉框的索引，之后循环
+    static int defaultKeyIndex(int key) { return key % kKeyEntryCount; }
+
+    PressScheduler::Mode mode = PressScheduler::Independent;
+    int keySlotCount = kDefaultKeySlotCount;
+    std::vector<SlotConfig> slotConfigs;  // 按调度器槽位排列，见schedulerSlot
+    bool topmost = false;
+    QString timerRules;
+    QString timeline;  // 时间轴文本，格式见Timeline.h
+    QString pixelRules;  // 像素条件规则，格式见PixelTrigger.h
+    quint64 seed = 0;  // randomSeed，0表示每次运行的间隔都不同
+    int holdTime = 100;  // 按键按住时长（毫秒）
+    int leadTime = 0;  // 提前发送的毫秒数，0为即时发送，见PressScheduler::setLeadTime
+    QString error;  // 非空时配置不能按原样运行（如录制样本文件缺失），调用方应报告而不是启动
+
+    static SlotProfile fromSettings(QSettings &settings);
+    // 按 intervalDistribution / intervalDistribution%1 / empiricalIntervals 设置各槽位的间隔分布。
+    // 有槽位使用录制样本但样本文件无法读取时返回false并写入error
+    static bool applyDistributions(QSettings &settings, std::vector<SlotConfig> &configs, QString *error = nullptr);
+    // 读取录制的间隔样本文件（每行一个间隔），失败时返回空
+    static std::shared_ptr<const IntervalDistribution::EmpiricalTable> loadEmpirical(const QString &path);
+    static SlotConfig keySlot(bool enabled, int shortcutIndex, int keyIndex, int minInterval, int maxInterval);
+    static SlotConfig spaceSlot(bool enabled, int minInterval, int maxInterval);
+};
+
+#endif // SLOTPROFILE_H
@@ -0,0 +1,242 @@
+﻿#include "SlotTableModel.h"
+#include "SlotProfile.h"
+#include <QComboBox>
+#include <QIntValidator>
+#include <QLineEdit>
+
+SlotTableModel::SlotTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+SlotTableModel::Row SlotTableModel::defaultRow(int index)
+{
+    Row values;
+    values.keyIndex = SlotProfile::defaultKeyIndex(index);
+    return values;
+}
+
+int SlotTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(checked.size());
+}
+
+int SlotTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant SlotTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount()) return QVariant();
+    const int r = index.row();
+
+    if (index.column() == EnabledColumn) {
+        return role == Qt::CheckStateRole ? QVariant(checked[r] ? Qt::Checked : Qt::Unchecked) : QVariant();
+    }
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case ShortcutColumn: {
+            int i = shortcutIndex[r];
+            return (i >= 0 && i < kShortcutEntryCount) ? QString(kShortcutEntries[i].name) : QString();
+        }
+        case KeyColumn: {
+            int i = keyIndex[r];
+            return (i >= 0 && i < kKeyEntryCount) ? QString(kKeyEntries[i].name) : QString();
+        }
+        case MinIntervalColumn: return minInterval[r];
+        case MaxIntervalColumn: return maxInterval[r];
+        }
+    } else if (role == Qt::EditRole) {
+        switch (index.column()) {
+        case ShortcutColumn: return shortcutIndex[r];
+        case KeyColumn: return keyIndex[r];
+        case MinIntervalColumn: return minInterval[r];
+        case MaxIntervalColumn: return maxInterval[r];
+        }
+    } else if (role == Qt::TextAlignmentRole && index.column() >= MinIntervalColumn) {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    return QVariant();
+}
+
+bool SlotTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || index.row() >= rowCount()) return false;
+    const int r = index.row();
+
+    if (index.column() == EnabledColumn) {
+        if (role != Qt::CheckStateRole) return false;
+        checked[r] = value.toInt() == Qt::Checked;
+    } else {
+        if (role != Qt::EditRole) return false;
+        switch (index.column()) {
+        case ShortcutColumn: shortcutIndex[r] = static_cast<int16_t>(value.toInt()); break;
+        case KeyColumn: keyIndex[r] = static_cast<int16_t>(value.toInt()); break;
+        case MinIntervalColumn: minInterval[r] = value.toInt(); break;
+        case MaxIntervalColumn: maxInterval[r] = value.toInt(); break;
+        }
+    }
+    Q_EMIT dataChanged(index, index);
+    Q_EMIT slotEdited(r);
+    return true;
+}
+
+Qt::ItemFlags SlotTableModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) return Qt::NoItemFlags;
+    if (index.column() == EnabledColumn) return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable;
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsEditable;
+}
+
+QVariant SlotTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole) return QVariant();
+    if (orientation == Qt::Vertical) return section + 1;
+    switch (section) {
+    case EnabledColumn: return QString();
+    case ShortcutColumn: return QStringLiteral("修饰键");
+    case KeyColumn: return QStringLiteral("按键");
+    case MinIntervalColumn: return QStringLiteral("最小值");
+    case MaxIntervalColumn: return QStringLiteral("最大值");
+    }
+    return QVariant();
+}
+
+bool SlotTableModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || row > rowCount() || count <= 0
+        || rowCount() + count > SlotProfile::kMaxKeySlotCount) {
+        return false;
+    }
+    beginInsertRows(QModelIndex(), row, row + count - 1);
+    checked.insert(checked.begin() + row, count, 0);
+    shortcutIndex.insert(shortcutIndex.begin() + row, count, 0);
+    keyIndex.insert(keyIndex.begin() + row, count, 0);
+    minInterval.insert(minInterval.begin() + row, count, 1000);
+    maxInterval.insert(maxInterval.begin() + row, count, 1000);
+    for (int i = row; i < row + count; ++i) {
+        keyIndex[i] = static_cast<int16_t>(defaultRow(i).keyIndex);
+    }
+    endInsertRows();
+    Q_EMIT slotsChanged();
+    return true;
+}
+
+bool SlotTableModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > rowCount()) return false;
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    checked.erase(checked.begin() + row, checked.begin() + row + count);
+    shortcutIndex.erase(shortcutIndex.begin() + row, shortcutIndex.begin() + row + count);
+    keyIndex.erase(keyIndex.begin() + row, keyIndex.begin() + row + count);
+    minInterval.erase(minInterval.begin() + row, minInterval.begin() + row + count);
+    maxInterval.erase(maxInterval.begin() + row, maxInterval.begin() + row + count);
+    endRemoveRows();
+    Q_EMIT slotsChanged();
+    return true;
+}
+
+SlotTableModel::Row SlotTableModel::row(int index) const
+{
+    Row values;
+    values.checked = checked[index] != 0;
+    values.shortcutIndex = shortcutIndex[index];
+    values.keyIndex = keyIndex[index];
+    values.minInterval = minInterval[index];
+    values.maxInterval = maxInterval[index];
+    return values;
+}
+
+void SlotTableModel::setRow(int index, const Row &values)
+{
+    checked[index] = values.checked;
+    shortcutIndex[index] = static_cast<int16_t>(values.shortcutIndex);
+    keyIndex[index] = static_cast<int16_t>(values.keyIndex);
+    minInterval[index] = values.minInterval;
+    maxInterval[index] = values.maxInterval;
+    Q_EMIT dataChanged(this->index(index, 0), this->index(index, ColumnCount - 1));
+    Q_EMIT slotEdited(index);
+}
+
+void SlotTableModel::setRows(const std::vector<Row> &rows)
+{
+    beginResetModel();
+    const size_t count = qMin(rows.size(), static_cast<size_t>(SlotProfile::kMaxKeySlotCount));
+    checked.resize(count);
+    shortcutIndex.resize(count);
+    keyIndex.resize(count);
+    minInterval.resize(count);
+    maxInterval.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        checked[i] = rows[i].checked;
+        shortcutIndex[i] = static_cast<int16_t>(rows[i].shortcutIndex);
+        keyIndex[i] = static_cast<int16_t>(rows[i].keyIndex);
+        minInterval[i] = rows[i].minInterval;
+        maxInterval[i] = rows[i].maxInterval;
+    }
+    endResetModel();
+    Q_EMIT slotsChanged();
+}
+
+SlotItemDelegate::SlotItemDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+    shortcutItems = new QStandardItemModel(this);
+    for (int i = 0; i < kShortcutEntryCount; ++i) {
+        shortcutItems->appendRow(new QStandardItem(kShortcutEntries[i].name));
+    }
+    keyItems = new QStandardItemModel(this);
+    for (int i = 0; i < kKeyEntryCount; ++i) {
+        keyItems->appendRow(new QStandardItem(kKeyEntries[i].name));
+    }
+}
+
+QWidget *SlotItemDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    switch (index.column()) {
+    case SlotTableModel::ShortcutColumn:
+    case SlotTableModel::KeyColumn: {
+        QComboBox *combo = new QComboBox(parent);
+        combo->setModel(index.column() == SlotTableModel::ShortcutColumn ? shortcutItems : keyItems);
+        // 选中即提交，不必再点别处
+        connect(combo, QOverload<int>::of(&QComboBox::activated), this, [this, combo]() {
+            SlotItemDelegate *self = const_cast<SlotItemDelegate *>(this);
+            Q_EMIT self->commitData(combo);
+            Q_EMIT self->closeEditor(combo);
+        });
+        return combo;
+    }
+    case SlotTableModel::MinIntervalColumn:
+    case SlotTableModel::MaxIntervalColumn: {
+        QLineEdit *edit = new QLineEdit(parent);
+        edit->setValidator(new QIntValidator(0, 86400000, edit));
+        return edit;
+    }
+    }
+    return QStyledItemDelegate::createEditor(parent, option, index);
+}
+
+void SlotItemDelegate::setEditorData(QWidget *editor, const QModelIndex &index) const
+{
+    if (QComboBox *combo = qobject_cast<QComboBox *>(editor)) {
+        combo->setCurrentIndex(index.data(Qt::EditRole).toInt());
+    } else if (QLineEdit *edit = qobject_cast<QLineEdit *>(editor)) {
+        edit->setText(index.data(Qt::EditRole).toString());
+        edit->selectAll();
+    } else {
+        QStyledItemDelegate::setEditorData(editor, index);
+    }
+}
+
+void SlotItemDelegate::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const
+{
+    if (QComboBox *combo = qobject_cast<QComboBox *>(editor)) {
+        if (combo->currentIndex() != index.data(Qt::EditRole).toInt()) model->setData(index, combo->currentIndex());
+    } else if (QLineEdit *edit = qobject_cast<QLineEdit *>(editor)) {
+        int value = edit->text().toInt();
+        if (value != index.data(Qt::EditRole).toInt()) model->setData(index, value);
+    } else {
+        QStyledItemDelegate::setModelData(editor, model, index);
+    }
+}
@@ -0,0 +1,74 @@
+﻿#ifndef SLOTTABLEMODEL_H
+#define SLOTTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QStyledItemDelegate>
+#include <QStandardItemModel>
+#include <vector>
+
+// 自定义按键表的数据模型，行数不限。每一列单独保存在一个数组中（结构数组），
+// 一行只占十几个字节；界面通过QTableView显示，编辑控件只在编辑某个单元格时由SlotItemDelegate创建，
+// 按键再多，控件数量也不变。
+class SlotTableModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column { EnabledColumn, ShortcutColumn, KeyColumn, MinIntervalColumn, MaxIntervalColumn, ColumnCount };
+
+    struct Row {
+        bool checked = false;
+        int shortcutIndex = 0;  // kShortcutEntries的索引
+        int keyIndex = 0;       // kKeyEntries的索引
+        int minInterval = 1000;
+        int maxInterval = 1000;
+    };
+
+    explicit SlotTableModel(QObject *parent = nullptr);
+
+    // 第index个按键的默认取值
+    static Row defaultRow(int index);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    // 插入的行取默认值
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+
+    Row row(int index) const;
+    void setRow(int index, const Row &values);
+    // 整体替换（加载配置），只通知一次
+    void setRows(const std::vector<Row> &rows);
+
+signals:
+    void slotEdited(int row);  // 单个按键被修改
+    void slotsChanged();       // 行数变化或整体替换，之后各行的按键序号可能都变了
+
+private:
+    std::vector<uint8_t> checked;
+    std::vector<int16_t> shortcutIndex;
+    std::vector<int16_t> keyIndex;
+    std::vector<int> minInterval;
+    std::vector<int> maxInterval;
+};
+
+// 按键表的编辑控件：修饰键和按键为下拉框（所有编辑器共用同一份条目），间隔为只接受整数的输入框
+class SlotItemDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+
+public:
+    explicit SlotItemDelegate(QObject *parent = nullptr);
+
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    void setEditorData(QWidget *editor, const QModelIndex &index) const override;
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const override;
+
+private:
+    QStandardItemModel *shortcutItems;
+    QStandardItemModel *keyItems;
+};
+
+#endif // SLOTTABLEMODEL_H
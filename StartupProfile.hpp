@@ -0,0 +1,89 @@
+#ifndef STARTUPPROFILE_HPP
+#define STARTUPPROFILE_HPP
+
+#include <QElapsedTimer>
+#include <QDebug>
+#include <vector>
+#include <windows.h>
+
+// Startup phase timing, enabled with --startup-profile.
+// mark() records the time since main() entered; report() prints every phase
+// with its delta, plus the time the process spent before main() (loader, DLLs,
+// static initializers). Marks taken after report() are printed immediately.
+class StartupProfile {
+public:
+    static void enable() {
+        StartupProfile& p = instance();
+        p.enabled = true;
+        p.timer.start();
+        p.preMainMs = millisecondsSinceProcessStart();
+    }
+
+    static bool isEnabled() {
+        return instance().enabled;
+    }
+
+    static void mark(const char* phase) {
+        StartupProfile& p = instance();
+        if (!p.enabled) {
+            return;
+        }
+        qint64 ns = p.timer.nsecsElapsed();
+        if (p.reported) {
+            qInfo().noquote() << QString("[startup] %1 +%2 ms").arg(phase).arg(ns / 1e6, 0, 'f', 1);
+            return;
+        }
+        p.phases.push_back({ phase, ns });
+    }
+
+    static void report() {
+        StartupProfile& p = instance();
+        if (!p.enabled || p.reported) {
+            return;
+        }
+        p.reported = true;
+        qInfo().noquote() << QString("[startup] before main: %1 ms").arg(p.preMainMs, 0, 'f', 1);
+        qint64 previous = 0;
+        for (const Phase& phase : p.phases) {
+            qInfo().noquote() << QString("[startup] %1: %2 ms (at %3 ms)")
+                                     .arg(phase.name, -24)
+                                     .arg((phase.ns - previous) / 1e6, 0, 'f', 1)
+                                     .arg(phase.ns / 1e6, 0, 'f', 1);
+            previous = phase.ns;
+        }
+        qInfo().noquote() << QString("[startup] total: %1 ms").arg(p.preMainMs + previous / 1e6, 0, 'f', 1);
+    }
+
+private:
+    struct Phase {
+        const char* name;
+        qint64 ns;
+    };
+
+    static StartupProfile& instance() {
+        static StartupProfile profile;
+        return profile;
+    }
+
+    static double millisecondsSinceProcessStart() {
+        FILETIME creation, exitTime, kernel, user, now;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) {
+            return 0.0;
+        }
+        GetSystemTimePreciseAsFileTime(&now);
+        ULARGE_INTEGER start, current;
+        start.LowPart = creation.dwLowDateTime;
+        start.HighPart = creation.dwHighDateTime;
+        current.LowPart = now.dwLowDateTime;
+        current.HighPart = now.dwHighDateTime;
+        return (current.QuadPart - start.QuadPart) / 10000.0;  // 100 ns units
+    }
+
+    bool enabled = false;
+    bool reported = false;
+    double preMainMs = 0.0;
+    QElapsedTimer timer;
+    std::vector<Phase> phases;
+};
+
+#endif // STARTUPPROFILE_HPP
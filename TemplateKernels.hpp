@@ -0,0 +1,233 @@
+#ifndef TEMPLATEKERNELS_HPP
+#define TEMPLATEKERNELS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "PixelKernels.hpp"
+
+// AVX2 kernels are compiled wherever SSE2 is the baseline and selected at run
+// time; MSVC accepts the intrinsics without /arch:AVX2, GCC/Clang need the
+// target attribute
+#ifdef KP_PIXEL_SSE2
+#if defined(_MSC_VER)
+#define KP_TEMPLATE_AVX2 1
+#define KP_TARGET_AVX2
+#elif defined(__GNUC__)
+#define KP_TEMPLATE_AVX2 1
+#define KP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#ifdef KP_TEMPLATE_AVX2
+#include <immintrin.h>
+#endif
+
+// Grayscale template matching kernels.
+// Frames are converted to 8-bit luma and halved into a pyramid; candidates
+// are searched with the sum of absolute differences (psadbw, 16 or 32 pixels
+// per instruction) and the final position is scored with normalized
+// cross-correlation, which tolerates brightness changes.
+
+namespace TemplateKernels {
+
+// The SAD kernels read whole vectors past the end of a row (and mask the
+// excess), so the buffer is padded to keep the last row's reads inside it
+constexpr int kRowPadding = 32;
+
+struct GrayImage {
+    std::vector<uint8_t> pixels;
+    int width = 0;
+    int height = 0;  // rows are packed, stride == width
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        pixels.resize(static_cast<size_t>(w) * h + kRowPadding);
+    }
+    uint8_t* row(int y) { return pixels.data() + static_cast<size_t>(y) * width; }
+    const uint8_t* row(int y) const { return pixels.data() + static_cast<size_t>(y) * width; }
+};
+
+inline uint8_t luma(uint32_t bgra) {
+    return static_cast<uint8_t>((77 * ((bgra >> 16) & 0xFF) + 150 * ((bgra >> 8) & 0xFF) + 29 * (bgra & 0xFF) + 128) >> 8);
+}
+
+// BT.601 luma of count BGRA pixels
+inline void toGrayRow(const uint32_t* in, uint8_t* out, int count) {
+    int i = 0;
+#ifdef KP_PIXEL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    for (; i + 8 <= count; i += 8) {
+        __m128i sums[2];
+        for (int half = 0; half < 2; ++half) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + half * 4));
+            // madd leaves (29B+150G, 77R) per pixel; add the pairs and gather lanes 0 and 2
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+            lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+            hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+            __m128i both = _mm_castps_si128(
+                _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+            sums[half] = _mm_srli_epi32(_mm_add_epi32(both, round), 8);
+        }
+        __m128i words = _mm_packs_epi32(sums[0], sums[1]);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words, words));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = luma(in[i]);
+    }
+}
+
+// Rows [firstRow, endRow) of out from the out-sized rectangle at (x, y) of
+// frame, which must lie inside it; row bands can be converted in parallel
+inline void toGrayRows(const PixelKernels::Frame& frame, int x, int y, GrayImage& out, int firstRow, int endRow) {
+    for (int row = firstRow; row < endRow; ++row) {
+        toGrayRow(frame.row(y + row) + x, out.row(row), out.width);
+    }
+}
+
+// Half-size image, each pixel the (rounded) mean of a 2x2 block
+inline void halve(const GrayImage& in, GrayImage& out) {
+    out.resize(in.width / 2, in.height / 2);
+    for (int y = 0; y < out.height; ++y) {
+        const uint8_t* a = in.row(2 * y);
+        const uint8_t* b = in.row(2 * y + 1);
+        uint8_t* o = out.row(y);
+        int x = 0;
+#ifdef KP_PIXEL_SSE2
+        const __m128i low = _mm_set1_epi16(0x00FF);
+        for (; x + 16 <= out.width; x += 16) {
+            __m128i v0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * x)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * x)));
+            __m128i v1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * x + 16)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * x + 16)));
+            v0 = _mm_avg_epu16(_mm_and_si128(v0, low), _mm_srli_epi16(v0, 8));
+            v1 = _mm_avg_epu16(_mm_and_si128(v1, low), _mm_srli_epi16(v1, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + x), _mm_packus_epi16(v0, v1));
+        }
+#endif
+        for (; x < out.width; ++x) {
+            int top = (a[2 * x] + b[2 * x] + 1) >> 1;
+            int bottom = (a[2 * x + 1] + b[2 * x + 1] + 1) >> 1;
+            o[x] = static_cast<uint8_t>((top + bottom + 1) >> 1);
+        }
+    }
+}
+
+using SadRowFunction = uint32_t (*)(const uint8_t* a, const uint8_t* b, int count);
+
+inline uint32_t sadRowScalar(const uint8_t* a, const uint8_t* b, int count) {
+    uint32_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += static_cast<uint32_t>(std::abs(int(a[i]) - int(b[i])));
+    }
+    return total;
+}
+
+#ifdef KP_PIXEL_SSE2
+// SAD of the first remaining (< 16) bytes: both sides are loaded whole and
+// the bytes past remaining zeroed, so they add nothing
+inline __m128i sadTailSse2(const uint8_t* a, const uint8_t* b, int remaining) {
+    alignas(16) static const uint8_t masks[32] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                                   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + 16 - remaining));
+    return _mm_sad_epu8(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)), mask),
+                        _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), mask));
+}
+
+inline uint32_t sadRowSse2(const uint8_t* a, const uint8_t* b, int count) {
+    __m128i sum = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+    }
+    if (i < count) {
+        sum = _mm_add_epi64(sum, sadTailSse2(a + i, b + i, count - i));
+    }
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+}
+#endif
+
+#ifdef KP_TEMPLATE_AVX2
+KP_TARGET_AVX2 inline uint32_t sadRowAvx2(const uint8_t* a, const uint8_t* b, int count) {
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    if (i + 16 <= count) {
+        half = _mm_add_epi64(half, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+        i += 16;
+    }
+    if (i < count) {
+        half = _mm_add_epi64(half, sadTailSse2(a + i, b + i, count - i));
+    }
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8)));
+}
+#endif
+
+// SAD of templ placed at (x, y) of image; stops early once the total exceeds limit
+inline uint32_t sad(const GrayImage& image, int x, int y, const GrayImage& templ, uint32_t limit, SadRowFunction sadRow) {
+    uint32_t total = 0;
+    for (int row = 0; row < templ.height && total <= limit; ++row) {
+        total += sadRow(image.row(y + row) + x, templ.row(row), templ.width);
+    }
+    return total;
+}
+
+struct TemplateStats {
+    double sum = 0.0;
+    double sumSquares = 0.0;
+};
+
+// Over the width x height pixels only: the row padding is not part of the
+// image and may hold stale bytes from an earlier, larger resize
+inline TemplateStats statistics(const GrayImage& templ) {
+    TemplateStats stats;
+    for (int y = 0; y < templ.height; ++y) {
+        const uint8_t* row = templ.row(y);
+        for (int x = 0; x < templ.width; ++x) {
+            stats.sum += row[x];
+            stats.sumSquares += double(row[x]) * row[x];
+        }
+    }
+    return stats;
+}
+
+// Normalized cross-correlation of templ at (x, y), in [-1, 1]. A flat template
+// has no correlation to speak of; it scores by mean absolute difference instead.
+inline double ncc(const GrayImage& image, int x, int y, const GrayImage& templ, const TemplateStats& stats) {
+    uint64_t sumImage = 0, sumImageSquares = 0, sumProduct = 0, sumAbs = 0;
+    for (int row = 0; row < templ.height; ++row) {
+        const uint8_t* a = image.row(y + row) + x;
+        const uint8_t* b = templ.row(row);
+        for (int i = 0; i < templ.width; ++i) {
+            sumImage += a[i];
+            sumImageSquares += uint32_t(a[i]) * a[i];
+            sumProduct += uint32_t(a[i]) * b[i];
+            sumAbs += static_cast<uint32_t>(std::abs(int(a[i]) - int(b[i])));
+        }
+    }
+    const double n = double(templ.width) * templ.height;
+    const double templVariance = stats.sumSquares - stats.sum * stats.sum / n;
+    if (templVariance < 1e-6 * n) {
+        return 1.0 - sumAbs / (255.0 * n);
+    }
+    const double imageVariance = sumImageSquares - double(sumImage) * sumImage / n;
+    if (imageVariance < 1e-6 * n) {
+        return 0.0;
+    }
+    return (sumProduct - sumImage * stats.sum / n) / std::sqrt(imageVariance * templVariance);
+}
+
+} // namespace TemplateKernels
+
+#endif // TEMPLATEKERNELS_HPP
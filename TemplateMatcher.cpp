@@ -0,0 +1,248 @@
+﻿#include "TemplateMatcher.h"
+#include <algorithm>
+#include <climits>
+#include <windows.h>
+
+#ifndef PF_AVX2_INSTRUCTIONS_AVAILABLE
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#endif
+
+using TemplateKernels::GrayImage;
+
+namespace {
+
+struct SadKernel {
+    TemplateKernels::SadRowFunction function;
+    const char *name;
+};
+
+// 首次使用时按CPU选择一次
+const SadKernel &sadKernel()
+{
+    static const SadKernel kernel = []() {
+#ifdef KP_TEMPLATE_AVX2
+        if (IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE)) {
+            return SadKernel{ &TemplateKernels::sadRowAvx2, "avx2" };
+        }
+#endif
+#ifdef KP_PIXEL_SSE2
+        return SadKernel{ &TemplateKernels::sadRowSse2, "sse2" };
+#else
+        return SadKernel{ &TemplateKernels::sadRowScalar, "scalar" };
+#endif
+    }();
+    return kernel;
+}
+
+} // namespace
+
+const char *TemplateMatcher::kernelName()
+{
+    return sadKernel().name;
+}
+
+int TemplateMatcher::addTemplate(const QImage &image)
+{
+    if (image.isNull() || image.width() < 8 || image.height() < 8) return -1;
+
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+    PixelKernels::Frame frame;
+    frame.pixels = reinterpret_cast<const uint32_t *>(rgb.constBits());
+    frame.width = rgb.width();
+    frame.height = rgb.height();
+    frame.stride = rgb.bytesPerLine() / 4;
+
+    Template templ;
+    templ.levels.resize(1);
+    templ.levels[0].resize(frame.width, frame.height);
+    TemplateKernels::toGrayRows(frame, 0, 0, templ.levels[0], 0, frame.height);
+    templ.stats = TemplateKernels::statistics(templ.levels[0]);
+    // 最粗一级的短边不小于8像素，再小时帧与模板的像素对齐误差会淹没特征
+    while (static_cast<int>(templ.levels.size()) <= kMaxLevels
+           && qMin(templ.levels.back().width, templ.levels.back().height) >= 16) {
+        GrayImage half;
+        TemplateKernels::halve(templ.levels.back(), half);
+        templ.levels.push_back(std::move(half));
+    }
+    templates.push_back(std::move(templ));
+    return static_cast<int>(templates.size()) - 1;
+}
+
+void TemplateMatcher::clear()
+{
+    templates.clear();
+}
+
+QSize TemplateMatcher::templateSize(int index) const
+{
+    if (index < 0 || index >= templateCount()) return QSize();
+    return QSize(templates[index].levels[0].width, templates[index].levels[0].height);
+}
+
+QRect TemplateMatcher::positions(const QRect &region, const Template &templ, int level) const
+{
+    const GrayImage &t = templ.levels[level];
+    const int scale = 1 << level;
+    int left = (region.x() + scale - 1) >> level;
+    int top = (region.y() + scale - 1) >> level;
+    int right = ((region.x() + region.width()) >> level) - t.width;
+    int bottom = ((region.y() + region.height()) >> level) - t.height;
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+void TemplateMatcher::search(const PixelKernels::Frame &frame, const QVector<Query> &queries, QVector<Match> &matches)
+{
+    matches.fill(Match(), queries.size());
+
+    // 裁剪到帧内，放不下模板的查询直接跳过
+    const QRect frameRect(0, 0, frame.width, frame.height);
+    QVector<QRect> regions(queries.size());
+    QRect all;
+    int levels = 0;
+    for (int i = 0; i < queries.size(); ++i) {
+        const Query &query = queries[i];
+        if (query.templateIndex < 0 || query.templateIndex >= templateCount()) continue;
+        QRect region = query.region.intersected(frameRect);
+        QSize size = templateSize(query.templateIndex);
+        if (region.width() < size.width() || region.height() < size.height()) continue;
+        regions[i] = region;
+        all = all.united(region);
+        levels = qMax(levels, static_cast<int>(templates[query.templateIndex].levels.size()) - 1);
+    }
+    if (all.isEmpty()) return;
+
+    // 外接矩形转灰度（按行分块并行），再逐级缩小
+    GrayImage &base = pyramid[0];
+    base.resize(all.width(), all.height());
+    const int grayBands = qBound(1, base.height / 64, pool.maxThreadCount());
+    runParallel(grayBands, [&](int i) {
+        TemplateKernels::toGrayRows(frame, all.x(), all.y(), base, base.height * i / grayBands,
+                                    base.height * (i + 1) / grayBands);
+    });
+    for (int level = 1; level <= levels; ++level) {
+        TemplateKernels::halve(pyramid[level - 1], pyramid[level]);
+    }
+
+    // 最粗一级全范围搜索，按行切成多个分块并行
+    for (QRect &region : regions) {
+        if (!region.isEmpty()) region.translate(-all.topLeft());
+    }
+    bands.clear();
+    for (int i = 0; i < queries.size(); ++i) {
+        if (regions[i].isEmpty()) continue;
+        const Template &templ = templates[queries[i].templateIndex];
+        // 取整后最粗一级可能放不下，退到能放下的一级
+        int level = static_cast<int>(templ.levels.size()) - 1;
+        QRect range = positions(regions[i], templ, level);
+        while (level > 0 && !range.isValid()) {
+            range = positions(regions[i], templ, --level);
+        }
+        if (!range.isValid()) continue;
+
+        const GrayImage &t = templ.levels[level];
+        const qint64 work = qint64(range.width()) * range.height() * t.width * t.height;
+        const int count = work < (1 << 18) ? 1 : qBound(1, range.height() / 4, pool.maxThreadCount());
+        for (int b = 0; b < count; ++b) {
+            Band band;
+            band.query = i;
+            band.templateIndex = queries[i].templateIndex;
+            band.level = level;
+            band.left = range.left();
+            band.right = range.right();
+            band.firstRow = range.top() + range.height() * b / count;
+            band.endRow = range.top() + range.height() * (b + 1) / count;
+            band.count = 0;
+            bands.push_back(band);
+        }
+    }
+    runParallel(static_cast<int>(bands.size()), [this](int b) { searchBand(bands[b]); });
+
+    // 合并各分块的候选，逐级细化后按NCC选出最好的位置
+    for (int i = 0; i < queries.size(); ++i) {
+        std::vector<Candidate> candidates;
+        int level = 0;
+        for (const Band &band : bands) {
+            if (band.query != i) continue;
+            candidates.insert(candidates.end(), band.best, band.best + band.count);
+            level = band.level;
+        }
+        if (candidates.empty()) continue;
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Candidate &a, const Candidate &b) { return a.sad < b.sad; });
+        if (static_cast<int>(candidates.size()) > kCandidates) candidates.resize(kCandidates);
+
+        const Template &templ = templates[queries[i].templateIndex];
+        Match &match = matches[i];
+        for (Candidate candidate : candidates) {
+            refine(candidate, regions[i], templ, level);
+            double score = TemplateKernels::ncc(base, candidate.x, candidate.y, templ.levels[0], templ.stats);
+            if (score > match.score) {
+                match.score = score;
+                match.position = all.topLeft() + QPoint(candidate.x, candidate.y);
+            }
+        }
+    }
+}
+
+void TemplateMatcher::searchBand(Band &band) const
+{
+    const GrayImage &image = pyramid[band.level];
+    const GrayImage &t = templates[band.templateIndex].levels[band.level];
+    const TemplateKernels::SadRowFunction sadRow = sadKernel().function;
+
+    // 保留SAD最小的几个位置，相邻（2像素内）的位置只留较好的一个，避免同一处占满候选；
+    // 候选满了以后，超过最差候选的位置提前结束累加
+    uint32_t limit = UINT_MAX;
+    band.count = 0;
+    for (int y = band.firstRow; y < band.endRow; ++y) {
+        for (int x = band.left; x <= band.right; ++x) {
+            uint32_t value = TemplateKernels::sad(image, x, y, t, limit, sadRow);
+            if (band.count == kCandidates && value >= limit) continue;
+            int slot = -1;
+            for (int i = 0; i < band.count; ++i) {
+                if (qAbs(band.best[i].x - x) <= 2 && qAbs(band.best[i].y - y) <= 2) {
+                    slot = i;
+                    break;
+                }
+            }
+            if (slot >= 0 && band.best[slot].sad <= value) continue;
+            if (slot < 0) slot = band.count < kCandidates ? band.count++ : kCandidates - 1;
+            while (slot > 0 && band.best[slot - 1].sad > value) {
+                band.best[slot] = band.best[slot - 1];
+                --slot;
+            }
+            band.best[slot] = Candidate{ value, x, y };
+            if (band.count == kCandidates) limit = band.best[kCandidates - 1].sad;
+        }
+    }
+}
+
+void TemplateMatcher::refine(Candidate &candidate, const QRect &region, const Template &templ, int fromLevel) const
+{
+    const TemplateKernels::SadRowFunction sadRow = sadKernel().function;
+    for (int level = fromLevel - 1; level >= 0; --level) {
+        // 上一级的一个像素对应这一级的2x2，再向外扩一像素抵消缩小时的取整
+        const QRect range = positions(region, templ, level);
+        const GrayImage &t = templ.levels[level];
+        Candidate best{ UINT_MAX, qBound(range.left(), candidate.x * 2, range.right()),
+                        qBound(range.top(), candidate.y * 2, range.bottom()) };
+        for (int y = candidate.y * 2 - 1; y <= candidate.y * 2 + 2; ++y) {
+            for (int x = candidate.x * 2 - 1; x <= candidate.x * 2 + 2; ++x) {
+                if (!range.contains(x, y)) continue;
+                uint32_t value = TemplateKernels::sad(pyramid[level], x, y, t, best.sad, sadRow);
+                if (value < best.sad) best = Candidate{ value, x, y };
+            }
+        }
+        candidate = best;
+    }
+}
+
+void TemplateMatcher::runParallel(int count, const std::function<void(int)> &work)
+{
+    // 当前线程执行第一块，其余交给线程池
+    for (int i = 1; i < count; ++i) {
+        pool.start([&work, i]() { work(i); });
+    }
+    if (count > 0) work(0);
+    pool.waitForDone();
+}
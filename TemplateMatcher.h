@@ -0,0 +1,81 @@
+﻿#ifndef TEMPLATEMATCHER_H
+#define TEMPLATEMATCHER_H
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+#include <vector>
+#include "TemplateKernels.hpp"
+
+// 图像模板匹配：在截图中查找图标等小图。
+// 帧和模板都先转为灰度并逐级缩小一半，在最粗一级用SAD（SSE2/AVX2，运行时选择）全区域搜索，
+// 候选位置逐级细化回原始分辨率，最后用归一化互相关（NCC，-1~1）打分。
+// 最粗一级的搜索按行分块，在自己的线程池中并行执行；search在所有分块完成后返回。
+class TemplateMatcher {
+public:
+    struct Query {
+        int templateIndex = 0;
+        QRect region;       // 帧坐标，超出帧的部分被裁掉
+    };
+
+    struct Match {
+        QPoint position;    // 模板左上角，帧坐标
+        double score = -1.0;
+    };
+
+    // 返回模板编号；图片为空或小于8x8时返回-1
+    int addTemplate(const QImage &image);
+    void clear();
+    int templateCount() const { return static_cast<int>(templates.size()); }
+    QSize templateSize(int index) const;
+
+    // matches与queries一一对应；区域小于模板时score为-1
+    void search(const PixelKernels::Frame &frame, const QVector<Query> &queries, QVector<Match> &matches);
+
+    // 当前使用的SAD内核："avx2"、"sse2"或"scalar"
+    static const char *kernelName();
+
+private:
+    static constexpr int kMaxLevels = 3;  // 最多缩小到1/8
+    static constexpr int kCandidates = 8; // 每个查询从最粗一级保留的互不相邻的候选数
+
+    struct Template {
+        std::vector<TemplateKernels::GrayImage> levels;  // levels[0]为原始大小
+        TemplateKernels::TemplateStats stats;
+    };
+
+    struct Candidate {
+        uint32_t sad;
+        int x;
+        int y;
+    };
+
+    // 最粗一级上一个查询的若干行，坐标相对金字塔原点
+    struct Band {
+        int query;
+        int templateIndex;
+        int level;
+        int left;
+        int right;      // 含
+        int firstRow;
+        int endRow;     // 不含
+        Candidate best[kCandidates];  // 按SAD从小到大
+        int count;
+    };
+
+    // 某一级上模板左上角可取的范围（相对金字塔原点），为空表示放不下
+    QRect positions(const QRect &region, const Template &templ, int level) const;
+    void searchBand(Band &band) const;
+    void refine(Candidate &candidate, const QRect &region, const Template &templ, int fromLevel) const;
+    void runParallel(int count, const std::function<void(int)> &work);
+
+    std::vector<Template> templates;
+    TemplateKernels::GrayImage pyramid[kMaxLevels + 1];  // 所有查询区域的外接矩形，逐级缩小
+    std::vector<Band> bands;
+    QThreadPool pool;
+};
+
+#endif // TEMPLATEMATCHER_H
@@ -0,0 +1,180 @@
+﻿#include "Timeline.h"
+#include "SlotProfile.h"
+#include <algorithm>
+
+namespace {
+
+// 按键名称不区分大小写，忽略空格（"Page Up"可写成PageUp）。数字按旧格式写的Arduino按键码
+// 与HID用法码含义不同，不再接受，只接受0x开头的用法码
+bool keyCode(const QString &token, int &code)
+{
+    QString name = token;
+    name.remove(' ');
+    for (int i = 0; i < kShortcutEntryCount; ++i) {
+        const ShortcutEntry &entry = kShortcutEntries[i];
+        if (entry.count == 1 && name.compare(QLatin1String(entry.name), Qt::CaseInsensitive) == 0) {
+            code = entry.codes[0];
+            return true;
+        }
+    }
+    for (int i = 0; i < kKeyEntryCount; ++i) {
+        if (name.compare(QString::fromLatin1(kKeyEntries[i].name).remove(' '), Qt::CaseInsensitive) == 0) {
+            code = kKeyEntries[i].code;
+            return true;
+        }
+    }
+    const QByteArray latin = name.toLatin1();
+    code = KeyTable::usage(latin.constData());
+    if (code != 0) return true;
+    bool ok = false;
+    code = name.startsWith("0x", Qt::CaseInsensitive) ? name.mid(2).toInt(&ok, 16) : 0;
+    return ok && KeyTable::isValidUsage(code);
+}
+
+bool parseStep(const QStringList &parts, TimelineStep &step)
+{
+    if (parts.size() < 2) return false;
+    for (const QString &token : parts[1].split('+')) {
+        int code = 0;
+        if (!keyCode(token, code)) return false;
+        step.keys.push_back(std::to_string(code));
+    }
+
+    for (int i = 2; i < parts.size(); ++i) {
+        const QString option = parts[i].toLower();
+        bool ok = i + 1 < parts.size();
+        if (!ok) return false;
+        const QString value = parts[++i];
+        if (option == "hold") {
+            step.holdMs = value.toInt(&ok);
+            ok = ok && step.holdMs >= 0 && step.holdMs <= 60000;
+        } else if (option == "gap") {
+            int dash = value.indexOf('-');
+            bool ok2 = true;
+            step.minGap = value.left(dash < 0 ? value.size() : dash).toInt(&ok);
+            step.maxGap = dash < 0 ? step.minGap : value.mid(dash + 1).toInt(&ok2);
+            ok = ok && ok2 && step.minGap >= 1 && step.maxGap >= step.minGap;
+            // gap后可跟分布名称
+            if (ok && i + 1 < parts.size()) {
+                const QString kind = parts[i + 1].toLower();
+                if (kind == "uniform" || kind == "normal" || kind == "lognormal") {
+                    step.distribution = IntervalDistribution::fromName(kind.toStdString());
+                    ++i;
+                }
+            }
+        } else if (option == "repeat") {
+            step.repeat = value.toInt(&ok);
+            ok = ok && step.repeat >= 1 && step.repeat <= CompiledTimeline::kMaxRepeat;
+        } else if (option == "skip") {
+            step.skip = value.toDouble(&ok);
+            ok = ok && step.skip >= 0.0 && step.skip <= 1.0;
+        } else {
+            ok = false;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool parseTrack(const QStringList &parts, TimelineTrack &track)
+{
+    int i = 1;
+    if (i < parts.size() && parts[i].toLower() != "offset" && parts[i].toLower() != "loops") {
+        track.name = parts[i++];
+    }
+    for (; i < parts.size(); i += 2) {
+        if (i + 1 >= parts.size()) return false;
+        bool ok = false;
+        const QString option = parts[i].toLower();
+        if (option == "offset") {
+            track.offsetMs = parts[i + 1].toInt(&ok);
+            ok = ok && track.offsetMs >= 0;
+        } else if (option == "loops") {
+            track.loops = parts[i + 1].toInt(&ok);
+            ok = ok && track.loops >= 0;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+Timeline Timeline::parse(const QString &text, QStringList *errors)
+{
+    Timeline timeline;
+    const QStringList lines = text.split('\n');
+    for (int n = 0; n < lines.size(); ++n) {
+        const QString line = lines[n].trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        const QStringList parts = line.simplified().split(' ');
+        const QString kind = parts[0].toLower();
+        bool ok = false;
+        if (kind == "track") {
+            TimelineTrack track;
+            ok = parseTrack(parts, track);
+            if (ok) timeline.tracks.push_back(track);
+        } else if (kind == "step") {
+            TimelineStep step;
+            ok = parseStep(parts, step);
+            if (ok) {
+                // 第一条track之前的步骤归入一条匿名轨道
+                if (timeline.tracks.empty()) timeline.tracks.emplace_back();
+                timeline.tracks.back().steps.push_back(step);
+            }
+        }
+        if (!ok && errors) {
+            errors->append(QStringLiteral("%1: %2").arg(n + 1).arg(line));
+        }
+    }
+    return timeline;
+}
+
+std::shared_ptr<const CompiledTimeline> CompiledTimeline::compile(const Timeline &timeline)
+{
+    auto compiled = std::make_shared<CompiledTimeline>();
+    for (const TimelineTrack &track : timeline.tracks) {
+        if (track.steps.empty()) continue;
+
+        Track out;
+        out.begin = static_cast<uint32_t>(compiled->steps.size());
+        out.offsetMs = track.offsetMs;
+        out.loops = track.loops;
+        const size_t firstGap = compiled->gaps.size();  // 间隔流只在轨道内共用
+
+        for (const TimelineStep &step : track.steps) {
+            Step flat = {};
+            flat.keyBegin = static_cast<uint32_t>(compiled->keys.size());
+            flat.keyCount = static_cast<uint8_t>(std::min<size_t>(step.keys.size(), 0xFF));
+            compiled->keys.insert(compiled->keys.end(), step.keys.begin(), step.keys.begin() + flat.keyCount);
+
+            uint8_t modifiers = 0;
+            std::vector<uint8_t> usages;
+            if (ArduinoController::chordFromKeys(step.keys, modifiers, usages)) {
+                flat.send = SendChord;
+                flat.modifiers = modifiers;
+                flat.usageCount = static_cast<uint8_t>(usages.size());
+                std::copy(usages.begin(), usages.end(), flat.usages);
+            } else {
+                flat.send = SendCombination;
+            }
+            flat.holdMs = static_cast<uint16_t>(step.holdMs);
+            flat.skipBelow = static_cast<uint32_t>(std::min(step.skip * 4294967296.0, 4294967295.0));
+
+            Gap gap = { step.distribution, step.minGap, step.maxGap };
+            auto same = std::find_if(compiled->gaps.begin() + firstGap, compiled->gaps.end(), [&gap](const Gap &other) {
+                return other.distribution == gap.distribution && other.minGap == gap.minGap && other.maxGap == gap.maxGap;
+            });
+            flat.gap = static_cast<uint32_t>(same - compiled->gaps.begin());
+            if (same == compiled->gaps.end()) compiled->gaps.push_back(gap);
+
+            for (int r = 0; r < std::min(step.repeat, kMaxRepeat); ++r) {
+                compiled->steps.push_back(flat);
+            }
+        }
+        out.end = static_cast<uint32_t>(compiled->steps.size());
+        compiled->tracks.push_back(out);
+    }
+    return compiled;
+}
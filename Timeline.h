@@ -0,0 +1,84 @@
+﻿#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "IntervalDistribution.hpp"
+
+// 时间轴：多条轨道同时运行，每条轨道按顺序循环执行自己的步骤，
+// 与独立/顺序触发的按键槽位并行。顺序触发相当于只有一条轨道、每个槽位一步的时间轴。
+// 文本格式（每行一条，#开头为注释）:
+//   track 名称 [offset 毫秒] [loops 次数]
+//       开始一条新轨道；offset为开始运行后的首次延迟，loops为循环次数（省略或0为无限）
+//   step 按键[+按键...] [hold 毫秒] [gap 最小[-最大] [uniform|normal|lognormal]] [repeat 次数] [skip 概率]
+//       按键为下拉框或KeyTable.hpp中的名称（F1、Ctrl、A、PageUp、Num1...）或十六进制HID用法码（0x3A）；
+//       gap为本步按下到下一步的间隔，repeat为连续执行次数，skip为跳过按键的概率（0~1，跳过时仍等待间隔）
+struct TimelineStep {
+    std::vector<std::string> keys;  // HID用法码，与SlotConfig::keys相同
+    int holdMs = 0;                 // 0表示使用调度器的按住时长
+    int minGap = 1000;
+    int maxGap = 1000;
+    IntervalDistribution::Kind distribution = IntervalDistribution::Uniform;
+    int repeat = 1;
+    double skip = 0.0;
+};
+
+struct TimelineTrack {
+    QString name;
+    int offsetMs = 0;
+    int loops = 0;  // 0为无限循环
+    std::vector<TimelineStep> steps;
+};
+
+struct Timeline {
+    std::vector<TimelineTrack> tracks;
+
+    // 解析整段文本；无法解析的行（含行号）放入errors，其余行照常生效
+    static Timeline parse(const QString &text, QStringList *errors = nullptr);
+};
+
+// 编译后的时间轴：所有轨道的步骤按repeat展开到一个平铺数组中，
+// 按键预先转换成HID报告，调度器执行一步只是按下标读取，不再解析文本或查表。
+struct CompiledTimeline {
+    enum SendKind : uint8_t { SendChord, SendCombination };
+
+    struct Step {
+        uint32_t keyBegin;    // 无法转换成报告的组合键（超过6个普通键）使用keys[keyBegin, keyBegin + keyCount)
+        uint8_t keyCount;
+        uint8_t send;         // SendKind
+        uint8_t modifiers;
+        uint8_t usageCount;
+        uint8_t usages[6];
+        uint16_t holdMs;      // 0表示使用调度器的按住时长
+        uint32_t gap;         // gaps下标，同一轨道内参数相同的步骤共用一个间隔流
+        uint32_t skipBelow;   // 32位随机数小于该值时跳过，0表示从不跳过
+    };
+
+    struct Track {
+        uint32_t begin;       // steps[begin, end)
+        uint32_t end;
+        int offsetMs;
+        int loops;
+    };
+
+    struct Gap {
+        IntervalDistribution::Kind distribution;
+        int minGap;
+        int maxGap;
+    };
+
+    static constexpr int kMaxRepeat = 1000;
+
+    std::vector<Step> steps;
+    std::vector<Track> tracks;
+    std::vector<Gap> gaps;
+    std::vector<std::string> keys;
+
+    static std::shared_ptr<const CompiledTimeline> compile(const Timeline &timeline);
+};
+
+#endif // TIMELINE_H
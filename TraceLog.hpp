@@ -0,0 +1,259 @@
+#ifndef TRACELOG_HPP
+#define TRACELOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <windows.h>
+
+// Binary trace log.
+// Call sites store a fixed-size record (timestamp, thread, level, format
+// literal, up to three integers and one short string) into an in-memory ring;
+// nothing is formatted on the calling thread and writers never block or lock.
+// The ring keeps the most recent records (a flight recorder): a background
+// flusher formats them into a file while running (start()), and dump() writes
+// whatever is still in memory on demand.
+//
+// Levels above KP_TRACE_LEVEL compile to nothing, arguments included.
+// Format placeholders: %1..%3 for the integer arguments, %s for the string.
+
+#define KP_TRACE_LEVEL_ERROR 1
+#define KP_TRACE_LEVEL_WARN 2
+#define KP_TRACE_LEVEL_INFO 3
+#define KP_TRACE_LEVEL_DEBUG 4
+
+#ifndef KP_TRACE_LEVEL
+#ifdef QT_NO_DEBUG
+#define KP_TRACE_LEVEL KP_TRACE_LEVEL_INFO
+#else
+#define KP_TRACE_LEVEL KP_TRACE_LEVEL_DEBUG
+#endif
+#endif
+
+#define KP_TRACE(level, ...) \
+    do { \
+        if constexpr ((level) <= KP_TRACE_LEVEL) TraceLog::write((level), __VA_ARGS__); \
+    } while (0)
+#define KP_TRACE_ERROR(...) KP_TRACE(KP_TRACE_LEVEL_ERROR, __VA_ARGS__)
+#define KP_TRACE_WARN(...) KP_TRACE(KP_TRACE_LEVEL_WARN, __VA_ARGS__)
+#define KP_TRACE_INFO(...) KP_TRACE(KP_TRACE_LEVEL_INFO, __VA_ARGS__)
+#define KP_TRACE_DEBUG(...) KP_TRACE(KP_TRACE_LEVEL_DEBUG, __VA_ARGS__)
+
+class TraceLog {
+public:
+    static constexpr uint32_t kCapacity = 4096;  // records, power of two
+
+    struct Record {
+        int64_t ticks;          // QueryPerformanceCounter
+        const char* format;     // string literal, never freed
+        int64_t args[3];
+        uint32_t thread;
+        uint8_t level;
+        char text[19];          // truncated copy of the string argument
+    };
+
+    template <typename... Args>
+    static void write(int level, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= 4, "at most three integers and one string");
+        TraceLog& log = instance();
+        Record record;
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        record.ticks = now.QuadPart;
+        record.format = format;
+        record.args[0] = record.args[1] = record.args[2] = 0;
+        record.thread = GetCurrentThreadId();
+        record.level = static_cast<uint8_t>(level);
+        record.text[0] = '\0';
+        int index = 0;
+        (put(record, index, args), ...);
+
+        uint64_t n = log.head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = log.slots[n & (kCapacity - 1)];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.record = record;
+        slot.sequence.store(n + 1, std::memory_order_release);
+    }
+
+    // Start the background flusher appending formatted records to path;
+    // it is stopped (and the file completed) at exit
+    static bool start(const std::string& path) {
+        TraceLog& log = instance();
+        static const bool stopAtExit = (std::atexit(&TraceLog::stop), true);
+        (void)stopAtExit;
+        std::lock_guard<std::mutex> lock(log.flushMutex);
+        if (log.flusher.joinable()) {
+            return false;
+        }
+        if (fopen_s(&log.output, path.c_str(), "a") != 0 || !log.output) {
+            log.output = nullptr;
+            return false;
+        }
+        log.stopping = false;
+        log.flusher = std::thread([&log]() {
+            std::unique_lock<std::mutex> wait(log.wakeMutex);
+            while (!log.stopping) {
+                log.wake.wait_for(wait, std::chrono::milliseconds(200));
+                log.drain(log.output);
+            }
+            log.drain(log.output);
+        });
+        return true;
+    }
+
+    // Stop the flusher after writing everything still queued
+    static void stop() {
+        TraceLog& log = instance();
+        std::lock_guard<std::mutex> lock(log.flushMutex);
+        if (!log.flusher.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> wait(log.wakeMutex);
+            log.stopping = true;
+        }
+        log.wake.notify_one();
+        log.flusher.join();
+        std::fclose(log.output);
+        log.output = nullptr;
+    }
+
+    // Write the records still held in memory to path (does not consume them)
+    static bool dump(const std::string& path) {
+        TraceLog& log = instance();
+        FILE* file = nullptr;
+        if (fopen_s(&file, path.c_str(), "w") != 0 || !file) {
+            return false;
+        }
+        uint64_t end = log.head.load(std::memory_order_acquire);
+        uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+        Record record;
+        for (uint64_t n = begin; n < end; ++n) {
+            if (log.read(n, record) == Read::Ok) {
+                log.format(file, record);
+            }
+        }
+        std::fclose(file);
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{ 0 };  // n + 1 once record n is complete, 0 while written
+        Record record;
+    };
+
+    enum class Read { Ok, Pending, Overwritten };
+
+    static TraceLog& instance() {
+        static TraceLog log;
+        return log;
+    }
+
+    TraceLog() {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = value.QuadPart;
+        QueryPerformanceCounter(&value);
+        origin = value.QuadPart;
+    }
+
+    template <typename T>
+    static void put(Record& record, int& index, T value) {
+        if (index < 3) {
+            record.args[index++] = static_cast<int64_t>(value);
+        }
+    }
+    static void put(Record& record, int&, const char* value) {
+        strncpy_s(record.text, sizeof(record.text), value ? value : "", _TRUNCATE);
+    }
+    static void put(Record& record, int& index, const std::string& value) {
+        put(record, index, value.c_str());
+    }
+
+    // Copy record n out of its slot; a concurrent writer is detected by the
+    // sequence changing under the copy
+    Read read(uint64_t n, Record& out) const {
+        const Slot& slot = slots[n & (kCapacity - 1)];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before > n + 1) {
+            return Read::Overwritten;
+        }
+        if (before != n + 1) {
+            return Read::Pending;
+        }
+        std::memcpy(&out, &slot.record, sizeof(Record));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == before ? Read::Ok : Read::Overwritten;
+    }
+
+    // Flusher thread only
+    void drain(FILE* file) {
+        uint64_t end = head.load(std::memory_order_acquire);
+        if (end - cursor > kCapacity) {
+            dropped += end - cursor - kCapacity;
+            cursor = end - kCapacity;
+        }
+        Record record;
+        for (; cursor < end; ++cursor) {
+            Read result = read(cursor, record);
+            if (result == Read::Pending) {
+                break;  // still being written, pick it up next round
+            }
+            if (result == Read::Ok) {
+                format(file, record);
+            } else {
+                ++dropped;
+            }
+        }
+        if (dropped != reportedDropped) {
+            std::fprintf(file, "[trace] %llu records overwritten before they were flushed\n",
+                         static_cast<unsigned long long>(dropped - reportedDropped));
+            reportedDropped = dropped;
+        }
+        std::fflush(file);
+    }
+
+    void format(FILE* file, const Record& record) const {
+        static const char* const levels[] = { "", "E", "W", "I", "D" };
+        double ms = (record.ticks - origin) * 1000.0 / frequency;
+        std::fprintf(file, "%12.3f %5u %s ", ms, record.thread, levels[record.level <= 4 ? record.level : 0]);
+        for (const char* p = record.format; *p; ++p) {
+            if (p[0] == '%' && p[1] >= '1' && p[1] <= '3') {
+                std::fprintf(file, "%lld", static_cast<long long>(record.args[p[1] - '1']));
+                ++p;
+            } else if (p[0] == '%' && p[1] == 's') {
+                std::fputs(record.text, file);
+                ++p;
+            } else {
+                std::fputc(*p, file);
+            }
+        }
+        std::fputc('\n', file);
+    }
+
+    Slot slots[kCapacity];
+    std::atomic<uint64_t> head{ 0 };
+    int64_t frequency = 1;
+    int64_t origin = 0;
+
+    std::mutex flushMutex;      // start/stop
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread flusher;
+    FILE* output = nullptr;
+    uint64_t cursor = 0;
+    uint64_t dropped = 0;
+    uint64_t reportedDropped = 0;
+};
+
+#endif // TRACELOG_HPP
@@ -0,0 +1,247 @@
+﻿#include "WindowProfileSwitcher.h"
+#include "TraceLog.hpp"
+#include <QFileInfo>
+#include <QProcess>
+
+namespace {
+
+// 合并编译时每条标题正则外面多了分组t0、t1……，按编号引用分组（\1、\g{2}、(?1)、(?(1)...)、(?R)）
+// 会指向别的规则或整个合并后的表达式，自己命名为tN的分组与外层重名。返回不能合并的原因，可以时为空
+QString titlePatternError(const QString &pattern)
+{
+    QRegularExpression alone(pattern);
+    if (!alone.isValid()) return alone.errorString();
+    static const QRegularExpression reserved(QStringLiteral("^t\\d+$"));
+    for (const QString &name : alone.namedCaptureGroups()) {
+        if (reserved.match(name).hasMatch()) return QStringLiteral("group name %1 is reserved").arg(name);
+    }
+
+    auto at = [&pattern](int i) { return i < pattern.size() ? pattern[i] : QChar(); };
+    auto numbered = [](QChar c) { return c.isDigit() || c == '+'; };
+    bool inClass = false;
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern[i];
+        if (c == '\\') {
+            const QChar next = at(i + 1);
+            if (next == 'Q') {
+                // \Q...\E之间都是字面字符
+                int end = pattern.indexOf(QStringLiteral("\\E"), i + 2);
+                if (end < 0) break;
+                i = end + 1;
+                continue;
+            }
+            if (!inClass) {
+                if (next.isDigit() && next != '0') return QStringLiteral("numbered backreference \\%1").arg(next);
+                if (next == 'g') {
+                    QChar ref = at(i + 2);
+                    if (ref == '{' || ref == '<' || ref == '\'') ref = at(i + 3);
+                    if (numbered(ref)) return QStringLiteral("numbered group reference \\g");
+                }
+            }
+            ++i;
+        } else if (inClass) {
+            if (c == ']') inClass = false;
+        } else if (c == '[') {
+            inClass = true;
+            if (at(i + 1) == '^') ++i;
+            if (at(i + 1) == ']') ++i;  // 紧跟在开头的]是字面字符
+        } else if (c == '(' && at(i + 1) == '?') {
+            QChar ref = at(i + 2);
+            if (ref == '(') ref = at(i + 3);  // 条件(?(1)...)
+            if (numbered(ref) || ref == 'R') return QStringLiteral("numbered group reference or recursion (?%1").arg(ref);
+        }
+    }
+    return QString();
+}
+
+} // namespace
+
+bool WindowProfileRule::parse(const QString &line, WindowProfileRule &out)
+{
+    QStringList parts = QProcess::splitCommand(line);
+    if (parts.size() != 3) return false;
+
+    WindowProfileRule rule;
+    QString kind = parts[0].toLower();
+    if (kind == "process") {
+        rule.kind = Process;
+    } else if (kind == "class") {
+        rule.kind = Class;
+    } else if (kind == "title") {
+        rule.kind = Title;
+        // 合并编译后外面多了分组，不支持按编号的反向引用（\1）等，见titlePatternError
+        if (!titlePatternError(parts[1]).isEmpty()) return false;
+    } else {
+        return false;
+    }
+    rule.pattern = parts[1];
+    rule.profile = parts[2];
+    if (rule.pattern.isEmpty() || rule.profile.isEmpty()) return false;
+    out = rule;
+    return true;
+}
+
+QVector<WindowProfileRule> WindowProfileRule::parseList(const QString &text, QStringList *invalid)
+{
+    QVector<WindowProfileRule> rules;
+    for (const QString &line : text.split('\n')) {
+        QString trimmed = line.trimmed();
+        if (trimmed.isEmpty() || trimmed.startsWith('#')) continue;
+        WindowProfileRule rule;
+        if (WindowProfileRule::parse(trimmed, rule)) {
+            rules.append(rule);
+        } else if (invalid) {
+            invalid->append(trimmed);
+        }
+    }
+    return rules;
+}
+
+void WindowProfileIndex::build(const QVector<WindowProfileRule> &rules, QStringList *invalid)
+{
+    profiles.clear();
+    byProcess.clear();
+    byClass.clear();
+    titleRules.clear();
+
+    QStringList alternatives;
+    for (int i = 0; i < rules.size(); ++i) {
+        const WindowProfileRule &rule = rules[i];
+        profiles.append(rule.profile);
+        switch (rule.kind) {
+        case WindowProfileRule::Process:
+            if (!byProcess.contains(rule.pattern.toLower())) byProcess.insert(rule.pattern.toLower(), i);
+            break;
+        case WindowProfileRule::Class:
+            if (!byClass.contains(rule.pattern)) byClass.insert(rule.pattern, i);
+            break;
+        case WindowProfileRule::Title: {
+            // 不经parse()构造的规则同样检查，不能合并的规则跳过，不影响其他规则
+            QString error = titlePatternError(rule.pattern);
+            if (!error.isEmpty()) {
+                KP_TRACE_WARN("Window profile rule %1 skipped: %s", i + 1, error.toStdString());
+                if (invalid) invalid->append(QStringLiteral("title %1: %2").arg(rule.pattern, error));
+                break;
+            }
+            // 每个分支都从标题开头用.*?向后找，整体锚定在开头，
+            // 这样先尝试完前一条规则的所有位置才会尝试下一条，保证行序优先
+            alternatives.append(QString("(?<t%1>.*?(?:%2))").arg(titleRules.size()).arg(rule.pattern));
+            titleRules.append(i);
+            break;
+        }
+        }
+    }
+    titles = QRegularExpression(alternatives.isEmpty() ? QString() : "^(?:" + alternatives.join('|') + ")",
+                                QRegularExpression::DotMatchesEverythingOption);
+    if (!titles.isValid()) {
+        // 单独都能编译、合并后却出错的情况，逐条加入找出第一条出错的规则，标题规则全部停用
+        for (int t = 1; t <= alternatives.size(); ++t) {
+            QRegularExpression prefix("^(?:" + alternatives.mid(0, t).join('|') + ")");
+            if (prefix.isValid()) continue;
+            const WindowProfileRule &rule = rules[titleRules[t - 1]];
+            KP_TRACE_WARN("Window profile rule %1 breaks the combined title pattern: %s", titleRules[t - 1] + 1,
+                          prefix.errorString().toStdString());
+            if (invalid) invalid->append(QStringLiteral("title %1: %2").arg(rule.pattern, prefix.errorString()));
+            break;
+        }
+        titleRules.clear();
+        titles = QRegularExpression();
+    }
+    titles.optimize();
+}
+
+QString WindowProfileIndex::lookup(const QString &process, const QString &windowClass, const QString &title) const
+{
+    int best = profiles.size();
+    auto processMatch = byProcess.constFind(process);
+    if (processMatch != byProcess.constEnd()) best = qMin(best, processMatch.value());
+    auto classMatch = byClass.constFind(windowClass);
+    if (classMatch != byClass.constEnd()) best = qMin(best, classMatch.value());
+
+    // 只有比哈希命中的规则更靠前的标题规则才需要匹配
+    if (!titleRules.isEmpty() && titleRules.front() < best) {
+        QRegularExpressionMatch match = titles.match(title);
+        if (match.hasMatch()) {
+            for (int t = 0; t < titleRules.size() && titleRules[t] < best; ++t) {
+                if (match.capturedStart(QString("t%1").arg(t)) >= 0) {
+                    best = titleRules[t];
+                    break;
+                }
+            }
+        }
+    }
+    return best < profiles.size() ? profiles[best] : QString();
+}
+
+WindowProfileSwitcher *WindowProfileSwitcher::instance = nullptr;
+
+WindowProfileSwitcher::WindowProfileSwitcher(QObject *parent)
+    : QObject(parent)
+{
+    instance = this;
+}
+
+WindowProfileSwitcher::~WindowProfileSwitcher()
+{
+    if (hook) UnhookWinEvent(hook);
+    if (instance == this) instance = nullptr;
+}
+
+void WindowProfileSwitcher::setRules(const QVector<WindowProfileRule> &rules, QStringList *invalid)
+{
+    index.build(rules, invalid);
+    if (index.isEmpty()) {
+        if (hook) UnhookWinEvent(hook);
+        hook = nullptr;
+        return;
+    }
+    if (!hook) {
+        hook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr, &WindowProfileSwitcher::eventProc,
+                               0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    }
+    checkForeground();
+}
+
+void WindowProfileSwitcher::checkForeground()
+{
+    HWND foreground = GetForegroundWindow();
+    DWORD processId = 0;
+    GetWindowThreadProcessId(foreground, &processId);
+    if (foreground && processId != GetCurrentProcessId()) onForeground(foreground);
+}
+
+QString WindowProfileSwitcher::processName(HWND hwnd)
+{
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hwnd, &processId);
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (!process) return QString();
+    wchar_t path[MAX_PATH];
+    DWORD size = MAX_PATH;
+    QString name;
+    if (QueryFullProcessImageNameW(process, 0, path, &size)) {
+        name = QFileInfo(QString::fromWCharArray(path, static_cast<int>(size))).fileName().toLower();
+    }
+    CloseHandle(process);
+    return name;
+}
+
+void WindowProfileSwitcher::onForeground(HWND hwnd)
+{
+    if (index.isEmpty() || !IsWindow(hwnd)) return;
+    wchar_t className[256];
+    wchar_t title[256];
+    int classLength = GetClassNameW(hwnd, className, 256);
+    int titleLength = GetWindowTextW(hwnd, title, 256);
+    QString profile = index.lookup(processName(hwnd), QString::fromWCharArray(className, qMax(classLength, 0)),
+                                   QString::fromWCharArray(title, qMax(titleLength, 0)));
+    if (profile.isEmpty()) return;
+    KP_TRACE_INFO("Foreground window matched %s", QFileInfo(profile).fileName().toStdString());
+    Q_EMIT matched(hwnd, profile);
+}
+
+void CALLBACK WindowProfileSwitcher::eventProc(HWINEVENTHOOK, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+{
+    if (event != EVENT_SYSTEM_FOREGROUND || idObject != OBJID_WINDOW || idChild != CHILDID_SELF) return;
+    if (instance) instance->onForeground(hwnd);
+}
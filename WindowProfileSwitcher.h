@@ -0,0 +1,74 @@
+﻿#ifndef WINDOWPROFILESWITCHER_H
+#define WINDOWPROFILESWITCHER_H
+
+#include <QHash>
+#include <QObject>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QVector>
+#include <windows.h>
+
+// 窗口配置规则：前台窗口切换时自动加载对应的配置文件。文本格式（每行一条，#开头为注释）:
+//   process 进程名 配置文件      进程的可执行文件名，不区分大小写，如 process game.exe D:\profiles\game.kphset
+//   class 窗口类名 配置文件      窗口类名完全相同
+//   title 正则表达式 配置文件    窗口标题包含匹配的部分即可，如 title "^魔兽.*" a.kphset；
+//                                不支持按编号引用分组（\1、(?1)等）和名为t0、t1……的分组
+// 含空格的参数加双引号。一个窗口符合多条规则时，写在前面的规则优先。
+struct WindowProfileRule {
+    enum Kind { Process, Class, Title };
+
+    Kind kind = Process;
+    QString pattern;
+    QString profile;
+
+    static bool parse(const QString &line, WindowProfileRule &out);
+    static QVector<WindowProfileRule> parseList(const QString &text, QStringList *invalid = nullptr);
+};
+
+// 规则索引：进程名和窗口类名放入哈希表，所有标题正则合并编译成一个表达式，
+// 查找一个窗口只需两次哈希查找和一次正则匹配，与规则条数无关
+class WindowProfileIndex {
+public:
+    // 不能合并编译的标题规则（按编号引用分组、分组名为tN）跳过，原因追加到invalid
+    void build(const QVector<WindowProfileRule> &rules, QStringList *invalid = nullptr);
+    bool isEmpty() const { return profiles.isEmpty(); }
+
+    // 返回匹配的配置文件路径，没有匹配时为空；process为小写的可执行文件名
+    QString lookup(const QString &process, const QString &windowClass, const QString &title) const;
+
+private:
+    QStringList profiles;              // 按规则行序
+    QHash<QString, int> byProcess;     // 小写进程名 -> 规则序号（同名取第一条）
+    QHash<QString, int> byClass;
+    QRegularExpression titles;         // ^(?:(?<t0>.*?(?:正则0))|(?<t1>.*?(?:正则1))|...)
+    QVector<int> titleRules;           // 分组ti对应的规则序号
+};
+
+// 前台窗口监视：常驻EVENT_SYSTEM_FOREGROUND钩子（WINEVENT_OUTOFCONTEXT，回调在界面线程执行，
+// 不含本进程的窗口），前台窗口符合某条规则时发出matched，由调用方切换目标窗口和配置
+class WindowProfileSwitcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit WindowProfileSwitcher(QObject *parent = nullptr);
+    ~WindowProfileSwitcher();
+
+    // 规则为空时卸载钩子；设置后立即检查一次当前的前台窗口。被跳过的规则见WindowProfileIndex::build
+    void setRules(const QVector<WindowProfileRule> &rules, QStringList *invalid = nullptr);
+    void checkForeground();
+
+    static QString processName(HWND hwnd);
+
+Q_SIGNALS:
+    void matched(HWND hwnd, const QString &profile);
+
+private:
+    static void CALLBACK eventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD eventThread, DWORD eventTime);
+    void onForeground(HWND hwnd);
+
+    static WindowProfileSwitcher *instance;
+    WindowProfileIndex index;
+    HWINEVENTHOOK hook = nullptr;
+};
+
+#endif // WINDOWPROFILESWITCHER_H
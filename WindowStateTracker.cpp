@@ -0,0 +1,114 @@
+﻿#include "WindowStateTracker.h"
+
+WindowStateTracker *WindowStateTracker::instance = nullptr;
+
+WindowStateTracker::WindowStateTracker(QObject *parent)
+    : QObject(parent)
+{
+    instance = this;
+}
+
+WindowStateTracker::~WindowStateTracker()
+{
+    unhookAll();
+    if (instance == this) instance = nullptr;
+}
+
+void WindowStateTracker::unhookAll()
+{
+    for (HWINEVENTHOOK &hook : hooks) {
+        if (hook) UnhookWinEvent(hook);
+        hook = nullptr;
+    }
+}
+
+void WindowStateTracker::setTarget(HWND target)
+{
+    unhookAll();
+    hwnd = target;
+    cached = State();
+    if (!hwnd) return;
+
+    // 前台切换需要监听所有进程；最小化、销毁、移动只关心目标窗口所在的进程。
+    // 每个钩子只覆盖实际处理的事件：一个大范围会把中间的菜单、捕获、拖动等事件也投递到界面线程
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hwnd, &processId);
+    const struct { DWORD first, last, process; } ranges[kHookCount] = {
+        { EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, 0 },
+        { EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, processId },
+        { EVENT_OBJECT_DESTROY, EVENT_OBJECT_REORDER, processId },  // 销毁、显示、隐藏、Z序
+        { EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, processId },
+    };
+    for (int i = 0; i < kHookCount; ++i) {
+        hooks[i] = SetWinEventHook(ranges[i].first, ranges[i].last, nullptr, &WindowStateTracker::eventProc,
+                                   ranges[i].process, 0, WINEVENT_OUTOFCONTEXT);
+    }
+    refresh();
+}
+
+void WindowStateTracker::refresh()
+{
+    State next;
+    next.exists = hwnd && IsWindow(hwnd);
+    if (next.exists) {
+        next.minimized = IsIconic(hwnd) != FALSE;
+        next.topmost = (GetWindowLongPtr(hwnd, GWL_EXSTYLE) & WS_EX_TOPMOST) != 0;
+        next.foreground = GetForegroundWindow() == hwnd;
+        RECT rect;
+        if (GetWindowRect(hwnd, &rect)) {
+            next.rect = QRect(QPoint(rect.left, rect.top), QPoint(rect.right - 1, rect.bottom - 1));
+        }
+    }
+
+    bool lost = cached.exists && !next.exists;
+    bool changed = next.exists != cached.exists || next.minimized != cached.minimized || next.topmost != cached.topmost
+                   || next.foreground != cached.foreground || next.rect != cached.rect;
+    cached = next;
+    if (changed) Q_EMIT stateChanged(cached);
+    if (lost) {
+        unhookAll();
+        Q_EMIT targetLost();
+    }
+}
+
+void CALLBACK WindowStateTracker::eventProc(HWINEVENTHOOK, DWORD event, HWND eventHwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+{
+    WindowStateTracker *self = instance;
+    if (!self || !self->hwnd) return;
+
+    if (event == EVENT_SYSTEM_FOREGROUND) {
+        // 任何窗口成为前台都可能让目标失去前台或被其他置顶窗口压住
+        self->refresh();
+        return;
+    }
+    if (eventHwnd != self->hwnd || idObject != OBJID_WINDOW || idChild != CHILDID_SELF) return;
+    switch (event) {
+    case EVENT_SYSTEM_MINIMIZESTART:
+    case EVENT_SYSTEM_MINIMIZEEND:
+    case EVENT_OBJECT_DESTROY:
+    case EVENT_OBJECT_SHOW:
+    case EVENT_OBJECT_HIDE:
+    case EVENT_OBJECT_REORDER:
+    case EVENT_OBJECT_LOCATIONCHANGE:
+        self->refresh();
+        break;
+    default:
+        break;
+    }
+}
+
+bool WindowStateTracker::prepareForPress(bool keepTopmost)
+{
+    if (!cached.exists) return false;
+    if (!keepTopmost) return true;
+
+    if (cached.minimized) {
+        ShowWindow(hwnd, SW_RESTORE);
+        cached.minimized = false;
+    }
+    if (!cached.topmost) {
+        SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_SHOWWINDOW | SWP_NOMOVE | SWP_NOSIZE);
+        cached.topmost = true;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+﻿#ifndef WINDOWSTATETRACKER_H
+#define WINDOWSTATETRACKER_H
+
+#include <QObject>
+#include <QRect>
+#include <windows.h>
+
+// 目标窗口状态缓存：由WinEvent钩子（前台切换、最小化、销毁、移动）驱动更新，
+// 每次按键前只读取缓存，状态确实变化时才调用ShowWindow/SetWindowPos。
+// 钩子为WINEVENT_OUTOFCONTEXT，回调在创建本对象的线程（界面线程）中执行。
+class WindowStateTracker : public QObject {
+    Q_OBJECT
+
+public:
+    struct State {
+        bool exists = false;
+        bool minimized = false;
+        bool topmost = false;
+        bool foreground = false;
+        QRect rect;
+    };
+
+    explicit WindowStateTracker(QObject *parent = nullptr);
+    ~WindowStateTracker();
+
+    void setTarget(HWND hwnd);
+    HWND target() const { return hwnd; }
+    const State &state() const { return cached; }
+
+    // 按键前调用。目标窗口已不存在时返回false（跳过本次按键）；
+    // keepTopmost为true时只在窗口被最小化或失去置顶时才恢复/置顶。
+    bool prepareForPress(bool keepTopmost);
+
+    // 外部主动改变了窗口状态（如取消置顶）后重新读取
+    void refresh();
+
+Q_SIGNALS:
+    void stateChanged(const WindowStateTracker::State &state);
+    void targetLost();
+
+private:
+    static void CALLBACK eventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD eventThread, DWORD eventTime);
+    void unhookAll();
+
+    static WindowStateTracker *instance;
+    HWND hwnd = nullptr;
+    State cached;
+    static constexpr int kHookCount = 4;
+    HWINEVENTHOOK hooks[kHookCount] = {};
+};
+
+#endif // WINDOWSTATETRACKER_H
@@ -10,7 +10,6 @@
 #include <QSettings>
 #include <QFileInfo>
 #include <QDateTime>
-#include <QRandomGenerator>
 #include <QDesktopServices>
 #include <QProcess>
 #include <QUrl>
@@ -18,6 +17,15 @@
 #include <QDebug>
 #include <qlogging.h>
 #include <QInputDialog>
+#include <QStyle>
+#include <QPointer>
+#include <QThreadPool>
+#include <QFontDatabase>
+#include <QHeaderView>
+#include <algorithm>
+#include "StartupProfile.hpp"
+#include "Simulator.h"
+#include <QTemporaryFile>
 
 
 KeyPresserHardware *KeyPresserHardware::instance = nullptr;
@@ -31,6 +39,26 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     instance = this;
     resize(330, 400);
 
+    // 自定义按键槽位（默认15个）+ 1个空格槽位
+    scheduler = new PressScheduler(&_controller, this);
+    scheduler->setSlotCount(SlotProfile::schedulerSlotCount(SlotProfile::kDefaultKeySlotCount));
+
+    pixelTrigger = new PixelTrigger(scheduler, this);
+
+    // 串口断开时暂停调度（不改变运行状态），重连后从当前时刻继续
+    linkKeeper = new LinkKeeper(&_controller, this);
+    connect(linkKeeper, &LinkKeeper::linkLost, this, [this]() {
+        scheduler->pause();
+        arduinoLabel->setText(QStringLiteral("连接断开，正在重连..."));
+        arduinoLabel->setStyleSheet("color: red;");
+    });
+    connect(linkKeeper, &LinkKeeper::linkRestored, this, [this](int downtimeMs) {
+        scheduler->resume();
+        arduinoLabel->setText(QStringLiteral("已重新连接 %1（断开 %2 ms）")
+                                  .arg(QString::fromStdString(_controller.getPortName())).arg(downtimeMs));
+        arduinoLabel->setStyleSheet("color: green;");
+    });
+
     // 设置窗口的大小策略：宽度可扩展，高度自适应最小值
     setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Minimum);
     QVBoxLayout *globalLayout = new QVBoxLayout(this);
@@ -97,6 +125,51 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     recordingButton->setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
     recordingButton->hide();
 
+    QToolButton *firmwareButton = new QToolButton(this);
+    firmwareButton->setIcon(QIcon(":/png/hardware.png"));
+    firmwareButton->setText(QStringLiteral("固件"));
+    firmwareButton->setToolTip(QStringLiteral("烧录/更新Arduino固件，设备固件已是最新时自动跳过；烧录中再次点击取消"));
+    firmwareButton->setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
+    connect(firmwareButton, &QToolButton::clicked, this, &KeyPresserHardware::flashFirmware);
+
+    QToolButton *simulateButton = new QToolButton(this);
+    simulateButton->setIcon(QIcon(":/png/timing.png"));
+    simulateButton->setText(QStringLiteral("模拟"));
+    simulateButton->setToolTip(QStringLiteral("按当前设置快速模拟运行若干小时，统计按键频率和冲突，不发送按键"));
+    simulateButton->setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
+    connect(simulateButton, &QToolButton::clicked, this, &KeyPresserHardware::simulateProfile);
+
+    QToolButton *scriptButton = new QToolButton(this);
+    scriptButton->setIcon(QIcon(":/png/pythonscrip.png"));
+    scriptButton->setText(QStringLiteral("脚本"));
+    scriptButton->setToolTip(QStringLiteral("运行Python脚本，再次点击停止"));
+    scriptButton->setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
+#ifdef KP_WITH_PYTHON
+    PythonScripting::Hooks hooks;
+    hooks.start = [this]() { if (!bIsRuning) startPressing(); };
+    hooks.stop = [this]() { if (bIsRuning) stopPressing(); };
+    hooks.isRunning = [this]() { return bIsRuning; };
+    hooks.targetWindow = [this]() { return targetHwnd; };
+    scripting = new PythonScripting(&_controller, hooks, this);
+    connect(scripting, &PythonScripting::finished, this, [scriptButton](bool ok) {
+        scriptButton->setText(QStringLiteral("脚本"));
+        if (!ok) qWarning() << "Python script finished with an error";
+    });
+    connect(scriptButton, &QToolButton::clicked, this, [this, scriptButton]() {
+        if (scripting->isRunning()) {
+            scripting->stop();
+            return;
+        }
+        QString filename = QFileDialog::getOpenFileName(this, QStringLiteral("运行脚本"), QDir::currentPath(),
+                                                        QStringLiteral("Python脚本 (*.py)"));
+        if (!filename.isEmpty() && scripting->runFile(filename)) {
+            scriptButton->setText(QStringLiteral("停止"));
+        }
+    });
+#else
+    scriptButton->hide();
+#endif
+
     QFrame *toolButtonFrame = new QFrame();
     toolButtonFrame->setFixedHeight(30);
     toolButtonFrame->setStyleSheet("QFrame { border-bottom: 1px solid #cccccc; border-radius: 0px; padding-bottom: 0px; background-color: #dadcde; }");
@@ -112,10 +185,14 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     //toolButtonLayout->addWidget(timingButton);
     toolButtonLayout->addWidget(aboutButton);
     toolButtonLayout->addWidget(helpButton);
+    toolButtonLayout->addWidget(firmwareButton);
+    toolButtonLayout->addWidget(simulateButton);
     toolButtonLayout->addWidget(openMouseButton);
     toolButtonLayout->addWidget(recordingButton);
+    toolButtonLayout->addWidget(scriptButton);
     toolButtonLayout->addStretch();
     layout->addLayout(toolButtonLayout);
+    StartupProfile::mark("toolbar");
 
 
     // 添加按钮事件处理
@@ -127,6 +204,8 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
             QStringLiteral("KeyPresserHardware设置文件 (*.kphset)"));
             
         if (!filename.isEmpty()) {
+            // 手动导入替换了按窗口规则加载的配置，之后切回该规则的窗口要重新加载
+            activeProfilePath.clear();
             loadSettingsFromFile(filename);
             QMessageBox::information(this, QStringLiteral("成功"), 
                 QStringLiteral("设置已成功导入！"));
@@ -154,8 +233,6 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
 
     connect(clearButton, &QPushButton::clicked, this, &KeyPresserHardware::clearSettings);
 
-    //QPushButton *uploadSketchBtn = new QPushButton(QStringLiteral("烧录程序（首次运行时先点击此按钮）"));
-    //layout->addWidget(uploadSketchBtn);
     arduinoLabel = new QLabel(QStringLiteral("未连接到Arduino Leonardo"), this);
     arduinoLabel->setStyleSheet("color: red;");
     layout->addWidget(arduinoLabel);
@@ -193,9 +270,44 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     modeGroup->addButton(sequentialModeRadio);
     independentModeRadio->setChecked(true);
 
+    connect(sequentialModeRadio, &QRadioButton::toggled, this, [this](bool sequential) {
+        // 运行中切换到独立触发时需要先关联目标窗口线程
+        if (bIsRuning && !sequential) attachToTargetWindow();
+        scheduler->setMode(sequential ? PressScheduler::Sequential : PressScheduler::Independent);
+    });
+
     modeLayout->addWidget(independentModeRadio);
     modeLayout->addWidget(sequentialModeRadio);
     modeLayout->addStretch();
+
+    // 间隔在[最小值,最大值]内的分布方式
+    modeLayout->addWidget(new QLabel(QStringLiteral("间隔分布:"), this));
+    distributionCombo = new QComboBox(this);
+    distributionCombo->addItem(QStringLiteral("均匀"), "uniform");
+    distributionCombo->addItem(QStringLiteral("正态"), "normal");
+    distributionCombo->addItem(QStringLiteral("对数正态"), "lognormal");
+    distributionCombo->addItem(QStringLiteral("录制样本"), "empirical");
+    distributionCombo->setToolTip(QStringLiteral("正态：集中在范围中间；对数正态：偏向较短的间隔，偶尔较长，接近人手操作；\n"
+                                                 "录制样本：按导入的真实按键间隔的分布，缩放到各按键的范围"));
+    connect(distributionCombo, QOverload<int>::of(&QComboBox::activated), this, [this](int index) {
+        // 第一次选择录制样本时需要先导入样本文件
+        if (distributionCombo->itemData(index).toString() == "empirical" && !empiricalTable
+            && !chooseEmpiricalSamples()) {
+            distributionCombo->setCurrentIndex(0);
+        }
+    });
+    connect(distributionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        updateSamplesButton();
+        applyAllSlots();
+    });
+    modeLayout->addWidget(distributionCombo);
+    // 已导入样本后也可以换用其他样本文件
+    samplesButton = new QPushButton(QStringLiteral("样本文件..."), this);
+    connect(samplesButton, &QPushButton::clicked, this, [this]() {
+        if (chooseEmpiricalSamples()) applyAllSlots();
+    });
+    modeLayout->addWidget(samplesButton);
+    updateSamplesButton();
     layout->addWidget(modeGroupBox);
 
     // 初始化置顶复选框
@@ -230,104 +342,72 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     QLabel *keysLabel = new QLabel(QStringLiteral("自定义组合键&按键和时间间隔 (毫秒) [范围]:"), this);
     layout->addWidget(keysLabel);
 
-    QVBoxLayout *allKeysLayout = new QVBoxLayout();
-
-    // 创建主要的10个按键的网格布局
-    QGridLayout *mainKeysLayout = new QGridLayout();
-    // 创建额外的5个按键的网格布局
-    QWidget *extraKeysWidget = new QWidget(this);
-    QGridLayout *extraKeysLayout = new QGridLayout(extraKeysWidget);
-    extraKeysLayout->setContentsMargins(0, 0, 0, 0);
-    extraKeysWidget->setVisible(false);
-
-    // 创建展开/折叠按钮
-    QPushButton *toggleExtraKeysButton = new QPushButton(QStringLiteral("▼ 更多按键"), this);
-    toggleExtraKeysButton->setStyleSheet("text-align: left; padding-left: 5px;");
-    connect(toggleExtraKeysButton, &QPushButton::clicked, [this, toggleExtraKeysButton, extraKeysWidget]() {
-        bool isVisible = extraKeysWidget->isVisible();
-        extraKeysWidget->setVisible(!isVisible);
-        toggleExtraKeysButton->setText(isVisible ? QStringLiteral("▼ 更多按键") : QStringLiteral("▲ 收起按键"));
-
-        // 只调整高度，保持当前宽度
-        int currentWidth = width();
-        adjustSize();
-        resize(currentWidth, height());
+    // 按键表：行数不限，只有正在编辑的单元格才有编辑控件
+    slotModel = new SlotTableModel(this);
+    slotTable = new QTableView(this);
+    slotTable->setModel(slotModel);
+    slotTable->setItemDelegate(new SlotItemDelegate(slotTable));
+    slotTable->setEditTriggers(QAbstractItemView::CurrentChanged | QAbstractItemView::SelectedClicked
+                               | QAbstractItemView::EditKeyPressed | QAbstractItemView::AnyKeyPressed);
+    slotTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    slotTable->verticalHeader()->setDefaultSectionSize(24);
+    slotTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    slotTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    slotTable->horizontalHeader()->setSectionResizeMode(SlotTableModel::EnabledColumn, QHeaderView::ResizeToContents);
+    // 默认显示10行，更多的按键滚动查看
+    slotTable->setMinimumHeight(slotTable->horizontalHeader()->sizeHint().height() + 10 * 24 + 2 * slotTable->frameWidth());
+    connect(slotModel, &SlotTableModel::slotEdited, this, [this](int row) {
+        applySlotEdit(SlotProfile::schedulerSlot(row));
     });
-
-    for (int i = 0; i < 15; ++i) {
-        keyCheckBoxes[i] = new QCheckBox(this);
-        shortcutCombos[i] = new QComboBox(this);
-        keyCombos[i] = new QComboBox(this);
-        populateShortcutCombos(shortcutCombos[i]);
-        populateKeyCombos(keyCombos[i]);
-        // 设置默认值：前12个为F1-F12，后3个为ABC
-        if (i < 12) {
-            keyCombos[i]->setCurrentText(QString("F%1").arg(i + 1));
-        } else {
-            keyCombos[i]->setCurrentText(QChar('A' + (i - 12)));
-        }
-
-        intervalLineEdits[i] = new QLineEdit(this);
-        intervalLineEdits[i]->setValidator(new QIntValidator(this));
-        intervalLineEdits[i]->setText("1000");
-        intervalLineEdits[i]->setPlaceholderText(QStringLiteral("最小值"));
-
-        QLabel *dashLabel2 = new QLabel("-", this);
-
-        maxIntervalLineEdits[i] = new QLineEdit(this);
-        maxIntervalLineEdits[i]->setValidator(new QIntValidator(this));
-        maxIntervalLineEdits[i]->setText("1000");
-        maxIntervalLineEdits[i]->setPlaceholderText(QStringLiteral("最大值"));
-
-        QTimer *timer = new QTimer(this);
-        connect(timer, &QTimer::timeout, [this, i]() {
-            pressKeys(i);
-            int minInterval = intervalLineEdits[i]->text().toInt();
-            int maxInterval = maxIntervalLineEdits[i]->text().toInt();
-            if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
-            int interval = getRandomInterval(minInterval, maxInterval);
-            timers[i]->start(interval);
-        });
-        timers.push_back(timer);
-
-        // 将前10个按键添加到主布局
-        if (i < 10) {
-            mainKeysLayout->addWidget(keyCheckBoxes[i], i, 0);
-            mainKeysLayout->addWidget(shortcutCombos[i], i, 1);
-            mainKeysLayout->addWidget(keyCombos[i], i, 2);
-            mainKeysLayout->addWidget(intervalLineEdits[i], i, 3);
-            mainKeysLayout->addWidget(dashLabel2, i, 4);
-            mainKeysLayout->addWidget(maxIntervalLineEdits[i], i, 5);
-        }
-        // 将后5个按键添加到额外布局
-        else {
-            int row = i - 10;
-            extraKeysLayout->addWidget(keyCheckBoxes[i], row, 0);
-            extraKeysLayout->addWidget(shortcutCombos[i], row, 1);
-            extraKeysLayout->addWidget(keyCombos[i], row, 2);
-            extraKeysLayout->addWidget(intervalLineEdits[i], row, 3);
-            extraKeysLayout->addWidget(dashLabel2, row, 4);
-            extraKeysLayout->addWidget(maxIntervalLineEdits[i], row, 5);
+    connect(slotModel, &SlotTableModel::slotsChanged, this, [this]() {
+        scheduler->setSlotCount(SlotProfile::schedulerSlotCount(slotModel->rowCount()));
+        applyAllSlots();
+    });
+    std::vector<SlotTableModel::Row> rows;
+    for (int i = 0; i < SlotProfile::kDefaultKeySlotCount; ++i) rows.push_back(SlotTableModel::defaultRow(i));
+    slotModel->setRows(rows);
+    layout->addWidget(slotTable);
+
+    QHBoxLayout *slotButtonLayout = new QHBoxLayout();
+    QPushButton *addSlotButton = new QPushButton(QStringLiteral("添加按键"), this);
+    QPushButton *removeSlotButton = new QPushButton(QStringLiteral("删除选中按键"), this);
+    removeSlotButton->setToolTip(QStringLiteral("其后按键的序号会前移，像素触发规则中的序号需要相应修改"));
+    connect(addSlotButton, &QPushButton::clicked, this, [this]() {
+        int row = slotModel->rowCount();
+        if (slotModel->insertRows(row, 1)) {
+            slotTable->scrollToBottom();
+            slotTable->setCurrentIndex(slotModel->index(row, SlotTableModel::KeyColumn));
         }
-    }
-
-    allKeysLayout->addLayout(mainKeysLayout);
-    allKeysLayout->addWidget(toggleExtraKeysButton);
-    allKeysLayout->addWidget(extraKeysWidget);
-    layout->addLayout(allKeysLayout);
+    });
+    connect(removeSlotButton, &QPushButton::clicked, this, [this]() {
+        // 从后往前删除，前面的行号不受影响
+        QModelIndexList selected = slotTable->selectionModel()->selectedRows();
+        std::sort(selected.begin(), selected.end(),
+                  [](const QModelIndex &a, const QModelIndex &b) { return a.row() > b.row(); });
+        for (const QModelIndex &index : selected) slotModel->removeRows(index.row(), 1);
+    });
+    slotButtonLayout->addWidget(addSlotButton);
+    slotButtonLayout->addWidget(removeSlotButton);
+    slotButtonLayout->addStretch();
+    layout->addLayout(slotButtonLayout);
+    StartupProfile::mark("key rows");
 
     toggleButton = new QPushButton(QStringLiteral("开始"), this);
     layout->addWidget(toggleButton);
 
     // 添加"快捷键设置"标签和组合框
-    // 添加定时任务相关UI元素
-    QGroupBox *timerTaskGroupBox = new QGroupBox(QStringLiteral("设置定时任务"), this);
-
+    // 添加定时任务相关UI元素（面板在首次展开时才创建）
     QPushButton *timerTaskButton = new QPushButton(QStringLiteral("▼ 定时任务"), this);
-    timerTaskGroupBox->setVisible(false);
     layout->addWidget(timerTaskButton);
     timerTaskButton->setStyleSheet("text-align: left; padding-left: 5px;");
-    connect(timerTaskButton, &QPushButton::clicked, [this, timerTaskButton, timerTaskGroupBox]() {
+    timerStart = QDateTime::currentDateTime();
+    timerEnd = timerStart.addDays(1);
+    connect(timerTaskButton, &QPushButton::clicked, [this, timerTaskButton, layout]() {
+        if (!timerTaskGroupBox) {
+            createTimerTaskPanel();
+            timerTaskGroupBox->setVisible(false);
+            layout->insertWidget(layout->indexOf(timerTaskButton) + 1, timerTaskGroupBox);
+        }
         bool isVisible = timerTaskGroupBox->isVisible();
         timerTaskGroupBox->setVisible(!isVisible);
         timerTaskButton->setText(isVisible ? QStringLiteral("▼ 定时任务") : QStringLiteral("▲ 定时任务"));
@@ -337,38 +417,122 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
         resize(currentWidth, height());
     });
 
-    QVBoxLayout *timerTaskLayout = new QVBoxLayout();
-
-    QVBoxLayout *timeRangeLayout = new QVBoxLayout();
-    QLabel *startTimeLabel = new QLabel(QStringLiteral("开始时间:"), this);
-    startTimeEdit = new QDateTimeEdit(QDateTime::currentDateTime(), this);
-    startTimeEdit->setCalendarPopup(true);
-    QLabel *endTimeLabel = new QLabel(QStringLiteral("停止时间:"), this);
-    endTimeEdit = new QDateTimeEdit(QDateTime::currentDateTime().addDays(1), this);
-    endTimeEdit->setCalendarPopup(true);
-
-    QHBoxLayout *startTimeLayout = new QHBoxLayout();
-    QHBoxLayout *endTimeLayout = new QHBoxLayout();
-    startTimeLayout->addWidget(startTimeLabel);
-    startTimeLayout->addWidget(startTimeEdit);
-    endTimeLayout->addWidget(endTimeLabel);
-    endTimeLayout->addWidget(endTimeEdit);
-    timeRangeLayout->addLayout(startTimeLayout);
-    timeRangeLayout->addLayout(endTimeLayout);
+    // 时间轴面板：多条按键轨道与上面的按键并行运行，文本修改后立即生效
+    QPushButton *timelineButton = new QPushButton(QStringLiteral("▼ 时间轴"), this);
+    layout->addWidget(timelineButton);
+    timelineButton->setStyleSheet("text-align: left; padding-left: 5px;");
+    connect(timelineButton, &QPushButton::clicked, [this, timelineButton, layout]() {
+        if (!timelineEdit) {
+            timelineEdit = new QPlainTextEdit(timelineText, this);
+            timelineEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+            timelineEdit->setMinimumHeight(120);
+            timelineEdit->setPlaceholderText(QStringLiteral("track 输出 loops 0\n"
+                                                            "step 1 gap 900-1100 normal repeat 3\n"
+                                                            "step Ctrl+2 hold 60 gap 1500 skip 0.1"));
+            timelineEdit->setToolTip(QStringLiteral("track 名称 [offset 毫秒] [loops 次数]  开始一条新轨道\n"
+                                                    "step 按键[+按键] [hold 毫秒] [gap 最小-最大 [uniform|normal|lognormal]] [repeat 次数] [skip 概率]\n"
+                                                    "各轨道同时运行，与上面勾选的按键互不影响"));
+            timelineEdit->setVisible(false);
+            layout->insertWidget(layout->indexOf(timelineButton) + 1, timelineEdit);
+            connect(timelineEdit, &QPlainTextEdit::textChanged, this, [this]() {
+                timelineText = timelineEdit->toPlainText();
+                applyTimeline();
+            });
+            applyTimeline();
+        }
+        bool isVisible = timelineEdit->isVisible();
+        timelineEdit->setVisible(!isVisible);
+        timelineButton->setText(isVisible ? QStringLiteral("▼ 时间轴") : QStringLiteral("▲ 时间轴"));
+        int currentWidth = width();
+        adjustSize();
+        resize(currentWidth, height());
+    });
 
-    timerTaskCheckBox = new QCheckBox(QStringLiteral("启用定时任务"), this);
-    connect(timerTaskCheckBox, &QCheckBox::stateChanged, this, &KeyPresserHardware::enableTimerTask);
+    // 像素触发面板：按目标窗口中指定位置的颜色按键或屏蔽按键
+    QPushButton *pixelButton = new QPushButton(QStringLiteral("▼ 像素触发"), this);
+    layout->addWidget(pixelButton);
+    pixelButton->setStyleSheet("text-align: left; padding-left: 5px;");
+    connect(pixelButton, &QPushButton::clicked, [this, pixelButton, layout]() {
+        if (!pixelPanel) {
+            createPixelPanel();
+            pixelPanel->setVisible(false);
+            layout->insertWidget(layout->indexOf(pixelButton) + 1, pixelPanel);
+        }
+        bool isVisible = pixelPanel->isVisible();
+        pixelPanel->setVisible(!isVisible);
+        pixelButton->setText(isVisible ? QStringLiteral("▼ 像素触发") : QStringLiteral("▲ 像素触发"));
+        int currentWidth = width();
+        adjustSize();
+        resize(currentWidth, height());
+    });
 
-    timerTaskLayout->addLayout(timeRangeLayout);
-    timerTaskLayout->addWidget(timerTaskCheckBox);
-    timerTaskGroupBox->setLayout(timerTaskLayout);
+    // 窗口配置面板：前台窗口符合规则时自动切换目标窗口和配置，运行中无需停止重选
+    QPushButton *windowProfilesButton = new QPushButton(QStringLiteral("▼ 窗口配置"), this);
+    layout->addWidget(windowProfilesButton);
+    windowProfilesButton->setStyleSheet("text-align: left; padding-left: 5px;");
+    connect(windowProfilesButton, &QPushButton::clicked, [this, windowProfilesButton, layout]() {
+        if (!windowProfilesEdit) {
+            windowProfilesEdit = new QPlainTextEdit(windowProfilesText, this);
+            windowProfilesEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+            windowProfilesEdit->setMinimumHeight(90);
+            windowProfilesEdit->setPlaceholderText(QStringLiteral("process game.exe \"D:\\配置\\游戏.kphset\"\n"
+                                                                  "title \"^记事本\" D:\\配置\\文本.kphset"));
+            windowProfilesEdit->setToolTip(QStringLiteral("process 进程名 配置文件  按可执行文件名（不区分大小写）\n"
+                                                          "class 窗口类名 配置文件  按窗口类名\n"
+                                                          "title 正则表达式 配置文件  按窗口标题\n"
+                                                          "前台窗口符合规则时自动设为目标窗口并加载配置，靠前的规则优先"));
+            windowProfilesEdit->setVisible(false);
+            layout->insertWidget(layout->indexOf(windowProfilesButton) + 1, windowProfilesEdit);
+            connect(windowProfilesEdit, &QPlainTextEdit::textChanged, this, [this]() {
+                windowProfilesText = windowProfilesEdit->toPlainText();
+                applyWindowProfiles();
+            });
+            applyWindowProfiles();
+        }
+        bool isVisible = windowProfilesEdit->isVisible();
+        windowProfilesEdit->setVisible(!isVisible);
+        windowProfilesButton->setText(isVisible ? QStringLiteral("▼ 窗口配置") : QStringLiteral("▲ 窗口配置"));
+        int currentWidth = width();
+        adjustSize();
+        resize(currentWidth, height());
+    });
 
-    layout->addWidget(timerTaskGroupBox);
+    // 运行指标面板：展开时每秒刷新一次
+    QPushButton *metricsButton = new QPushButton(QStringLiteral("▼ 运行指标"), this);
+    layout->addWidget(metricsButton);
+    metricsButton->setStyleSheet("text-align: left; padding-left: 5px;");
+    connect(metricsButton, &QPushButton::clicked, [this, metricsButton, layout]() {
+        if (!metricsView) {
+            metricsView = new QPlainTextEdit(this);
+            metricsView->setReadOnly(true);
+            metricsView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+            metricsView->setMinimumHeight(160);
+            metricsView->setVisible(false);
+            layout->insertWidget(layout->indexOf(metricsButton) + 1, metricsView);
+            metricsTimer = new QTimer(this);
+            connect(metricsTimer, &QTimer::timeout, this, &KeyPresserHardware::refreshMetricsView);
+        }
+        bool isVisible = metricsView->isVisible();
+        metricsView->setVisible(!isVisible);
+        metricsButton->setText(isVisible ? QStringLiteral("▼ 运行指标") : QStringLiteral("▲ 运行指标"));
+        if (isVisible) {
+            metricsTimer->stop();
+        } else {
+            refreshMetricsView();
+            metricsTimer->start(1000);
+        }
+        int currentWidth = width();
+        adjustSize();
+        resize(currentWidth, height());
+    });
 
-    // 初始化定时任务检查器
-    timerTaskChecker = new QTimer(this);
-    connect(timerTaskChecker, &QTimer::timeout, this, &KeyPresserHardware::checkTimerTask);
-    timerTaskChecker->start(1000); // 每秒检查一次
+    // 初始化定时任务：只在时间窗口开始/结束时刻触发，空闲时不占用CPU
+    calendar = new CalendarScheduler(this);
+    connect(calendar, &CalendarScheduler::activeChanged, this, &KeyPresserHardware::checkTimerTask);
+    connect(this, &KeyPresserHardware::windowStateChanged, this, [this]() {
+        // 时间窗口内才选中目标窗口时，立即开始
+        if (bTimerTaskEnabled && calendar->isActive() && !bIsRuning) startPressing();
+    });
     bTimerTaskEnabled = false;
 
     QHBoxLayout *shortcutLayout = new QHBoxLayout();
@@ -407,10 +571,26 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     shortcutLayout->addWidget(triggerKeyComboBox);
     shortcutLayout->addStretch();
 
+    // 全局热键：钩子线程中直接让调度器停止发送按键，界面状态随后同步
+    hotkeys = new HotkeyService(std::unique_ptr<HotkeyBackend>(new LowLevelHookBackend), this);
+    hotkeys->setStopHandler([this]() { return scheduler->isRunning(); },
+                            [this]() { scheduler->requestStop(); });
+    connect(hotkeys, &HotkeyService::toggled, this, [this](bool wasRunning, qint64 pressedAt) {
+        if (wasRunning) {
+            stopPressing();
+            hotkeys->markStopped(pressedAt);
+        } else if (!bIsRuning) {
+            startPressing();
+        }
+    });
+    connect(triggerKeyComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        hotkeys->setKey(triggerKeyComboBox->currentData().toUInt());
+    });
+
     layout->addLayout(shortcutLayout);
 
-    QLabel *labelPrompt = new QLabel(QStringLiteral("修改配置后需点击开始按钮以使更改生效。"), this);
-    labelPrompt->setStyleSheet("color: red;");
+    QLabel *labelPrompt = new QLabel(QStringLiteral("运行中修改配置将立即生效，无需重新开始。"), this);
+    labelPrompt->setStyleSheet("color: gray;");
     layout->addWidget(labelPrompt);
 
     instructionLabel = new QLabel(QStringLiteral("停止中"), this);
@@ -424,39 +604,73 @@ KeyPresserHardware::KeyPresserHardware(QWidget *parent) : QWidget(parent)
     connect(aboutButton, &QPushButton::clicked, this, &KeyPresserHardware::aboutMe);
     connect(topmostCheckBox, &QCheckBox::stateChanged, this, &KeyPresserHardware::onTopmostCheckBoxChanged);
 
-    spaceTimer = new QTimer(this);
-    connect(spaceTimer, &QTimer::timeout, [this]() {
-        pressSpace();
-        int minInterval = spaceIntervalLineEdit->text().toInt();
-        int maxInterval = spaceMaxIntervalLineEdit->text().toInt();
-        if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
-        int interval = getRandomInterval(minInterval, maxInterval);
-        spaceTimer->start(interval);
+    connect(spaceCheckBox, &QCheckBox::toggled, this, [this]() { applySlotEdit(kSpaceSlot); });
+    connect(spaceIntervalLineEdit, &QLineEdit::editingFinished, this, [this]() { applySlotEdit(kSpaceSlot); });
+    connect(spaceMaxIntervalLineEdit, &QLineEdit::editingFinished, this, [this]() { applySlotEdit(kSpaceSlot); });
+
+    // 目标窗口状态由事件驱动缓存，按键前只在被最小化或失去置顶时才恢复/置顶
+    windowTracker = new WindowStateTracker(this);
+    connect(windowTracker, &WindowStateTracker::targetLost, this, [this]() {
+        if (bIsRuning) stopPressing();
+        targetHwnd = nullptr;
+        selectedWindowLabel->setText(QStringLiteral("目标窗口已关闭，请重新选择"));
+        selectedWindowLabel->setToolTip(QString());
+    });
+    scheduler->setBeforePressHook([this]() {
+        if (!bIsRuning || !targetHwnd) return false;
+        return windowTracker->prepareForPress(topmostCheckBox->isChecked());
     });
+    profileSwitcher = new WindowProfileSwitcher(this);
+    connect(profileSwitcher, &WindowProfileSwitcher::matched, this, &KeyPresserHardware::switchToWindowProfile);
 
+    StartupProfile::mark("services");
     loadSettings();
+    StartupProfile::mark("load settings");
+    if (!hotkeys->start(triggerKeyComboBox->currentData().toUInt())) {
+        qWarning() << "Failed to install the start/stop hotkey hook";
+    }
+    StartupProfile::mark("hotkey hook");
 
 
-    //QString currentPath = QCoreApplication::applicationDirPath();
-    //QString hexPath = QDir(currentPath).filePath("keypresser.ino.hex");
-    //_controller.uploadSketch(hexPath.toLocal8Bit().toStdString());
+}
 
+bool KeyPresserHardware::checkArduino()
+{
+    if (_controller.isConnected()) return true;
+    return connectArduino(SerialPort::findArduinoLeonardoPort());
+}
 
+void KeyPresserHardware::checkArduinoAsync()
+{
+    arduinoLabel->setText(QStringLiteral("正在检测Arduino Leonardo..."));
+    arduinoLabel->setStyleSheet("color: gray;");
+    // SetupAPI枚举和COM口扫描可能耗时数秒，放到线程池中，不推迟窗口显示
+    QPointer<KeyPresserHardware> self(this);
+    QThreadPool::globalInstance()->start([self]() {
+        std::string portName = SerialPort::findArduinoLeonardoPort();
+        if (!self) return;
+        QMetaObject::invokeMethod(self, [self, portName]() {
+            if (self) self->connectArduino(portName);
+            StartupProfile::mark("device probe");
+        }, Qt::QueuedConnection);
+    });
 }
 
-bool KeyPresserHardware::checkArduino()
+bool KeyPresserHardware::connectArduino(std::string portName)
 {
     static bool bFirst = true;
     if(!bFirst) return true;
-    std::string portName = SerialPort::findArduinoLeonardoPort(true);
     if (portName.empty()) {
         portName = QInputDialog::getText(this, QStringLiteral("无法自动检测到Arduino Leonardo！"), QStringLiteral("请插入Arduino Leonardo后重启软件或手动输入端口名称 (如 COM3): ")).toStdString();
     }
     else {
-        qInfo() << QStringLiteral("\n自动检测到Arduino Leonardo端口: ");
+        KP_TRACE_INFO("Detected Arduino Leonardo on %s", portName);
     }
     // 2. 连接到Arduino
     if (!_controller.connect(portName)) {
+        // 检测在后台完成，失败时要把“正在检测”改掉，否则关闭对话框后状态一直停在检测中
+        arduinoLabel->setText(QStringLiteral("未连接到Arduino Leonardo"));
+        arduinoLabel->setStyleSheet("color: red;");
 
         switch( QMessageBox::critical(this,QStringLiteral("错误"),QStringLiteral("无法连接到Arduino Leonardo！请重新插拔Arduino Leonardo开发板的USB 或 点击Arduino Leonardo开发板上的Reset按钮（红色按钮）后重试！"),QStringLiteral("购买Leonardo开发板"), QStringLiteral("关闭"),0,1))
         {
@@ -475,7 +689,7 @@ bool KeyPresserHardware::checkArduino()
         return false;
     }
 
-    qInfo() << QStringLiteral("成功连接到Arduino！");
+    KP_TRACE_INFO("Connected to %s", portName);
 
     //setWindowTitle(QStringLiteral("KeyPresser硬件版-成功连接到Arduino Leonardo端口:") + portName.c_str());
     arduinoLabel->setText(QStringLiteral("成功连接到Arduino Leonardo端口:") + portName.c_str());
@@ -501,161 +715,140 @@ void KeyPresserHardware::highlightWindow() {
         raise();
         activateWindow();
 
-        // 获取窗口的矩形区域
+        // 在目标窗口上方闪烁高亮框，由定时器驱动，不阻塞调度也不让目标重绘
         RECT rect;
         GetWindowRect(targetHwnd, &rect);
+        if (!highlightOverlay) highlightOverlay = new HighlightOverlay(this);
+        highlightOverlay->flash(rect);
 
-        // 获取窗口的设备上下文
-        HDC hdc = GetWindowDC(NULL);  // 使用屏幕的设备上下文
+    } else {
+        QMessageBox::warning(this, QStringLiteral("警告"), QStringLiteral("请先选择一个窗口！"));
+    }
+}
 
-        // 创建一个红色画笔
-        HPEN hRedPen = CreatePen(PS_SOLID, 3, RGB(255, 0, 0));
-        HPEN hWhitePen = CreatePen(PS_SOLID, 3, RGB(255, 255, 255));
 
-        int borderWidth = 3;
-        for(int i = 0; i < 10; i++){
-            SelectObject(hdc, i%2 ? hRedPen : hWhitePen);
-            // 绘制红色框，稍微扩大边界以避免遮盖
-            Rectangle(hdc, rect.left - borderWidth, rect.top - borderWidth, rect.right + borderWidth, rect.bottom + borderWidth);
-            Sleep(30);
-        }
+void KeyPresserHardware::simulateProfile() {
+    bool ok = false;
+    double hours = QInputDialog::getDouble(this, QStringLiteral("模拟运行"), QStringLiteral("模拟时长（小时）:"),
+                                           8.0, 0.1, 1000.0, 1, &ok);
+    if (!ok) return;
 
-        // 释放资源
-        //SelectObject(hdc, hOldPen);
-        DeleteObject(hRedPen);
-        DeleteObject(hWhitePen);
-        ReleaseDC(NULL, hdc);
+    // 经由配置文件得到与无界面模式相同的配置快照
+    QTemporaryFile file;
+    if (!file.open()) return;
+    file.close();
+    QSettings settings(file.fileName(), QSettings::IniFormat);
+    saveSettingsToObject(settings);
+    settings.sync();
+    SlotProfile profile = SlotProfile::fromSettings(settings);
+    if (!profile.error.isEmpty()) {
+        QMessageBox::warning(this, QStringLiteral("模拟运行"), QStringLiteral("间隔分布使用录制样本，但样本文件无法读取，请先重新选择样本文件。"));
+        return;
+    }
+    SimulationResult result = ProfileSimulator::run(profile, static_cast<qint64>(hours * 3600000.0));
+
+    QMessageBox box(QMessageBox::Information, QStringLiteral("模拟结果"), result.summary(), QMessageBox::Close, this);
+    QPushButton *saveButton = box.addButton(QStringLiteral("保存时间线"), QMessageBox::ActionRole);
+    box.exec();
+    if (box.clickedButton() != saveButton) return;
+    QString path = QFileDialog::getSaveFileName(this, QStringLiteral("保存时间线"), QDir::currentPath(),
+                                                QStringLiteral("CSV文件 (*.csv)"));
+    if (!path.isEmpty() && !result.writeTimeline(path)) {
+        QMessageBox::warning(this, QStringLiteral("模拟结果"), QStringLiteral("无法写入文件：") + path);
+    }
+}
 
-        // 等待3秒
-        //Sleep(2000);
+void KeyPresserHardware::flashFirmware() {
+    if (!flasher) {
+        flasher = new FirmwareFlasher(&_controller, this);
+        connect(flasher, &FirmwareFlasher::progress, this, [this](int percent, const QString &message) {
+            arduinoLabel->setText(QStringLiteral("%1 %2%").arg(message).arg(percent));
+            arduinoLabel->setStyleSheet("color: blue;");
+        });
+        connect(flasher, &FirmwareFlasher::finished, this, [this](FirmwareFlasher::Result result, const QString &message) {
+            bool connected = _controller.isConnected();
+            arduinoLabel->setText(connected ? QStringLiteral("成功连接到Arduino Leonardo端口:") + QString::fromStdString(_controller.getPortName())
+                                            : QStringLiteral("未连接到Arduino Leonardo"));
+            arduinoLabel->setStyleSheet(connected ? "color: green;" : "color: red;");
+            if (result == FirmwareFlasher::Failed) {
+                QMessageBox::warning(this, QStringLiteral("固件"), message);
+            } else if (result != FirmwareFlasher::Cancelled) {
+                QMessageBox::information(this, QStringLiteral("固件"), message);
+            }
+        });
+    }
 
-        // 重新绘制窗口以清除红色框
-        InvalidateRect(targetHwnd, NULL, TRUE);
-        UpdateWindow(targetHwnd);
+    if (flasher->isBusy()) {
+        flasher->cancel();
+        return;
+    }
 
-    } else {
-        QMessageBox::warning(this, QStringLiteral("警告"), QStringLiteral("请先选择一个窗口！"));
+    QString hexPath = QDir(QCoreApplication::applicationDirPath()).filePath("keypresser.ino.hex");
+    if (!QFileInfo::exists(hexPath)) {
+        hexPath = QFileDialog::getOpenFileName(this, QStringLiteral("选择固件"), QDir::currentPath(),
+                                               QStringLiteral("Arduino固件 (*.hex)"));
+        if (hexPath.isEmpty()) return;
     }
+
+    // 烧录期间串口会被释放，先停止运行
+    if (bIsRuning) stopPressing();
+    flasher->start(hexPath);
 }
 
+QGroupBox *KeyPresserHardware::createTimerTaskPanel() {
+    timerTaskGroupBox = new QGroupBox(QStringLiteral("设置定时任务"), this);
+    QVBoxLayout *timerTaskLayout = new QVBoxLayout();
 
-// Arduino特殊键码定义
-#define ARDUINO_KEY_LEFT_SHIFT 129
-#define ARDUINO_KEY_LEFT_CTRL 128
-#define ARDUINO_KEY_LEFT_ALT 130
-#define ARDUINO_KEY_LEFT_GUI 131
-#define ARDUINO_KEY_RIGHT_GUI 135
-#define ARDUINO_KEY_F1 0x3A
-#define ARDUINO_KEY_F2 0x3B
-#define ARDUINO_KEY_F3 0x3C
-#define ARDUINO_KEY_F4 0x3D
-#define ARDUINO_KEY_F5 0x3E
-#define ARDUINO_KEY_F6 0x3F
-#define ARDUINO_KEY_F7 0x40
-#define ARDUINO_KEY_F8 0x41
-#define ARDUINO_KEY_F9 0x42
-#define ARDUINO_KEY_F10 0x43
-#define ARDUINO_KEY_F11 0x44
-#define ARDUINO_KEY_F12 0x45
-#define ARDUINO_KEY_SPACE 0x20
-#define ARDUINO_KEY_RETURN 0x28
-#define ARDUINO_KEY_TAB 0x2B
-#define ARDUINO_KEY_ESCAPE 0x29
-#define ARDUINO_KEY_BACK 0x2A
-#define ARDUINO_KEY_INSERT 0x49
-#define ARDUINO_KEY_DELETE 0x4C
-#define ARDUINO_KEY_HOME 0x4A
-#define ARDUINO_KEY_END 0x4D
-#define ARDUINO_KEY_PAGE_UP 0x4B
-#define ARDUINO_KEY_PAGE_DOWN 0x4E
-#define ARDUINO_KEY_LEFT 0x50
-#define ARDUINO_KEY_RIGHT 0x4F
-#define ARDUINO_KEY_UP 0x52
-#define ARDUINO_KEY_DOWN 0x51
-
-void KeyPresserHardware::populateShortcutCombos(QComboBox *comboBox)
-{
-    // 添加单个修饰键
-    comboBox->addItem("", QStringList());
-    comboBox->addItem("Shift", QStringList() << QString::number(ARDUINO_KEY_LEFT_SHIFT));
-    comboBox->addItem("Ctrl", QStringList() << QString::number(ARDUINO_KEY_LEFT_CTRL));
-    comboBox->addItem("Alt", QStringList() << QString::number(ARDUINO_KEY_LEFT_ALT));
-    comboBox->addItem("Win", QStringList() << QString::number(ARDUINO_KEY_LEFT_GUI));
-
-    // 添加常见的两键组合
-    comboBox->addItem("Shift+Ctrl", QStringList() << QString::number(ARDUINO_KEY_LEFT_SHIFT) << QString::number(ARDUINO_KEY_LEFT_CTRL));
-    comboBox->addItem("Shift+Alt", QStringList() << QString::number(ARDUINO_KEY_LEFT_SHIFT) << QString::number(ARDUINO_KEY_LEFT_ALT));
-    comboBox->addItem("Ctrl+Alt", QStringList() << QString::number(ARDUINO_KEY_LEFT_CTRL) << QString::number(ARDUINO_KEY_LEFT_ALT));
-    comboBox->addItem("Ctrl+Win", QStringList() << QString::number(ARDUINO_KEY_LEFT_CTRL) << QString::number(ARDUINO_KEY_LEFT_GUI));
-    comboBox->addItem("Alt+Win", QStringList() << QString::number(ARDUINO_KEY_LEFT_ALT) << QString::number(ARDUINO_KEY_LEFT_GUI));
-    comboBox->addItem("Shift+Win", QStringList() << QString::number(ARDUINO_KEY_LEFT_SHIFT) << QString::number(ARDUINO_KEY_LEFT_GUI));
-}
+    QVBoxLayout *timeRangeLayout = new QVBoxLayout();
+    QLabel *startTimeLabel = new QLabel(QStringLiteral("开始时间:"), this);
+    startTimeEdit = new QDateTimeEdit(timerStart, this);
+    startTimeEdit->setCalendarPopup(true);
+    QLabel *endTimeLabel = new QLabel(QStringLiteral("停止时间:"), this);
+    endTimeEdit = new QDateTimeEdit(timerEnd, this);
+    endTimeEdit->setCalendarPopup(true);
+
+    QHBoxLayout *startTimeLayout = new QHBoxLayout();
+    QHBoxLayout *endTimeLayout = new QHBoxLayout();
+    startTimeLayout->addWidget(startTimeLabel);
+    startTimeLayout->addWidget(startTimeEdit);
+    endTimeLayout->addWidget(endTimeLabel);
+    endTimeLayout->addWidget(endTimeEdit);
+    timeRangeLayout->addLayout(startTimeLayout);
+    timeRangeLayout->addLayout(endTimeLayout);
+
+    QLabel *timerRulesLabel = new QLabel(QStringLiteral("附加时间规则（每行一条）:"), this);
+    timerRulesEdit = new QPlainTextEdit(timerRules, this);
+    timerRulesEdit->setFixedHeight(60);
+    timerRulesEdit->setPlaceholderText(QStringLiteral("daily 09:00 18:00"));
+    timerRulesEdit->setToolTip(QStringLiteral("once 2026-10-19T09:00:00 2026-10-19T18:00:00  单次\n"
+                                              "daily 09:00 18:00  每天\n"
+                                              "weekly 1,2,3,4,5 09:00 18:00  每周（1=周一）\n"
+                                              "cron 0 9-17 * * 1-5 30  分 时 日 月 周 持续分钟"));
 
-void KeyPresserHardware::populateKeyCombos(QComboBox *comboBox) {
-    comboBox->addItem("F1", ARDUINO_KEY_F1);
-    comboBox->addItem("F2", ARDUINO_KEY_F2);
-    comboBox->addItem("F3", ARDUINO_KEY_F3);
-    comboBox->addItem("F4", ARDUINO_KEY_F4);
-    comboBox->addItem("F5", ARDUINO_KEY_F5);
-    comboBox->addItem("F6", ARDUINO_KEY_F6);
-    comboBox->addItem("F7", ARDUINO_KEY_F7);
-    comboBox->addItem("F8", ARDUINO_KEY_F8);
-    comboBox->addItem("F9", ARDUINO_KEY_F9);
-    comboBox->addItem("F10", ARDUINO_KEY_F10);
-    comboBox->addItem("F11", ARDUINO_KEY_F11);
-    comboBox->addItem("F12", ARDUINO_KEY_F12);
-    comboBox->addItem("A", 'A');
-    comboBox->addItem("B", 'B');
-    comboBox->addItem("C", 'C');
-    comboBox->addItem("D", 'D');
-    comboBox->addItem("E", 'E');
-    comboBox->addItem("F", 'F');
-    comboBox->addItem("G", 'G');
-    comboBox->addItem("H", 'H');
-    comboBox->addItem("I", 'I');
-    comboBox->addItem("J", 'J');
-    comboBox->addItem("K", 'K');
-    comboBox->addItem("L", 'L');
-    comboBox->addItem("M", 'M');
-    comboBox->addItem("N", 'N');
-    comboBox->addItem("O", 'O');
-    comboBox->addItem("P", 'P');
-    comboBox->addItem("Q", 'Q');
-    comboBox->addItem("R", 'R');
-    comboBox->addItem("S", 'S');
-    comboBox->addItem("T", 'T');
-    comboBox->addItem("U", 'U');
-    comboBox->addItem("V", 'V');
-    comboBox->addItem("W", 'W');
-    comboBox->addItem("X", 'X');
-    comboBox->addItem("Y", 'Y');
-    comboBox->addItem("Z", 'Z');
-    comboBox->addItem("0", '0');
-    comboBox->addItem("1", '1');
-    comboBox->addItem("2", '2');
-    comboBox->addItem("3", '3');
-    comboBox->addItem("4", '4');
-    comboBox->addItem("5", '5');
-    comboBox->addItem("6", '6');
-    comboBox->addItem("7", '7');
-    comboBox->addItem("8", '8');
-    comboBox->addItem("9", '9');
-    comboBox->addItem("Shift", ARDUINO_KEY_LEFT_SHIFT);
-    comboBox->addItem("Space", ARDUINO_KEY_SPACE);
-    comboBox->addItem("Enter", ARDUINO_KEY_RETURN);
-    comboBox->addItem("Tab", ARDUINO_KEY_TAB);
-    comboBox->addItem("Esc", ARDUINO_KEY_ESCAPE);
-    comboBox->addItem("Backspace", ARDUINO_KEY_BACK);
-    comboBox->addItem("Insert", ARDUINO_KEY_INSERT);
-    comboBox->addItem("Delete", ARDUINO_KEY_DELETE);
-    comboBox->addItem("Home", ARDUINO_KEY_HOME);
-    comboBox->addItem("End", ARDUINO_KEY_END);
-    comboBox->addItem("Page Up", ARDUINO_KEY_PAGE_UP);
-    comboBox->addItem("Page Down", ARDUINO_KEY_PAGE_DOWN);
-    comboBox->addItem("Left Arrow", ARDUINO_KEY_LEFT);
-    comboBox->addItem("Right Arrow", ARDUINO_KEY_RIGHT);
-    comboBox->addItem("Up Arrow", ARDUINO_KEY_UP);
-    comboBox->addItem("Down Arrow", ARDUINO_KEY_DOWN);
+    timerTaskCheckBox = new QCheckBox(QStringLiteral("启用定时任务"), this);
+    timerTaskCheckBox->setChecked(bTimerTaskEnabled);
+    connect(timerTaskCheckBox, &QCheckBox::stateChanged, this, &KeyPresserHardware::enableTimerTask);
+
+    timerTaskLayout->addLayout(timeRangeLayout);
+    timerTaskLayout->addWidget(timerRulesLabel);
+    timerTaskLayout->addWidget(timerRulesEdit);
+    timerTaskLayout->addWidget(timerTaskCheckBox);
+    timerTaskGroupBox->setLayout(timerTaskLayout);
+
+    connect(startTimeEdit, &QDateTimeEdit::dateTimeChanged, this, [this](const QDateTime &dateTime) {
+        timerStart = dateTime;
+        applyTimerWindows();
+    });
+    connect(endTimeEdit, &QDateTimeEdit::dateTimeChanged, this, [this](const QDateTime &dateTime) {
+        timerEnd = dateTime;
+        applyTimerWindows();
+    });
+    connect(timerRulesEdit, &QPlainTextEdit::textChanged, this, [this]() {
+        timerRules = timerRulesEdit->toPlainText();
+        applyTimerWindows();
+    });
+    applyTimerWindows();
+    return timerTaskGroupBox;
 }
 
 void KeyPresserHardware::selectWindow() {
@@ -666,7 +859,13 @@ void KeyPresserHardware::selectWindow() {
 void KeyPresserHardware::togglePressing()
 {
     bIsRuning ? stopPressing() : startPressing();
-    qApp->setStyleSheet(qApp->styleSheet());
+}
+
+void KeyPresserHardware::refreshToggleButtonStyle()
+{
+    // state属性改变后只重新应用该按钮的样式，不重新解析整个样式表
+    toggleButton->style()->unpolish(toggleButton);
+    toggleButton->style()->polish(toggleButton);
 }
 
 void KeyPresserHardware::startPressing() {
@@ -675,70 +874,36 @@ void KeyPresserHardware::startPressing() {
         QMessageBox::warning(this, QStringLiteral("警告"), QStringLiteral("请选择窗口后，再点击开始！"));
         return;
     }
+    // 样本缺失时不悄悄改用均匀分布
+    if (usesEmpiricalSamples() && !empiricalTable) {
+        QMessageBox::warning(this, QStringLiteral("警告"),
+                             QStringLiteral("间隔分布使用录制样本，但样本文件无法读取：%1\n请点击“样本文件...”重新选择。")
+                                 .arg(empiricalPath.isEmpty() ? QStringLiteral("（未导入）") : empiricalPath));
+        return;
+    }
 
     bIsRuning = !bIsRuning;
     toggleButton->setText(QStringLiteral("停止"));
     toggleButton->setProperty("state", "running");
+    refreshToggleButtonStyle();
 
     instructionLabel->setText(QStringLiteral("运行中"));
-    stopAllTimers();
+    scheduler->stop();
+    applyAllSlots();
 
     // 根据模式选择不同处理逻辑
     if(sequentialModeRadio->isChecked()) {
         // 顺序触发模式
-        QList<int> selectedKeys;
-        for(int i = 0; i < 15; ++i) {
-            if(keyCheckBoxes[i]->isChecked()) {
-                selectedKeys.append(i);
-            }
-        }
-        currentIndex = 0;
-        sequenceTimer = new QTimer(this);
-        connect(sequenceTimer, &QTimer::timeout, [this, selectedKeys]() {
-            if(!selectedKeys.isEmpty()) {
-                if(currentIndex < selectedKeys.size()) {
-                    pressKeys(selectedKeys[currentIndex]);
-                    currentIndex = (currentIndex + 1) % selectedKeys.size();
-                }
-
-                // 动态获取时间设置
-                int currentKey = selectedKeys[currentIndex];
-                int minInterval = intervalLineEdits[currentKey]->text().toInt();
-                int maxInterval = maxIntervalLineEdits[currentKey]->text().toInt();
-                if(minInterval > maxInterval) std::swap(minInterval, maxInterval);
-                sequenceTimer->start(getRandomInterval(minInterval, maxInterval));
-            }
-        });
-
-        // 初始时间间隔
-        if(!selectedKeys.isEmpty()) {
-            int minInterval = intervalLineEdits[selectedKeys[0]]->text().toInt();
-            int maxInterval = maxIntervalLineEdits[selectedKeys[0]]->text().toInt();
-            if(minInterval > maxInterval) std::swap(minInterval, maxInterval);
-            sequenceTimer->start(getRandomInterval(minInterval, maxInterval));
-        }
+        scheduler->setMode(PressScheduler::Sequential);
     } else {
         // 原有独立触发模式
+        scheduler->setMode(PressScheduler::Independent);
         attachToTargetWindow();
-        if (spaceCheckBox->isChecked()) {
-            pressSpace();
-            int minInterval = spaceIntervalLineEdit->text().toInt();
-            int maxInterval = spaceMaxIntervalLineEdit->text().toInt();
-            if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
-            int interval = getRandomInterval(minInterval, maxInterval);
-            spaceTimer->start(interval);
-        }
-        for (int i = 0; i < 15; ++i) {
-            if (keyCheckBoxes[i]->isChecked() && keyCombos[i]->currentIndex() != -1) {
-                pressKeys(i);
-                int minInterval = intervalLineEdits[i]->text().toInt();
-                int maxInterval = maxIntervalLineEdits[i]->text().toInt();
-                if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
-                int interval = getRandomInterval(minInterval, maxInterval);
-                timers[i]->start(interval);
-            }
-        }
     }
+    scheduler->start();
+    // 没有规则时start不会启动定时器
+    pixelTrigger->setSource(std::make_unique<GdiFrameSource>(targetHwnd));
+    pixelTrigger->start();
 }
 
 void KeyPresserHardware::stopPressing() {
@@ -747,12 +912,9 @@ void KeyPresserHardware::stopPressing() {
     toggleButton->setText(QStringLiteral("开始"));
     instructionLabel->setText(QStringLiteral("停止中"));
     toggleButton->setProperty("state", "stopped");
-    stopAllTimers();
-    if(sequenceTimer) {
-        sequenceTimer->stop();
-        delete sequenceTimer;
-        sequenceTimer = nullptr;
-    }
+    refreshToggleButtonStyle();
+    pixelTrigger->stop();
+    scheduler->stop();
     // 清理消息队列中的按键和窗口消息
     if (targetHwnd) {
         MSG msg;
@@ -774,80 +936,142 @@ void KeyPresserHardware::aboutMe()
     dlg.exec();
 }
 
-void KeyPresserHardware::stopAllTimers() {
-    spaceTimer->stop();
-    for (QTimer *timer : timers) {
-        timer->stop();
-    }
-}
-
 void KeyPresserHardware::pressSpace() {
-    if(!bIsRuning) return;
-    if (targetHwnd) {
-        if(topmostCheckBox->isChecked()){
-            // 如果窗口最小化则先恢复窗口
-            if (IsIconic(targetHwnd)) {
-                ShowWindow(targetHwnd, SW_RESTORE);
-            }
-            SetWindowPos(targetHwnd, topmostCheckBox->isChecked() ? HWND_TOPMOST : HWND_NOTOPMOST,
-                         0, 0, 0, 0, SWP_SHOWWINDOW | SWP_NOMOVE | SWP_NOSIZE);
-        }
-
-        _controller.sendKey(std::to_string(VK_SPACE));
-        return;
-    }
+    scheduler->pressNow(kSpaceSlot);
 }
 
 void KeyPresserHardware::onTopmostCheckBoxChanged(int state) {
     bool topmost = (state == Qt::Checked);
     if(!topmost) SetWindowPos(targetHwnd, HWND_NOTOPMOST, 0, 0, 0, 0, SWP_SHOWWINDOW | SWP_NOMOVE | SWP_NOSIZE);
+    windowTracker->refresh();
 }
 
-std::vector<std::string> qStringListToStdVector(const QStringList &qList)
-{
-    std::vector<std::string> stdVector;
-    stdVector.reserve(qList.size()); // 预分配内存，提高性能
+void KeyPresserHardware::pressKeys(int index) {
+    scheduler->pressNow(index);
+}
 
-    for (const QString &str : qList) {
-        // 使用toStdString()方法将QString转换为std::string
-        stdVector.push_back(str.toStdString());
+SlotConfig KeyPresserHardware::slotConfigFromUi(int index) const {
+    SlotConfig config;
+    const int key = SlotProfile::keyOfSlot(index);
+    if (index == kSpaceSlot) {
+        config = SlotProfile::spaceSlot(spaceCheckBox->isChecked(),
+                                        spaceIntervalLineEdit->text().toInt(),
+                                        spaceMaxIntervalLineEdit->text().toInt());
+    } else if (key < slotModel->rowCount()) {
+        SlotTableModel::Row values = slotModel->row(key);
+        config = SlotProfile::keySlot(values.checked, values.shortcutIndex, values.keyIndex,
+                                      values.minInterval, values.maxInterval);
+    } else {
+        return config;  // 按键不足15个时的空位
     }
 
-    return stdVector;
+    QString distribution = distributionOverrides.value(index);
+    if (distribution.isEmpty()) {
+        distribution = distributionCombo ? distributionCombo->currentData().toString() : QString("uniform");
+    }
+    config.distribution = IntervalDistribution::fromName(distribution.toStdString());
+    if (config.distribution == IntervalDistribution::Empirical) {
+        config.empirical = empiricalTable;
+    }
+    return config;
 }
 
-void KeyPresserHardware::pressKeys(int index) {
-    if(!bIsRuning) return;
-    if (targetHwnd) {
-        if(topmostCheckBox->isChecked()){
-            // 如果窗口最小化则先恢复窗口
-            if (IsIconic(targetHwnd)) {
-                ShowWindow(targetHwnd, SW_RESTORE);
-            }
-            SetWindowPos(targetHwnd, topmostCheckBox->isChecked() ? HWND_TOPMOST : HWND_NOTOPMOST,
-                         0, 0, 0, 0, SWP_SHOWWINDOW | SWP_NOMOVE | SWP_NOSIZE);
-        }
+bool KeyPresserHardware::chooseEmpiricalSamples() {
+    QString path = QFileDialog::getOpenFileName(this, QStringLiteral("导入按键间隔样本"), QDir::homePath(),
+                                                QStringLiteral("间隔样本 (*.txt *.csv);;所有文件 (*)"));
+    if (path.isEmpty()) return false;
 
-        int key = keyCombos[index]->currentData().toInt();
+    auto table = SlotProfile::loadEmpirical(path);
+    if (!table) {
+        QMessageBox::warning(this, QStringLiteral("导入失败"), QStringLiteral("文件中至少需要两个有效的间隔（每行一个，单位毫秒）"));
+        return false;
+    }
+    empiricalPath = path;
+    empiricalTable = table;
+    updateSamplesButton();
+    return true;
+}
 
-        QStringList shortCuts = shortcutCombos[index]->currentData().toStringList();
-        std::vector<std::string> stdVector = qStringListToStdVector(shortCuts);
-        if(shortCuts.size() == 0) _controller.sendKey(std::to_string(key));
-        else {
-            stdVector.emplace_back(std::to_string(key));
-            _controller.pressKeyCombination(stdVector);
-        }
-        return;
+bool KeyPresserHardware::usesEmpiricalSamples() const {
+    if (distributionCombo && distributionCombo->currentData().toString() == "empirical") return true;
+    for (const QString &distribution : distributionOverrides) {
+        if (distribution == "empirical") return true;
+    }
+    return false;
+}
+
+void KeyPresserHardware::updateSamplesButton() {
+    if (!samplesButton) return;
+    samplesButton->setVisible(usesEmpiricalSamples());
+    bool missing = !empiricalTable;
+    samplesButton->setStyleSheet(missing ? "color: red;" : QString());
+    if (empiricalPath.isEmpty()) {
+        samplesButton->setToolTip(QStringLiteral("尚未导入样本文件"));
+    } else {
+        samplesButton->setToolTip((missing ? QStringLiteral("样本文件无法读取：") : QStringLiteral("当前样本文件：")) + empiricalPath);
+    }
+}
+
+void KeyPresserHardware::applySlotEdit(int index) {
+    scheduler->setSlot(index, slotConfigFromUi(index));
+}
+
+void KeyPresserHardware::refreshMetricsView() {
+    Metrics::Registry &registry = Metrics::Registry::instance();
+    QStringList lines;
+    lines << QStringLiteral("串口写入 %1 次，命令 %2 条，%3 字节，失败 %4 次")
+                 .arg(registry.counterValue("kp_serial_writes_total"))
+                 .arg(registry.counterValue("kp_serial_commands_total"))
+                 .arg(registry.counterValue("kp_serial_bytes_written_total"))
+                 .arg(registry.counterValue("kp_serial_write_failures_total"));
+    if (scheduler->leadTime() > 0) {
+        DeviceClock::Estimate clock = _controller.clockEstimate();
+        lines << (clock.synced ? QStringLiteral("设备时钟：往返 %1 us，漂移 %2 ppm，提前 %3 ms发送")
+                                     .arg(clock.roundTripUs)
+                                     .arg(clock.driftPpm, 0, 'f', 1)
+                                     .arg(scheduler->leadTime())
+                               : QStringLiteral("设备时钟未同步（固件不支持时钟探测），按键即时发送"));
+    }
+    qint64 savedCommands = registry.counterValue("kp_peephole_saved_commands_total");
+    if (savedCommands > 0) {
+        lines << QStringLiteral("合并优化节省命令 %1 条，%2 字节")
+                     .arg(savedCommands)
+                     .arg(registry.counterValue("kp_peephole_saved_bytes_total"));
     }
+
+    Metrics::Histogram::Snapshot io = registry.histogramSnapshot("kp_serial_write_seconds");
+    Metrics::Histogram::Snapshot late = registry.histogramSnapshot("kp_press_lateness_ms");
+    lines << QStringLiteral("平均写入耗时 %1 ms，平均触发延迟 %2 ms")
+                 .arg(io.count ? io.sum * 1000.0 / io.count : 0.0, 0, 'f', 2)
+                 .arg(late.count ? late.sum / late.count : 0.0, 0, 'f', 1);
+
+    lines << QStringLiteral("槽位   次数   失败   抽取间隔   实际间隔");
+    for (int i = 0; i < scheduler->slotCount(); ++i) {
+        std::string label = "slot=\"" + std::to_string(i) + "\"";
+        qint64 presses = registry.counterValue("kp_presses_total", label);
+        if (presses == 0) continue;
+        QString name = (i == kSpaceSlot) ? QStringLiteral("空格") : QString::number(SlotProfile::keyOfSlot(i) + 1);
+        lines << QString("%1 %2 %3 %4 %5")
+                     .arg(name, -6)
+                     .arg(presses, -6)
+                     .arg(registry.counterValue("kp_press_failures_total", label), -6)
+                     .arg(registry.gaugeValue("kp_interval_planned_ms", label), -10, 'f', 0)
+                     .arg(registry.gaugeValue("kp_interval_achieved_ms", label), -10, 'f', 0);
+    }
+    metricsView->setPlainText(lines.join('\n'));
 }
 
-int KeyPresserHardware::getRandomInterval(int minInterval, int maxInterval) {
-    return (minInterval == maxInterval) ? minInterval : QRandomGenerator::global()->bounded(minInterval, maxInterval + 1);
+void KeyPresserHardware::applyAllSlots() {
+    for (int i = 0; i < scheduler->slotCount(); ++i) {
+        applySlotEdit(i);
+    }
 }
 
 void KeyPresserHardware::loadSettings() {
     QSettings settings("FinnSoft", "KeyPresserHardware");
     loadSettingsFromObject(settings);
+    windowProfilesText = settings.value("windowProfiles").toString();
+    applyWindowProfiles();
 }
 
 // 新增：从配置文件加载设置
@@ -867,31 +1091,60 @@ void KeyPresserHardware::loadSettingsFromObject(QSettings &settings) {
     spaceMaxIntervalLineEdit->setText(settings.value("spaceMaxIntervalLineEdit", "1000").toString());
     triggerKeyComboBox->setCurrentIndex(settings.value("triggerKeyComboBox", 0).toInt());
     topmostCheckBox->setChecked(settings.value("topmostCheckBox", false).toBool());
-    
-    for (int i = 0; i < 15; ++i) {
-        QString keyName = QString("keyCombo%1").arg(i);
-        if(settings.contains(keyName))
-            keyCombos[i]->setCurrentIndex(settings.value(keyName, 0).toInt());
-        else{
-            if (i < 12) {
-                keyCombos[i]->setCurrentText(QString("F%1").arg(i + 1));
-            } else {
-                keyCombos[i]->setCurrentText(QChar('A' + (i - 12)));
-            }
-        }
+    timerRules = settings.value("timerRules").toString();
+    if (timerRulesEdit) {
+        timerRulesEdit->setPlainText(timerRules);
+    } else {
+        applyTimerWindows();
+    }
 
-        QString shotcutKeyName = QString("shortcutCombo%1").arg(i);
-        shortcutCombos[i]->setCurrentIndex(settings.value(shotcutKeyName, 0).toInt());
+    pixelRulesText = settings.value("pixelTriggers").toString();
+    if (pixelRulesEdit) {
+        pixelRulesEdit->setPlainText(pixelRulesText);
+    } else {
+        applyPixelRules();
+    }
+
+    timelineText = settings.value("timeline").toString();
+    if (timelineEdit) {
+        timelineEdit->setPlainText(timelineText);
+    } else {
+        applyTimeline();
+    }
 
-        keyCheckBoxes[i]->setChecked(settings.value(QString("keyCheckBox%1").arg(i), false).toBool());
-        intervalLineEdits[i]->setText(settings.value(QString("intervalLineEdit%1").arg(i), "1000").toString());
-        maxIntervalLineEdits[i]->setText(settings.value(QString("maxIntervalLineEdit%1").arg(i), "1000").toString());
+    empiricalPath = settings.value("empiricalIntervals").toString();
+    empiricalTable = empiricalPath.isEmpty() ? nullptr : SlotProfile::loadEmpirical(empiricalPath);
+    randomSeed = settings.value("randomSeed", 0).toULongLong();
+    scheduler->setSeed(randomSeed);
+    scheduler->setHoldTime(settings.value("holdTime", 100).toInt());
+    scheduler->setLeadTime(settings.value("leadTime", 0).toInt());
+    const int keyCount = qBound(0, settings.value("keySlotCount", SlotProfile::kDefaultKeySlotCount).toInt(),
+                                SlotProfile::kMaxKeySlotCount);
+    distributionOverrides.clear();
+    for (int i = 0; i < SlotProfile::schedulerSlotCount(keyCount); ++i) {
+        QString distribution = settings.value(QString("intervalDistribution%1").arg(i)).toString();
+        if (!distribution.isEmpty()) distributionOverrides.insert(i, distribution);
+    }
+    int distributionIndex = distributionCombo->findData(settings.value("intervalDistribution", "uniform").toString());
+    distributionCombo->setCurrentIndex(qMax(distributionIndex, 0));
+    updateSamplesButton();
+
+    std::vector<SlotTableModel::Row> rows(keyCount);
+    for (int i = 0; i < keyCount; ++i) {
+        SlotTableModel::Row &values = rows[i];
+        values.keyIndex = settings.value(QString("keyCombo%1").arg(i), SlotProfile::defaultKeyIndex(i)).toInt();
+        values.shortcutIndex = settings.value(QString("shortcutCombo%1").arg(i), 0).toInt();
+        values.checked = settings.value(QString("keyCheckBox%1").arg(i), false).toBool();
+        values.minInterval = settings.value(QString("intervalLineEdit%1").arg(i), "1000").toInt();
+        values.maxInterval = settings.value(QString("maxIntervalLineEdit%1").arg(i), "1000").toInt();
     }
+    slotModel->setRows(rows);
 }
 
 void KeyPresserHardware::saveSettings() {
     QSettings settings("FinnSoft", "KeyPresserHardware");
     saveSettingsToObject(settings);
+    settings.setValue("windowProfiles", windowProfilesText);
 }
 
 // 新增：保存设置到配置文件
@@ -910,13 +1163,26 @@ void KeyPresserHardware::saveSettingsToObject(QSettings &settings) {
     settings.setValue("spaceMaxIntervalLineEdit", spaceMaxIntervalLineEdit->text());
     settings.setValue("triggerKeyComboBox", triggerKeyComboBox->currentIndex());
     settings.setValue("topmostCheckBox", topmostCheckBox->isChecked());
-    
-    for (int i = 0; i < 15; ++i) {
-        settings.setValue(QString("keyCheckBox%1").arg(i), keyCheckBoxes[i]->isChecked());
-        settings.setValue(QString("shortcutCombo%1").arg(i), shortcutCombos[i]->currentIndex());
-        settings.setValue(QString("keyCombo%1").arg(i), keyCombos[i]->currentIndex());
-        settings.setValue(QString("intervalLineEdit%1").arg(i), intervalLineEdits[i]->text());
-        settings.setValue(QString("maxIntervalLineEdit%1").arg(i), maxIntervalLineEdits[i]->text());
+    settings.setValue("timerRules", timerRules);
+    settings.setValue("timeline", timelineText);
+    settings.setValue("pixelTriggers", pixelRulesText);
+    settings.setValue("intervalDistribution", distributionCombo->currentData().toString());
+    if (!empiricalPath.isEmpty()) settings.setValue("empiricalIntervals", empiricalPath);
+    if (randomSeed != 0) settings.setValue("randomSeed", randomSeed);
+    settings.setValue("holdTime", scheduler->holdTime());
+    if (scheduler->leadTime() != 0) settings.setValue("leadTime", scheduler->leadTime());
+    for (auto it = distributionOverrides.cbegin(); it != distributionOverrides.cend(); ++it) {
+        settings.setValue(QString("intervalDistribution%1").arg(it.key()), it.value());
+    }
+
+    settings.setValue("keySlotCount", slotModel->rowCount());
+    for (int i = 0; i < slotModel->rowCount(); ++i) {
+        SlotTableModel::Row values = slotModel->row(i);
+        settings.setValue(QString("keyCheckBox%1").arg(i), values.checked);
+        settings.setValue(QString("shortcutCombo%1").arg(i), values.shortcutIndex);
+        settings.setValue(QString("keyCombo%1").arg(i), values.keyIndex);
+        settings.setValue(QString("intervalLineEdit%1").arg(i), values.minInterval);
+        settings.setValue(QString("maxIntervalLineEdit%1").arg(i), values.maxInterval);
     }
 }
 
@@ -928,18 +1194,45 @@ void KeyPresserHardware::clearSettings() {
     spaceCheckBox->setChecked(false);
     spaceIntervalLineEdit->setText("1000");
     spaceMaxIntervalLineEdit->setText("1000");
+    timerRules.clear();
+    if (timerRulesEdit) {
+        timerRulesEdit->clear();
+    } else {
+        applyTimerWindows();
+    }
 
-    for (int i = 0; i < 15; ++i) {
-        keyCheckBoxes[i]->setChecked(false);
-        // 设置默认值：前12个为F1-F12，后3个为ABC
-        if (i < 12) {
-            keyCombos[i]->setCurrentText(QString("F%1").arg(i + 1));
-        } else {
-            keyCombos[i]->setCurrentText(QChar('A' + (i - 12)));
-        }
-        intervalLineEdits[i]->setText("1000");
-        maxIntervalLineEdits[i]->setText("1000");
+    pixelRulesText.clear();
+    if (pixelRulesEdit) {
+        pixelRulesEdit->clear();
+    } else {
+        applyPixelRules();
+    }
+
+    timelineText.clear();
+    if (timelineEdit) {
+        timelineEdit->clear();
+    } else {
+        applyTimeline();
     }
+
+    distributionOverrides.clear();
+    empiricalPath.clear();
+    empiricalTable = nullptr;
+    updateSamplesButton();
+    randomSeed = 0;
+    scheduler->setSeed(0);
+    scheduler->setHoldTime(100);
+    scheduler->setLeadTime(0);
+    distributionCombo->setCurrentIndex(0);
+
+    // 恢复默认的15个按键，已有按键的修饰键保持不变
+    std::vector<SlotTableModel::Row> rows;
+    for (int i = 0; i < SlotProfile::kDefaultKeySlotCount; ++i) {
+        SlotTableModel::Row values = SlotTableModel::defaultRow(i);
+        if (i < slotModel->rowCount()) values.shortcutIndex = slotModel->row(i).shortcutIndex;
+        rows.push_back(values);
+    }
+    slotModel->setRows(rows);
 }
 
 void KeyPresserHardware::attachToTargetWindow() {
@@ -960,17 +1253,8 @@ void KeyPresserHardware::detachFromTargetWindow() {
 
 void CALLBACK KeyPresserHardware::WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime) {
     if (event == EVENT_SYSTEM_FOREGROUND) {
-        wchar_t windowTitle[256];
-        GetWindowText(hwnd, windowTitle, 256);
         if (KeyPresserHardware::instance) {
-            KeyPresserHardware::instance->targetHwnd = hwnd;
-            auto label = KeyPresserHardware::instance->selectedWindowLabel;
-            QString newStr = QString::fromWCharArray(windowTitle);
-            QFontMetrics fontWidth(label->font());
-            QString elideNode = fontWidth.elidedText(newStr,Qt::ElideRight,KeyPresserHardware::instance->width()-20);
-            KeyPresserHardware::instance->selectedWindowLabel->setText(elideNode);
-            KeyPresserHardware::instance->selectedWindowLabel->setToolTip(newStr);
-            Q_EMIT KeyPresserHardware::instance->windowStateChanged();
+            KeyPresserHardware::instance->setTargetWindow(hwnd);
             UnhookWinEvent(hWinEventHook);
 
             QTimer::singleShot(300, []() {
@@ -984,24 +1268,158 @@ void CALLBACK KeyPresserHardware::WinEventProc(HWINEVENTHOOK hWinEventHook, DWOR
 }
 
 
+void KeyPresserHardware::setTargetWindow(HWND hwnd) {
+    wchar_t windowTitle[256];
+    GetWindowText(hwnd, windowTitle, 256);
+    targetHwnd = hwnd;
+    windowTracker->setTarget(hwnd);
+    QString newStr = QString::fromWCharArray(windowTitle);
+    QFontMetrics fontWidth(selectedWindowLabel->font());
+    QString elideNode = fontWidth.elidedText(newStr, Qt::ElideRight, width() - 20);
+    selectedWindowLabel->setText(elideNode);
+    selectedWindowLabel->setToolTip(newStr);
+    Q_EMIT windowStateChanged();
+}
+
+void KeyPresserHardware::applyWindowProfiles() {
+    QStringList invalidRules;
+    QVector<WindowProfileRule> rules = WindowProfileRule::parseList(windowProfilesText, &invalidRules);
+    profileSwitcher->setRules(rules, &invalidRules);
+    if (windowProfilesEdit) {
+        windowProfilesEdit->setStyleSheet(invalidRules.isEmpty() ? QString() : QStringLiteral("color: red;"));
+    }
+}
+
+void KeyPresserHardware::switchToWindowProfile(HWND hwnd, const QString &profile) {
+    if (hwnd != targetHwnd) {
+        if (bIsRuning) detachFromTargetWindow();
+        // 离开的窗口不再保持置顶
+        if (targetHwnd && topmostCheckBox->isChecked()) {
+            SetWindowPos(targetHwnd, HWND_NOTOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+        }
+        setTargetWindow(hwnd);
+        if (bIsRuning) {
+            if (!sequentialModeRadio->isChecked()) attachToTargetWindow();
+            pixelTrigger->setSource(std::make_unique<GdiFrameSource>(targetHwnd));
+        }
+    }
+    if (profile == activeProfilePath) return;
+    if (!QFileInfo::exists(profile)) {
+        qWarning() << "Window profile not found" << profile;
+        return;
+    }
+    // 运行中加载与导入相同，按槽位增量生效，调度不中断
+    activeProfilePath = profile;
+    loadSettingsFromFile(profile);
+}
+
 void KeyPresserHardware::enableTimerTask(bool enable) {
     bTimerTaskEnabled = enable;
-    if (!enable) {
-        // 如果禁用定时任务，清除可能的任务状态
-        timerTaskChecker->stop();
-        timerTaskChecker->start(1000); // 保持每秒检查一次，但不执行任务
+    applyTimerWindows();
+    calendar->setEnabled(enable);
+    checkTimerTask();
+}
+
+void KeyPresserHardware::applyTimerWindows() {
+    QVector<TimeWindow> windows;
+    windows.append(TimeWindow::once(timerStart, timerEnd));
+
+    QStringList invalidRules;
+    windows += TimeWindow::parseList(timerRules, &invalidRules);
+    if (timerRulesEdit) {
+        timerRulesEdit->setStyleSheet(invalidRules.isEmpty() ? QString() : QStringLiteral("color: red;"));
+    }
+
+    calendar->setWindows(windows);
+}
+
+void KeyPresserHardware::applyTimeline() {
+    QStringList invalidLines;
+    Timeline timeline = Timeline::parse(timelineText, &invalidLines);
+    if (timelineEdit) {
+        timelineEdit->setStyleSheet(invalidLines.isEmpty() ? QString() : QStringLiteral("color: red;"));
+    }
+    scheduler->setTimeline(CompiledTimeline::compile(timeline));
+}
+
+void KeyPresserHardware::applyPixelRules() {
+    QStringList invalidRules;
+    QVector<PixelRule> rules = PixelRule::parseList(pixelRulesText, &invalidRules);
+    if (pixelRulesEdit) {
+        pixelRulesEdit->setStyleSheet(invalidRules.isEmpty() ? QString() : QStringLiteral("color: red;"));
+    }
+    pixelTrigger->setRules(rules);
+    if (bIsRuning) {
+        pixelTrigger->stop();
+        pixelTrigger->start();
     }
 }
 
+QWidget *KeyPresserHardware::createPixelPanel() {
+    pixelPanel = new QWidget(this);
+    QVBoxLayout *panelLayout = new QVBoxLayout(pixelPanel);
+    panelLayout->setContentsMargins(0, 0, 0, 0);
+
+    pixelRulesEdit = new QPlainTextEdit(pixelRulesText, pixelPanel);
+    pixelRulesEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    pixelRulesEdit->setMinimumHeight(90);
+    pixelRulesEdit->setPlaceholderText(QStringLiteral("fire 1 at 120,340 color #FF3030 tol 40\n"
+                                                      "suppress space at 10,10 size 30x4 color #202020 min 0.9"));
+    pixelRulesEdit->setToolTip(QStringLiteral("动作 槽位 at x,y [size 宽x高] color #RRGGBB [tol 容差] [min 比例]\n"
+                                              "fire：颜色出现时立即按一次该槽位\n"
+                                              "suppress：颜色符合期间不按该槽位\n"
+                                              "require：颜色不符合期间不按该槽位\n"
+                                              "动作 槽位 image \"图片路径\" [at x,y size 宽x高] [score 相似度]\n"
+                                              "在区域内（省略时为整个窗口）查找图片，相似度默认0.9\n"
+                                              "槽位为按键表中的序号或space，坐标为目标窗口客户区坐标"));
+    connect(pixelRulesEdit, &QPlainTextEdit::textChanged, this, [this]() {
+        pixelRulesText = pixelRulesEdit->toPlainText();
+        applyPixelRules();
+    });
+
+    // 取点：3秒后读取鼠标所在位置的颜色，追加一条规则
+    QPushButton *pickButton = new QPushButton(QIcon(":/png/selPt.png"), QStringLiteral("取点（3秒后读取鼠标位置）"), pixelPanel);
+    connect(pickButton, &QPushButton::clicked, this, [this, pickButton]() {
+        pickButton->setEnabled(false);
+        QTimer::singleShot(3000, this, [this, pickButton]() {
+            pickButton->setEnabled(true);
+            POINT point;
+            GetCursorPos(&point);
+            HDC screen = GetDC(nullptr);
+            COLORREF color = GetPixel(screen, point.x, point.y);
+            ReleaseDC(nullptr, screen);
+            if (color == CLR_INVALID) return;
+            if (targetHwnd) ScreenToClient(targetHwnd, &point);
+            // COLORREF 为 0x00BBGGRR
+            uint rgb = (GetRValue(color) << 16) | (GetGValue(color) << 8) | GetBValue(color);
+            pixelRulesEdit->appendPlainText(QStringLiteral("fire 1 at %1,%2 color #%3 tol 30")
+                                                .arg(point.x).arg(point.y)
+                                                .arg(QString::number(rgb, 16).rightJustified(6, '0').toUpper()));
+        });
+    });
+
+    // 选择图片：追加一条在整个窗口中查找该图片的规则
+    QPushButton *imageButton = new QPushButton(QStringLiteral("选择图片"), pixelPanel);
+    connect(imageButton, &QPushButton::clicked, this, [this]() {
+        QString filename = QFileDialog::getOpenFileName(this, QStringLiteral("选择图片"), QDir::currentPath(),
+                                                        QStringLiteral("图片 (*.png *.bmp *.jpg)"));
+        if (filename.isEmpty()) return;
+        pixelRulesEdit->appendPlainText(QStringLiteral("fire 1 image \"%1\" score 0.9").arg(QDir::toNativeSeparators(filename)));
+    });
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    buttonLayout->addWidget(pickButton);
+    buttonLayout->addWidget(imageButton);
+    panelLayout->addWidget(pixelRulesEdit);
+    panelLayout->addLayout(buttonLayout);
+    return pixelPanel;
+}
+
 void KeyPresserHardware::checkTimerTask() {
     if (!bTimerTaskEnabled) return;
 
-    QDateTime currentTime = QDateTime::currentDateTime();
-    QDateTime startTime = startTimeEdit->dateTime();
-    QDateTime endTime = endTimeEdit->dateTime();
-
     // 检查是否在定时任务时间范围内
-    if (currentTime >= startTime && currentTime <= endTime) {
+    if (calendar->isActive()) {
         // 如果不在运行中，则开始运行
         if (!bIsRuning && targetHwnd) {
             startPressing();
@@ -1012,13 +1430,16 @@ void KeyPresserHardware::checkTimerTask() {
             stopPressing();
         }
     }
-
-    qApp->setStyleSheet(qApp->styleSheet());
 }
 
 void KeyPresserHardware::setTimerTask(QDateTime start, QDateTime end) {
-    startTimeEdit->setDateTime(start);
-    endTimeEdit->setDateTime(end);
-    bTimerTaskEnabled = true;
-    timerTaskCheckBox->setChecked(true);
+    timerStart = start;
+    timerEnd = end;
+    if (timerTaskGroupBox) {
+        startTimeEdit->setDateTime(start);
+        endTimeEdit->setDateTime(end);
+        timerTaskCheckBox->setChecked(true);
+    } else {
+        enableTimerTask(true);
+    }
 }
@@ -17,7 +17,26 @@
 #include <QFileDialog>
 #include <QDir>
 #include <QDateTimeEdit>
+#include <QPlainTextEdit>
+#include <QTableView>
+#include <QMap>
+#include <QVBoxLayout>
+#include <QGridLayout>
 #include <ArduinoController.hpp>
+#include "PressScheduler.h"
+#include "SlotProfile.h"
+#include "CalendarScheduler.h"
+#include "HotkeyService.h"
+#include "WindowStateTracker.h"
+#include "WindowProfileSwitcher.h"
+#include "HighlightOverlay.h"
+#include "FirmwareFlasher.h"
+#include "LinkKeeper.h"
+#include "PixelTrigger.h"
+#include "SlotTableModel.h"
+#ifdef KP_WITH_PYTHON
+#include "PythonScripting.h"
+#endif
 
 class KeyPresserHardware : public QWidget {
     Q_OBJECT
@@ -37,6 +56,8 @@ public:
     //Dm::Idmsoft* _dm = nullptr;
     ArduinoController _controller;
     bool checkArduino();
+    // 先显示窗口，在后台线程检测端口，完成后在界面线程连接并更新arduinoLabel
+    void checkArduinoAsync();
 public slots:
     void selectWindow();
     void togglePressing();
@@ -63,25 +84,53 @@ private:
     bool bIsRuning = false;
     bool bTimerTaskEnabled = false;
     QPushButton *toggleButton;
-    QTimer *sequenceTimer = nullptr;
-    QTimer *timerTaskChecker = nullptr;
+    CalendarScheduler *calendar = nullptr;
+    HotkeyService *hotkeys = nullptr;
+    WindowStateTracker *windowTracker = nullptr;
+    HighlightOverlay *highlightOverlay = nullptr;
+    FirmwareFlasher *flasher = nullptr;
+    LinkKeeper *linkKeeper = nullptr;
     QDateTimeEdit *startTimeEdit = nullptr;
     QDateTimeEdit *endTimeEdit = nullptr;
+    QGroupBox *timerTaskGroupBox = nullptr;
     QCheckBox *timerTaskCheckBox = nullptr;
-    int currentIndex = 0;
+    QPlainTextEdit *timerRulesEdit = nullptr;
+    QPlainTextEdit *timelineEdit = nullptr;  // 时间轴面板，首次展开时创建
+    QString timelineText;
+    PixelTrigger *pixelTrigger = nullptr;
+    QWidget *pixelPanel = nullptr;           // 像素触发面板，首次展开时创建
+    QPlainTextEdit *pixelRulesEdit = nullptr;
+    QString pixelRulesText;
+    WindowProfileSwitcher *profileSwitcher = nullptr;
+    QPlainTextEdit *windowProfilesEdit = nullptr;  // 窗口配置面板，首次展开时创建
+    QString windowProfilesText;     // 规则保存在程序设置中，不随配置文件导入导出
+    QString activeProfilePath;      // 上次按窗口规则加载的配置文件
+    QPlainTextEdit *metricsView = nullptr;  // 运行指标面板，首次展开时创建
+    QTimer *metricsTimer = nullptr;
+    // 定时任务面板首次展开时才创建，之前由这些成员保存其取值
+    QDateTime timerStart;
+    QDateTime timerEnd;
+    QString timerRules;
+#ifdef KP_WITH_PYTHON
+    PythonScripting *scripting = nullptr;
+#endif
     static void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime);
 
     QCheckBox *spaceCheckBox;
     QLineEdit *spaceIntervalLineEdit;
     QLineEdit *spaceMaxIntervalLineEdit;
-    QCheckBox *keyCheckBoxes[15];
-    QComboBox *shortcutCombos[15];
-    QComboBox *keyCombos[15];
-    QLineEdit *intervalLineEdits[15];
-    QLineEdit *maxIntervalLineEdits[15];
+    // 自定义按键表：数据在模型中，编辑时才创建控件
+    SlotTableModel *slotModel;
+    QTableView *slotTable;
     QCheckBox *topmostCheckBox;
     QRadioButton *independentModeRadio;
     QRadioButton *sequentialModeRadio;
+    QComboBox *distributionCombo = nullptr;
+    QPushButton *samplesButton = nullptr;  // 选择录制样本文件，仅在用到录制样本时显示
+    QMap<int, QString> distributionOverrides;  // 配置文件中按调度器槽位单独指定的分布，界面不编辑，原样保存
+    QString empiricalPath;              // 录制的间隔样本文件
+    std::shared_ptr<const IntervalDistribution::EmpiricalTable> empiricalTable;
+    quint64 randomSeed = 0;
 
     //QRadioButton *normalKeyModeRadio;
     //QRadioButton *widnowsKeyModelRadio;
@@ -89,20 +138,35 @@ private:
 
 
     QButtonGroup *modeGroup;
-    QTimer *spaceTimer;
-    std::vector<QTimer*> timers;
+    PressScheduler *scheduler;
+    static constexpr int kSpaceSlot = SlotProfile::kSpaceSlot;  // 调度器中空格键所在的槽位
 
 
-    void populateShortcutCombos(QComboBox *comboBox);
-    void populateKeyCombos(QComboBox *comboBox);
-    void stopAllTimers();
+    QGroupBox *createTimerTaskPanel();
+    bool connectArduino(std::string portName);
+    SlotConfig slotConfigFromUi(int index) const;
+    void applySlotEdit(int index);
+    void applyAllSlots();
+    bool chooseEmpiricalSamples();
+    bool usesEmpiricalSamples() const;
+    void updateSamplesButton();
+    void applyTimerWindows();
+    void applyTimeline();
+    void applyPixelRules();
+    void applyWindowProfiles();
+    void switchToWindowProfile(HWND hwnd, const QString &profile);
+    void setTargetWindow(HWND hwnd);
+    QWidget *createPixelPanel();
+    void refreshToggleButtonStyle();
     void loadSettings();
     void saveSettings();
     void attachToTargetWindow();
     void detachFromTargetWindow();
-    int getRandomInterval(int minInterval, int maxInterval);
     void highlightWindow();
     void onTopmostCheckBoxChanged(int state);
+    void flashFirmware();
+    void simulateProfile();
+    void refreshMetricsView();
 };
 
 #endif // KeyPresserHardware_H
@@ -1,16 +1,271 @@
 ﻿#include <QApplication>
 #include "keypresserHardware.h"
+#include "HeadlessDaemon.h"
+#include "FirmwareFlasher.h"
+#include "StartupProfile.hpp"
+#include "TraceLog.hpp"
+#include "MetricsExporter.h"
+#include "Simulator.h"
+#include "FrameSource.h"
+#include "TemplateMatcher.h"
+#include <QElapsedTimer>
+#include <QThread>
 #include <QFile>
+#include <QFileInfo>
+#include <QSettings>
 #include <QTextStream>
 #include <QTextCodec>
 #include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+static bool hasArg(int argc, char *argv[], const char *name) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// 从已解析的参数中取 "--name value"
+static QString argValue(const QStringList &args, const QString &name, const QString &defaultValue = QString()) {
+    int index = args.indexOf(name);
+    return (index >= 0 && index + 1 < args.size()) ? args[index + 1] : defaultValue;
+}
+
+// 程序是GUI子系统，命令行模式下挂到父控制台以便输出
+static void attachParentConsole() {
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+}
+
+// --trace <file>：后台线程把跟踪记录写入文件；不指定时记录只保留在内存中，可用 --ctl trace 导出
+static void startTrace(const QStringList &args) {
+    QString path = argValue(args, "--trace");
+    if (!path.isEmpty() && !TraceLog::start(path.toLocal8Bit().toStdString())) {
+        qWarning() << "Failed to open trace file" << path;
+    }
+}
+
+// --metrics-port <端口>：在127.0.0.1上提供Prometheus格式的指标；--metrics-file <文件>：每10秒写入文件
+static void startMetrics(const QStringList &args, QObject *parent) {
+    QString port = argValue(args, "--metrics-port");
+    QString file = argValue(args, "--metrics-file");
+    if (port.isEmpty() && file.isEmpty()) return;
+
+    MetricsExporter *exporter = new MetricsExporter(parent);
+    if (!port.isEmpty() && !exporter->listen(static_cast<quint16>(port.toUInt()))) {
+        qWarning() << "Failed to listen for metrics on port" << port;
+    }
+    if (!file.isEmpty()) exporter->writePeriodically(file);
+}
+
+// 烧录固件后退出，设备固件已是最新时跳过（--force 强制烧录）
+static int runFlash(QCoreApplication &app, const QStringList &args) {
+    std::string portName = argValue(args, "--port").toStdString();
+    if (portName.empty()) portName = SerialPort::findArduinoLeonardoPort();
+    if (portName.empty()) {
+        qWarning() << "No Arduino Leonardo found, use --port";
+        return -1;
+    }
+
+    // 连接失败（如固件损坏）时不检查版本，直接烧录
+    ArduinoController controller;
+    controller.connect(portName);
+
+    FirmwareFlasher flasher(&controller);
+    QObject::connect(&flasher, &FirmwareFlasher::progress, [](int percent, const QString &message) {
+        qInfo().noquote() << QString("[%1%]").arg(percent, 3) << message;
+    });
+    QObject::connect(&flasher, &FirmwareFlasher::finished, [&app](FirmwareFlasher::Result result, const QString &message) {
+        qInfo().noquote() << message;
+        app.exit(result == FirmwareFlasher::Uploaded || result == FirmwareFlasher::UpToDate ? 0 : 1);
+    });
+    if (!flasher.start(argValue(args, "--flash"), args.contains("--force"))) return -1;
+    return app.exec();
+}
+
+// 按配置文件模拟运行若干小时后输出统计，不连接设备：
+//   --simulate 8 --profile a.kphset [--sim-start 2026-10-19T08:00:00] [--sim-timeline out.csv]
+static int runSimulation(const QStringList &args) {
+    bool ok = false;
+    double hours = argValue(args, "--simulate").toDouble(&ok);
+    QString path = argValue(args, "--profile");
+    if (!ok || hours <= 0 || path.isEmpty() || !QFileInfo::exists(path)) {
+        qWarning() << "Usage: --simulate <hours> --profile <file> [--sim-start <ISO time>] [--sim-timeline <csv>]";
+        return -1;
+    }
+    QSettings settings(path, QSettings::IniFormat);
+    SlotProfile profile = SlotProfile::fromSettings(settings);
+    if (!profile.error.isEmpty()) {
+        qWarning().noquote() << profile.error;
+        return -1;
+    }
+
+    QString startText = argValue(args, "--sim-start");
+    QDateTime start = startText.isEmpty() ? QDateTime::currentDateTime() : QDateTime::fromString(startText, Qt::ISODate);
+    if (!start.isValid()) {
+        qWarning() << "Invalid --sim-start" << startText;
+        return -1;
+    }
+
+    QString timelinePath = argValue(args, "--sim-timeline");
+    SimulationResult result = ProfileSimulator::run(profile, static_cast<qint64>(hours * 3600000.0), start,
+                                                    timelinePath.isEmpty() ? 0 : 1000000);
+    qInfo().noquote() << result.summary();
+    if (!timelinePath.isEmpty() && !result.writeTimeline(timelinePath)) {
+        qWarning() << "Failed to write timeline" << timelinePath;
+        return 1;
+    }
+    return 0;
+}
+
+// 在保存的截图上测量模板匹配耗时，每张截图在整幅范围内查找所有模板：
+//   --bench-match 截图目录 --template a.png [--template b.png ...] [--repeat 5]
+static int runMatchBenchmark(const QStringList &args) {
+    ImageSequenceSource frames(ImageSequenceSource::imagesInDirectory(argValue(args, "--bench-match")));
+    TemplateMatcher matcher;
+    QStringList names;
+    for (int i = args.indexOf("--template"); i >= 0 && i + 1 < args.size(); i = args.indexOf("--template", i + 1)) {
+        if (matcher.addTemplate(QImage(args[i + 1])) < 0) {
+            qWarning() << "Failed to load template image (at least 8x8)" << args[i + 1];
+            return -1;
+        }
+        names.append(QFileInfo(args[i + 1]).fileName());
+    }
+    if (frames.frameCount() == 0 || names.isEmpty()) {
+        qWarning() << "Usage: --bench-match <screenshot dir> --template <png> [--template <png> ...] [--repeat <n>]";
+        return -1;
+    }
+    const int repeat = qMax(1, argValue(args, "--repeat", "5").toInt());
+
+    QVector<qint64> timesUs;
+    QVector<int> found(names.size(), 0);
+    QVector<TemplateMatcher::Match> matches;
+    for (int f = 0; f < frames.frameCount(); ++f) {
+        const QImage &image = frames.image(f);
+        PixelKernels::Frame frame;
+        frame.pixels = reinterpret_cast<const uint32_t *>(image.constBits());
+        frame.width = image.width();
+        frame.height = image.height();
+        frame.stride = image.bytesPerLine() / 4;
+        QVector<TemplateMatcher::Query> queries(names.size());
+        for (int t = 0; t < names.size(); ++t) {
+            queries[t].templateIndex = t;
+            queries[t].region = image.rect();
+        }
+
+        // 第一次包含线程池启动和内存分配，不计入
+        matcher.search(frame, queries, matches);
+        for (int r = 0; r < repeat; ++r) {
+            QElapsedTimer timer;
+            timer.start();
+            matcher.search(frame, queries, matches);
+            timesUs.append(timer.nsecsElapsed() / 1000);
+        }
+        for (int t = 0; t < names.size(); ++t) {
+            if (matches[t].score >= 0.9) ++found[t];
+            qInfo().noquote() << QString("frame %1  %2: (%3,%4) score %5")
+                                     .arg(f + 1).arg(names[t])
+                                     .arg(matches[t].position.x()).arg(matches[t].position.y())
+                                     .arg(matches[t].score, 0, 'f', 3);
+        }
+    }
+
+    std::sort(timesUs.begin(), timesUs.end());
+    qint64 total = 0;
+    for (qint64 us : timesUs) total += us;
+    qInfo().noquote() << QString("kernel %1, %2 threads, %3 frames x %4 templates")
+                             .arg(TemplateMatcher::kernelName()).arg(QThread::idealThreadCount())
+                             .arg(frames.frameCount()).arg(names.size());
+    qInfo().noquote() << QString("per frame: mean %1 ms, median %2 ms, max %3 ms")
+                             .arg(total / 1000.0 / timesUs.size(), 0, 'f', 2)
+                             .arg(timesUs[timesUs.size() / 2] / 1000.0, 0, 'f', 2)
+                             .arg(timesUs.last() / 1000.0, 0, 'f', 2);
+    for (int t = 0; t < names.size(); ++t) {
+        qInfo().noquote() << QString("%1: found (score >= 0.9) in %2/%3 frames").arg(names[t]).arg(found[t]).arg(frames.frameCount());
+    }
+    return 0;
+}
+
+// 无界面模式：
+//   KeyPresserHardware --headless [--profile a.kphset] [--port COM3] [--socket name] [--ring name] [--peephole] [--pixel-frames dir] [--window-profiles rules.txt] [--start]
+//   KeyPresserHardware --ctl start|stop|status|load <file>|key <key>|text <str>|raw <json> [--socket name]
+//   KeyPresserHardware --flash keypresser.ino.hex [--port COM3] [--force]
+//   KeyPresserHardware --simulate 8 --profile a.kphset [--sim-timeline out.csv]
+//   KeyPresserHardware --bench-match screenshots --template icon.png [--template ...]
+static int runHeadless(int argc, char *argv[]) {
+    attachParentConsole();
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    startTrace(args);
+    if (args.contains("--flash")) return runFlash(app, args);
+    if (args.contains("--simulate")) return runSimulation(args);
+    if (args.contains("--bench-match")) return runMatchBenchmark(args);
+
+    QString serverName = argValue(args, "--socket", HeadlessDaemon::kDefaultServerName);
+
+    int ctlIndex = args.indexOf("--ctl");
+    if (ctlIndex >= 0) {
+        QStringList ctlArgs = args.mid(ctlIndex + 1);
+        int socketIndex = ctlArgs.indexOf("--socket");
+        if (socketIndex >= 0) ctlArgs.erase(ctlArgs.begin() + socketIndex, ctlArgs.begin() + qMin(socketIndex + 2, ctlArgs.size()));
+        return HeadlessDaemon::runClient(serverName, ctlArgs);
+    }
+
+    HeadlessDaemon daemon;
+    if (!daemon.connectDevice(argValue(args, "--port"))) return -1;
+    startMetrics(args, &daemon);
+
+    QString profile = argValue(args, "--profile");
+    QString error;
+    if (!profile.isEmpty() && !daemon.loadProfile(profile, &error)) {
+        qWarning() << error;
+        return -1;
+    }
+    if (!daemon.listen(serverName)) return -1;
+    if (args.contains("--peephole")) daemon.setPeephole(true);
+    QString ringName = argValue(args, "--ring");
+    if (!ringName.isEmpty() && !daemon.attachSharedRing(ringName)) {
+        qWarning() << "Failed to create shared command ring" << ringName;
+        return -1;
+    }
+    QString framesDir = argValue(args, "--pixel-frames");
+    if (!framesDir.isEmpty() && !daemon.usePixelFrames(framesDir)) {
+        qWarning() << "No frames found in" << framesDir;
+        return -1;
+    }
+    QString windowProfiles = argValue(args, "--window-profiles");
+    if (!windowProfiles.isEmpty() && !daemon.loadWindowProfiles(windowProfiles, &error)) {
+        qWarning() << error;
+        return -1;
+    }
+    if (args.contains("--start")) daemon.start();
+
+    return app.exec();
+}
 
 int main(int argc, char *argv[]) {
+    if (hasArg(argc, argv, "--headless") || hasArg(argc, argv, "--ctl") || hasArg(argc, argv, "--flash")
+        || hasArg(argc, argv, "--simulate") || hasArg(argc, argv, "--bench-match")) {
+        return runHeadless(argc, argv);
+    }
+
+    // --startup-profile：输出启动各阶段耗时
+    if (hasArg(argc, argv, "--startup-profile")) {
+        attachParentConsole();
+        StartupProfile::enable();
+    }
+
     QApplication app(argc, argv);
-    
+    startTrace(app.arguments());
+    StartupProfile::mark("QApplication");
+
     // 设置全局编码为UTF-8
     QTextCodec::setCodecForLocale(QTextCodec::codecForName("UTF-8"));
-    
+
     // 加载QSS样式表
     QFile styleFile(":/style.qss");
     if (styleFile.open(QFile::ReadOnly | QFile::Text)) {
@@ -18,15 +273,35 @@ int main(int argc, char *argv[]) {
         app.setStyleSheet(stream.readAll());
         styleFile.close();
     }
+    StartupProfile::mark("style sheet");
 
     KeyPresserHardware keyPresser;
     keyPresser.setWindowIcon(QIcon(":/keypresser.ico"));
     keyPresser.setWindowTitle(QStringLiteral("KeyPresser硬件版"));
+    StartupProfile::mark("main window");
 
-#ifdef QT_NO_DEBUG
-    if(!keyPresser.checkArduino()) { return -1; }
-#endif
+    // 可选：开启共享内存命令环，供外部进程高速提交命令（见KeyPresserRing.h）
+    QString ringName = argValue(app.arguments(), "--ring");
+    if (!ringName.isEmpty() && !keyPresser._controller.attachSharedRing(ringName.toStdString())) {
+        qWarning() << "Failed to create shared command ring" << ringName;
+    }
+    // 可选：合并每次写入中相邻的命令（需要支持TAP_KEY的固件）
+    if (app.arguments().contains("--peephole")) {
+        keyPresser._controller.setPeephole(true);
+    }
 
+    startMetrics(app.arguments(), &keyPresser);
     keyPresser.show();
+    StartupProfile::mark("show");
+    // 事件循环开始处理后回调，近似为首帧显示的时间
+    QTimer::singleShot(0, []() {
+        StartupProfile::mark("first frame");
+        StartupProfile::report();
+    });
+
+    // 窗口显示后再在后台检测设备，检测失败时的提示与原来相同
+#ifdef QT_NO_DEBUG
+    keyPresser.checkArduinoAsync();
+#endif
     return app.exec();
 }
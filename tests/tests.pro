@@ -0,0 +1,7 @@
+# 回归测试：qmake tests/tests.pro && nmake check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    tst_simulator.pro \
+    tst_hotkeyservice.pro \
+    tst_calendarscheduler.pro
@@ -0,0 +1,57 @@
+﻿#include <QtTest>
+#include "CalendarScheduler.h"
+
+// 解析规则文本，展开2026年1月的发生区间（1月1日为周四）
+class TestCalendarScheduler : public QObject {
+    Q_OBJECT
+
+private:
+    static QVector<QDateTime> starts(const TimeWindow &window)
+    {
+        QVector<QPair<QDateTime, QDateTime>> occurrences;
+        window.occurrences(QDateTime(QDate(2026, 1, 1), QTime(0, 0)), QDateTime(QDate(2026, 2, 1), QTime(0, 0)), occurrences);
+        QVector<QDateTime> result;
+        for (const auto &occurrence : occurrences) result.append(occurrence.first);
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    static QDateTime at(int day) { return QDateTime(QDate(2026, 1, day), QTime(9, 0)); }
+
+private Q_SLOTS:
+    void cronStepDayIsWildcard();
+    void cronRestrictedDaysMatchEither();
+    void onceRequiresEndAfterStart();
+};
+
+// 日字段为*/2时算作通配：日和周按“且”组合，只有奇数日的周一
+void TestCalendarScheduler::cronStepDayIsWildcard()
+{
+    TimeWindow window;
+    QVERIFY(TimeWindow::parse(QStringLiteral("cron 0 9 */2 * 1 60"), window));
+    QVERIFY(window.monthDayWildcard);
+    QVERIFY(!window.weekDayWildcard);
+    QCOMPARE(starts(window), QVector<QDateTime>({ at(5), at(19) }));
+}
+
+// 日和周都有限定时满足其一即可：1日加上每个周一
+void TestCalendarScheduler::cronRestrictedDaysMatchEither()
+{
+    TimeWindow window;
+    QVERIFY(TimeWindow::parse(QStringLiteral("cron 0 9 1 * 1 60"), window));
+    QVERIFY(!window.monthDayWildcard);
+    QCOMPARE(starts(window), QVector<QDateTime>({ at(1), at(5), at(12), at(19), at(26) }));
+}
+
+// 单次窗口的结束时间必须晚于开始时间
+void TestCalendarScheduler::onceRequiresEndAfterStart()
+{
+    TimeWindow window;
+    QVERIFY(TimeWindow::parse(QStringLiteral("once 2026-01-05T09:00:00 2026-01-05T10:00:00"), window));
+    QCOMPARE(starts(window), QVector<QDateTime>({ at(5) }));
+    QVERIFY(!TimeWindow::parse(QStringLiteral("once 2026-01-05T09:00:00 2026-01-05T09:00:00"), window));
+    QVERIFY(!TimeWindow::parse(QStringLiteral("once 2026-01-05T10:00:00 2026-01-05T09:00:00"), window));
+}
+
+QTEST_GUILESS_MAIN(TestCalendarScheduler)
+#include "tst_calendarscheduler.moc"
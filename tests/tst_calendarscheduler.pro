@@ -0,0 +1,18 @@
+# 定时任务规则的解析和展开测试
+QT       += core testlib
+QT       -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_calendarscheduler
+INCLUDEPATH += ..
+
+SOURCES += \
+    tst_calendarscheduler.cpp \
+    ../CalendarScheduler.cpp
+
+HEADERS += \
+    ../CalendarScheduler.h
+
+LIBS += -luser32
@@ -0,0 +1,120 @@
+﻿#include <QtTest>
+#include <atomic>
+#include <thread>
+#include "HotkeyService.h"
+
+// 用FakeHotkeyBackend模拟热键，检查运行中按下时在后端线程立即停止、
+// 按住不放的自动重复只算一次，以及从按下到停止的延迟统计
+class TestHotkeyService : public QObject {
+    Q_OBJECT
+
+private:
+    static constexpr unsigned int kHotkey = VK_F8;
+
+    // 服务持有后端，测试通过fake模拟按键
+    struct Fixture {
+        FakeHotkeyBackend *fake = new FakeHotkeyBackend;
+        HotkeyService service{ std::unique_ptr<HotkeyBackend>(fake) };
+        std::atomic<bool> running{ false };
+        std::atomic<int> stops{ 0 };
+        std::thread::id stoppedOn;
+
+        Fixture()
+        {
+            service.setStopHandler([this]() { return running.load(); },
+                                   [this]() {
+                                       stoppedOn = std::this_thread::get_id();
+                                       running = false;
+                                       stops++;
+                                   });
+            service.start(kHotkey);
+        }
+    };
+
+private Q_SLOTS:
+    void stopRunsOnBackendThread();
+    void autoRepeatIsIgnored();
+    void latencyIsRecorded();
+};
+
+// 停止在按键所在的线程同步完成，界面状态随后以队列方式通知
+void TestHotkeyService::stopRunsOnBackendThread()
+{
+    Fixture fixture;
+    fixture.running = true;
+    QSignalSpy toggled(&fixture.service, &HotkeyService::toggled);
+
+    std::thread::id hookThread;
+    std::thread hook([&]() {
+        hookThread = std::this_thread::get_id();
+        fixture.fake->keyDown(kHotkey);
+    });
+    hook.join();
+
+    QCOMPARE(fixture.stops.load(), 1);
+    QVERIFY(fixture.stoppedOn == hookThread);
+    QVERIFY(!fixture.running.load());
+    QCOMPARE(toggled.count(), 0);
+
+    QVERIFY(toggled.wait(1000));
+    QCOMPARE(toggled.count(), 1);
+    QCOMPARE(toggled.at(0).at(0).toBool(), true);
+}
+
+// 按住不放只触发一次，松开再按才是下一次；其他按键不触发
+void TestHotkeyService::autoRepeatIsIgnored()
+{
+    Fixture fixture;
+    QSignalSpy toggled(&fixture.service, &HotkeyService::toggled);
+
+    fixture.fake->keyDown(kHotkey);
+    fixture.fake->keyDown(kHotkey);
+    fixture.fake->keyDown(kHotkey);
+    fixture.fake->keyDown(VK_F9);
+    fixture.fake->keyUp(kHotkey);
+    fixture.fake->keyDown(kHotkey);
+
+    QTRY_COMPARE(toggled.count(), 2);
+    QTest::qWait(50);
+    QCOMPARE(toggled.count(), 2);
+    QCOMPARE(toggled.at(0).at(0).toBool(), false);
+    QCOMPARE(fixture.stops.load(), 0);
+}
+
+void TestHotkeyService::latencyIsRecorded()
+{
+    Fixture fixture;
+    connect(&fixture.service, &HotkeyService::toggled, &fixture.service,
+            [&fixture](bool wasRunning, qint64 pressedAt) {
+                if (wasRunning) fixture.service.markStopped(pressedAt);
+            });
+    QSignalSpy toggled(&fixture.service, &HotkeyService::toggled);
+
+    fixture.running = true;
+    fixture.fake->keyDown(kHotkey);
+    fixture.fake->keyUp(kHotkey);
+    QVERIFY(toggled.wait(1000));
+
+    HotkeyService::Latency first = fixture.service.latency();
+    QCOMPARE(first.count, qint64(1));
+    QVERIFY(first.lastUs >= 0);
+    QCOMPARE(first.maxUs, first.lastUs);
+    QCOMPARE(first.totalUs, first.lastUs);
+
+    // 没在运行时的按下是开始，不记延迟
+    fixture.fake->keyDown(kHotkey);
+    fixture.fake->keyUp(kHotkey);
+    QVERIFY(toggled.wait(1000));
+    QCOMPARE(fixture.service.latency().count, qint64(1));
+
+    fixture.running = true;
+    fixture.fake->keyDown(kHotkey);
+    QVERIFY(toggled.wait(1000));
+    HotkeyService::Latency second = fixture.service.latency();
+    QCOMPARE(second.count, qint64(2));
+    QCOMPARE(second.totalUs, first.lastUs + second.lastUs);
+    QCOMPARE(second.maxUs, qMax(first.lastUs, second.lastUs));
+}
+
+QTEST_GUILESS_MAIN(TestHotkeyService)
+#include "tst_hotkeyservice.moc"
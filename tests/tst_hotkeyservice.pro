@@ -0,0 +1,18 @@
+# 全局热键服务的测试，用FakeHotkeyBackend代替低级键盘钩子
+QT       += core testlib
+QT       -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_hotkeyservice
+INCLUDEPATH += ..
+
+SOURCES += \
+    tst_hotkeyservice.cpp \
+    ../HotkeyService.cpp
+
+HEADERS += \
+    ../HotkeyService.h
+
+LIBS += -luser32
@@ -0,0 +1,131 @@
+﻿#include <QtTest>
+#include "Simulator.h"
+
+// 用固定种子和固定间隔的配置跑模拟器（虚拟时钟 + 记录命令的传输层），
+// 检查发出的命令序列和间隔统计。调度器或固件协议的改动会在这里体现出来
+class TestSimulator : public QObject {
+    Q_OBJECT
+
+private:
+    static SlotConfig fixedSlot(const char *key, int interval)
+    {
+        SlotConfig config;
+        config.enabled = true;
+        config.keys = { key };
+        config.minInterval = interval;
+        config.maxInterval = interval;
+        return config;
+    }
+
+    static QDateTime simulationStart() { return QDateTime(QDate(2026, 1, 1), QTime(0, 0)); }
+
+private Q_SLOTS:
+    void commandStream();
+    void overlappingHolds();
+    void intervalsSkipInactiveRanges();
+    void fixedSeedIsReproducible();
+};
+
+// F1每秒一次，按住100毫秒：每次按下和松开各一个键盘报告
+void TestSimulator::commandStream()
+{
+    SlotProfile profile;
+    profile.holdTime = 100;
+    profile.slotConfigs = { fixedSlot("58", 1000) };
+
+    SimulationResult result = ProfileSimulator::run(profile, 3000, simulationStart());
+    QCOMPARE(result.events.size(), 3);
+    for (int i = 0; i < result.events.size(); ++i) {
+        const SimulationEvent &event = result.events[i];
+        QCOMPARE(event.startMs, qint64(i) * 1000);
+        QCOMPARE(event.endMs, qint64(i) * 1000 + 100);
+        QCOMPARE(event.source, 0);
+        QCOMPARE(event.commands, QByteArray("<13,0,58><13,0>"));
+    }
+
+    const SimulationSource &source = result.sources[0];
+    QCOMPARE(source.presses, 3);
+    QCOMPARE(source.intervals, 2);
+    QCOMPARE(source.minInterval, qint64(1000));
+    QCOMPARE(source.maxInterval, qint64(1000));
+    QCOMPARE(result.overlaps, 0);
+}
+
+// 槽位与时间轴轨道同时按下：按住的按键合成一个报告，各自到期只松开自己的按键
+void TestSimulator::overlappingHolds()
+{
+    SlotProfile profile;
+    profile.holdTime = 100;
+    profile.slotConfigs = { fixedSlot("58", 1000) };
+    profile.timeline = QStringLiteral("track t\nstep F2 hold 50 gap 700");
+
+    SimulationResult result = ProfileSimulator::run(profile, 1000, simulationStart());
+    QCOMPARE(result.events.size(), 3);
+    QCOMPARE(result.events[0].source, 0);
+    QCOMPARE(result.events[0].commands, QByteArray("<13,0,58><13,0>"));
+    QCOMPARE(result.events[0].endMs, qint64(100));
+    QCOMPARE(result.events[1].source, 1);
+    QCOMPARE(result.events[1].commands, QByteArray("<13,0,58,59><13,0,58>"));
+    QCOMPARE(result.events[1].startMs, qint64(0));
+    QCOMPARE(result.events[1].endMs, qint64(50));
+    QCOMPARE(result.events[2].source, 1);
+    QCOMPARE(result.events[2].startMs, qint64(700));
+    QCOMPARE(result.events[2].commands, QByteArray("<13,0,59><13,0>"));
+    QCOMPARE(result.overlaps, 1);
+    QCOMPARE(result.collisions, 1);
+}
+
+// 两段定时任务窗口之间停止的时间不算作间隔
+void TestSimulator::intervalsSkipInactiveRanges()
+{
+    SlotProfile profile;
+    profile.slotConfigs = { fixedSlot("58", 1000) };
+    profile.timerRules = QStringLiteral("once 2026-01-01T00:00:00 2026-01-01T00:00:05\n"
+                                        "once 2026-01-01T00:01:00 2026-01-01T00:01:05");
+
+    SimulationResult result = ProfileSimulator::run(profile, 120000, simulationStart());
+    QCOMPARE(result.activeMs, qint64(10000));
+    const SimulationSource &source = result.sources[0];
+    QCOMPARE(source.presses, 10);
+    QCOMPARE(source.intervals, 8);
+    QCOMPARE(source.minInterval, qint64(1000));
+    QCOMPARE(source.maxInterval, qint64(1000));
+    QCOMPARE(result.events[5].startMs, qint64(60000));
+}
+
+// 随机间隔在固定种子下完全可复现，且都落在[min, max]内
+void TestSimulator::fixedSeedIsReproducible()
+{
+    SlotProfile profile;
+    profile.seed = 42;
+    SlotConfig slot = fixedSlot("4", 0);
+    slot.minInterval = 300;
+    slot.maxInterval = 700;
+    profile.slotConfigs = { slot, fixedSlot("5", 1000) };
+    profile.slotConfigs[1].distribution = IntervalDistribution::Normal;
+    profile.slotConfigs[1].minInterval = 800;
+    profile.timeline = QStringLiteral("step Ctrl+C gap 900-1100 normal skip 0.2");
+
+    SimulationResult first = ProfileSimulator::run(profile, 600000, simulationStart());
+    SimulationResult second = ProfileSimulator::run(profile, 600000, simulationStart());
+    QCOMPARE(first.events.size(), second.events.size());
+    for (int i = 0; i < first.events.size(); ++i) {
+        QCOMPARE(first.events[i].startMs, second.events[i].startMs);
+        QCOMPARE(first.events[i].commands, second.events[i].commands);
+    }
+    QCOMPARE(first.commands, second.commands);
+
+    const SimulationSource &uniform = first.sources[0];
+    QVERIFY(uniform.presses > 600000 / 700);
+    QVERIFY(uniform.minInterval >= 300);
+    QVERIFY(uniform.maxInterval <= 700);
+    const SimulationSource &normal = first.sources[1];
+    QVERIFY(normal.minInterval >= 800);
+    QVERIFY(normal.maxInterval <= 1000);
+    const SimulationSource &track = first.sources[2];
+    QVERIFY(track.presses > 0);
+    QVERIFY(track.minInterval >= 900);
+}
+
+QTEST_GUILESS_MAIN(TestSimulator)
+#include "tst_simulator.moc"
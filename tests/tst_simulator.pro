@@ -0,0 +1,27 @@
+# 模拟运行的回归测试，由tests.pro统一构建
+QT       += core testlib
+QT       -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_simulator
+INCLUDEPATH += ..
+
+SOURCES += \
+    tst_simulator.cpp \
+    ../CalendarScheduler.cpp \
+    ../PressScheduler.cpp \
+    ../Simulator.cpp \
+    ../SlotProfile.cpp \
+    ../Timeline.cpp
+
+HEADERS += \
+    ../ArduinoController.hpp \
+    ../CalendarScheduler.h \
+    ../PressScheduler.h \
+    ../Simulator.h \
+    ../SlotProfile.h \
+    ../Timeline.h
+
+LIBS += -luser32